@@ -0,0 +1,75 @@
+/** @file FileWatcher.hpp
+ *  @brief Reports files whose content changed on disk, from a background thread
+ *
+ *  On Linux the directory of every watched file gets an inotify watch and the thread sleeps
+ *  in poll() until a file in it is written or renamed into place. Elsewhere the thread
+ *  checks the modification time of every watched file twice a second.
+ *
+ *  Either way a candidate is only reported once its content hash differs from the last one
+ *  seen, so the several events an editor fires per save, or a save without edits, report
+ *  nothing or a single change. The render thread collects them with TakeChangedFiles.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class FileWatcher {
+private:
+    struct WatchedFile {
+        uint64_t contentHash = 0; // 0 while the file does not exist
+        std::filesystem::file_time_type lastWriteTime;
+    };
+
+    // A directory holding watched files, events only name the file inside it
+    struct WatchedDirectory {
+        int watchDescriptor = -1;
+        std::unordered_map<std::string, std::string> pathByFileName;
+    };
+
+    std::unordered_map<std::string, WatchedFile> m_files;
+    std::unordered_map<std::string, WatchedDirectory> m_directories;
+    std::unordered_map<int, std::string> m_directoryByWatchDescriptor;
+    std::vector<std::string> m_changedFiles;
+    std::mutex m_mutex;
+
+    std::thread m_thread;
+    std::atomic<bool> m_isRunning{false};
+    int m_inotifyDescriptor = -1;
+
+    void WatchLoop();
+
+    // Blocks up to a few hundred ms, returns the watched files that may have changed
+    std::vector<std::string> WaitForCandidates();
+
+    // Adds the inotify watch of a directory, m_mutex must be held
+    void AddDirectoryWatch(const std::string& directory, WatchedDirectory& watched);
+
+    // FNV-1a over the file's bytes, 0 if it cannot be read
+    static uint64_t HashFile(const std::string& path);
+public:
+    FileWatcher() = default;
+    // Stops the thread
+    ~FileWatcher();
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // Starts the watcher thread, files can be watched before or after
+    void Start();
+    void Stop();
+
+    // Watches a file, which does not have to exist yet. Watching a file twice does nothing.
+    void Watch(const std::string& path);
+
+    // Files whose content changed since the last call, each path once, in the order they changed
+    std::vector<std::string> TakeChangedFiles();
+
+    // False when the thread falls back to polling modification times
+    bool IsUsingInotify() const;
+};
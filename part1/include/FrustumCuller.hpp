@@ -0,0 +1,77 @@
+/** @file FrustumCuller.hpp
+ *  @brief Tests many objects' world bounds against view frustums, eight objects per AVX2 register
+ *
+ *  Every object has a bounding box and a bounding sphere, both kept as structure of arrays (one
+ *  array per coordinate) so a register loads the same coordinate of eight objects at once. An
+ *  object is outside a frustum when its sphere or its box is fully behind one of the six planes:
+ *  the sphere test is tighter for round objects, the box test for flat and long ones.
+ *
+ *  Several frustums can be tested in one Cull, an object is visible when it is inside any of them,
+ *  i.e. the cascades of a directional light or the faces of a point light's cube map. Large sets
+ *  are split between worker threads.
+ *
+ *  The build does not turn on AVX2 for the whole program, so the AVX2 test is compiled on its own
+ *  and picked when the CPU has it. Otherwise four objects are tested per SSE register.
+ */
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+struct Frustum {
+    // Left, right, bottom, top, near, far. Normalized and facing inwards: dot(xyz, p) + w is the distance inside.
+    glm::vec4 planes[6];
+
+    // Planes of the clip space volume of a view projection matrix, without near and far for casters of
+    // an orthographic shadow map, whose depth always spans the scene
+    static Frustum FromMatrix(const glm::mat4& viewProjection, bool isDepthClipped = true);
+
+    // Single objects, the culler does the same for many at once
+    bool IsBoxInside(glm::vec3 worldMin, glm::vec3 worldMax) const;
+};
+
+class FrustumCuller {
+public:
+    struct Stats {
+        int numObjects = 0;
+        int numVisible = 0;
+        int numFrusta = 0;
+        int numThreads = 0;             // Threads the last Cull was split between
+        bool isAVX2 = false;
+        double cullMilliseconds = 0.0;
+    };
+
+    FrustumCuller() = default;
+    FrustumCuller(const FrustumCuller&) = delete;
+    FrustumCuller& operator=(const FrustumCuller&) = delete;
+
+    void Clear();
+
+    // World bounds of one more object, returns its index
+    int Add(glm::vec3 worldMin, glm::vec3 worldMax, glm::vec3 sphereCenter, float sphereRadius);
+
+    inline int GetNumObjects() const { return m_numObjects;}
+
+    // Finds the objects inside at least one of the frustums, read with IsVisible until the next Cull
+    void Cull(const Frustum* frusta, int numFrusta);
+
+    inline bool IsVisible(int object) const { return (m_visibleMasks[object >> 3] >> (object & 7)) & 1;}
+
+    const Stats& GetStats() const;
+
+private:
+    // Coordinates of every object, padded to a multiple of eight with objects no frustum holds
+    std::vector<float> m_minX, m_minY, m_minZ;
+    std::vector<float> m_maxX, m_maxY, m_maxZ;
+    std::vector<float> m_centerX, m_centerY, m_centerZ, m_radius;
+    int m_numObjects = 0;
+    // A bit per object, eight objects a byte
+    std::vector<uint8_t> m_visibleMasks;
+    Stats m_stats;
+
+    // Tests the objects of blocks of eight firstBlock up to lastBlock
+    void CullBlocks(int firstBlock, int lastBlock, const Frustum* frusta, int numFrusta, bool isAVX2);
+    void CullBlocksAVX2(int firstBlock, int lastBlock, const Frustum* frusta, int numFrusta);
+    void CullBlocksSSE(int firstBlock, int lastBlock, const Frustum* frusta, int numFrusta);
+};
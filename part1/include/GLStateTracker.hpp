@@ -0,0 +1,116 @@
+/** @file GLStateTracker.hpp
+ *  @brief Remembers the OpenGL state we set and drops calls that would not change it
+ *
+ *  All state changes go through GLStateTracker::Get() instead of calling gl* directly, i.e.
+ *      GLStateTracker::Get().UseProgram(program);
+ *  A call whose value matches what was last set is counted as elided and never reaches the driver.
+ *  The tracker only knows what went through it, so code that changes state behind its back (or deletes
+ *  bound objects) has to call Invalidate() afterwards.
+ */
+#pragma once
+
+#include <glad/glad.h>
+#include <array>
+#include <unordered_map>
+
+class GLStateTracker {
+public:
+    struct FrameStats {
+        int numIssued = 0;
+        int numElided = 0;
+    };
+
+    // There is only one GL context
+    static GLStateTracker& Get();
+
+    void UseProgram(GLuint program);
+    void BindVertexArray(GLuint vertexArray);
+    // GL_ELEMENT_ARRAY_BUFFER is remembered per vertex array, since it is part of the vertex array's state
+    void BindBuffer(GLenum target, GLuint buffer);
+    void BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    void BindFramebuffer(GLenum target, GLuint framebuffer);
+
+    void ActiveTexture(GLenum textureUnit);
+    // Binds to the active unit, for creating and updating textures
+    void BindTexture(GLenum target, GLuint texture);
+    // Binds to a unit for sampling, unit is an index (0 for GL_TEXTURE0)
+    void BindTextureToUnit(GLuint unit, GLenum target, GLuint texture);
+
+    void Enable(GLenum capability);
+    void Disable(GLenum capability);
+    void DepthFunc(GLenum func);
+    void DepthMask(GLboolean flag);
+    void ColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha);
+    void StencilFunc(GLenum func, GLint ref, GLuint mask);
+    void StencilOp(GLenum stencilFail, GLenum depthFail, GLenum depthPass);
+    void StencilMask(GLuint mask);
+    void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    void Scissor(GLint x, GLint y, GLsizei width, GLsizei height);
+    void PolygonMode(GLenum face, GLenum mode);
+    void PolygonOffset(GLfloat factor, GLfloat units);
+    void ClearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+
+    // Forget everything, the next call of each kind is always issued
+    void Invalidate();
+
+    // Calls since the last ResetFrameStats, call once per frame
+    FrameStats GetFrameStats() const;
+    void ResetFrameStats();
+
+private:
+    // A value that is unknown until first set
+    template <typename T>
+    struct Cached {
+        T value{};
+        bool isKnown = false;
+
+        // Returns true if the call has to be issued
+        bool Update(const T& newValue) {
+            if (isKnown && value == newValue) {
+                return false;
+            }
+            value = newValue;
+            isKnown = true;
+            return true;
+        }
+    };
+
+    // Texture targets tracked per unit
+    enum TextureTargetSlot {
+        TEXTURE_TARGET_2D = 0,
+        TEXTURE_TARGET_2D_ARRAY,
+        TEXTURE_TARGET_CUBE_MAP,
+        TEXTURE_TARGET_BUFFER,
+        TEXTURE_TARGET_COUNT
+    };
+    static constexpr int kMaxTextureUnits = 16;
+
+    Cached<GLuint> m_program;
+    Cached<GLuint> m_vertexArray;
+    std::unordered_map<GLenum, Cached<GLuint>> m_buffers;
+    std::unordered_map<GLuint, GLuint> m_elementBufferByVertexArray;
+    std::unordered_map<GLuint, Cached<std::array<GLintptr, 3>>> m_uniformBufferRanges; // buffer, offset, size per index
+    Cached<GLuint> m_drawFramebuffer;
+    Cached<GLuint> m_readFramebuffer;
+    Cached<GLenum> m_activeTexture;
+    std::array<std::array<Cached<GLuint>, TEXTURE_TARGET_COUNT>, kMaxTextureUnits> m_textures;
+    std::unordered_map<GLenum, Cached<bool>> m_capabilities;
+    Cached<GLenum> m_depthFunc;
+    Cached<GLboolean> m_depthMask;
+    Cached<std::array<GLboolean, 4>> m_colorMask;
+    Cached<std::array<GLuint, 3>> m_stencilFunc;
+    Cached<std::array<GLenum, 3>> m_stencilOp;
+    Cached<GLuint> m_stencilMask;
+    Cached<std::array<GLint, 4>> m_viewport;
+    Cached<std::array<GLint, 4>> m_scissor;
+    Cached<GLenum> m_polygonMode;
+    Cached<std::array<GLfloat, 2>> m_polygonOffset;
+    Cached<std::array<GLfloat, 4>> m_clearColor;
+
+    FrameStats m_frameStats;
+
+    // Counts the call, returns isChanged so it reads as if (Count(cache.Update(x))) glCall(x);
+    bool Count(bool isChanged);
+    static int GetTextureTargetSlot(GLenum target);
+    void SetCapability(GLenum capability, bool isEnabled);
+};
@@ -0,0 +1,40 @@
+/** @file GPUQuery.hpp
+ *  @brief Averages a query over a range of commands, i.e. GPU time or fragments drawn, without stalling
+ *
+ *  Begin/End wrap the commands in a query of the given target (GL_TIME_ELAPSED in nanoseconds,
+ *  GL_SAMPLES_PASSED in samples). Each frame uses the next of kNumQueries queries, and a query's
+ *  result is only read when it comes around again, by which point the GPU has long finished
+ *  those commands.
+ */
+#pragma once
+
+#include <glad/glad.h>
+
+class GPUQuery {
+public:
+    static constexpr int kNumQueries = 4;
+
+    // target is the query type, i.e. GL_TIME_ELAPSED or GL_SAMPLES_PASSED
+    void Create(GLenum target);
+
+    // Queries of the same target do not nest, only one of them can be running at a time
+    void Begin();
+    void End();
+
+    // Over every result read since the last Reset, in the target's units, 0 before the first one
+    double GetAverage() const;
+    int GetNumSamples() const;
+
+    // Starts averaging over, results of queries still in flight are dropped
+    void Reset();
+
+    void CleanUp();
+
+private:
+    GLenum m_target = GL_TIME_ELAPSED;
+    GLuint m_queries[kNumQueries] = {};
+    bool m_isPending[kNumQueries] = {};
+    int m_currentQuery = 0;
+    double m_total = 0.0;
+    int m_numSamples = 0;
+};
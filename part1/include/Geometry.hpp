@@ -21,6 +21,7 @@ namespace Geometry  {
         float r,g,b; 	// color
         float nx,ny,nz; // normals
         float tx,ty; // texture coordinates
+        float materialIndex; // index into the mesh's own materials, offset by the instance's materialBase in the shader
     };
 
     //TODO: This should really be a class. 
@@ -64,6 +65,7 @@ namespace Geometry  {
             result.push_back(v.nz);
             result.push_back(v.tx);
             result.push_back(v.ty);
+            result.push_back(v.materialIndex);
         }
         return result;
     }
@@ -91,6 +93,7 @@ namespace Geometry  {
             result.push_back(v.nz);
             result.push_back(v.tx);
             result.push_back(v.ty);
+            result.push_back(v.materialIndex);
         }
         return result;
     }
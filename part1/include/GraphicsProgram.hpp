@@ -11,10 +11,37 @@
 
 #include "Camera.hpp"
 #include "DeltaTime.hpp"
+#include "FileWatcher.hpp"
+#include "FrustumCuller.hpp"
 #include "Geometry.hpp"
+#include "GPUQuery.hpp"
+#include "HalftoneDotTexture.hpp"
+#include "InstanceBuffer.hpp"
+#include "LightClusters.hpp"
+#include "ObjModelLoader.hpp"
+#include "OcclusionCuller.hpp"
+#include "OcclusionQueries.hpp"
 #include "PointLight.hpp"
+#include "ProgramBinaryCache.hpp"
 #include "Plane.hpp"
+#include "ShadowAtlas.hpp"
 #include "ShadowDirectionalLight.hpp"
+#include "ShadowFilter.hpp"
+#include "ShadowPointLight.hpp"
+#include "MaterialTable.hpp"
+#include "GLStateTracker.hpp"
+#include "RenderQueue.hpp"
+#include "SceneFramebuffer.hpp"
+#include "ShaderLibrary.hpp"
+#include "ShaderProgram.hpp"
+#include "UniformBlocks.hpp"
+#include "UniformBufferRing.hpp"
+#include "TextureAtlas.hpp"
+#include "TextureImage.hpp"
+#include "TextureStreamer.hpp"
+#include <future>
+#include <memory>
+#include <unordered_map>
 
 
 class GraphicsProgram {
@@ -30,13 +57,74 @@ class GraphicsProgram {
 
         SDL_Window* gGraphicsApplicationWindow 	= nullptr;
         SDL_GLContext gOpenGLContext			= nullptr;
-        GLuint m_graphicsPipelineLit	= 0; // Displays lit objects
-        GLuint m_graphicsPipelineLights = 0; // Displays lights themselves
-        GLuint m_graphicsPipelineOutline = 0; // Displays outline of objects
+        ShaderProgram m_graphicsPipelineLit; // Displays lit objects
+        ShaderProgram m_graphicsPipelineLitUntextured; // Lit objects without textures, the atlas is compiled out
+        ShaderProgram m_graphicsPipelineLights; // Displays lights themselves
+        ShaderProgram m_graphicsPipelineOutline; // Displays outline of objects
 
-        GLuint m_graphicsPipelineShadows = 0; // Graphics pipeline for shadow pass
+        ShaderProgram m_graphicsPipelineShadows; // Graphics pipeline for shadow pass
         const std::string m_shadowVertShader = "./shaders/shadow_pass_vert.glsl";
         const std::string m_shadowFragShader = "./shaders/shadow_pass_frag.glsl";
+        // Shadow pass of the main light's cube map, the geometry shader draws each caster into every face it reaches
+        ShaderProgram m_graphicsPipelineCubeShadows;
+        const std::string m_shadowCubeVertShader = "./shaders/shadow_cube_vert.glsl";
+        const std::string m_shadowCubeGeomShader = "./shaders/shadow_cube_geom.glsl";
+
+        ShaderProgram m_graphicsPipelineScreenOutline; // Outlines the scene framebuffer onto the screen
+        const std::string m_vertexShaderSourceFullScreen = "./shaders/fullscreen_vert.glsl";
+        const std::string m_fragmentShaderSourceScreenOutline = "./shaders/screen_outline_frag.glsl";
+
+        // Linked programs from earlier launches
+        ProgramBinaryCache m_programCache;
+        const std::string m_programCacheDirectory = "./shadercache";
+        // Preprocesses and compiles the permutations, see the defines at the top of each shader
+        ShaderLibrary m_shaderLibrary;
+        // Requests not swapped into their program yet, oldest first
+        std::vector<std::pair<ShaderProgram*, int>> m_pendingPrograms;
+        int m_debugView = 0; // DEBUG_VIEW in halftone_toon.glsl, cycled with v
+        static constexpr int m_numDebugViews = 5;
+        const char* m_debugViewNames[m_numDebugViews] = {"none", "shadows", "normals", "cascades", "light clusters"};
+        bool m_isDotTextureEnabled = true; // DOT_TEXTURE in halftone_toon.glsl, toggled with h
+
+        // Baked dot lattice for the DOT_TEXTURE permutation
+        HalftoneDotTexture m_halftoneDotTexture;
+        // Opaque objects are drawn depth only with the shadow program first, the lit pass then runs with GL_EQUAL
+        // and no depth writes, so the halftone shader runs once per pixel. Toggled with p.
+        bool m_isDepthPrepassEnabled = true;
+
+        // Measured around the depth pre-pass and opaque pass, where the halftone shading happens,
+        // printed every m_benchmarkFrames
+        GPUQuery m_opaquePassTimer; // Including the pre-pass
+        GPUQuery m_opaquePassFragments; // Halftone invocations that passed the depth test
+        GPUQuery m_depthPrepassFragments;
+        const int m_benchmarkFrames = 300;
+        // Every cascade's copy of the shadow cache and its moving casters, plus the cache whenever it is redrawn
+        GPUQuery m_shadowPassTimer;
+        int m_numStaticShadowRedraws = 0; // Cascades whose cache was redrawn, over the timer's frames
+        // The main light's cube map pass, in place of the cascades' one
+        GPUQuery m_pointShadowTimer;
+        long long m_numPointShadowCasters = 0; // Added up over the timer's frames
+        long long m_numPointShadowFaceDraws = 0; // Faces the casters were sent to after the CPU culled them
+
+        // Outlines by edge detection over the lit pass's depth, normals and IDs, one full-screen pass whatever
+        // the scene. Otherwise outlined objects are drawn again, extruded, around their stencil. Toggled with o.
+        bool m_isScreenSpaceOutline = true;
+        SceneFramebuffer m_sceneFramebuffer;
+        GLuint m_vertexArrayObjectFullScreen = 0; // Empty, the full-screen triangle comes from gl_VertexID
+        glm::vec3 m_outlineColor = glm::vec3(0.0f, 0.0f, 0.0f);
+        int m_outlineWidthPixels = 2; // Changed with [ and ]
+        int m_numOutlinedObjects = 0; // Outline IDs handed out this frame
+
+        // Reports shader, model, material and texture files edited while running
+        FileWatcher m_fileWatcher;
+        // Files each program was last built from, includes too
+        std::unordered_map<ShaderProgram*, std::vector<std::string>> m_programSourceFiles;
+        std::string m_modelPath;
+        // OBJ, MTL, textures and their caches, any of them changing reimports the model
+        std::vector<std::string> m_modelSourceFiles;
+        // Reimport running in the background, swapped in by UpdatePendingModel
+        std::future<std::unique_ptr<ObjModelLoader>> m_pendingModel;
+        bool m_isModelReloadQueued = false; // A file changed while m_pendingModel was still running
 
         // Main loop flag
         bool gQuit = false; // If this is quit = 'true' then the program terminates.
@@ -63,11 +151,91 @@ class GraphicsProgram {
         GLuint m_vertexArrayObjectLights = 0;
         GLuint m_vertexBufferObjectLights = 0;
         GLuint m_elementBufferObjectLights = 0;
-        std::vector<PointLight> m_lights;
+        std::vector<PointLight> m_lights; // The light in LightData, the only one casting shadows
+
+        // Unshadowed lights around the scene, the lit pass only loops over the ones of a fragment's cluster
+        std::vector<PointLight> m_clusteredLights;
+        const int m_numClusteredLights = 256;
+        const float m_clusteredLightCutoff = 0.02f; // Attenuation the lights' range ends at, see PointLight::GetRange
+        bool m_isClusteredLightingEnabled = true; // Toggled with l
+        LightClusters m_lightClusters;
+        // Assignment time on the CPU and light counts, averaged and printed every m_benchmarkFrames
+        int m_numClusterSamples = 0;
+        double m_clusterAssignMilliseconds = 0.0;
+        long long m_numClusterLightIndices = 0;
+        int m_maxLightsPerCluster = 0;
+        // Shadows of the clustered lights, tiles go to the lights that look largest on screen
+        ShadowAtlas m_shadowAtlas;
+        GPUQuery m_shadowAtlasTimer;
+        ShadowAtlas::Stats m_shadowAtlasTotals; // Added up over the timer's frames
 
         GLuint m_numVerticesToDraw = 0;
         GLuint m_numVerticesToDrawLights = 0;
 
+        // Model matrix, material and color of every draw this frame, see InstanceBuffer
+        InstanceBuffer m_instanceBuffer;
+        // Copies of the model around the scene, to measure instancing with. Toggled with i.
+        struct CrowdChunk {
+            int firstInstance;      // Into m_crowdInstances
+            int numInstances;
+            glm::vec3 worldMin;
+            glm::vec3 worldMax;
+        };
+        bool m_isModelCrowdEnabled = false;
+        const int m_numCrowdInstances = 100000;
+        const int m_crowdChunkSide = 32; // Instances along each side of a chunk, a chunk is one draw per pass
+        const float m_crowdScale = 1.5f;
+        std::vector<InstanceData> m_crowdInstances;
+        std::vector<CrowdChunk> m_crowdChunks;
+
+        // Objects outside the camera's view or the main light's shadow views are not drawn there. Toggled with k.
+        bool m_isFrustumCullingEnabled = true;
+        // The frame's views, set before anything is queued
+        Frustum m_cameraFrustum;
+        std::vector<Frustum> m_shadowFrusta;    // One per cascade, or one per cube face
+        // World bounds of every crowd instance, in m_crowdInstances' order
+        FrustumCuller m_crowdCuller;
+        // Whether each crowd instance is in the camera's view and in the main light's, from CullModelCrowd
+        std::vector<uint8_t> m_crowdCameraVisible;
+        std::vector<uint8_t> m_crowdShadowVisible;
+        // Cull times on the CPU and visible instances, added up and printed every m_benchmarkFrames
+        int m_numCullSamples = 0;
+        double m_cameraCullMilliseconds = 0.0;
+        double m_shadowCullMilliseconds = 0.0;
+        long long m_numCameraVisibleInstances = 0;
+        long long m_numShadowVisibleInstances = 0;
+
+        // Objects hidden behind the occluders are left out of the camera's passes. Toggled with j.
+        bool m_isOcclusionCullingEnabled = true;
+        OcclusionCuller m_occlusionCuller;
+        const int m_numCrowdOccluders = 16;     // Nearest crowd instances in view, on top of the model and the planes
+        // The model's mesh for the occlusion culler, set with the model
+        std::vector<glm::vec3> m_modelOccluderPositions;
+        std::vector<uint32_t> m_modelOccluderIndices;
+        // Added up and printed every m_benchmarkFrames
+        int m_numOcclusionSamples = 0;
+        double m_occlusionRasterizeMilliseconds = 0.0;
+        double m_occlusionTestMilliseconds = 0.0;
+        long long m_numOcclusionTested = 0;
+        long long m_numOccluded = 0;
+
+        // Hardware occlusion queries on the model and the crowd chunks, cycled with g
+        enum OcclusionQueryMode {
+            OCCLUSION_QUERIES_OFF,
+            OCCLUSION_QUERIES_CONDITIONAL,  // Objects hidden last frame are drawn under conditional render on this frame's query
+            OCCLUSION_QUERIES_READBACK,     // Objects hidden last frame are skipped until a later query says they are visible
+            OCCLUSION_QUERIES_COUNT
+        };
+        int m_occlusionQueryMode = OCCLUSION_QUERIES_CONDITIONAL;
+        OcclusionQueries m_occlusionQueries;
+        // Added up and printed every m_benchmarkFrames
+        int m_numOcclusionQuerySamples = 0;
+        long long m_numQueriesIssued = 0;
+        long long m_numQueriesPredictedHidden = 0;
+        long long m_numQueriesPending = 0;
+        long long m_numQueryFalseNegatives = 0;
+        long long m_numQueryPops = 0;
+
         // Camera
         Camera gCamera;
 
@@ -77,9 +245,75 @@ class GraphicsProgram {
         const float movementSpeed = 1.0f;
         const float m_lookSpeed = 0.7f;
 
-        // Textures
-        GLuint m_textureID = 0;
-        bool m_isTextureProvided = false;
+        // Textures of every loaded model by path, packed into the atlas once the material table is complete
+        std::unordered_map<std::string, TextureImage> m_loadedTextures;
+        // Every diffuse texture in the scene in one array texture, bound once to unit 0
+        TextureAtlas m_textureAtlas;
+        // Starts the atlas at its small mips and streams the rest in as objects get closer
+        TextureStreamer m_textureStreamer;
+        const int m_textureStartupSize = 64; // Largest mip resident at startup
+        const size_t m_textureBudgetBytes = 64 * 1024 * 1024;
+        const size_t m_textureUploadBytesPerFrame = 2 * 1024 * 1024;
+        const float m_fieldOfViewDegrees = 45.0f;
+        const float m_nearPlane = 0.1f;
+        const float m_farPlane = 20.0f;
+
+        // Materials of every object in the scene, uploaded once as a buffer texture
+        MaterialTable m_materialTable;
+        const GLint m_shadowMapTextureUnit = 1;
+        // 4 cascades of 512 texels hold as many texels as the single 1024 map they replaced
+        const ShadowCascadeSettings m_shadowCascadeSettings;
+        // PCF kernel of the lit pass's shadow lookups, cycled through its presets with f
+        ShadowFilter m_shadowFilter;
+        const GLint m_materialTableTextureUnit = 2; // 0 is the texture atlas, 1 the shadow map
+        const GLint m_dotDistanceTextureUnit = 3;
+        // Scene framebuffer attachments, only sampled by the screen space outline
+        const GLint m_sceneColorTextureUnit = 4;
+        const GLint m_sceneNormalAndIDTextureUnit = 5;
+        const GLint m_sceneDepthTextureUnit = 6;
+        // Light clusters, see LightClusters
+        const GLint m_clusterLightsTextureUnit = 7;
+        const GLint m_clusterRecordsTextureUnit = 8;
+        const GLint m_clusterLightIndicesTextureUnit = 9;
+        // Shadow atlas of the clustered lights and its tiles, see ShadowAtlas
+        const GLint m_shadowAtlasTextureUnit = 10;
+        const GLint m_shadowAtlasTilesTextureUnit = 11;
+        // The main light's shadow, a depth cube map around it, see ShadowPointLight
+        const GLint m_pointShadowTextureUnit = 12;
+        const ShadowPointLightSettings m_pointShadowSettings;
+        // The cube map shadows the main light from every direction, the cascades only from one. Toggled with c.
+        bool m_isPointShadowEnabled = true;
+        int m_modelMaterialBase = 0; // ID of the loaded model's first material
+        int m_modelNumMaterials = 0;
+
+        // Draws of the current frame by pass, refilled every frame
+        RenderQueue m_renderQueue;
+
+        // FrameData, LightData, ShadowData and ClusterData blocks of the last few frames
+        UniformBufferRing m_uniformRing;
+
+        // Uniform uploads, added up and printed every m_benchmarkFrames
+        int m_numUniformStatsFrames = 0;
+        long long m_numUniformUploads = 0;
+        long long m_numUniformsSkipped = 0;
+        // State changes, added up and printed every m_benchmarkFrames
+        int m_numStateStatsFrames = 0;
+        long long m_numStateChangesIssued = 0;
+        long long m_numStateChangesElided = 0;
+        float m_modelBoundingRadius = 0.0f; // Around the model's origin, before scaling
+        // From ObjModelLoader, before scaling
+        glm::vec3 m_modelBoundsMin = glm::vec3(0.0f);
+        glm::vec3 m_modelBoundsMax = glm::vec3(0.0f);
+        glm::vec3 m_modelSphereCenter = glm::vec3(0.0f);
+        float m_modelSphereRadius = 0.0f;
+
+        // Passes QueueInstances records a draw into
+        enum QueuedPasses {
+            QUEUED_PASSES_CAMERA = 1,           // Depth pre-pass, opaque and outline
+            QUEUED_PASSES_MAIN_SHADOW = 2,      // Cascades or cube map of the main light
+            QUEUED_PASSES_SHADOW_ATLAS = 4,     // Clustered lights, every face culls by the box on its own
+            QUEUED_PASSES_ALL = 7
+        };
         
         void GLClearAllErrors();
 
@@ -89,38 +323,31 @@ class GraphicsProgram {
         #define GLCheck(x) GLClearAllErrors(); x; GLCheckErrorStatus(#x,__LINE__);
 
         /**
-        * LoadShaderAsString takes a filepath as an argument and will read line by line a file and return a string that is meant to be compiled at runtime for a vertex, fragment, geometry, tesselation, or compute shader.
-        * e.g.
-        *       LoadShaderAsString("./shaders/filepath");
-        *
-        * @param filename Path to the shader file
-        * @return Entire file stored as a single string 
-        */
-        std::string LoadShaderAsString(const std::string& filename);
+         * Requests every program from m_shaderLibrary without waiting for them, call right after InitializeProgram.
+         */
+        void RequestShaderPrograms();
 
-        /**
-        * CompileShader will compile any valid vertex, fragment, geometry, tesselation, or compute shader.
-        * e.g.
-        *	    Compile a vertex shader: 	CompileShader(GL_VERTEX_SHADER, vertexShaderSource);
-        *       Compile a fragment shader: 	CompileShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
-        *
-        * @param type We use the 'type' field to determine which shader we are going to compile.
-        * @param source : The shader source code.
-        * @return id of the shaderObject
-        */
-        GLuint CompileShader(GLuint type, const std::string& source);
+        // Halftone permutation for the current debug view
+        std::vector<std::string> GetLitDefines(bool isTextured);
+
+        // Requests the program's shaders with its current defines, it is swapped in by UpdatePendingPrograms
+        void RequestProgram(ShaderProgram& program);
+
+        // Requests both lit permutations again, i.e. after the debug view changed
+        void RequestLitPrograms();
 
         /**
-        * Creates a graphics program object (i.e. graphics pipeline) with a Vertex Shader and a Fragment Shader
-        *
-        * @param vertexShaderSource Vertex source code as a string
-        * @param fragmentShaderSource Fragment shader source code as a string
-        * @return id of the program Object
-        */
-        GLuint CreateShaderProgram(const std::string& vertexShaderSource, const std::string& fragmentShaderSource);
+         * Swaps finished requests into their ShaderProgram. A program that fails to build keeps the previous one.
+         *
+         * @param isBlocking Wait for every request instead of only taking the ones the driver is done with
+         */
+        void UpdatePendingPrograms(bool isBlocking);
+
+        // Uniform blocks and sampler units, once per linked program
+        void SetUpProgram(ShaderProgram& program);
 
         /**
-        * Create the graphics pipeline
+        * Create the graphics pipeline, waits for the programs of RequestShaderPrograms
         *
         * @return void
         */
@@ -141,6 +368,43 @@ class GraphicsProgram {
         */
         void VertexSpecification(std::string modelPath);
 
+        /**
+        * Fills the model's vertex and element buffers, materials and textures from a loaded model and
+        * watches the files it came from. The model's vertex array must be bound.
+        *
+        * @return false if the model has no triangles, nothing is changed then
+        */
+        bool UploadModel(ObjModelLoader& modelLoader);
+
+        /**
+         * Rebuilds whatever depends on files that changed on disk: affected programs are requested again and
+         * the model is reimported on its own thread. Nothing is swapped in here, see UpdatePendingPrograms
+         * and UpdatePendingModel.
+         */
+        void ReloadChangedFiles();
+
+        // Swaps in a finished reimport at the start of a frame, a failed one keeps the previous model
+        void UpdatePendingModel();
+
+        /**
+        * Checks the driver extension list, i.e. IsExtensionSupported("GL_EXT_texture_compression_s3tc")
+        */
+        bool IsExtensionSupported(const std::string& extensionName);
+
+        /**
+        * Packs the textures of every material in the table into m_textureAtlas and uploads both.
+        * Call after all materials are added.
+        */
+        void UploadMaterialsAndTextures();
+
+        /**
+        * Tells the texture streamer how large an object's materials appear on screen this frame.
+        * Assumes the object's texture coordinates span its texture once, which holds for unwrapped models.
+        *
+        * @param boundingRadius World space radius around translation
+        */
+        void RequestTextureDetail(int materialBase, int numMaterials, glm::vec3 translation, float boundingRadius);
+
         void CreateLights();
 
         /**
@@ -150,37 +414,99 @@ class GraphicsProgram {
         * 		 pipeline.
         * @return void
         */
-        void PreDraw(int graphicsPipeline,
-                     glm::mat4 viewMatrix, 
-                     glm::mat4 projectionMatrix,
-                     glm::vec3 modelTranslation = glm::vec3(0.0f, 0.0f, 0.0f), 
-                     glm::vec3 modelScale = glm::vec3(1.0f, 1.0f, 1.0f));
+        void PreDraw();
 
-        /**
-         * Sets the lighting uniforms for Phong shading. Need to use glUseProgram before calling, handled in PreDraw.
-         */
-        void SetLightingUniforms(int graphicsPipeline, std::array<u_int8_t, 3> colorOfShadowDots, int numDotsHorizontally);
+        glm::mat4 GetModelMatrix(glm::vec3 modelTranslation, glm::vec3 modelScale);
 
-        void SetShadowUniforms(int graphicsPipeline, ShadowDirectionalLight shadowCaster);
+        // Distance along the view direction as a fraction of farPlane, for sort keys
+        float GetSortDepth(const glm::mat4& viewMatrix, glm::vec3 worldPosition, float farPlane);
 
-        void SetOutlineUniforms(int graphicsPipeline, float outlineExtrudeDistance);
+        /**
+         * Records a single instance of a mesh, see QueueInstances. When outlineExtrudeDistance > 0 the instance gets an outline ID.
+         * Left out of the camera's or the main light's passes when its box is outside all of their frustums.
+         *
+         * @param localMin, localMax Box around the mesh before the model matrix
+         */
+        void QueueMesh(GLuint vertexArray, GLsizei numVertices, bool isIndexed, glm::vec3 modelTranslation, glm::vec3 modelScale,
+                       glm::vec3 localMin, glm::vec3 localMax, int materialBase, int numMaterials, float outlineExtrudeDistance,
+                       bool isStaticShadowCaster, ShadowDirectionalLight& shadowCaster, const ShadowPointLight& pointShadow,
+                       int occlusionObject = -1);
 
         /**
-         * Sets the uniforms in shader that uses textures. Need to use glUseProgram before calling, handled in PreDraw.
+         * Records instances of a mesh into the shadow and opaque passes, one instanced draw per pass. When
+         * outlineExtrudeDistance > 0 and outlines are not drawn in screen space, they are recorded into the outline pass too.
+         *
+         * @param isIndexed Whether the vertex array has an element buffer
+         * @param firstInstance, numInstances Already in m_instanceBuffer, with their materials and outline IDs
+         * @param worldMin, worldMax Box around every instance, they are only drawn into the shadow views it reaches
+         * @param numMaterials Materials the mesh uses from materialBase on, picks the textured or untextured lit program
+         * @param materialBase ID returned by MaterialTable::AddMaterials/AddMaterial for the mesh, for sorting
+         * @param isStaticShadowCaster Never moves, so it is drawn into the shadow cache instead of every frame
+         * @param pointShadow Only the cube faces the box reaches draw the instances
+         * @param passes QueuedPasses bits, culled instances are queued separately for the passes that see them
+         * @param occlusionObject ID in m_occlusionQueries when the camera's draw gets an occlusion query, -1 for none
          */
-        void SetTextureUniforms(int graphicsPipeline);
+        void QueueInstances(GLuint vertexArray, GLsizei numVertices, bool isIndexed, int firstInstance, int numInstances,
+                            glm::vec3 worldMin, glm::vec3 worldMax, int materialBase, int numMaterials, float outlineExtrudeDistance,
+                            bool isStaticShadowCaster, ShadowDirectionalLight& shadowCaster, const ShadowPointLight& pointShadow,
+                            int passes = QUEUED_PASSES_ALL, int occlusionObject = -1);
+
+        // Every light's cube, as instances of one mesh tinted with their light's color
+        void QueueLightGizmos();
+
+        // Lays m_numCrowdInstances copies of the model out on a grid, in chunks of neighbouring instances
+        void BuildModelCrowd();
+
+        // The camera's frustum and the main light's, whichever of cascades or cube map is on, after both moved
+        void UpdateCullingFrusta(const glm::mat4& viewProjection, ShadowDirectionalLight& shadowCaster, const ShadowPointLight& pointShadow);
+
+        // Finds the crowd instances in the camera's and the main light's frustums, after UpdateCullingFrusta.
+        // Prints the cull times every m_benchmarkFrames.
+        void CullModelCrowd();
+        // Nominates the m_numCrowdOccluders crowd instances in view nearest to the camera as occluders
+        void AddCrowdOccluders();
+
+        // Each chunk's instances visible to the camera, then those visible to the main light, go to m_instanceBuffer
+        // and are queued for their passes. The ones in the camera's view are tested against the occluders first.
+        void QueueModelCrowd(ShadowDirectionalLight& shadowCaster, const ShadowPointLight& pointShadow);
+        // Copies each chunk's visible instances, returns their first instance and count per chunk
+        std::vector<glm::ivec2> AddVisibleCrowdInstances(const std::vector<uint8_t>& isVisible);
+
+        // Adds up the occlusion culler's frame and prints it every m_benchmarkFrames
+        void ReportOcclusionCulling();
+        // Same for the occlusion queries' frame
+        void ReportOcclusionQueries();
+        const char* GetOcclusionQueryModeName() const;
 
         /**
-        * Draw
-        * The render function gets called once per loop.
-        * Typically this includes 'glDraw' related calls, and the relevant setup of buffers
-        * for those calls.
-        *
-        * @return void
-        */
-        void DrawLit();
+         * Fills FrameData for the draws that follow, once per rendered view (each shadow cascade, camera).
+         * Every program reads it from the same binding, so nothing is set per program.
+         */
+        void PushFrameData(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+
+        // Fills LightData once per frame, after the lights have moved
+        void PushLightData();
+
+        // Fills ShadowData for the lit programs, with the cube map or the cascades, whichever is on
+        void BindShadowMap(ShadowDirectionalLight& shadowCaster, const ShadowPointLight& pointShadow);
+
+        // Draws the main light's cube map, every caster once with all its faces
+        void DrawPointShadow(ShadowPointLight& pointShadow);
+
+        // m_clusteredLights, or none when they are turned off
+        const std::vector<PointLight>& GetClusteredLights() const;
+
+        // Assigns the clustered lights to the camera's clusters, uploads them and fills ClusterData for the lit programs
+        void UpdateLightClusters(const glm::mat4& viewMatrix);
+
+        // Draws the stale faces of the shadow atlas, each with only the casters reaching it
+        void DrawShadowAtlas();
+
+        // Starts the opaque pass measurements over, after anything that changes its cost
+        void ResetOpaquePassStats();
 
-        void DrawLights();
+        // Draws m_sceneFramebuffer to the screen with outlines where its depth, normals or outline IDs change
+        void DrawScreenSpaceOutline();
 
         void RotateLights();
 
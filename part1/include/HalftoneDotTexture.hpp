@@ -0,0 +1,37 @@
+/** @file HalftoneDotTexture.hpp
+ *  @brief Tiling distance texture of the halftone dot lattice
+ *
+ *  The halftone dots sit on a staggered lattice: one dot spacing apart along each row, with
+ *  every odd row shifted by half a spacing. One spacing wide and two rows high, that pattern
+ *  repeats, so a single tile of "distance to the nearest dot" covers every fragment with
+ *  GL_REPEAT. halftone_toon.glsl built with DOT_TEXTURE then tests a fragment with one fetch
+ *  and a compare instead of the floor/modulo/sqrt math of the analytic path.
+ *
+ *  Distances are stored in units of the dot spacing, so one texture serves every material's
+ *  dot count.
+ */
+#pragma once
+
+#include <glad/glad.h>
+#include <vector>
+
+class HalftoneDotTexture {
+public:
+    /**
+     * Bakes the tile and uploads it as GL_R16F, width x 2 * width texels.
+     *
+     * @param width Texels per dot spacing. Bilinear filtering keeps the dot edges smooth, 64 is plenty.
+     */
+    void Create(int width = 64);
+
+    // Binds the texture, i.e. Bind(GL_TEXTURE3)
+    void Bind(GLenum texUnit);
+
+    void CleanUp();
+
+    // Distance of every texel center to the nearest dot, rows bottom up
+    static std::vector<float> ComputeDistances(int width, int height);
+
+private:
+    GLuint m_texture = 0;
+};
@@ -0,0 +1,66 @@
+/** @file InstanceBuffer.hpp
+ *  @brief Per-instance model matrix, material and color of every draw, streamed once per frame
+ *
+ *  Every mesh is uploaded once and drawn with glDrawElementsInstanced (or glDrawArraysInstanced):
+ *  what used to be per-draw uniforms is a vertex attribute advancing once per instance
+ *  (glVertexAttribDivisor 1), read from one vertex buffer holding every instance of the frame.
+ *  The draws of a frame Add their instances, Upload then replaces the buffer's storage in one call.
+ *
+ *  OpenGL 4.1 cannot start an instanced draw at an instance other than 0, so BindInstances points
+ *  a vertex array's instance attributes at the draw's first instance instead. Attribute locations,
+ *  see include/instance_data.glsl:
+ *
+ *      5-8  model matrix, a column each
+ *      9    color, multiplies the vertex colors
+ *      10   ID of the mesh's first material in the material table and outline ID, integers
+ */
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+struct InstanceData {
+    glm::mat4 modelMatrix = glm::mat4(1.0f);
+    glm::vec4 color = glm::vec4(1.0f);
+    GLint materialBase = 0;     // Vertices store material indices relative to it
+    GLint outlineID = 0;        // 0 for instances without an outline, see SceneFramebuffer
+    GLint padding[2] = {};
+};
+
+static_assert(sizeof(InstanceData) == 96, "InstanceData must match the attributes set up by InstanceBuffer::BindInstances");
+
+class InstanceBuffer {
+public:
+    static constexpr GLuint kFirstAttribute = 5; // Locations 0-4 are the vertex attributes
+
+    void Create();
+
+    // Enables the instance attributes of a vertex array, once after it is created
+    void Attach(GLuint vertexArray);
+
+    // Empties the frame's instances, keeps their memory
+    void Clear();
+
+    // Appends instances, returns the index of the first one
+    int Add(const InstanceData& instance);
+    int Add(const InstanceData* instances, int numInstances);
+
+    // Replaces the buffer's storage with this frame's instances, after the last Add and before the first draw
+    void Upload();
+
+    // Points the bound vertex array's instance attributes at the draw's first instance, only when they point elsewhere
+    void BindInstances(GLuint vertexArray, int firstInstance);
+
+    inline int GetNumInstances() const { return m_instances.size();}
+
+    void CleanUp();
+
+private:
+    GLuint m_buffer = 0;
+    std::vector<InstanceData> m_instances;
+    // First instance each vertex array's attributes point at, the pointers outlive Upload's new storage
+    std::unordered_map<GLuint, int> m_boundFirstInstance;
+};
@@ -0,0 +1,127 @@
+/** @file LightClusters.hpp
+ *  @brief Assigns point lights to a 3D grid of view frustum clusters for clustered forward shading
+ *
+ *  The camera's view frustum is cut into tiles across the screen and into depth slices that grow
+ *  exponentially with distance, like perspective does. Every frame each cluster gets the list of
+ *  lights whose range reaches its view space box, so a fragment only loops over the lights of its
+ *  own cluster instead of every light in the scene.
+ *
+ *  The sphere/box tests run on the CPU: depth slices are split between worker threads, and every
+ *  test checks four lights per SSE register. Lights outside a slice's depth range are dropped
+ *  before its clusters are tested.
+ *
+ *  The results go to the GPU as three buffer textures (OpenGL 4.1 has no storage buffers):
+ *
+ *      lights          RGBA32F, 2 texels per light: world position and range, falloff constants
+ *      cluster records RG32UI, offset into the index list and light count per cluster
+ *      index list      R16UI, the lights of every cluster one after the other
+ *
+ *  A cluster's index is (slice * tilesY + tileY) * tilesX + tileX, with tile 0, 0 at the bottom left.
+ */
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "PointLight.hpp"
+#include "ThreadPool.hpp"
+#include "UniformBlocks.hpp"
+
+struct LightClusterSettings {
+    int tilesX = 16;
+    int tilesY = 9;
+    int slices = 24;
+};
+
+class LightClusters {
+public:
+    struct Stats {
+        int numLights = 0;
+        int numLightIndices = 0;        // Sum of every cluster's light count
+        int maxLightsPerCluster = 0;
+        int numThreads = 0;             // Threads the last assignment was split between
+        double assignMilliseconds = 0.0;
+    };
+
+    explicit LightClusters(const LightClusterSettings& settings = LightClusterSettings());
+    LightClusters(const LightClusters&) = delete;
+    LightClusters& operator=(const LightClusters&) = delete;
+
+    /**
+     * Fills every cluster's light list for the camera, runs on the CPU only.
+     *
+     * @param cutoff Light reaching less than this is left out, see PointLight::GetRange
+     */
+    void AssignLights(const std::vector<PointLight>& lights, const glm::mat4& viewMatrix, float fieldOfViewRadians,
+                      float aspectRatio, float nearPlane, float farPlane, float cutoff);
+
+    // Creates the buffer textures with no lights and binds them once, i.e. Create(GL_TEXTURE7, GL_TEXTURE8, GL_TEXTURE9)
+    void Create(GLenum lightsTexUnit, GLenum recordsTexUnit, GLenum indicesTexUnit);
+
+    // Refills the buffer textures with the last assignment
+    void Upload();
+
+    // Grid and depth slicing for the lit shaders, screen size in pixels
+    ClusterData GetClusterData(int screenWidth, int screenHeight) const;
+
+    // Offset into GetLightIndices and light count of a cluster, for debugging and tests
+    glm::uvec2 GetClusterRecord(int tileX, int tileY, int slice) const;
+    const std::vector<uint16_t>& GetLightIndices() const;
+
+    const Stats& GetStats() const;
+
+    void CleanUp();
+
+private:
+    struct ClusterBounds {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    // One slice's results, written by a single thread
+    struct SliceLights {
+        std::vector<uint32_t> counts;   // Per tile, tileY * tilesX + tileX
+        std::vector<uint16_t> indices;
+        // Lights reaching the slice's depth range, view space SoA padded to a multiple of 4
+        std::vector<float> x, y, z, radiusSquared;
+        std::vector<uint16_t> lightIndices;
+    };
+
+    LightClusterSettings m_settings;
+
+    // View space boxes of every cluster, rebuilt when the projection changes
+    std::vector<ClusterBounds> m_clusterBounds;
+    glm::vec4 m_boundsProjection = glm::vec4(0.0f); // Field of view, aspect ratio, near and far plane of m_clusterBounds
+    float m_nearPlane = 0.1f;
+    float m_farPlane = 20.0f;
+
+    // Every light in view space, SoA
+    std::vector<float> m_lightX, m_lightY, m_lightZ, m_lightRadius;
+    std::vector<SliceLights> m_sliceLights;
+
+    // What Upload sends to the GPU
+    std::vector<float> m_lightTexels;
+    std::vector<uint32_t> m_records;
+    std::vector<uint16_t> m_indices;
+    Stats m_stats;
+
+    GLuint m_lightsBuffer = 0;
+    GLuint m_lightsTexture = 0;
+    GLuint m_recordsBuffer = 0;
+    GLuint m_recordsTexture = 0;
+    GLuint m_indicesBuffer = 0;
+    GLuint m_indicesTexture = 0;
+
+    void BuildClusterBounds(float fieldOfViewRadians, float aspectRatio, float nearPlane, float farPlane);
+
+    // View space distance the slice starts at, slice == slices is the far plane
+    float GetSliceDepth(int slice) const;
+
+    // Tests the lights of every slice from firstSlice on, sliceStep apart
+    void AssignSlices(int firstSlice, int sliceStep);
+
+    // Appends the lights reaching a box to slice.indices, returns how many
+    static uint32_t TestCluster(const ClusterBounds& bounds, SliceLights& slice);
+};
@@ -0,0 +1,74 @@
+/** @file Material.hpp
+ *  @brief Plain data for one MTL material
+ *
+ *  The layout matches the material table buffer texture one to one (9 RGBA32F texels per
+ *  material), so a std::vector<Material> can be uploaded without any repacking. Integers
+ *  (illum, texture indices, dot count) are stored as floats, which is exact for these ranges.
+ */
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// Texture maps a material can reference, index into Material::textureIndices
+enum TextureSlot {
+    TEXTURE_SLOT_DIFFUSE = 0,           // map_Kd
+    TEXTURE_SLOT_AMBIENT,               // map_Ka
+    TEXTURE_SLOT_SPECULAR,              // map_Ks
+    TEXTURE_SLOT_SPECULAR_EXPONENT,     // map_Ns
+    TEXTURE_SLOT_DISSOLVE,              // map_d
+    TEXTURE_SLOT_EMISSIVE,              // map_Ke
+    TEXTURE_SLOT_BUMP,                  // map_Bump, bump, norm
+    TEXTURE_SLOT_DISPLACEMENT,          // disp
+    TEXTURE_SLOT_COUNT
+};
+
+struct Material {
+    float diffuseColor[3];      // Kd
+    float dissolve;             // d (1 is opaque)
+    float ambientColor[3];      // Ka
+    float specularExponent;     // Ns
+    float specularColor[3];     // Ks
+    float illuminationModel;    // illum
+    float emissiveColor[3];     // Ke
+    float numDotsHorizontally;  // halftone_dots (not standard MTL)
+    float dotColor[3];          // halftone_color (not standard MTL), darker Kd when not given
+    float diffuseTextureLayer;  // Layer of map_Kd in the texture atlas, -1 when untextured
+    float textureIndices[TEXTURE_SLOT_COUNT]; // Index into the texture path list, -1 when there is no map
+    float diffuseTextureRect[4]; // Atlas UV offset (xy) and scale (zw) of map_Kd
+    float diffuseTextureMinLod; // Finest mip of map_Kd that is streamed in, relative to the atlas base level
+    float padding[3];
+
+    // Number of RGBA texels one material takes up in the material table
+    static constexpr int kTexelsPerMaterial = 9;
+
+    // Defaults used for a newmtl block before any of its statements are read
+    static Material CreateDefault() {
+        Material m = {};
+        m.diffuseColor[0] = m.diffuseColor[1] = m.diffuseColor[2] = 0.8f;
+        m.dissolve = 1.0f;
+        m.specularExponent = 0.0f;
+        m.illuminationModel = 2.0f;
+        m.numDotsHorizontally = 75.0f;
+        m.dotColor[0] = -1.0f; // Filled from Kd once the block is done
+        m.diffuseTextureLayer = -1.0f;
+        m.diffuseTextureRect[2] = m.diffuseTextureRect[3] = 1.0f;
+        for (int i = 0; i < TEXTURE_SLOT_COUNT; i++) {
+            m.textureIndices[i] = -1.0f;
+        }
+        return m;
+    }
+
+    // Untextured halftone material, i.e. for planes that do not come from an MTL file
+    static Material CreateHalftone(std::array<uint8_t, 3> diffuseColorRGB, std::array<uint8_t, 3> dotColorRGB, int numDotsHorizontally) {
+        Material m = CreateDefault();
+        for (int c = 0; c < 3; c++) {
+            m.diffuseColor[c] = diffuseColorRGB[c] / 255.0f;
+            m.dotColor[c] = dotColorRGB[c] / 255.0f;
+        }
+        m.numDotsHorizontally = (float)numDotsHorizontally;
+        return m;
+    }
+};
+
+static_assert(sizeof(Material) == Material::kTexelsPerMaterial * 4 * sizeof(float), "Material must match the material table texel layout");
@@ -2,15 +2,36 @@
 
 #include <string>
 #include <vector>
-#include "PPM.hpp"
-#include <optional>
 #include <cstdint>
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include "Material.hpp"
+#include "TextureImage.hpp"
 
 class MaterialLoader    {
 private:
     std::string m_materialFilePath;
-    std::optional<PPM> m_diffuseTexture;
+
+    // Every newmtl block in file order
+    std::vector<Material> m_materials;
+    std::unordered_map<std::string, int> m_materialIndexByName;
+
+    // Every texture referenced by any material, each path only once
+    std::vector<std::string> m_texturePaths;
+    std::unordered_map<std::string, int> m_textureIndexByPath;
+
+    // One decode job per texture path, queued on the shared ThreadPool as soon as the map statement is read
+    // so decoding overlaps with the rest of the MTL and OBJ parse
+    std::vector<std::shared_future<TextureImage>> m_textureJobs;
+
+    // Texture of the first map_Kd, which is the texture GraphicsProgram binds. -1 when there is none.
+    int m_diffuseTextureIndex = -1;
+
     void ProcessLineFromMaterialFile(std::string line);
+
+    // Adds the path to m_texturePaths and queues its decode if it is new, returns its index
+    int AddTexturePath(const std::string& texturePath);
 public:
     MaterialLoader(std::string materialFilePath);
 
@@ -20,4 +41,20 @@ public:
     int GetDiffuseTextureWidth() const;
     int GetDiffuseTextureHeight() const;
     bool HasDiffuseTexture() const;
-};
\ No newline at end of file
+
+    const std::vector<Material>& GetMaterials() const;
+
+    const std::string& GetMaterialFilePath() const;
+
+    // Material::textureIndices index into this list
+    const std::vector<std::string>& GetTexturePaths() const;
+
+    // Index into GetMaterials() for a usemtl name, -1 if the file has no such material
+    int GetMaterialIndex(const std::string& materialName) const;
+
+    // Blocks until the texture at that index (into GetTexturePaths()) is decoded
+    const TextureImage& GetTexture(int textureIndex) const;
+
+    // Blocks until every texture is decoded, takes as long as the slowest one
+    void WaitForTextures() const;
+};
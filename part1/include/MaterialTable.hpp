@@ -0,0 +1,79 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Material.hpp"
+#include "TextureAtlas.hpp"
+#include "TextureStreamer.hpp"
+
+/*
+Every material in the scene, stored once on the GPU as a buffer texture (RGBA32F, Material::kTexelsPerMaterial
+texels each). Shaders look materials up by ID with texelFetch, so an instance only has to carry its materialBase.
+A buffer texture is used instead of a shader storage buffer because we target OpenGL 4.1.
+*/
+
+class MaterialTable {
+private:
+    std::vector<Material> m_materials;
+
+    // Texture paths of every material, each path only once across all models
+    std::vector<std::string> m_texturePaths;
+    std::unordered_map<std::string, int> m_textureIndexByPath;
+
+    // Ranges of m_materials no object uses since a reimport moved its materials, {first ID, count}, sorted and merged
+    std::vector<std::pair<int, int>> m_freeRanges;
+
+    GLuint m_bufferObject = 0;
+    GLuint m_bufferTexture = 0;
+
+    // Points the material's texture indices into m_texturePaths instead of texturePaths
+    Material RemapTextureIndices(Material m, const std::vector<std::string>& texturePaths);
+    // First ID of count consecutive materials, from a free range when one is big enough or else at the end
+    int AllocateRange(int count);
+    // Gives the materials back for AllocateRange, the ones at the end of the table are dropped
+    void FreeRange(int first, int count);
+    // Drops texture paths no material refers to any more, i.e. after a reimport swapped the model's textures
+    void RemoveUnusedTexturePaths();
+public:
+    /**
+     * Adds a model's materials, remapping their texture indices into the table's texture list.
+     *
+     * @param texturePaths List the materials' textureIndices refer to
+     * @return ID of the first added material, use as the model instances' materialBase
+     */
+    int AddMaterials(const std::vector<Material>& materials, const std::vector<std::string>& texturePaths);
+
+    /**
+     * Swaps in a reimported model's materials. When they fit in the old range they replace the old ones in place
+     * and the IDs stay, what is left of the range is freed. Otherwise the old range is freed and they are added like AddMaterials.
+     * Textures only the old materials used leave the texture list, so rebuild the atlas from GetTexturePaths() afterwards.
+     *
+     * @param materialBase, numMaterials The model's current materials
+     * @return ID of the model's first material from now on
+     */
+    int ReplaceMaterials(int materialBase, int numMaterials, const std::vector<Material>& materials,
+                         const std::vector<std::string>& texturePaths);
+
+    // Adds a material that has no textures, returns its ID
+    int AddMaterial(const Material& material);
+
+    const std::vector<Material>& GetMaterials() const;
+    const std::vector<std::string>& GetTexturePaths() const;
+
+    // Points every material's diffuse map at its layer and UV rect, atlas must be built from GetTexturePaths() order
+    void ApplyTextureRegions(const TextureAtlas& atlas);
+
+    // Clamps every textured material's LOD to what the streamer has resident, refill with Upload afterwards
+    void ApplyTextureResidency(const TextureStreamer& streamer);
+
+    // Creates (or refills) the buffer texture, call after all materials are added
+    void Upload();
+
+    // Binds the buffer texture, i.e. Bind(GL_TEXTURE2)
+    void Bind(GLenum texUnit);
+
+    void CleanUp();
+};
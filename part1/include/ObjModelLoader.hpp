@@ -2,7 +2,9 @@
 
 #include <string>
 #include <vector>
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <glm/glm.hpp>
 #include <sstream>
 #include <unordered_map>
 #include <array>
@@ -17,11 +19,11 @@
 
 class ObjModelLoader {
 private:
-    // Hashes a vertex that is in form 1/4/1, position/texture/normal
+    // Hashes a vertex that is in form 1/4/1, position/texture/normal, plus the material it is used with
     struct VertexHashFunctor { 
-        std::size_t operator()(const std::array<int, 3>& a) const {
+        std::size_t operator()(const std::array<int, 4>& a) const {
             std::hash<int> hashIntFunctor;
-            return hashIntFunctor(a[0]) * 100 + hashIntFunctor(a[1]) * 10 + hashIntFunctor(a[2]);
+            return hashIntFunctor(a[0]) * 1000 + hashIntFunctor(a[1]) * 100 + hashIntFunctor(a[2]) * 10 + hashIntFunctor(a[3]);
         }  
     };
     
@@ -35,20 +37,13 @@ private:
     std::vector<Geometry::IndexedTriangle> triangles;
 
     // Memory of vertices already seen in form 7//7 5//5 3//3, returns index of vertices member variable
-    std::unordered_map<std::array<int, 3>, int, VertexHashFunctor> vertexMap;
-
-    // Gold Chalice
-    u_int8_t defaultColorR = 255;
-    u_int8_t defaultColorG = 215;
-    u_int8_t defaultColorB = 0;
-
-    // White Astronaut
-    //u_int8_t defaultColorR = 255;
-    //u_int8_t defaultColorG = 255;
-    //u_int8_t defaultColorB = 255;
+    std::unordered_map<std::array<int, 4>, int, VertexHashFunctor> vertexMap;
 
     // Object will look for material in same folder as object
     std::optional<MaterialLoader> material;
+
+    // Index into the material file's materials set by the last usemtl, 0 (the first material) until then
+    int currentMaterialIndex = 0;
     
     void ProcessLineFromOBJFile(std::string line);
 
@@ -58,20 +53,31 @@ private:
     //i.e "14//194"
     GLuint GetVertexIndex(std::string const &s);
     
-    // vertexInfo in {positionIndex, textureIndex, normalIndex}
-    GLuint AddUniqueVertexAndReturnIndex(std::array<int, 3> vertexInfo);
+    // vertexInfo in {positionIndex, textureIndex, normalIndex, materialIndex}
+    GLuint AddUniqueVertexAndReturnIndex(std::array<int, 4> vertexInfo);
 
     std::string m_objFilePath;
-    
+    // Bounds of the vertices the faces use, found once the file is read
+    glm::vec3 m_boundsMin = glm::vec3(0.0f);
+    glm::vec3 m_boundsMax = glm::vec3(0.0f);
+    glm::vec3 m_boundingSphereCenter = glm::vec3(0.0f);
+    float m_boundingSphereRadius = 0.0f;
+    void ComputeBounds();
+
 public:
     ObjModelLoader(std::string filePath);
     
     // Formatted: positionX, positionY, positionZ, colorR, colorB, colorG, normalX, 
-    // normalY, normalZ, textureX, textureY, positionX, ...
+    // normalY, normalZ, textureX, textureY, materialIndex, positionX, ...
     std::vector<GLfloat> GetVertexBufferObjectData();
 
     // Formatted: v1, v2, v3, v1, v2, v3, v1...
     std::vector<GLuint> GetElementBufferObjectData();
+    // Model space bounding box and sphere, the sphere is centered on the box for culling
+    inline glm::vec3 GetBoundsMin() const { return m_boundsMin;}
+    inline glm::vec3 GetBoundsMax() const { return m_boundsMax;}
+    inline glm::vec3 GetBoundingSphereCenter() const { return m_boundingSphereCenter;}
+    inline float GetBoundingSphereRadius() const { return m_boundingSphereRadius;}
 
     bool HasDiffuseTexture();
 
@@ -79,4 +85,19 @@ public:
 
     int GetDiffuseTextureWidth();
     int GetDiffuseTextureHeight();
+
+    // Materials the vertex materialIndex refers to. A model without an MTL file gets one default material.
+    std::vector<Material> GetMaterials();
+
+    // Material::textureIndices index into this list
+    std::vector<std::string> GetTexturePaths();
+
+    // MTL file named by mtllib, empty when the model has none
+    std::string GetMaterialFilePath();
+
+    // Blocks until the texture at that index (into GetTexturePaths()) has been decoded by its worker
+    const TextureImage& GetTexture(int textureIndex);
+
+    // Blocks until every texture the materials reference is decoded
+    void WaitForTextures();
 };
\ No newline at end of file
@@ -0,0 +1,95 @@
+/** @file OcclusionCuller.hpp
+ *  @brief Hides objects behind nearer ones on the CPU, with a small software depth buffer
+ *
+ *  Every frame a few nominated occluders (meshes that are cheap and large on screen, or simplified
+ *  stand-ins for them) are rasterized into a low resolution depth buffer. Then the bounding boxes of
+ *  the objects about to be drawn are tested against it: a box whose nearest point is behind every
+ *  occluder pixel it covers cannot be seen and is not drawn.
+ *
+ *  The buffer is split into tiles of 8x8 pixels, each keeping the furthest depth in it. A box is
+ *  first tested against the tiles it covers, only tiles it is not fully behind are tested pixel by
+ *  pixel. Rasterization goes four pixels per SSE register, with bands of tile rows split between
+ *  worker threads. Nothing here touches OpenGL, so it runs and can be tested without a window.
+ *
+ *  Depth is clip space z / w mapped to 0 (near) to 1 (far), like the GL depth buffer. Triangles
+ *  crossing the near plane are left out, which only ever hides less. Occluders cover the pixels
+ *  whose centers they cover, so a gap between them narrower than a pixel of this buffer can hide
+ *  what is behind it.
+ */
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+struct OcclusionCullerSettings {
+    int width = 256;            // Depth buffer size in pixels, multiples of the 8 pixel tiles
+    int height = 144;
+};
+
+class OcclusionCuller {
+public:
+    static constexpr int kTileSize = 8;
+
+    struct Stats {
+        int numOccluders = 0;
+        int numOccluderTriangles = 0;   // Added this frame, before the ones crossing the near plane are dropped
+        int numTested = 0;
+        int numOccluded = 0;
+        int numThreads = 0;             // Threads the rasterization was split between
+        double rasterizeMilliseconds = 0.0;
+        double testMilliseconds = 0.0;
+    };
+
+    explicit OcclusionCuller(const OcclusionCullerSettings& settings = OcclusionCullerSettings());
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+    // Clears the occluders and the tested counts, call once per frame before adding occluders
+    void BeginFrame(const glm::mat4& viewProjection);
+
+    /**
+     * Adds the triangles of an occluder, transformed to screen space right away.
+     *
+     * @param indices Three per triangle into positions, empty when every three positions are a triangle
+     */
+    void AddOccluder(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, const glm::mat4& modelMatrix);
+
+    // Clears the depth buffer and draws every occluder added since BeginFrame
+    void RasterizeOccluders();
+
+    // Whether any part of the world box could be in front of the occluders, after RasterizeOccluders
+    bool IsBoxVisible(glm::vec3 worldMin, glm::vec3 worldMax);
+
+    // The same for many boxes at once, isVisible gets a 0 or 1 per box. Split between worker threads when there are many.
+    void TestBoxes(const std::vector<glm::vec3>& worldMins, const std::vector<glm::vec3>& worldMaxs, std::vector<uint8_t>& isVisible);
+
+    inline int GetWidth() const { return m_settings.width;}
+    inline int GetHeight() const { return m_settings.height;}
+    // Row by row from the bottom left, for debugging and tests
+    inline const std::vector<float>& GetDepth() const { return m_depth;}
+
+    const Stats& GetStats() const;
+
+private:
+    // Pixel coordinates and depth of the corners
+    struct ScreenTriangle {
+        glm::vec3 corners[3];
+        int minY;
+        int maxY;
+    };
+
+    OcclusionCullerSettings m_settings;
+    int m_tilesX;
+    int m_tilesY;
+    glm::mat4 m_viewProjection = glm::mat4(1.0f);
+    std::vector<ScreenTriangle> m_triangles;
+    std::vector<float> m_depth;
+    std::vector<float> m_tileMaxDepth;     // Furthest depth of each tile's pixels
+    Stats m_stats;
+
+    // Draws every triangle into the tile rows firstTileRow, firstTileRow + tileRowStep, ...
+    void RasterizeTileRows(int firstTileRow, int tileRowStep);
+    void RasterizeTriangle(const ScreenTriangle& triangle, int minY, int maxY);
+    bool TestBox(glm::vec3 worldMin, glm::vec3 worldMax) const;
+};
@@ -0,0 +1,66 @@
+/** @file OcclusionQueries.hpp
+ *  @brief Hardware occlusion queries on box proxies of heavy objects, read back without ever waiting
+ *
+ *  Every frame each object's bounding box is drawn (no color, no depth writes) inside its own
+ *  GL_ANY_SAMPLES_PASSED query, after the objects visible last frame have laid down their depth.
+ *  A query's result is only read once GL_QUERY_RESULT_AVAILABLE says it is there, usually a frame
+ *  later, and becomes the object's prediction for the frames after:
+ *
+ *      predicted visible   drawn first, like any object, its query tells whether it still is
+ *      predicted hidden    drawn after the proxies, either inside glBeginConditionalRender on this
+ *                          frame's query (GL_QUERY_NO_WAIT, the GPU draws it if the result is not in
+ *                          yet), or not at all until a later query says it is visible again
+ *
+ *  Skipping hidden objects outright saves their vertex work but an object coming into view then
+ *  pops in a frame or more late; these are counted as pops. Query objects are kept in a pool and
+ *  reused once their result is read.
+ */
+#pragma once
+
+#include <glad/glad.h>
+#include <vector>
+
+class OcclusionQueries {
+public:
+    struct Stats {
+        int numIssued = 0;
+        int numPredictedHidden = 0;
+        int numResultsRead = 0;
+        int numResultsPending = 0;      // Still in flight at BeginFrame, read in a later frame
+        int numFalseNegatives = 0;      // Predicted hidden, but the query came back visible
+        int numPops = 0;                // Of those, the ones that were not drawn in their frame
+        int numPooledQueries = 0;       // Query objects created so far
+    };
+
+    // Reads back every query whose result is available, the others wait for a later frame. Call once per frame before queueing.
+    void BeginFrame();
+
+    // From the object's last query that came back, objects without a recent query are visible. object is any small ID >= 0.
+    bool IsPredictedVisible(int object) const;
+
+    /**
+     * A query from the pool for the object's proxy this frame, 0 while its previous one is still in flight.
+     *
+     * @param isDrawn Whether the object itself is drawn this frame no matter what the query says,
+     *                a hidden prediction drawn under conditional render counts as drawn
+     */
+    GLuint IssueQuery(int object, bool isPredictedVisible, bool isDrawn);
+
+    const Stats& GetStats() const;
+
+    void CleanUp();
+
+private:
+    struct ObjectQuery {
+        bool isVisible = true;
+        GLuint query = 0;               // In flight, 0 when none is
+        bool wasPredictedVisible = true; // When query was issued
+        bool wasDrawn = true;
+        int lastIssuedFrame = -2;
+    };
+
+    std::vector<ObjectQuery> m_objects;
+    std::vector<GLuint> m_freeQueries;
+    int m_frame = 0;
+    Stats m_stats;
+};
@@ -1,7 +1,7 @@
 /** @file PPM.hpp
  *  @brief Class for working with PPM images
  *  
- *  Class for working with P3 PPM images specifically.
+ *  Class for working with P3 (text) and P6 (binary) PPM images.
  *
  *  @author Zachary Walker-Liang
  *  @bug No known bugs.
@@ -62,6 +62,8 @@ private:
     int m_maxRange{0};
 
     u_int8_t getNextInteger(std::ifstream& inputFile, std::stringstream& stream);
+    // Reads the rest of a binary PPM after its P6 magic number
+    void loadP6(std::ifstream& inputFile);
 };
 
 
@@ -20,4 +20,16 @@ public:
     Plane(float size, std::array<u_int8_t, 3> planeColorRGB);
     
     void Draw();
+
+    inline GLuint GetVertexArrayObject() { return m_vertexArrayObject;}
+    // Not indexed, draw with glDrawArrays
+    inline GLsizei GetNumVertices() { return m_mesh.size() * 3;}
+    // Bounds before the model matrix, the plane lies at y = -1 and extends towards -z
+    inline glm::vec3 GetMinCorner() { return glm::vec3(-m_size / 2.0f, -1.0f, -m_size);}
+    inline glm::vec3 GetMaxCorner() { return glm::vec3(m_size / 2.0f, -1.0f, 0.0f);}
+    // Sphere through the four corners
+    inline glm::vec3 GetBoundingSphereCenter() { return (GetMinCorner() + GetMaxCorner()) * 0.5f;}
+    inline float GetBoundingSphereRadius() { return m_size * 0.5f * 1.41421356f;}
+    // Corners of every triangle, three per triangle, for the occlusion culler
+    std::vector<glm::vec3> GetTrianglePositions();
 };
\ No newline at end of file
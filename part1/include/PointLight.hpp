@@ -3,6 +3,7 @@
 #include <glm/vec3.hpp>
 #include <vector>
 #include <glad/glad.h>
+#include "UniformBlocks.hpp"
 
 class PointLight {
     private:
@@ -23,7 +24,11 @@ class PointLight {
         // posx, posy, posz, colorR, colorG, colorB, posx, ...
         std::vector<GLfloat> GetVertexBufferObjectData();
         std::vector<GLuint> GetElementBufferObjectData();
-        glm::vec3 GetPosition();
+        glm::vec3 GetPosition() const;
+        glm::vec3 GetDiffuseColor() const;
+
+        // Distance at which 1 / (constant + linear * d + quadtratic * d^2) drops to cutoff, infinite without a falloff
+        float GetRange(float cutoff) const;
 
         // Getters for GLSL Uniform
 
@@ -35,4 +40,7 @@ class PointLight {
         const float GetConstantFallOffForUniform() const;
         const float GetLinearFallOffForUniform() const;
         const float GetQuadtraticFallOffForUniform() const;
+
+        // Everything above packed for the LightData uniform block
+        LightData GetUniformBlockData() const;
 };
\ No newline at end of file
@@ -0,0 +1,69 @@
+/** @file ProgramBinaryCache.hpp
+ *  @brief Keeps linked programs on disk so later launches skip compiling and linking
+ *
+ *  A linked program's driver binary (glGetProgramBinary) is written to the cache directory under a hash
+ *  of its shader sources and the GL vendor, renderer and version strings, so a driver update or another
+ *  GPU simply misses. Program binaries are GL 4.1 (ARB_get_program_binary) and our glad only loads 3.3,
+ *  so the three entry points are loaded here through the same loader glad uses.
+ *
+ *  A driver may still reject a binary it wrote (e.g. after an update that kept the version string), Load
+ *  then returns 0 and the caller compiles from source as if there was no cache.
+ */
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+
+class ProgramBinaryCache {
+public:
+    struct Stats {
+        int numHits = 0;
+        int numMisses = 0;
+        int numRejected = 0;    // Found on disk but refused by the driver, also counted as a miss
+        int numStored = 0;
+    };
+
+    /**
+     * Loads the program binary functions and reads the driver strings. Without driver support for
+     * any binary format the cache stays disabled and Load always misses.
+     *
+     * @param loadProc i.e. SDL_GL_GetProcAddress, needs a current context
+     */
+    void Initialize(const std::string& cacheDirectory, GLADloadproc loadProc);
+    bool IsEnabled() const;
+
+    /**
+     * @param geometryShaderSource Empty when the program has no geometry shader
+     * @return A linked program, or 0 when not cached, corrupt or rejected by the driver
+     */
+    GLuint Load(const std::string& vertexShaderSource, const std::string& geometryShaderSource, const std::string& fragmentShaderSource);
+
+    // Call between glCreateProgram and glLinkProgram, some drivers only keep a retrievable binary when asked to
+    void PrepareForLink(GLuint program);
+
+    // Writes a successfully linked program to disk
+    void Store(GLuint program, const std::string& vertexShaderSource, const std::string& geometryShaderSource,
+               const std::string& fragmentShaderSource);
+
+    Stats GetStats() const;
+
+private:
+    typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+    typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+    typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+
+    GetProgramBinaryProc m_getProgramBinary = nullptr;
+    ProgramBinaryProc m_programBinary = nullptr;
+    ProgramParameteriProc m_programParameteri = nullptr;
+
+    std::string m_cacheDirectory;
+    std::string m_driverString; // Vendor, renderer and version, part of every key
+    bool m_isEnabled = false;
+    Stats m_stats;
+
+    // FNV-1a over the sources and the driver string
+    uint64_t GetKey(const std::string& vertexShaderSource, const std::string& geometryShaderSource,
+                    const std::string& fragmentShaderSource) const;
+    std::string GetCachePath(uint64_t key) const;
+};
@@ -0,0 +1,130 @@
+/** @file RenderQueue.hpp
+ *  @brief Collects the draws of each render pass and submits them in state-sorted order
+ *
+ *  Instead of drawing as the scene is walked, every draw is recorded as a DrawPacket with a 64-bit
+ *  sort key into the bucket of its pass. Sort() radix sorts each bucket, Execute() then walks it and
+ *  only changes what differs from the previous packet, through GLStateTracker and ShaderProgram's
+ *  uniform cache. Key layout from the most significant bit:
+ *
+ *      | program 8 | material 16 | texture 16 | depth 24 |
+ *
+ *  so draws are grouped by program first and, inside a group, drawn front to back to cut overdraw.
+ *
+ *  A pass drawn into several views (the shadow cascades) is recorded once, each packet's viewMask
+ *  says which views it shows up in and Execute only draws the packets of the view asked for.
+ *  Programs drawing into every view at once (the shadow cube faces) get the mask as u_ViewMask.
+ *  Passes with more views than the mask has bits (the shadow atlas faces) cull each packet's world
+ *  box per view instead, see ExecuteCulled.
+ *
+ *  Every draw is instanced, a packet draws numInstances instances of its mesh from the InstanceBuffer
+ *  set with SetInstanceBuffer. A packet's world box covers all of them.
+ */
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "InstanceBuffer.hpp"
+#include "ShaderProgram.hpp"
+
+enum RenderPass {
+    RENDER_PASS_SHADOW_STATIC = 0, // Depth only, casters that never move, into the shadow cache when it is stale
+    RENDER_PASS_SHADOW_DYNAMIC,    // Depth only, moving casters, into the shadow map over the cached casters
+    RENDER_PASS_SHADOW_ATLAS,      // Depth only, every caster, into the shadow atlas faces it reaches
+    RENDER_PASS_SHADOW_CUBE,       // Depth only, casters of the main light's cube map, once for every face it reaches
+    RENDER_PASS_DEPTH,       // Depth only from the camera, when the depth pre-pass is on
+    RENDER_PASS_OPAQUE,      // Lit objects, may write the stencil for the outline pass
+    RENDER_PASS_OCCLUSION_PROXY, // Depth tested boxes around objects, no writes, each in its own occlusion query
+    RENDER_PASS_OPAQUE_OCCLUDED, // Lit objects hidden last frame, after the proxies, drawn on their query's result
+    RENDER_PASS_LIGHTS,      // Light meshes
+    RENDER_PASS_OUTLINE,     // Where the stencil was not written, only when outlines are not drawn in screen space
+    RENDER_PASS_COUNT
+};
+
+struct DrawPacket {
+    uint64_t sortKey = 0;
+    ShaderProgram* program = nullptr;
+    GLuint vertexArray = 0;
+    GLsizei numVertices = 0;
+    bool isIndexed = true;          // glDrawElements with GL_UNSIGNED_INT from the vertex array's element buffer
+    int firstInstance = 0;          // Model matrix, material and outline ID of each instance, see InstanceBuffer
+    int numInstances = 1;
+    float outlineExtrudeDistance = 0.0f; // Set as u_OutlineExtrudeDistance when the program has it
+    GLint stencilRef = -1;          // Written to the stencil where the draw passes, -1 leaves the stencil alone
+    uint32_t viewMask = ~0u;        // Bit per view of the pass the draw is in, i.e. the shadow cascades it touches.
+                                    // Also set as u_ViewMask when the program has it, for programs drawing every view at once.
+    GLuint occlusionQuery = 0;      // GL_ANY_SAMPLES_PASSED query wrapped around the draw, 0 for none
+    GLuint conditionQuery = 0;      // Drawn under glBeginConditionalRender on this query without waiting for it, 0 always draws
+    // World space box around the draw for ExecuteCulled, everywhere unless set
+    glm::vec3 worldMin = glm::vec3(-std::numeric_limits<float>::max());
+    glm::vec3 worldMax = glm::vec3(std::numeric_limits<float>::max());
+};
+
+class RenderQueue {
+public:
+    /**
+     * Packs the sort key, larger values are clamped to their field.
+     *
+     * @param depth 0 at the near plane, 1 at the far plane
+     */
+    static uint64_t MakeSortKey(GLuint program, int material, int texture, float depth);
+
+    // Where the packets' instances are, set once
+    inline void SetInstanceBuffer(InstanceBuffer* instanceBuffer) { m_instanceBuffer = instanceBuffer;}
+
+    // Empties every bucket, keeps their memory
+    void Clear();
+
+    void Add(RenderPass pass, const DrawPacket& packet);
+
+    // Sorts every bucket by key, draws with equal keys keep the order they were added in
+    void Sort();
+
+    /**
+     * Draws a sorted bucket. Pass wide state (framebuffer, depth and stencil test, uniform blocks) is up to the caller.
+     *
+     * @param viewMask Only packets sharing a bit with it are drawn
+     */
+    void Execute(RenderPass pass, uint32_t viewMask = ~0u);
+
+    /**
+     * Draws the packets of a sorted bucket whose world box is in view, for views too many for viewMask.
+     *
+     * @param isInView Called as isInView(worldMin, worldMax), returns whether to draw the packet
+     * @return Number of packets drawn
+     */
+    template <typename IsInView>
+    int ExecuteCulled(RenderPass pass, IsInView isInView);
+
+    int GetNumPackets(RenderPass pass, uint32_t viewMask = ~0u) const;
+
+private:
+    InstanceBuffer* m_instanceBuffer = nullptr;
+    std::vector<DrawPacket> m_buckets[RENDER_PASS_COUNT];
+    // Order of each bucket after Sort, indices into the bucket
+    std::vector<uint32_t> m_sortedOrder[RENDER_PASS_COUNT];
+    // Key and index pairs, ping-ponged between by the radix passes
+    std::vector<std::pair<uint64_t, uint32_t>> m_sortScratch[2];
+
+    void RadixSort(RenderPass pass);
+    void Draw(const DrawPacket& packet);
+};
+
+template <typename IsInView>
+int RenderQueue::ExecuteCulled(RenderPass pass, IsInView isInView) {
+    const std::vector<DrawPacket>& bucket = m_buckets[pass];
+    bool isSorted = m_sortedOrder[pass].size() == bucket.size();
+    int numDrawn = 0;
+    for (size_t i = 0; i < bucket.size(); i++) {
+        const DrawPacket& packet = bucket[isSorted ? m_sortedOrder[pass][i] : i];
+        if (isInView(packet.worldMin, packet.worldMax)) {
+            Draw(packet);
+            numDrawn++;
+        }
+    }
+    return numDrawn;
+}
@@ -0,0 +1,35 @@
+/** @file SceneFramebuffer.hpp
+ *  @brief Offscreen target of the lit pass, read back by full-screen post passes
+ *
+ *  Attachment 0 holds the shaded color. Attachment 1 holds the world normal in rgb (biased
+ *  into 0..1) and the object's outline ID / 255 in alpha, 0 for objects without an outline.
+ *  Depth and stencil share a GL_DEPTH24_STENCIL8 texture so the depth can be sampled too.
+ */
+#pragma once
+
+#include <glad/glad.h>
+
+class SceneFramebuffer {
+public:
+    void Create(int width, int height);
+
+    // Makes it the draw target, with both color attachments as draw buffers
+    void Bind();
+
+    // Clears color to the clear color, normals and IDs to 0, and depth and stencil
+    void Clear();
+
+    // Binds the attachments for sampling, i.e. BindTextures(4, 5, 6). They stay bound there.
+    void BindTextures(GLuint colorUnit, GLuint normalAndIDUnit, GLuint depthUnit);
+
+    void CleanUp();
+
+private:
+    GLuint m_framebuffer = 0;
+    GLuint m_colorTexture = 0;
+    GLuint m_normalAndIDTexture = 0;
+    GLuint m_depthStencilTexture = 0;
+
+    // Screen sized and sampled texel for texel, so no filtering or mips
+    static GLuint CreateTexture(GLenum internalFormat, GLenum format, GLenum type, int width, int height);
+};
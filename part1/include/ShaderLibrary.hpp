@@ -0,0 +1,91 @@
+/** @file ShaderLibrary.hpp
+ *  @brief Builds shader permutations, all submitted to the driver before any result is needed
+ *
+ *  Request() preprocesses a vertex/fragment pair, optionally with a geometry shader, with a set of
+ *  defines and hands it to the driver (or takes it from the ProgramBinaryCache) without asking for
+ *  the result, Finish() later checks the compile and link status. Asking for the status is what stalls, so requesting every program first
+ *  and finishing them after other startup work lets the driver compile in the meantime.
+ *
+ *  With KHR_parallel_shader_compile (or the ARB version) the driver compiles on its own threads and
+ *  IsReady() can poll GL_COMPLETION_STATUS_KHR without blocking. Without it, IsReady() is always true
+ *  and Finish() simply waits.
+ */
+#pragma once
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+
+#include "ProgramBinaryCache.hpp"
+#include "ShaderPreprocessor.hpp"
+
+class ShaderLibrary {
+public:
+    struct Stats {
+        int numRequested = 0;
+        int numFromCache = 0;
+        int numFailed = 0;
+    };
+
+    /**
+     * @param programCache Checked before compiling and filled after linking, may be nullptr
+     * @param loadProc i.e. SDL_GL_GetProcAddress, for the parallel compile entry point
+     * @param isParallelCompileSupported KHR_parallel_shader_compile or ARB_parallel_shader_compile is in the extension list
+     */
+    void Initialize(ProgramBinaryCache* programCache, GLADloadproc loadProc, bool isParallelCompileSupported);
+    bool IsParallelCompileEnabled() const;
+
+    /**
+     * Starts building a program, returns a handle for IsReady/Finish.
+     *
+     * @param defines Permutation, see ShaderPreprocessor::Process. Both stages get the same defines.
+     */
+    int Request(const std::string& vertexShaderPath, const std::string& fragmentShaderPath, const std::vector<std::string>& defines);
+    // The same with a geometry shader between the two stages, geometryShaderPath may be empty for none
+    int Request(const std::string& vertexShaderPath, const std::string& geometryShaderPath, const std::string& fragmentShaderPath,
+                const std::vector<std::string>& defines);
+
+    // True once Finish would not block
+    bool IsReady(int request);
+
+    /**
+     * Waits for the program and reports compile and link errors.
+     *
+     * @return The linked program, owned by the caller from now on, or 0 if it failed
+     */
+    GLuint Finish(int request);
+
+    // Every source file of a request, including the ones pulled in with #include
+    std::vector<std::string> GetSourceFiles(int request) const;
+
+    // Done with a finished request, its handle may be handed out again by a later Request
+    void Release(int request);
+
+    Stats GetStats() const;
+
+private:
+    struct PendingProgram {
+        std::string name; // Every path, for messages
+        ShaderPreprocessor::Result vertex;
+        ShaderPreprocessor::Result geometry; // Empty source without a geometry shader
+        ShaderPreprocessor::Result fragment;
+        GLuint program = 0;
+        GLuint vertexShader = 0;
+        GLuint geometryShader = 0;
+        GLuint fragmentShader = 0;
+        bool isFromCache = false;
+        bool isFinished = false;
+    };
+
+    typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+
+    ProgramBinaryCache* m_programCache = nullptr;
+    bool m_isParallelCompileEnabled = false;
+    std::vector<PendingProgram> m_requests;
+    std::vector<int> m_releasedRequests; // Slots of m_requests the next requests reuse, hot reloads would grow it otherwise
+    Stats m_stats;
+
+    static GLuint SubmitShader(GLenum type, const std::string& source);
+    // Prints the info log, returns false if compiling failed
+    static bool CheckShader(GLuint shader, const ShaderPreprocessor::Result& source);
+};
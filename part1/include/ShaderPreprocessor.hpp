@@ -0,0 +1,33 @@
+/** @file ShaderPreprocessor.hpp
+ *  @brief Resolves #include in GLSL files and injects permutation #defines
+ *
+ *  GLSL has no #include, so shared code (uniform blocks, helpers) is spliced in here before the
+ *  source reaches the driver. Includes are relative to the including file and each file is only
+ *  included once per shader. Defines go right after #version, so every #ifdef in the file and its
+ *  includes sees them.
+ *
+ *  #line directives keep the driver's error messages pointing at the right file: the source string
+ *  number in "0(12)" style errors is the index into Result::files.
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+class ShaderPreprocessor {
+public:
+    struct Result {
+        std::string source;
+        std::vector<std::string> files;  // Every file read, files[0] is the shader itself
+        bool isValid = false;
+    };
+
+    /**
+     * @param defines "NAME" or "NAME VALUE", i.e. {"SHADOWS", "DEBUG_VIEW DEBUG_VIEW_NORMALS"}
+     */
+    static Result Process(const std::string& path, const std::vector<std::string>& defines);
+
+private:
+    static bool ProcessFile(const std::string& path, const std::vector<std::string>& defines,
+                            std::vector<std::string>& includeStack, Result& result);
+};
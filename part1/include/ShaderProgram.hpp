@@ -0,0 +1,73 @@
+/** @file ShaderProgram.hpp
+ *  @brief A linked program plus its reflected uniforms
+ *
+ *  Every active uniform is looked up once with glGetActiveUniform when the program is
+ *  set, so setting a uniform is a hash lookup in our own table instead of a
+ *  glGetUniformLocation round trip. The last value of each uniform is remembered and
+ *  uploads of an unchanged value are skipped. Uniforms are program state, so the cache
+ *  stays valid across glUseProgram switches.
+ */
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+class ShaderProgram {
+public:
+    struct Uniform {
+        GLint location = -1;
+        GLenum type = 0;    // i.e. GL_FLOAT_VEC3, GL_SAMPLER_2D
+        GLint size = 1;     // Array length
+        bool hasValue = false;
+        std::array<float, 16> value; // Last uploaded value, ints are stored by bit pattern
+    };
+
+    struct FrameStats {
+        int numUploads = 0;
+        int numSkipped = 0; // Set calls whose value was already uploaded
+    };
+
+    ShaderProgram() = default;
+
+    // Takes ownership of a linked program and reflects its uniforms, 0 leaves the program empty
+    void SetProgram(GLuint programID);
+    GLuint GetID() const;
+
+    bool HasUniform(const std::string& name) const;
+    const Uniform* GetUniform(const std::string& name) const;
+
+    // The program must be in use. Unknown names (misspelled or optimized out) are reported once and ignored.
+    void SetUniform(const std::string& name, int value);
+    void SetUniform(const std::string& name, float value);
+    void SetUniform(const std::string& name, const glm::vec3& value);
+    void SetUniform(const std::string& name, const glm::mat4& value);
+
+    /**
+     * Points a uniform block at a binding index. Blocks are program state, so this is done once after linking.
+     *
+     * @param expectedSize sizeof the C++ mirror of the block, a different GL_UNIFORM_BLOCK_DATA_SIZE is reported
+     * @return false if the program has no such active block
+     */
+    bool BindUniformBlock(const std::string& blockName, GLuint bindingIndex, size_t expectedSize);
+
+    void CleanUp();
+
+    // Uniform uploads of every program since the last ResetFrameStats, call once per frame
+    static FrameStats GetFrameStats();
+    static void ResetFrameStats();
+
+private:
+    GLuint m_programID = 0;
+    std::unordered_map<std::string, Uniform> m_uniforms;
+    std::unordered_set<std::string> m_reportedMissing;
+
+    static FrameStats s_frameStats;
+
+    // Returns the uniform if value differs from its cached value (and caches it), nullptr if the upload can be skipped
+    Uniform* PrepareUpload(const std::string& name, const float* value, int numFloats, bool isFloatType, GLenum expectedType);
+};
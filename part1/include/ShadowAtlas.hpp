@@ -0,0 +1,141 @@
+/** @file ShadowAtlas.hpp
+ *  @brief Shadows of many point lights in one depth texture, split into square tiles of different sizes
+ *
+ *  Each shadowed light gets six tiles of the same size, one per cube face, and each face is drawn
+ *  with a 90 degree perspective projection. Tile sizes are powers of two and come from how large the
+ *  light's range looks on screen, so close lights get sharp shadows and far ones cheap ones. The
+ *  tiles are handed out by a quadtree buddy allocator: a free tile is split in four to make smaller
+ *  ones, and four free siblings merge back into their parent.
+ *
+ *  Every face is drawn into the same frame buffer, its tile picked with the viewport and scissor.
+ *  A tile keeps its contents from frame to frame: a face is only redrawn when its light got a new
+ *  tile or moved, or a moving caster reaches it. At most maxFacesPerFrame faces are drawn per frame,
+ *  a light only casts its shadow once all six of its faces were drawn.
+ *
+ *  The lit shaders look the tiles up in a buffer texture, 4 RGBA32F texels per light, in the order
+ *  of the lights passed to AssignTiles:
+ *
+ *      0-2  atlas UVs of the faces' bottom left corners, two faces per texel (+x, -x, +y, -y, +z, -z)
+ *      3    tile size in atlas UVs (0 without a shadow), near plane, far plane (the light's range), unused
+ *
+ *  The faces look along the axes like the faces of a GL cube map, see GetFaceViewMatrix.
+ */
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "PointLight.hpp"
+
+struct ShadowAtlasSettings {
+    int resolution = 4096;          // Width and height of the atlas, a power of two
+    int maxTileSize = 256;          // Largest and smallest face tile, powers of two
+    int minTileSize = 32;
+    int maxShadowedLights = 32;     // The most important ones get shadows
+    int maxFacesPerFrame = 48;      // Faces drawn per frame at most, the rest wait for the next frames
+    float texelsPerPixel = 1.0f;    // Face tile size for each pixel of the light's range on screen
+    float nearPlane = 0.05f;
+    // glPolygonOffset while drawing casters, like ShadowCascadeSettings
+    float depthBiasSlope = 2.0f;
+    float depthBiasUnits = 16.0f;   // In steps of the 16 bit depth buffer
+};
+
+// A face to draw this frame, see ShadowAtlas::GetFacesToDraw
+struct ShadowAtlasFace {
+    int light;                      // Index into the lights passed to AssignTiles
+    int face;                       // +x, -x, +y, -y, +z, -z
+    glm::vec3 lightPosition;
+    float range;
+    glm::mat4 viewMatrix;
+    glm::mat4 projectionMatrix;
+    glm::ivec4 viewport;            // Tile in atlas texels, x, y, width and height
+};
+
+class ShadowAtlas {
+public:
+    static constexpr int kNumFaces = 6;
+    static constexpr int kTexelsPerLight = 4;
+
+    struct Stats {
+        int numShadowedLights = 0;  // With all six faces drawn, so casting their shadow
+        int numFacesDrawn = 0;
+        int numFacesReused = 0;     // Faces of shadowed lights kept from earlier frames
+        int numFacesWaiting = 0;    // Stale faces left for later frames by maxFacesPerFrame
+        int numAllocatedTexels = 0;
+    };
+
+    explicit ShadowAtlas(const ShadowAtlasSettings& settings = ShadowAtlasSettings());
+    ShadowAtlas(const ShadowAtlas&) = delete;
+    ShadowAtlas& operator=(const ShadowAtlas&) = delete;
+
+    // Creates the depth atlas and the tile buffer texture and binds them once, i.e. Create(GL_TEXTURE10, GL_TEXTURE11)
+    void Create(GLenum depthTexUnit, GLenum tilesTexUnit);
+
+    inline const ShadowAtlasSettings& GetSettings() const { return m_settings;}
+    inline GLuint GetDepthTexture() const { return m_depthTexture;}
+
+    /**
+     * Picks the lights that get shadows and the size of their tiles, from the camera's view, call once per frame
+     * after the lights have moved. Lights keeping their tile size keep their tiles, and what was drawn into them.
+     *
+     * @param cutoff Attenuation the lights' range ends at, see PointLight::GetRange
+     */
+    void AssignTiles(const std::vector<PointLight>& lights, float cutoff, const glm::mat4& viewMatrix, float fieldOfViewRadians,
+                     float aspectRatio, float nearPlane, float farPlane, int screenHeight);
+
+    // A moving caster's world box, every face it reaches is redrawn. Call every frame it moves, after AssignTiles.
+    void InvalidateBox(glm::vec3 worldMin, glm::vec3 worldMax);
+
+    // Picks this frame's faces, binds the atlas frame buffer and sets up the depth bias
+    void BeginShadowPass();
+    const std::vector<ShadowAtlasFace>& GetFacesToDraw() const;
+    // Viewport and scissor to the face's tile, clears it
+    void BeginFace(const ShadowAtlasFace& face);
+    void EndShadowPass();
+
+    // Fills the tile buffer texture, after BeginShadowPass decided which lights have all their faces
+    void Upload();
+
+    const Stats& GetStats() const;
+
+    void CleanUp();
+
+    // Looks along face's axis, up as in the GL cube map table
+    static glm::mat4 GetFaceViewMatrix(glm::vec3 lightPosition, int face);
+    // Whether a world box is inside a face's frustum and the light's range, for culling casters per face
+    static bool IsBoxInFace(glm::vec3 lightPosition, float range, int face, glm::vec3 worldMin, glm::vec3 worldMax);
+
+private:
+    struct LightShadow {
+        int tileSize = 0;                   // Face tile size in texels, 0 without tiles
+        glm::ivec2 faceTiles[kNumFaces];    // Bottom left corners in texels
+        bool isFaceValid[kNumFaces] = {};   // Drawn at least once since the tiles were allocated
+        bool isFaceStale[kNumFaces] = {};   // Needs a redraw, the light moved or a moving caster reaches it
+        glm::vec3 position = glm::vec3(0.0f); // Where the light was when its faces were drawn
+        float range = 0.0f;
+        float importance = 0.0f;            // Radius of the light's range on screen in pixels, 0 when out of view
+    };
+
+    ShadowAtlasSettings m_settings;
+    std::vector<LightShadow> m_lightShadows;
+    // Free tiles per level of the quadtree, level 0 is the whole atlas and every level halves the size
+    std::vector<std::vector<glm::ivec2>> m_freeTiles;
+    std::vector<int> m_lightOrder;          // Shadowed lights, most important first
+    std::vector<ShadowAtlasFace> m_facesToDraw;
+    std::vector<float> m_tileTexels;
+    Stats m_stats;
+
+    GLuint m_depthTexture = 0;
+    GLuint m_framebuffer = 0;
+    GLuint m_tilesBuffer = 0;
+    GLuint m_tilesTexture = 0;
+
+    int GetLevel(int tileSize) const;
+    // Returns false when the atlas has no room left for the size
+    bool AllocateTile(int level, glm::ivec2& tile);
+    void FreeTile(int level, glm::ivec2 tile);
+    bool AllocateLight(LightShadow& shadow, int tileSize);
+    void FreeLight(LightShadow& shadow);
+    bool IsLightReady(const LightShadow& shadow) const;
+};
@@ -1,32 +1,115 @@
 #pragma once
 #include <glad/glad.h>
+#include <cstdint>
+#include <vector>
 #include "glm/glm.hpp"
+#include "UniformBlocks.hpp"
 
 /*
 This is a light that does not provide any light. It just provides a shadow. This way, lights and shadows are decoupled
 in case we need a light that doesn't cast shadows.
+
+The shadow is a cascaded shadow map: the camera's view range is split into slices and each slice gets its own
+orthographic shadow map, a layer of one depth texture array. Near slices are short, so close up shadows get
+far more texels than one map over the whole scene could give them.
+
+Casters that never move are drawn into a second array, the static cache, only when their cascade changes: the light
+turned further than lightUpdateAngleDegrees or the camera moved the cascade by a texel. Every frame the cached layer
+is copied into the layer the shaders read and the moving casters are drawn on top.
 */ 
 
+struct ShadowCascadeSettings {
+    int numCascades = 4;        // At most kMaxShadowCascades
+    int resolution = 512;       // Width and height of every cascade
+    float splitLambda = 0.75f;  // Blend from uniform (0) to logarithmic (1) split distances
+    float maxDistance = 20.0f;  // Camera distance the last cascade ends at, nothing further away is shadowed
+    float lightUpdateAngleDegrees = 1.0f; // The cascades only follow the light once it turned this far, redrawing the static cache
+    // glPolygonOffset while drawing casters, so receivers need no bias in the shader. The slope factor grows with
+    // the filter radius, taps further out read the receiver's own depth further along its slope.
+    float depthBiasSlope = 1.5f;
+    float depthBiasUnits = 8192.0f; // In steps of the 24 bit depth buffer, about 0.0005 of the depth range
+};
+
 class ShadowDirectionalLight    {
 private:
+    struct Cascade {
+        glm::mat4 projection;
+        float farDepth; // Camera view space distance the cascade ends at
+        glm::mat4 staticCacheProjection; // Projection the static cache was drawn with
+        bool isStaticCacheValid = false;
+        bool isCopyOfStaticCache = false; // The layer holds no moving casters, so it needs no new copy
+    };
+
     GLenum m_texUnit; // Texture unit to bind depth (shadow) map to
-    unsigned int m_depthMapFBO;
-    unsigned int m_depthMapTex;
-    const unsigned int m_shadowMapWidth = 1024;
-    const unsigned int m_shadowMapHeight = 1024;
+    unsigned int m_depthMapTex; // GL_TEXTURE_2D_ARRAY, a layer per cascade
+    std::vector<GLuint> m_cascadeFBOs;
+    unsigned int m_staticDepthMapTex; // Same layout, only the casters that never move
+    std::vector<GLuint> m_staticCascadeFBOs;
+    ShadowCascadeSettings m_settings;
+    std::vector<Cascade> m_cascades;
+    glm::mat4 m_lightRotation; // World to light space, rotation only, shared by every cascade
+    glm::vec3 m_lightDirection = glm::vec3(0.0f); // The direction m_lightRotation looks in
     float m_nearPlane;
     float m_farPlane;
     glm::vec3 m_eyePosition;
     glm::vec3 m_target;
     glm::vec3 m_upVector;
+    glm::vec3 m_sceneMin = glm::vec3(-10.0f);
+    glm::vec3 m_sceneMax = glm::vec3(10.0f);
+    float m_filterRadiusTexels = 0.0f;
+
+    // A depth texture array with a layer per cascade and a frame buffer per layer
+    void CreateDepthMap(unsigned int& depthMapTex, std::vector<GLuint>& framebuffers);
 public:
-    ShadowDirectionalLight(GLenum texUnit, glm::vec3 eyePosition, glm::vec3 target, glm::vec3 upVector, float nearPlane, float farPlane);
+    ShadowDirectionalLight(GLenum texUnit, glm::vec3 eyePosition, glm::vec3 target, glm::vec3 upVector, float nearPlane, float farPlane,
+                           const ShadowCascadeSettings& settings = ShadowCascadeSettings());
     inline GLenum GetTexUnit()  {return m_texUnit;}
-    inline unsigned int GetShadowMapWidth() { return m_shadowMapWidth;}
-    inline unsigned int GetShadowMapHeight() { return m_shadowMapHeight;}
-    void ActivateTexUnitAndBindFBO();
+    inline GLuint GetDepthMapTexture() { return m_depthMapTex;}
+    inline int GetNumCascades() { return m_settings.numCascades;}
+    inline int GetCascadeResolution() { return m_settings.resolution;}
+    inline float GetFarPlane() { return m_farPlane;}
+
+    // Eye to target, for ordering casters front to back. Cascades use GetCascadeViewMatrix.
     glm::mat4 GetViewMatrix();
-    glm::mat4 GetProjectionMatrix();
-    glm::mat4 GetWorldToLightSpaceTransform();
+
+    // World space box around every shadow caster and receiver, the cascades never reach past it
+    void SetSceneBounds(glm::vec3 sceneMin, glm::vec3 sceneMax);
+
+    /**
+    * Splits the camera's view range and fits each cascade around its slice, call once per frame
+    * after the camera and the light have moved.
+    *
+    * Each cascade covers the bounding sphere of its slice, which keeps its size when the camera turns,
+    * moved inside the scene bounds (or shrunk to them when the scene is smaller) and snapped to whole texels
+    * in light space. Together that keeps shadow edges from shimmering while the camera moves.
+    */
+    void UpdateCascades(const glm::mat4& cameraViewMatrix, float fieldOfViewRadians, float aspectRatio, float nearPlane, float farPlane);
+
+    glm::mat4 GetCascadeViewMatrix();
+    glm::mat4 GetCascadeProjectionMatrix(int cascade);
+
+    // Bit per cascade the world space box reaches into, casters outside a cascade need not be drawn into it
+    uint32_t GetCascadeMask(glm::vec3 worldMin, glm::vec3 worldMax);
+
+    // True when the cascade's static casters have to be drawn again, into BindStaticCacheFBO after a depth clear
+    bool IsStaticCacheStale(int cascade);
+    void BindStaticCacheFBO(int cascade);
+
+    /**
+    * Copies the static cache into the cascade's layer and binds that layer for the moving casters. The copy is
+    * skipped when the layer already holds exactly the cache. Marks the cache as drawn, so call it after the static
+    * casters.
+    */
+    void BeginDynamicCasters(int cascade, bool hasDynamicCasters);
+
+    // Cascade matrices and split depths for the lit shaders, ShadowFilter fills in the kernel
+    ShadowData GetShadowData();
+
+    // Radius of the PCF kernel, sets the slope bias. Changing it redraws the static cache.
+    void SetFilterRadius(float radiusTexels);
+
+    // Enable and disable the depth bias around the casters of the shadow pass
+    void BeginShadowPass();
+    void EndShadowPass();
     inline void SetEyePosition(glm::vec3 eyePosition) { m_eyePosition = eyePosition;}
-};
\ No newline at end of file
+};
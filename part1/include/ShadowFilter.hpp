@@ -0,0 +1,56 @@
+/** @file ShadowFilter.hpp
+ *  @brief Percentage closer filtering kernels for the shadow cascades, and the quality presets that pick them
+ *
+ *  The shadow map is sampled through a comparison sampler, so every tap already compares the four
+ *  nearest texels and filters the results bilinearly. A kernel spreads a few of those taps over a
+ *  disc of radiusTexels around the fragment, which softens the edges further:
+ *
+ *      rotated grid  A square grid turned by atan(1/2), no two taps share a row or column
+ *      Poisson disk  Best candidate points, no two taps closer than they have to be
+ *
+ *  A Poisson kernel can be turned by a per-pixel angle, which trades its banding for noise.
+ *  Presets trade taps for frame time, compare them in the opaque pass timings.
+ */
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "UniformBlocks.hpp"
+
+enum ShadowKernel {
+    SHADOW_KERNEL_ROTATED_GRID = 0,
+    SHADOW_KERNEL_POISSON
+};
+
+struct ShadowFilterPreset {
+    const char* name;
+    ShadowKernel kernel;
+    int numTaps;            // At most kMaxShadowKernelTaps, a square for the rotated grid
+    float radiusTexels;     // Radius of the kernel in shadow map texels
+    bool isRotatedPerPixel;
+};
+
+class ShadowFilter {
+public:
+    static constexpr int kNumPresets = 4;
+    static const ShadowFilterPreset kPresets[kNumPresets];
+
+    ShadowFilter();
+
+    void SetPreset(int preset);
+    inline int GetPreset() const { return m_preset;}
+    inline const ShadowFilterPreset& GetPresetSettings() const { return kPresets[m_preset];}
+
+    // Fills the kernel part of ShadowData for cascades cascadeResolution texels wide
+    void FillShadowData(ShadowData& shadowData, int cascadeResolution) const;
+
+    // Offsets in the unit disc, numTaps rounded to a square
+    static std::vector<glm::vec2> MakeRotatedGrid(int numTaps);
+    // Offsets in the unit disc, always the same for the same numTaps
+    static std::vector<glm::vec2> MakePoissonDisk(int numTaps);
+
+private:
+    int m_preset = 1;
+    std::vector<glm::vec2> m_kernel;
+};
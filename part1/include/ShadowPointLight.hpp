@@ -0,0 +1,71 @@
+/** @file ShadowPointLight.hpp
+ *  @brief Omnidirectional shadow of the main point light, a depth cube map drawn in one layered pass
+ *
+ *  The six faces look along the axes from the light with a 90 degree perspective projection, like
+ *  the shadow atlas faces, but here they are the layers of a GL cube map. Every caster is drawn once:
+ *  shadow_cube_geom.glsl projects each triangle into the faces whose bit is set in the draw's
+ *  u_ViewMask and sends it to that face's layer with gl_Layer, dropping it where it is outside the
+ *  face's frustum. The mask comes from GetFaceMask on the CPU, so casters miss the faces they cannot
+ *  reach before they are ever drawn.
+ *
+ *  The lit shaders look the cube up with a samplerCubeShadow in the direction from the light, see
+ *  GetPointShadow in halftone_toon.glsl.
+ */
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+
+#include "UniformBlocks.hpp"
+
+struct ShadowPointLightSettings {
+    int resolution = 1024;      // Width and height of every face
+    float nearPlane = 0.1f;
+    float farPlane = 30.0f;     // Nothing further from the light is shadowed
+    // glPolygonOffset while drawing casters, like ShadowCascadeSettings. Grows with the filter radius the same way.
+    float depthBiasSlope = 1.5f;
+    float depthBiasUnits = 256.0f; // In steps of the 24 bit depth buffer
+};
+
+class ShadowPointLight {
+public:
+    static constexpr int kNumFaces = 6;
+
+    // Creates the depth cube map and its layered frame buffer, and leaves the cube map bound to texUnit
+    explicit ShadowPointLight(GLenum texUnit, const ShadowPointLightSettings& settings = ShadowPointLightSettings());
+    ShadowPointLight(const ShadowPointLight&) = delete;
+    ShadowPointLight& operator=(const ShadowPointLight&) = delete;
+
+    inline GLenum GetTexUnit() const { return m_texUnit;}
+    inline GLuint GetDepthMapTexture() const { return m_depthMapTex;}
+    inline int GetResolution() const { return m_settings.resolution;}
+    inline float GetFarPlane() const { return m_settings.farPlane;}
+
+    // Call once per frame after the light moved, before the casters are queued
+    void SetPosition(glm::vec3 position);
+    inline glm::vec3 GetPosition() const { return m_position;}
+
+    // World to a face's clip space, u_CubeFaceMatrices[face] in shadow_cube_geom.glsl
+    glm::mat4 GetFaceMatrix(int face) const;
+
+    // Bit per face the world space box reaches into, 0 when it is out of the light's range
+    uint32_t GetFaceMask(glm::vec3 worldMin, glm::vec3 worldMax) const;
+
+    // Binds the frame buffer and clears every face, sets up the depth bias for the PCF kernel's radius
+    void BeginShadowPass(float filterRadiusTexels);
+    void EndShadowPass();
+
+    // Fills in the point shadow part of shadowData, the kernel taps come from ShadowFilter as for the cascades
+    void FillShadowData(ShadowData& shadowData, float filterRadiusTexels) const;
+
+    void CleanUp();
+
+private:
+    GLenum m_texUnit;
+    ShadowPointLightSettings m_settings;
+    GLuint m_depthMapTex = 0;   // GL_TEXTURE_CUBE_MAP
+    GLuint m_framebuffer = 0;   // Every face attached at once, gl_Layer picks the face
+    glm::vec3 m_position = glm::vec3(0.0f);
+    glm::mat4 m_faceMatrices[kNumFaces];
+};
@@ -0,0 +1,100 @@
+/** @file TextureAtlas.hpp
+ *  @brief Packs every material texture into one GL_TEXTURE_2D_ARRAY
+ *
+ *  When all textures have the same size and format each one becomes a layer of the array
+ *  (compressed layers stay compressed). Otherwise they are skyline packed, with padding,
+ *  into square pages and each page becomes a layer. Either way a material addresses its
+ *  texture as a layer plus a UV rect, and the whole scene draws with a single texture binding.
+ */
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "TextureImage.hpp"
+
+class TextureAtlas {
+public:
+    // Where a texture ended up. UVs inside the texture map to uvOffset + fract(uv) * uvScale.
+    struct Region {
+        int layer = -1;
+        float uvOffset[2] = {0.0f, 0.0f};
+        float uvScale[2] = {1.0f, 1.0f};
+    };
+
+    /**
+     * Decides the packing and lays out the pixels on the CPU. No OpenGL calls, call Upload afterwards.
+     *
+     * @param images Textures in material table order, Region i belongs to images[i]
+     * @param maxPageSize Largest layer size, i.e. GL_MAX_TEXTURE_SIZE
+     * @param padding Pixels of edge color repeated around each packed texture so bilinear filtering does not bleed
+     */
+    void Build(const std::vector<TextureImage>& images, int maxPageSize = 4096, int padding = 2);
+
+    /**
+     * Creates the array texture. Compressed layers are only uploaded compressed when the driver supports
+     * their format, otherwise they are decoded on the CPU first.
+     *
+     * @param maxStartupSize Compressed mip chains only upload the levels no larger than this, TextureStreamer
+     *                       fills in the finer ones later. 0 uploads every level.
+     */
+    void Upload(bool isS3TCSupported, bool isBPTCSupported, int maxStartupSize = 0);
+
+    // Binds the array texture, i.e. Bind(GL_TEXTURE0)
+    void Bind(GLenum texUnit);
+
+    const Region& GetRegion(int textureIndex) const;
+    int GetNumTextures() const;
+    int GetNumLayers() const;
+    int GetLayerWidth() const;
+    int GetLayerHeight() const;
+    // True when textures were skyline packed, false when each texture is its own layer
+    bool IsPacked() const;
+
+    // True when the layers were uploaded compressed with a mip chain that can be streamed
+    bool IsStreamable() const;
+    GLuint GetTexture() const;
+    // Compressed internal format of the array, 0 when uploaded as RGBA8
+    GLenum GetInternalFormat() const;
+    // Finest mip level uploaded by Upload
+    int GetBaseLevel() const;
+    const std::vector<std::shared_ptr<TextureCache>>& GetCompressedLayers() const;
+
+    void CleanUp();
+
+private:
+    // A horizontal segment of the skyline, the packed height of the page between x and x + width
+    struct SkylineNode {
+        int x;
+        int y;
+        int width;
+    };
+
+    std::vector<Region> m_regions;
+    bool m_isPacked = false;
+    int m_numLayers = 0;
+    int m_layerWidth = 0;
+    int m_layerHeight = 0;
+
+    // Uncompressed layers in RGBA8
+    std::vector<std::vector<uint8_t>> m_layerPixels;
+    // Compressed layers, only when every texture shares size and format
+    std::vector<std::shared_ptr<TextureCache>> m_compressedLayers;
+
+    GLuint m_texture = 0;
+    GLenum m_internalFormat = 0;
+    int m_baseLevel = 0;
+
+    // Finds the lowest spot a width x height rect fits on the skyline, returns false if the page is full
+    static bool FindSkylinePosition(const std::vector<SkylineNode>& skyline, int pageSize, int width, int height,
+                                    int& bestX, int& bestY, size_t& bestNode);
+    static void AddSkylineLevel(std::vector<SkylineNode>& skyline, size_t nodeIndex, int x, int y, int width, int height);
+
+    // Copies a texture into a page with its edge pixels repeated padding times around it
+    static void BlitWithPadding(const std::vector<uint8_t>& rgba, int width, int height,
+                                std::vector<uint8_t>& page, int pageSize, int x, int y, int padding);
+
+    static std::vector<uint8_t> GetRGBA(const TextureImage& image);
+};
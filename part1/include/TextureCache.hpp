@@ -0,0 +1,77 @@
+/** @file TextureCache.hpp
+ *  @brief Container file for block compressed textures with their whole mip chain
+ *
+ *  Layout: Header, then one MipEntry per level, then the block data of each level
+ *  (16 byte aligned). Files are memory mapped on Linux/Mac so the compressed blocks
+ *  can be handed to glCompressedTexImage2D without another copy.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "TextureCompressor.hpp"
+
+class TextureCache {
+public:
+    struct Header {
+        char magic[4];      // "TXC1"
+        uint32_t version;
+        uint32_t format;    // TextureCompressor::Format
+        uint32_t width;
+        uint32_t height;
+        uint32_t mipCount;
+    };
+
+    struct MipEntry {
+        uint32_t width;
+        uint32_t height;
+        uint64_t offset;    // From the start of the file
+        uint64_t size;      // In bytes
+    };
+
+    /**
+     * Opens and maps a cache file. Check IsValid() afterwards, a missing or corrupt file leaves the cache invalid.
+     *
+     * @param cacheFilePath Path to a file written by TextureCache::Write
+     */
+    TextureCache(const std::string& cacheFilePath);
+    ~TextureCache();
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    bool IsValid() const;
+    TextureCompressor::Format GetFormat() const;
+    int GetWidth() const;
+    int GetHeight() const;
+    int GetMipCount() const;
+    int GetMipWidth(int level) const;
+    int GetMipHeight(int level) const;
+    size_t GetMipSize(int level) const;
+    const uint8_t* GetMipData(int level) const;
+
+    // i.e "./textures/wood.ppm" -> "./textures/wood.texcache"
+    static std::string GetCachePathForTexture(const std::string& texturePath);
+
+    static bool Write(const std::string& cacheFilePath, TextureCompressor::Format format,
+                      const std::vector<TextureCompressor::MipLevel>& compressedMips);
+
+    /**
+     * Offline step: loads a PPM, compresses every mip level and writes the cache next to it.
+     * Prints the PSNR and encode speed of each level.
+     *
+     * @return true if the cache file was written
+     */
+    static bool CompressPPM(const std::string& ppmFilePath, TextureCompressor::Format format);
+
+private:
+    const uint8_t* m_fileData = nullptr;
+    size_t m_fileSize = 0;
+    bool m_isMapped = false;
+    std::vector<uint8_t> m_fileContents; // Used when the file could not be memory mapped
+    const Header* m_header = nullptr;
+    const MipEntry* m_mips = nullptr;
+
+    bool ValidateLayout();
+};
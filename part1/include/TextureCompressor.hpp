@@ -0,0 +1,73 @@
+/** @file TextureCompressor.hpp
+ *  @brief CPU block compressor for BC1, BC3 and BC7 textures
+ *
+ *  Compresses RGBA8 images into 4x4 block compressed formats so they can be uploaded
+ *  with glCompressedTexImage2D. Work is split over block rows on multiple threads, and the
+ *  endpoint/index search uses SSE2 when the compiler targets it.
+ *
+ *  BC7 blocks are always written in mode 6 (single subset, RGBA endpoints, 4 bit indices),
+ *  so Decompress only understands mode 6 for BC7.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class TextureCompressor {
+public:
+    enum class Format : uint32_t {
+        BC1 = 1, // RGB, 8 bytes per block (DXT1)
+        BC3 = 3, // RGBA, 16 bytes per block (DXT5)
+        BC7 = 7  // RGBA, 16 bytes per block (BPTC)
+    };
+
+    // One level of a mip chain. Holds RGBA8 pixels or compressed blocks depending on where it came from.
+    struct MipLevel {
+        int width = 0;
+        int height = 0;
+        std::vector<uint8_t> data;
+    };
+
+    // 8 for BC1, 16 for BC3 and BC7
+    static int GetBlockSizeInBytes(Format format);
+
+    static size_t GetCompressedSize(Format format, int width, int height);
+
+    // i.e "bc1" -> Format::BC1, returns false if the name is not known
+    static bool ParseFormat(const std::string& name, Format& format);
+    static std::string GetFormatName(Format format);
+
+    // RGB triplets to RGBA with alpha set to 255
+    static std::vector<uint8_t> ExpandRGBToRGBA(const std::vector<uint8_t>& rgb);
+
+    // Box filters an RGBA8 image down to 1x1. Level 0 is a copy of the input.
+    static std::vector<MipLevel> BuildMipChain(const std::vector<uint8_t>& rgba, int width, int height);
+
+    /**
+     * Compresses an RGBA8 image into blocks. Images that are not a multiple of 4 are padded by clamping to the edge.
+     *
+     * @param numThreads Worker threads to split block rows over, 0 uses std::thread::hardware_concurrency
+     * @return Compressed blocks, row by row, GetCompressedSize bytes long
+     */
+    static std::vector<uint8_t> Compress(const uint8_t* rgba, int width, int height, Format format, unsigned int numThreads = 0);
+
+    // Decodes blocks back to RGBA8. Used for PSNR reports and for drivers without S3TC/BPTC support.
+    static std::vector<uint8_t> Decompress(const uint8_t* blocks, int width, int height, Format format);
+
+    // Peak signal to noise ratio in dB between two RGBA8 images, infinity when identical
+    static double ComputePSNR(const uint8_t* a, const uint8_t* b, size_t numPixels, bool includeAlpha);
+
+private:
+    static void CompressBlockBC1(const uint8_t* blockRGBA, uint8_t* out);
+    static void CompressBlockBC4Alpha(const uint8_t* blockRGBA, uint8_t* out);
+    static void CompressBlockBC7(const uint8_t* blockRGBA, uint8_t* out);
+
+    static void DecompressBlockBC1(const uint8_t* in, uint8_t* blockRGBA, bool alwaysFourColors);
+    static void DecompressBlockBC4Alpha(const uint8_t* in, uint8_t* blockRGBA);
+    static void DecompressBlockBC7(const uint8_t* in, uint8_t* blockRGBA);
+
+    // Copies the 4x4 block at (blockX, blockY) into 64 bytes of RGBA, clamping at the image edges
+    static void FetchBlock(const uint8_t* rgba, int width, int height, int blockX, int blockY, uint8_t* blockRGBA);
+};
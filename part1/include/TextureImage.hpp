@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TextureCache.hpp"
+
+/*
+A decoded texture ready for upload. Either RGB pixels (bottom left pixel first, OpenGL order) or,
+when a .texcache at least as new as the source image exists next to it, the memory mapped compressed mip chain.
+*/
+
+struct TextureImage {
+    std::string path;
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> rgb;
+    std::shared_ptr<TextureCache> compressed;
+
+    bool IsValid() const { return width > 0 && height > 0; }
+    bool IsCompressed() const { return compressed != nullptr; }
+
+    /**
+     * Loads a texture from disk, preferring its .texcache. Safe to call from worker threads (no OpenGL calls).
+     *
+     * @param texturePath Path to a P3 or P6 .ppm
+     */
+    static TextureImage LoadFromFile(const std::string& texturePath);
+};
@@ -0,0 +1,110 @@
+/** @file TextureStreamer.hpp
+ *  @brief Streams the finer mip levels of the texture atlas in as they are needed
+ *
+ *  At startup only the small mips of each layer are resident (see TextureAtlas::Upload).
+ *  Every frame the renderer reports how many pixels each layer covers on screen, which
+ *  gives the mip level that layer wants. Missing levels are read from the layer's
+ *  TextureCache on the shared ThreadPool and uploaded a few per frame.
+ *
+ *  A texture array shares its mip levels between all layers, so VRAM is allocated and
+ *  freed one whole level at a time and the budget is checked against those allocations.
+ *  Which layers actually have data in a level is tracked per layer, the shader clamps its
+ *  LOD to the layer's resident level (Material::diffuseTextureMinLod).
+ */
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "TextureAtlas.hpp"
+#include "TextureCache.hpp"
+
+class TextureStreamer {
+public:
+    struct Stats {
+        int numLayers = 0;
+        int numLayersAtWantedDetail = 0;
+        int baseLevel = 0;              // Finest allocated mip level
+        size_t residentBytes = 0;
+        size_t budgetBytes = 0;
+        int numPendingRequests = 0;     // Level reads queued or running on the thread pool
+        int numUploadsLastFrame = 0;
+        size_t uploadedBytesLastFrame = 0;
+    };
+
+    /**
+     * Takes over the mip levels of an uploaded atlas, dropping any previous atlas.
+     * Streams nothing unless atlas.IsStreamable().
+     *
+     * @param budgetBytes VRAM the atlas may use in total
+     * @param maxUploadBytesPerFrame Streamed data uploaded per frame, the rest waits for the next frame
+     */
+    void Initialize(const TextureAtlas& atlas, size_t budgetBytes, size_t maxUploadBytesPerFrame);
+    bool IsEnabled() const;
+
+    // Forgets last frame's requests, call before RequestTexelDensity
+    void BeginFrame();
+
+    // A draw shows the whole texture of a layer across screenPixelsAcross pixels
+    void RequestTexelDensity(int layer, float screenPixelsAcross);
+
+    /**
+     * Frees unused levels, allocates and uploads finished levels and queues new reads.
+     * Binds the atlas to GL_TEXTURE0, where it always lives.
+     *
+     * @return true if a layer's resident level or the base level changed, the material table needs refreshing
+     */
+    bool Update();
+
+    // Lowering the budget frees levels on the next Update
+    void SetBudget(size_t budgetBytes);
+
+    int GetBaseLevel() const;
+    // Finest level with data for the layer
+    int GetResidentLevel(int layer) const;
+    Stats GetStats() const;
+
+private:
+    struct LayerState {
+        int residentLevel = 0;
+        int wantedLevel = 0;
+        bool isPending = false;
+    };
+
+    struct PendingRequest {
+        int layer;
+        int level;
+        std::future<std::vector<uint8_t>> data;
+    };
+
+    // Reads in flight at once, more would only delay the most needed ones
+    static constexpr int kMaxPendingRequests = 8;
+    // Frames a level has to go unwanted before it is freed, so turning the camera back and forth does not thrash
+    static constexpr int kEvictDelayFrames = 120;
+
+    std::vector<std::shared_ptr<TextureCache>> m_layers;
+    std::vector<LayerState> m_layerStates;
+    std::vector<PendingRequest> m_pendingRequests;
+    GLuint m_texture = 0;
+    GLenum m_internalFormat = 0;
+    int m_layerSize = 0;
+    int m_mipCount = 0;
+    int m_baseLevel = 0;
+    int m_framesBaseLevelUnwanted = 0;
+
+    size_t m_budgetBytes = 0;
+    size_t m_maxUploadBytesPerFrame = 0;
+    int m_numUploadsLastFrame = 0;
+    size_t m_uploadedBytesLastFrame = 0;
+
+    // Size of a level summed over every layer, which is what allocating it costs
+    size_t GetLevelBytes(int level) const;
+    size_t GetResidentBytes() const;
+
+    void AllocateLevel(int level);
+    void FreeBaseLevel();
+};
@@ -0,0 +1,68 @@
+/** @file ThreadPool.hpp
+ *  @brief Fixed set of worker threads that run queued jobs
+ *
+ *  Jobs are submitted as callables and complete through std::future, i.e.
+ *      std::future<PPM> decoded = ThreadPool::GetShared().Submit([path]() { return PPM(path); });
+ *
+ *  Jobs must not wait on other jobs of the same pool, the pool does not grow.
+ */
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class ThreadPool {
+private:
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_isStopping = false;
+
+    void WorkerLoop();
+public:
+    // numThreads of 0 uses std::thread::hardware_concurrency
+    explicit ThreadPool(unsigned int numThreads = 0);
+    // Finishes every queued job before joining the workers
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template <typename F>
+    std::future<std::invoke_result_t<F>> Submit(F&& job) {
+        using Result = std::invoke_result_t<F>;
+        // packaged_task is move only, std::function needs something copyable
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+        std::future<Result> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push([task]() { (*task)(); });
+        }
+        m_condition.notify_one();
+        return result;
+    }
+
+    unsigned int GetNumThreads() const;
+
+    /**
+     * Runs job(index, numJobs) for every index below numJobs and returns once they are all done. The calling
+     * thread runs index 0 itself instead of only waiting, so numJobs is capped at GetNumThreads() + 1.
+     *
+     * @return Jobs that ran, at least 1
+     */
+    int RunSplit(int numJobs, const std::function<void(int job, int numJobs)>& job);
+
+    // [first, last) of count items that are job's share when they are split evenly between numJobs jobs
+    static std::pair<int, int> GetJobRange(int count, int job, int numJobs);
+
+    // Pool shared by the loaders and the renderer's per frame work, created on first use
+    static ThreadPool& GetShared();
+};
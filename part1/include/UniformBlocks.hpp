@@ -0,0 +1,90 @@
+/** @file UniformBlocks.hpp
+ *  @brief C++ mirrors of the std140 uniform blocks shared by every shader
+ *
+ *  The GLSL side is declared in each shader that uses the block, i.e.
+ *      layout(std140) uniform FrameData { mat4 u_ViewMatrix; ... };
+ *  Blocks are bound by index (GLSL 4.1 has no layout(binding)), see ShaderProgram::BindUniformBlock.
+ *  Any change here has to be made in the shaders too, the static_asserts catch C++ side drift
+ *  and BindUniformBlock compares the sizes the driver reports at link time.
+ */
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <glm/mat4x4.hpp>
+
+// Binding points, the same for every program
+enum UniformBlockBinding : GLuint {
+    UNIFORM_BLOCK_FRAME_DATA = 0,
+    UNIFORM_BLOCK_LIGHT_DATA = 1,
+    UNIFORM_BLOCK_SHADOW_DATA = 2,
+    UNIFORM_BLOCK_CLUSTER_DATA = 3
+};
+
+// Size of the cascade arrays in ShadowData, see ShadowDirectionalLight
+constexpr int kMaxShadowCascades = 4;
+// Size of the filter kernel in ShadowData, see ShadowFilter
+constexpr int kMaxShadowKernelTaps = 16;
+
+// One per view rendered (shadow map, then camera), the per-draw model matrix stays a plain uniform
+struct FrameData {
+    glm::mat4 viewMatrix;               // u_ViewMatrix
+    glm::mat4 projection;               // u_Projection
+    float cameraWorldPos[4];            // u_CameraWorldPos, w unused
+};
+
+static_assert(offsetof(FrameData, projection) == 64, "FrameData must match the std140 FrameData block");
+static_assert(offsetof(FrameData, cameraWorldPos) == 128, "FrameData must match the std140 FrameData block");
+static_assert(sizeof(FrameData) == 144, "FrameData must match the std140 FrameData block");
+
+// Once per frame, what the lit shaders need to find a fragment in the cascaded shadow map
+struct ShadowData {
+    glm::mat4 cascadeMatrices[kMaxShadowCascades];  // u_ShadowCascadeMatrices, world to each cascade's clip space
+    float cascadeFarDepths[kMaxShadowCascades];     // u_ShadowCascadeFarDepths, camera distance each cascade ends at
+    float kernel[kMaxShadowKernelTaps * 2];         // u_ShadowKernel, two taps per vec4, offsets in the unit disc
+    GLint numCascades;                              // u_NumShadowCascades
+    GLint numKernelTaps;                            // u_NumShadowKernelTaps
+    float kernelRadius;                             // u_ShadowKernelRadius, in shadow map UV units
+    GLint isKernelRotated;                          // u_IsShadowKernelRotated, turned by a per-pixel angle
+    float pointShadowNearPlane;                     // u_PointShadowNearPlane, see ShadowPointLight
+    float pointShadowFarPlane;                      // u_PointShadowFarPlane
+    float pointShadowKernelRadius;                  // u_PointShadowKernelRadius, in cube face coordinates (-1 to 1)
+    GLint isPointShadow;                            // u_IsPointShadow, the cube map instead of the cascades
+};
+
+static_assert(offsetof(ShadowData, cascadeFarDepths) == 256, "ShadowData must match the std140 ShadowData block");
+static_assert(offsetof(ShadowData, kernel) == 272, "ShadowData must match the std140 ShadowData block");
+static_assert(offsetof(ShadowData, numCascades) == 400, "ShadowData must match the std140 ShadowData block");
+static_assert(offsetof(ShadowData, isKernelRotated) == 412, "ShadowData must match the std140 ShadowData block");
+static_assert(offsetof(ShadowData, pointShadowNearPlane) == 416, "ShadowData must match the std140 ShadowData block");
+static_assert(sizeof(ShadowData) == 432, "ShadowData must match the std140 ShadowData block");
+
+// The PointLight struct in the shaders. std140 packs a float after a vec3 into the same 16 bytes.
+struct LightData {
+    float worldPosition[3];
+    float padding0;
+    float ambientColor[3];
+    float ambientStrength;
+    float diffuseColor[3];
+    float padding1;
+    float specularColor[3];
+    float constantFallOff;
+    float linearFallOff;
+    float quadtraticFallOff;
+    float padding2[2];                  // Structs are rounded up to 16 bytes
+};
+
+static_assert(offsetof(LightData, ambientStrength) == 28, "LightData must match the std140 PointLight struct");
+static_assert(offsetof(LightData, diffuseColor) == 32, "LightData must match the std140 PointLight struct");
+static_assert(offsetof(LightData, constantFallOff) == 60, "LightData must match the std140 PointLight struct");
+static_assert(offsetof(LightData, quadtraticFallOff) == 68, "LightData must match the std140 PointLight struct");
+static_assert(sizeof(LightData) == 80, "LightData must match the std140 PointLight struct");
+
+// Once per frame, how the lit shaders find their light cluster, see LightClusters
+struct ClusterData {
+    GLint gridSize[4];                  // u_ClusterGridSize, tiles across, tiles down, depth slices, number of lights
+    float scale[4];                     // u_ClusterScale, tiles per pixel across and down, slices per log depth, log(near) times that
+};
+
+static_assert(offsetof(ClusterData, scale) == 16, "ClusterData must match the std140 ClusterData block");
+static_assert(sizeof(ClusterData) == 32, "ClusterData must match the std140 ClusterData block");
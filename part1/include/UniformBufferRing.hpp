@@ -0,0 +1,43 @@
+/** @file UniformBufferRing.hpp
+ *  @brief Per-frame uniform block data written into one buffer, round robin
+ *
+ *  The buffer holds kNumFrames regions. Each frame writes its blocks one after another into its
+ *  own region and binds them with glBindBufferRange, so the GPU can still be reading the previous
+ *  frames' data while this one is written. A fence per region keeps a frame from overwriting data
+ *  the GPU has not consumed yet.
+ */
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <vector>
+
+class UniformBufferRing {
+public:
+    static constexpr int kNumFrames = 3;
+
+    /**
+     * @param bytesPerFrame Space for every block pushed in one frame, before alignment
+     * @param maxPushesPerFrame Used to reserve room for GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT padding
+     */
+    void Create(size_t bytesPerFrame, int maxPushesPerFrame);
+
+    // Moves to the next region, waiting if the GPU is still reading it
+    void BeginFrame();
+
+    // Copies a block into this frame's region and binds that range to the binding point
+    void Push(GLuint bindingIndex, const void* data, size_t size);
+
+    // Fences this frame's region, call after the frame's last draw
+    void EndFrame();
+
+    void CleanUp();
+
+private:
+    GLuint m_buffer = 0;
+    size_t m_regionSize = 0;
+    size_t m_alignment = 256;
+    int m_frame = 0;
+    size_t m_offset = 0;
+    GLsync m_fences[kNumFrames] = {};
+};
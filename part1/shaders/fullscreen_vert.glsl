@@ -0,0 +1,8 @@
+#version 410 core
+// One triangle covering the screen, drawn with glDrawArrays(GL_TRIANGLES, 0, 3) and no vertex buffer
+
+void main()
+{
+	vec2 position = vec2((gl_VertexID & 1) * 4.0f - 1.0f, (gl_VertexID >> 1) * 4.0f - 1.0f);
+	gl_Position = vec4(position, 0.0f, 1.0f);
+}
@@ -1,72 +1,234 @@
 #version 410 core
+// Permutations, defined by ShaderLibrary when requested:
+//   SHADOWS          Dots grow towards full size in the main light's shadow, clustered lights use the shadow atlas
+//   TEXTURED         Materials may sample the texture atlas, untextured meshes leave it out
+//   SHADOW_DARKEN    Also darkens shadowed pixels slightly
+//   DOT_TEXTURE      Looks the dot distance up in u_DotDistance instead of computing it
+//   DEBUG_VIEW       One of the DEBUG_VIEW_ values below instead of the halftone shading
+#define DEBUG_VIEW_NONE 0
+#define DEBUG_VIEW_SHADOWS 1  // Shadowed pixels blue, lit ones white
+#define DEBUG_VIEW_NORMALS 2
+#define DEBUG_VIEW_CASCADES 3 // Tints each shadow cascade, red, green, blue, yellow
+#define DEBUG_VIEW_LIGHT_COUNT 4 // Lights in each fragment's cluster, black for none to white for 16 or more
+#ifndef DEBUG_VIEW
+#define DEBUG_VIEW DEBUG_VIEW_NONE
+#endif
 
 in vec3 v_vertexColors;
 in vec3 v_vertexNormals;
 in vec3 v_vertexWorldPosition;
 in vec2 v_texCoord;
+flat in int v_materialID;
+flat in int v_outlineID; // 0 when the object has no outline
+in float v_viewDepth;
 
-out vec4 color;
+layout(location = 0) out vec4 color;
+// Read by the screen space outline, see SceneFramebuffer
+layout(location = 1) out vec4 normalAndOutlineID;
 
-struct PointLight	{
-	vec3 worldPosition; // World position of light
+#include "include/light_data.glsl"
 
-	vec3 ambientColor;
-	float ambientStrength; // Between 0 and 1
-	vec3 diffuseColor;
-	vec3 specularColor;
+#include "include/frame_data.glsl"
 
-	float constantFallOff;
-	float linearFallOff;
-	float quadtraticFallOff;
-};
+#ifdef TEXTURED
+// Every diffuse texture in the scene, a material picks its layer, UV rect and streamed LOD (texel 4.a, 7 and 8)
+uniform sampler2DArray u_TextureAtlas;
+#endif
 
-uniform PointLight u_Light;
-uniform vec3 u_CameraWorldPos;
-uniform sampler2D u_TextureSampler;
-uniform vec3 u_dotColor;
-uniform int u_numDotsHorizontally;
+// Material table, 9 texels per material, see Material.hpp for the layout
+uniform samplerBuffer u_MaterialTable;
+const int MATERIAL_TEXELS = 9;
 
-// Shadows
-uniform mat4 u_ShadowLightSpaceMatrix;
-uniform sampler2D u_DepthMap;
-in vec4 v_vertexShadowLightPos;
+vec4 FetchMaterialTexel(int texel)	{
+	return texelFetch(u_MaterialTable, v_materialID * MATERIAL_TEXELS + texel);
+}
+
+#ifdef SHADOWS
+#include "include/shadow_data.glsl"
+
+// A layer per cascade. Comparison sampler, so a lookup returns how lit the 4 nearest texels are, bilinearly filtered.
+uniform sampler2DArrayShadow u_DepthMap;
+
+// Cascades end further away one after the other, so the cascade is how many have ended before this fragment.
+// Past the last one it is u_NumShadowCascades, unused cascades end at the largest float and never count.
+int GetShadowCascade()	{
+	return int(dot(vec4(greaterThan(vec4(v_viewDepth), u_ShadowCascadeFarDepths)), vec4(1.0f)));
+}
 
-bool IsFragInShadow()	{
-	float bias = 0.003f;
+// Noise that looks the same from frame to frame, 0 to 1 (Jimenez, interleaved gradient noise)
+float InterleavedGradientNoise(vec2 pixel)	{
+	return fract(52.9829189f * fract(dot(pixel, vec2(0.06711056f, 0.00583715f))));
+}
+
+// The main light's cube map, every face a 90 degree perspective view along an axis, see ShadowPointLight
+uniform samplerCubeShadow u_PointShadowMap;
 
-	if (v_vertexShadowLightPos.w == 0.0)	{ // Make sure no divide by 0
-		return false;
-	} 
+// Like the cascades, with the kernel laid out across the direction from the light
+float GetPointShadow()	{
+	vec3 fromLight = v_vertexWorldPosition - u_Light.worldPosition;
+	vec3 absFromLight = abs(fromLight);
+	// The face's view space depth is the distance along the major axis, so its depth is the perspective one
+	float majorAxis = max(absFromLight.x, max(absFromLight.y, absFromLight.z));
+	if (majorAxis >= u_PointShadowFarPlane)	{ // Further away than the shadow reaches
+		return 0.0f;
+	}
+	float depth = ((u_PointShadowFarPlane + u_PointShadowNearPlane) - 2.0f * u_PointShadowFarPlane * u_PointShadowNearPlane / majorAxis)
+	              / (u_PointShadowFarPlane - u_PointShadowNearPlane) * 0.5f + 0.5f;
+
+	// Offsets along two directions across the face, scaled by the major axis so they are in face coordinates
+	vec3 direction = fromLight / majorAxis;
+	vec3 tangent = normalize(cross(absFromLight.y < majorAxis ? vec3(0, 1, 0) : vec3(1, 0, 0), direction));
+	vec3 bitangent = cross(direction, tangent);
+	mat2 kernelRotation = mat2(1.0f);
+	if (u_IsShadowKernelRotated != 0)	{
+		float angle = 6.2831853f * InterleavedGradientNoise(gl_FragCoord.xy);
+		kernelRotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+	}
+	float lit = 0.0f;
+	for (int tap = 0; tap < u_NumShadowKernelTaps; tap++)	{
+		vec4 tapPair = u_ShadowKernel[tap / 2];
+		vec2 offset = kernelRotation * (tap % 2 == 0 ? tapPair.xy : tapPair.zw) * u_PointShadowKernelRadius;
+		lit += texture(u_PointShadowMap, vec4(direction + tangent * offset.x + bitangent * offset.y, depth));
+	}
+	return 1.0f - lit / float(u_NumShadowKernelTaps);
+}
 
-	vec3 clipSpaceVertexShadowLightPos = v_vertexShadowLightPos.xyz / v_vertexShadowLightPos.w; // What is this doing?
-	if (clipSpaceVertexShadowLightPos.z > 1.0 || clipSpaceVertexShadowLightPos.z > 1.0)	{ // Only calculate the shadow if we are within the view at all
-		return false;
+// 0 when lit, 1 when fully in shadow, in between along the filtered edges.
+// The casters were drawn with a slope scaled polygon offset, so the depths compare without a bias here.
+float GetShadow()	{
+	if (u_IsPointShadow != 0)	{
+		return GetPointShadow();
+	}
+	int cascade = GetShadowCascade();
+	if (cascade >= u_NumShadowCascades)	{ // Further away than shadows reach
+		return 0.0f;
+	}
+	// Orthographic, w is 1
+	vec3 clipSpaceVertexShadowLightPos = (u_ShadowCascadeMatrices[cascade] * vec4(v_vertexWorldPosition, 1.0f)).xyz;
+	if (clipSpaceVertexShadowLightPos.z > 1.0)	{ // Only calculate the shadow if we are within the view at all
+		return 0.0f;
 	}
 	clipSpaceVertexShadowLightPos = clipSpaceVertexShadowLightPos * 0.5f + 0.5f; // Put in range from -1 to 1 to 0 to 1
-	float depthValueFromMap = texture(u_DepthMap, clipSpaceVertexShadowLightPos.xy).r;
-	return depthValueFromMap < clipSpaceVertexShadowLightPos.z - bias;
+
+	mat2 kernelRotation = mat2(1.0f);
+	if (u_IsShadowKernelRotated != 0)	{
+		float angle = 6.2831853f * InterleavedGradientNoise(gl_FragCoord.xy);
+		kernelRotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+	}
+	float lit = 0.0f;
+	for (int tap = 0; tap < u_NumShadowKernelTaps; tap++)	{
+		vec4 tapPair = u_ShadowKernel[tap / 2];
+		vec2 offset = kernelRotation * (tap % 2 == 0 ? tapPair.xy : tapPair.zw) * u_ShadowKernelRadius;
+		lit += texture(u_DepthMap, vec4(clipSpaceVertexShadowLightPos.xy + offset, cascade, clipSpaceVertexShadowLightPos.z));
+	}
+	return 1.0f - lit / float(u_NumShadowKernelTaps);
 }
 
-void RenderRawShadows()	{
-	mat4 m =  u_ShadowLightSpaceMatrix; // So doesn't optimize out
-	if (IsFragInShadow())	{
-		color = vec4(0, 0, 1, 1);
+void RenderRawShadows(float shadow)	{
+	color = mix(vec4(1, 1, 1, 1), vec4(0, 0, 1, 1), shadow);
+}
+#endif
+
+#include "include/cluster_data.glsl"
+
+// Every clustered light, 2 texels each: world position and range, then the falloff constants
+uniform samplerBuffer u_ClusterLights;
+// Offset into u_ClusterLightIndices and light count of every cluster
+uniform usamplerBuffer u_ClusterRecords;
+uniform usamplerBuffer u_ClusterLightIndices;
+
+ivec3 GetCluster()	{
+	ivec3 cluster = ivec3(gl_FragCoord.xy * u_ClusterScale.xy, int(log(v_viewDepth) * u_ClusterScale.z - u_ClusterScale.w));
+	return clamp(cluster, ivec3(0), u_ClusterGridSize.xyz - 1);
+}
+
+uvec2 GetClusterRecord()	{
+	ivec3 cluster = GetCluster();
+	return texelFetch(u_ClusterRecords, (cluster.z * u_ClusterGridSize.y + cluster.y) * u_ClusterGridSize.x + cluster.x).rg;
+}
+
+#ifdef SHADOWS
+// Six square tiles per clustered light in one depth texture, looked up in u_ShadowAtlasTiles, see ShadowAtlas
+uniform sampler2DShadow u_ShadowAtlas;
+uniform samplerBuffer u_ShadowAtlasTiles;
+const int SHADOW_ATLAS_TEXELS = 4;
+
+// 0 when lit, 1 when in the light's shadow, always 0 for lights without tiles
+float GetAtlasShadow(int light, vec3 fromLight)	{
+	vec4 tileSizeAndDepthRange = texelFetch(u_ShadowAtlasTiles, light * SHADOW_ATLAS_TEXELS + 3);
+	float tileSize = tileSizeAndDepthRange.x;
+	if (tileSize <= 0.0f)	{
+		return 0.0f;
+	}
+	// The face of the largest axis, its coordinates as in the GL cube map table
+	vec3 absFromLight = abs(fromLight);
+	int face;
+	float majorAxis;
+	vec2 faceCoord;
+	if (absFromLight.x >= absFromLight.y && absFromLight.x >= absFromLight.z)	{
+		face = fromLight.x > 0.0f ? 0 : 1;
+		majorAxis = absFromLight.x;
+		faceCoord = vec2(fromLight.x > 0.0f ? -fromLight.z : fromLight.z, -fromLight.y);
+	} else if (absFromLight.y >= absFromLight.z)	{
+		face = fromLight.y > 0.0f ? 2 : 3;
+		majorAxis = absFromLight.y;
+		faceCoord = vec2(fromLight.x, fromLight.y > 0.0f ? fromLight.z : -fromLight.z);
 	} else {
-		color = vec4(1, 1, 1, 1);
+		face = fromLight.z > 0.0f ? 4 : 5;
+		majorAxis = absFromLight.z;
+		faceCoord = vec2(fromLight.z > 0.0f ? fromLight.x : -fromLight.x, -fromLight.y);
+	}
+	vec4 tilePair = texelFetch(u_ShadowAtlasTiles, light * SHADOW_ATLAS_TEXELS + face / 2);
+	vec2 tileCorner = face % 2 == 0 ? tilePair.xy : tilePair.zw;
+	// Kept half a texel inside the tile, the comparison filter would blend in the neighbouring tiles
+	float halfTexel = 0.5f / float(textureSize(u_ShadowAtlas, 0).x);
+	vec2 atlasCoord = tileCorner + clamp((faceCoord / majorAxis * 0.5f + 0.5f) * tileSize, halfTexel, tileSize - halfTexel);
+	// The face's perspective depth, its view space depth is the distance along the major axis
+	float nearPlane = tileSizeAndDepthRange.y;
+	float farPlane = tileSizeAndDepthRange.z;
+	float depth = ((farPlane + nearPlane) - 2.0f * farPlane * nearPlane / majorAxis) / (farPlane - nearPlane) * 0.5f + 0.5f;
+	return 1.0f - texture(u_ShadowAtlas, vec3(atlasCoord, depth));
+}
+#endif
+
+// Dot product times attenuation of every light in the fragment's cluster, added up.
+// With SHADOWS the lights with tiles in the shadow atlas cast shadows.
+float GetClusterLight(vec3 norm)	{
+	uvec2 record = GetClusterRecord();
+	float light = 0.0f;
+	for (uint i = 0u; i < record.y; i++)	{
+		int index = int(texelFetch(u_ClusterLightIndices, int(record.x + i)).r);
+		vec4 positionAndRange = texelFetch(u_ClusterLights, index * 2);
+		vec3 fallOff = texelFetch(u_ClusterLights, index * 2 + 1).xyz;
+		vec3 toLight = positionAndRange.xyz - v_vertexWorldPosition;
+		float distance = max(length(toLight), 1e-4f);
+		float attenuation = 1.0f / (fallOff.x + fallOff.y * distance + fallOff.z * distance * distance);
+		// Fades to 0 at the range the light was assigned with, so the cluster edges do not show
+		float window = clamp(1.0f - pow(distance / positionAndRange.w, 4.0f), 0.0f, 1.0f);
+#ifdef SHADOWS
+		attenuation *= 1.0f - GetAtlasShadow(index, -toLight);
+#endif
+		light += max(dot(norm, toLight / distance), 0.0f) * attenuation * window * window;
 	}
+	return light;
 }
 
-float GetRadiusOfDot(float dotProdTimesAttenuation, float distanceBetweenDots)	{
+float GetRadiusOfDot(float light, float distanceBetweenDots)	{
 	// Dot calculations done in texture space (u-v between 0 and 1)
 	float maxDotRadius = distanceBetweenDots * 0.3f;
-	
-	if (IsFragInShadow())	{
-		return maxDotRadius;
-	} else {
-		return max((1.0f - dotProdTimesAttenuation) * maxDotRadius, 0); 
-	}
+	return max((1.0f - light) * maxDotRadius, 0);
 }
 
+#ifdef DOT_TEXTURE
+// Distance to the nearest dot in dot spacings, over a tile one spacing wide and two rows high, see HalftoneDotTexture
+uniform sampler2D u_DotDistance;
+
+bool IsFragInDot(float radiusOfDot, float distanceBetweenDots)	{
+	float dotsPerUnit = 1.0f / distanceBetweenDots;
+	float distanceFromDotPos = texture(u_DotDistance, v_texCoord * dotsPerUnit * vec2(1.0f, 0.5f)).r;
+	return distanceFromDotPos <= radiusOfDot * dotsPerUnit;
+}
+#else
 bool IsFragInDot(float radiusOfDot, float distanceBetweenDots)	{
 	float hor = v_texCoord.x;
 	float ver = v_texCoord.y;
@@ -91,6 +253,7 @@ bool IsFragInDot(float radiusOfDot, float distanceBetweenDots)	{
 	float distanceFromDotPos = sqrt(pow(distanceXFromDotPos, 2) + pow(distanceYFromDotPos, 2));
 	return distanceFromDotPos <= radiusOfDot;
 }
+#endif
 
 void main()
 {
@@ -102,27 +265,67 @@ void main()
 	float attenuation = 1.0f / (u_Light.constantFallOff + (u_Light.linearFallOff * distance) + (u_Light.quadtraticFallOff * distance * distance));
 	float dotProdTimesAttenuation = dotProd * attenuation; // Bigger number means more light
 
+	// Material
+	vec3 diffuseColor = FetchMaterialTexel(0).rgb;
+	float numDotsHorizontally = FetchMaterialTexel(3).a;
+	vec4 dotColorAndLayer = FetchMaterialTexel(4);
+	vec3 dotColor = dotColorAndLayer.rgb;
+#ifdef TEXTURED
+	if (dotColorAndLayer.a >= 0.0f)	{ // Textured, map_Kd tints the diffuse color like in the MTL spec
+		vec4 rect = FetchMaterialTexel(7);
+		float minLod = FetchMaterialTexel(8).r;
+		vec2 atlasCoord = rect.xy + fract(v_texCoord) * rect.zw;
+		// LOD from the unwrapped coordinates, the derivatives of fract() jump at every seam
+		vec2 texelCoord = v_texCoord * rect.zw * vec2(textureSize(u_TextureAtlas, 0).xy);
+		float lod = log2(max(length(dFdx(texelCoord)), length(dFdy(texelCoord))));
+		// Finer levels than minLod are not streamed in yet for this layer
+		diffuseColor *= textureLod(u_TextureAtlas, vec3(atlasCoord, dotColorAndLayer.a), max(lod, minLod)).rgb;
+	}
+#endif
+
+	// Shadow map lookup, once for the dots, the darkening and the debug view
+#ifdef SHADOWS
+	float shadow = GetShadow();
+#else
+	float shadow = 0.0f;
+#endif
+	// Only the main light casts shadows, soft shadow edges grow the dots gradually
+	float clusterLight = GetClusterLight(norm);
+	float light = dotProdTimesAttenuation * (1.0f - shadow) + clusterLight;
+
 	// Dot calculation
-	float distanceBetweenDots = 1.0f / float(u_numDotsHorizontally);
-	float radiusOfDot = GetRadiusOfDot(dotProdTimesAttenuation, distanceBetweenDots);
+	float distanceBetweenDots = 1.0f / numDotsHorizontally;
+	float radiusOfDot = GetRadiusOfDot(light, distanceBetweenDots);
 	vec4 objectColor4;
 
 	if (IsFragInDot(radiusOfDot, distanceBetweenDots))	{
-		objectColor4 = vec4(u_dotColor, 1);
+		objectColor4 = vec4(dotColor, 1);
 	} else {
-		objectColor4 = vec4(v_vertexColors, 1);
+		objectColor4 = vec4(diffuseColor, 1);
 	}
 
-	if (dotProdTimesAttenuation < 0.95f)	{ // Cel shading factor, have some darker color in addition to the dots
+	if (dotProdTimesAttenuation + clusterLight < 0.95f)	{ // Cel shading factor, have some darker color in addition to the dots
 		objectColor4 = max(objectColor4 - 0.05f, 0.0f);
 	}
 
-	//if (IsFragInShadow())	{ // Slight darken of pixel if in shadow
-		//objectColor4 = max(objectColor4 - 0.05f, 0.0f);
-	//}
+#if defined(SHADOWS) && defined(SHADOW_DARKEN)
+	// Slight darken of pixel if in shadow
+	objectColor4 = max(objectColor4 - 0.05f * shadow, 0.0f);
+#endif
 
-	//RenderRawShadows();
 	color = objectColor4;
+	normalAndOutlineID = vec4(norm * 0.5f + 0.5f, v_outlineID / 255.0f);
+#if DEBUG_VIEW == DEBUG_VIEW_SHADOWS && defined(SHADOWS)
+	RenderRawShadows(shadow);
+#elif DEBUG_VIEW == DEBUG_VIEW_NORMALS
+	color = vec4(norm * 0.5f + 0.5f, 1);
+#elif DEBUG_VIEW == DEBUG_VIEW_CASCADES && defined(SHADOWS)
+	const vec3 cascadeTints[MAX_SHADOW_CASCADES] = vec3[](vec3(1, 0.3, 0.3), vec3(0.3, 1, 0.3), vec3(0.3, 0.3, 1), vec3(1, 1, 0.3));
+	int cascade = GetShadowCascade();
+	color = cascade < u_NumShadowCascades ? vec4(objectColor4.rgb * cascadeTints[cascade], 1) : objectColor4;
+#elif DEBUG_VIEW == DEBUG_VIEW_LIGHT_COUNT
+	color = vec4(vec3(min(float(GetClusterRecord().y) / 16.0f, 1.0f)), 1);
+#endif
 	
 	
 }
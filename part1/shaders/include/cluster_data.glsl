@@ -0,0 +1,5 @@
+// Mirrors ClusterData in UniformBlocks.hpp, see LightClusters
+layout(std140) uniform ClusterData	{
+	ivec4 u_ClusterGridSize; // Tiles across, tiles down, depth slices, number of lights
+	vec4 u_ClusterScale; // Tiles per pixel across and down, slices per log depth, log(near plane) times that
+};
@@ -0,0 +1,6 @@
+// Shared by every program, see UniformBlocks.hpp
+layout(std140) uniform FrameData	{
+	mat4 u_ViewMatrix;
+	mat4 u_Projection; // We'll use a perspective projection
+	vec4 u_CameraWorldPos; // w unused
+};
@@ -0,0 +1,4 @@
+// Mirrors InstanceData in InstanceBuffer.hpp, advances once per instance (glVertexAttribDivisor 1)
+layout(location = 5) in mat4 aInstanceModelMatrix; // Locations 5 to 8, a column each
+layout(location = 9) in vec4 aInstanceColor; // Multiplies the vertex colors
+layout(location = 10) in ivec2 aInstanceMaterialAndOutline; // ID of the mesh's first material, outline ID (0 for none)
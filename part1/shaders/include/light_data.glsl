@@ -0,0 +1,17 @@
+// Mirrors LightData in UniformBlocks.hpp
+struct PointLight	{
+	vec3 worldPosition; // World position of light
+
+	vec3 ambientColor;
+	float ambientStrength; // Between 0 and 1
+	vec3 diffuseColor;
+	vec3 specularColor;
+
+	float constantFallOff;
+	float linearFallOff;
+	float quadtraticFallOff;
+};
+
+layout(std140) uniform LightData	{
+	PointLight u_Light;
+};
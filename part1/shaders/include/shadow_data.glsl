@@ -0,0 +1,17 @@
+// Mirrors ShadowData in UniformBlocks.hpp, see ShadowDirectionalLight and ShadowPointLight
+const int MAX_SHADOW_CASCADES = 4;
+const int MAX_SHADOW_KERNEL_TAPS = 16;
+
+layout(std140) uniform ShadowData	{
+	mat4 u_ShadowCascadeMatrices[MAX_SHADOW_CASCADES]; // World to each cascade's clip space
+	vec4 u_ShadowCascadeFarDepths; // Camera distance each cascade ends at
+	vec4 u_ShadowKernel[MAX_SHADOW_KERNEL_TAPS / 2]; // PCF tap offsets in the unit disc, two per vec4, see ShadowFilter
+	int u_NumShadowCascades;
+	int u_NumShadowKernelTaps;
+	float u_ShadowKernelRadius; // Scales the offsets to shadow map UVs
+	int u_IsShadowKernelRotated;
+	float u_PointShadowNearPlane;
+	float u_PointShadowFarPlane;
+	float u_PointShadowKernelRadius; // Scales the offsets to cube face coordinates
+	int u_IsPointShadow; // Looks up u_PointShadowMap instead of the cascades
+};
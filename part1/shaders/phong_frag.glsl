@@ -6,21 +6,9 @@ in vec3 v_vertexWorldPosition;
 
 out vec4 color;
 
-struct PointLight	{
-	vec3 worldPosition; // World position of light
+#include "include/light_data.glsl"
 
-	vec3 ambientColor;
-	float ambientStrength; // Between 0 and 1
-	vec3 diffuseColor;
-	vec3 specularColor;
-
-	float constantFallOff;
-	float linearFallOff;
-	float quadtraticFallOff;
-};
-
-uniform PointLight u_Light;
-uniform vec3 u_CameraWorldPos;
+#include "include/frame_data.glsl"
 
 // Entry point of program
 void main()
@@ -43,7 +31,7 @@ void main()
 	vec3 objectDiffuseColorBlend = (objectColor * u_Light.diffuseColor) * dotProd * attenuation;
 
 	// Specular
-	vec3 pointingToCamera = normalize(u_CameraWorldPos - v_vertexWorldPosition);
+	vec3 pointingToCamera = normalize(u_CameraWorldPos.xyz - v_vertexWorldPosition);
 	vec3 lightBounceOffObject = reflect(vecPointingToLight, norm); // Should already be normalized as vecPointingToLight is normalized
 	float specular = pow(max(dot(lightBounceOffObject, pointingToCamera), 0.0f), 32); // The higher the power, the shinier the object
 	vec3 objectSpecularColorBlend = specular * u_Light.specularColor;
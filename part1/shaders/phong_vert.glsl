@@ -9,8 +9,7 @@ layout(location=2) in vec3 vertexNormals;
 
 // Uniform variables
 uniform mat4 u_ModelMatrix;
-uniform mat4 u_ViewMatrix;
-uniform mat4 u_Projection; // We'll use a perspective projection
+#include "include/frame_data.glsl"
 
 // Pass vertex colors into the fragment shader
 out vec3 v_vertexColors;
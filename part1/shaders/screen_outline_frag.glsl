@@ -0,0 +1,61 @@
+#version 410 core
+// Outlines objects from the lit pass's depth, normals and outline IDs (see SceneFramebuffer)
+// with a Roberts cross, then writes the scene color with the outlines on top
+
+out vec4 color;
+
+#include "include/frame_data.glsl"
+
+uniform sampler2D u_SceneColor;
+uniform sampler2D u_SceneNormalAndID; // World normal in rgb, outline ID / 255 in a
+uniform sampler2D u_SceneDepth;
+
+uniform vec3 u_OutlineColor;
+uniform int u_OutlineWidth; // In pixels
+
+const float DEPTH_THRESHOLD = 0.05f; // Relative jump in view depth that counts as an edge
+const float NORMAL_THRESHOLD = 0.4f; // Summed 1 - cos of the two diagonals
+
+struct Sample	{
+	float depth; // View space distance
+	vec3 normal;
+	int outlineID;
+};
+
+Sample FetchSample(ivec2 pixel)	{
+	pixel = clamp(pixel, ivec2(0), textureSize(u_SceneColor, 0) - 1);
+	vec4 normalAndID = texelFetch(u_SceneNormalAndID, pixel, 0);
+	float ndcDepth = texelFetch(u_SceneDepth, pixel, 0).r * 2.0f - 1.0f;
+	Sample s;
+	// Inverse of the perspective projection's depth mapping
+	s.depth = u_Projection[3][2] / (ndcDepth + u_Projection[2][2]);
+	s.normal = normalAndID.rgb * 2.0f - 1.0f;
+	s.outlineID = int(normalAndID.a * 255.0f + 0.5f);
+	return s;
+}
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	int before = u_OutlineWidth / 2;
+	int after = u_OutlineWidth - before;
+	// The two diagonals of a u_OutlineWidth wide square around the pixel
+	Sample a = FetchSample(pixel + ivec2(-before, -before));
+	Sample b = FetchSample(pixel + ivec2(after, -before));
+	Sample c = FetchSample(pixel + ivec2(-before, after));
+	Sample d = FetchSample(pixel + ivec2(after, after));
+
+	color = texelFetch(u_SceneColor, pixel, 0);
+	// Only objects that opted in get lines, other objects and the background never do
+	if (max(max(a.outlineID, b.outlineID), max(c.outlineID, d.outlineID)) == 0)	{
+		return;
+	}
+
+	bool isIDEdge = a.outlineID != d.outlineID || b.outlineID != c.outlineID;
+	float nearestDepth = min(min(a.depth, b.depth), min(c.depth, d.depth));
+	bool isDepthEdge = abs(a.depth - d.depth) + abs(b.depth - c.depth) > DEPTH_THRESHOLD * nearestDepth;
+	bool isNormalEdge = (1.0f - dot(a.normal, d.normal)) + (1.0f - dot(b.normal, c.normal)) > NORMAL_THRESHOLD;
+	if (isIDEdge || isDepthEdge || isNormalEdge)	{
+		color = vec4(u_OutlineColor, 1.0f);
+	}
+}
@@ -0,0 +1,41 @@
+#version 410 core
+// Draws every triangle into the faces of the point light's depth cube map it reaches, in one pass, see ShadowPointLight
+layout(triangles) in;
+layout(triangle_strip, max_vertices = 18) out;
+
+// World to each face's clip space, +x, -x, +y, -y, +z, -z
+uniform mat4 u_CubeFaceMatrices[6];
+// Bit per face the object's box reaches, the CPU already culled the rest
+uniform int u_ViewMask;
+
+// Bit per clip plane the vertex is outside of
+int GetOutCode(vec4 position)	{
+	return int(position.x < -position.w) | int(position.x > position.w) << 1 |
+	       int(position.y < -position.w) << 2 | int(position.y > position.w) << 3 |
+	       int(position.z < -position.w) << 4 | int(position.z > position.w) << 5;
+}
+
+void main()
+{
+	for (int face = 0; face < 6; face++)	{
+		if ((u_ViewMask & (1 << face)) == 0)	{
+			continue;
+		}
+		vec4 positions[3];
+		int outside = 63;
+		for (int i = 0; i < 3; i++)	{
+			positions[i] = u_CubeFaceMatrices[face] * gl_in[i].gl_Position;
+			outside &= GetOutCode(positions[i]);
+		}
+		// All three corners beyond the same plane, the triangle misses the face
+		if (outside != 0)	{
+			continue;
+		}
+		for (int i = 0; i < 3; i++)	{
+			gl_Layer = face;
+			gl_Position = positions[i];
+			EmitVertex();
+		}
+		EndPrimitive();
+	}
+}
@@ -0,0 +1,10 @@
+#version 410 core
+layout (location = 0) in vec3 aPos;
+
+#include "include/instance_data.glsl"
+
+// World space, shadow_cube_geom.glsl projects every triangle into the cube faces
+void main()
+{
+    gl_Position = aInstanceModelMatrix * vec4(aPos, 1.0f);
+}
@@ -1,9 +1,5 @@
 #version 410 core
 
-uniform mat4 u_ModelMatrix;
-uniform mat4 u_ViewMatrix;
-uniform mat4 u_Projection;
-
 void main()
 {             
    // Don't need anything in here for the frag shader, as we only need the depth buffer
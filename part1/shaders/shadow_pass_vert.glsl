@@ -1,11 +1,15 @@
 #version 410 core
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 u_ModelMatrix;
-uniform mat4 u_ViewMatrix;
-uniform mat4 u_Projection;
+#include "include/instance_data.glsl"
+#include "include/frame_data.glsl"
+
+// Also the depth pre-pass, whose depth the lit pass tests GL_EQUAL against. Both shaders compute the
+// position with the same expression and declare it invariant, so the depth comes out bit for bit equal.
+invariant gl_Position;
 
 void main()
 {
-    gl_Position = u_Projection * u_ViewMatrix * u_ModelMatrix * vec4(aPos, 1.0);
+    vec4 worldPosition = aInstanceModelMatrix * vec4(aPos, 1.0f);
+    gl_Position = u_Projection * u_ViewMatrix * worldPosition;
 }  
\ No newline at end of file
@@ -7,32 +7,37 @@ layout(location=0) in vec3 position;
 layout(location=1) in vec3 vertexColors;
 layout(location=2) in vec3 vertexNormals;
 layout(location=3) in vec2 texCoord;
+layout(location=4) in float materialIndex;
 
-// Uniform variables
-uniform mat4 u_ModelMatrix;
-uniform mat4 u_ViewMatrix;
-uniform mat4 u_Projection; // We'll use a perspective projection
+#include "include/instance_data.glsl"
+
+#include "include/frame_data.glsl"
 
 // Pass into the fragment shader
 out vec3 v_vertexColors;
 out vec3 v_vertexNormals;
 out vec3 v_vertexWorldPosition;
 out vec2 v_texCoord;
+flat out int v_materialID;
+flat out int v_outlineID;
+
+out float v_viewDepth; // Picks the shadow cascade and the light cluster
 
-// Shadows
-uniform mat4 u_ShadowLightSpaceMatrix;
-out vec4 v_vertexShadowLightPos;
+// Must match the depth pre-pass, see shadow_pass_vert.glsl
+invariant gl_Position;
 
 void main()
 {
   v_vertexColors = vertexColors;
   v_vertexNormals= vertexNormals;
-  v_vertexWorldPosition = vec3(u_ModelMatrix * vec4(position, 1.0f)); // 1 in w because this is a point
+  vec4 worldPosition = aInstanceModelMatrix * vec4(position, 1.0f); // 1 in w because this is a point
+  v_vertexWorldPosition = vec3(worldPosition);
   v_texCoord = texCoord;
-  v_vertexShadowLightPos = u_ShadowLightSpaceMatrix * u_ModelMatrix * vec4(position, 1.0f);
+  v_materialID = aInstanceMaterialAndOutline.x + int(materialIndex + 0.5f);
+  v_outlineID = aInstanceMaterialAndOutline.y;
+  v_viewDepth = -(u_ViewMatrix * worldPosition).z;
 
-  vec4 newPosition = u_Projection * u_ViewMatrix * vec4(v_vertexWorldPosition, 1.0f); // 1 in w because this is a point
-	gl_Position = vec4(newPosition.x, newPosition.y, newPosition.z, newPosition.w);
+	gl_Position = u_Projection * u_ViewMatrix * worldPosition;
 }
 
 
@@ -2,10 +2,12 @@
 
 in vec3 v_vertexColors;
 
-out vec4 color;
+layout(location = 0) out vec4 color;
+layout(location = 1) out vec4 normalAndOutlineID;
 
 // Entry point of program
 void main()
 {
 	color = vec4(v_vertexColors.x, v_vertexColors.y, v_vertexColors.z, 1.0f);
+	normalAndOutlineID = vec4(0.0f); // Lights never get an outline
 }
@@ -6,18 +6,18 @@
 layout(location=0) in vec3 position;
 layout(location=1) in vec3 vertexColors;
 
+#include "include/instance_data.glsl"
+
 // Uniform variables
-uniform mat4 u_ModelMatrix;
-uniform mat4 u_ViewMatrix;
-uniform mat4 u_Projection; // We'll use a perspective projection
+#include "include/frame_data.glsl"
 
 // Pass vertex colors into the fragment shader
 out vec3 v_vertexColors;
 
 void main()
 {
-  v_vertexColors = vertexColors;
-  vec4 newPosition = u_Projection * u_ViewMatrix * u_ModelMatrix * vec4(position,1.0f);
+  v_vertexColors = vertexColors * aInstanceColor.rgb; // Light gizmos take their light's color
+  vec4 newPosition = u_Projection * u_ViewMatrix * aInstanceModelMatrix * vec4(position,1.0f);
                                                                     // Don't forget 'w'
 	gl_Position = vec4(newPosition.x, newPosition.y, newPosition.z, newPosition.w);
 }
@@ -0,0 +1,194 @@
+#include "FileWatcher.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+#include "Utils.hpp"
+
+#if defined(LINUX)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // How long the thread sleeps between checks, also how long Stop can take
+    const int kWaitMilliseconds = 100;
+    // Modification times are only checked every few waits when polling
+    const int kPollWaits = 5;
+}
+
+FileWatcher::~FileWatcher() {
+    Stop();
+}
+
+void FileWatcher::Start() {
+    if (m_isRunning) {
+        return;
+    }
+#if defined(LINUX)
+    m_inotifyDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotifyDescriptor < 0) {
+        std::cout << "inotify is not available, checking file modification times instead" << std::endl;
+    } else {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& directory : m_directories) {
+            AddDirectoryWatch(directory.first, directory.second);
+        }
+    }
+#endif
+    m_isRunning = true;
+    m_thread = std::thread(&FileWatcher::WatchLoop, this);
+}
+
+void FileWatcher::Stop() {
+    if (!m_isRunning) {
+        return;
+    }
+    m_isRunning = false;
+    m_thread.join();
+#if defined(LINUX)
+    if (m_inotifyDescriptor >= 0) {
+        // Closing the descriptor removes its watches
+        close(m_inotifyDescriptor);
+        m_inotifyDescriptor = -1;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_directoryByWatchDescriptor.clear();
+        for (auto& directory : m_directories) {
+            directory.second.watchDescriptor = -1;
+        }
+    }
+#endif
+}
+
+void FileWatcher::Watch(const std::string& path) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_files.count(path) != 0) {
+            return;
+        }
+    }
+    // Hashed outside the lock, the watcher thread may be hashing too
+    WatchedFile file;
+    file.contentHash = HashFile(path);
+    std::error_code error;
+    file.lastWriteTime = std::filesystem::last_write_time(path, error);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_files.emplace(path, file).second) {
+        return;
+    }
+    std::string directory = Utils::GetDirectoryOfFile(path);
+    size_t locationOfLastSlash = path.find_last_of("/");
+    std::string fileName = locationOfLastSlash == std::string::npos ? path : path.substr(locationOfLastSlash + 1);
+    WatchedDirectory& watched = m_directories[directory];
+    watched.pathByFileName[fileName] = path;
+    AddDirectoryWatch(directory, watched);
+}
+
+std::vector<std::string> FileWatcher::TakeChangedFiles() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<std::string> changedFiles;
+    changedFiles.swap(m_changedFiles);
+    return changedFiles;
+}
+
+bool FileWatcher::IsUsingInotify() const {
+    return m_inotifyDescriptor >= 0;
+}
+
+void FileWatcher::AddDirectoryWatch(const std::string& directory, WatchedDirectory& watched) {
+#if defined(LINUX)
+    if (m_inotifyDescriptor < 0 || watched.watchDescriptor >= 0) {
+        return;
+    }
+    // Editors either write the file in place or write a temporary and rename it over the file
+    watched.watchDescriptor = inotify_add_watch(m_inotifyDescriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (watched.watchDescriptor < 0) {
+        std::cout << "Could not watch directory " << directory << " for changes" << std::endl;
+        return;
+    }
+    m_directoryByWatchDescriptor[watched.watchDescriptor] = directory;
+#endif
+}
+
+void FileWatcher::WatchLoop() {
+    while (m_isRunning) {
+        for (const std::string& path : WaitForCandidates()) {
+            uint64_t contentHash = HashFile(path);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            WatchedFile& file = m_files[path];
+            if (contentHash == file.contentHash) {
+                continue;
+            }
+            file.contentHash = contentHash;
+            if (std::find(m_changedFiles.begin(), m_changedFiles.end(), path) == m_changedFiles.end()) {
+                m_changedFiles.push_back(path);
+            }
+        }
+    }
+}
+
+std::vector<std::string> FileWatcher::WaitForCandidates() {
+    std::vector<std::string> candidates;
+#if defined(LINUX)
+    if (m_inotifyDescriptor >= 0) {
+        pollfd descriptor = {m_inotifyDescriptor, POLLIN, 0};
+        if (poll(&descriptor, 1, kWaitMilliseconds) <= 0) {
+            return candidates;
+        }
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        while ((length = read(m_inotifyDescriptor, buffer, sizeof(buffer))) > 0) {
+            for (char* next = buffer; next < buffer + length;) {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(next);
+                next += sizeof(inotify_event) + event->len;
+                auto directory = m_directoryByWatchDescriptor.find(event->wd);
+                if (event->len == 0 || directory == m_directoryByWatchDescriptor.end()) {
+                    continue;
+                }
+                // Events arrive for every file in the directory, not only the watched ones
+                const WatchedDirectory& watched = m_directories[directory->second];
+                auto path = watched.pathByFileName.find(event->name);
+                if (path != watched.pathByFileName.end() &&
+                    std::find(candidates.begin(), candidates.end(), path->second) == candidates.end()) {
+                    candidates.push_back(path->second);
+                }
+            }
+        }
+        return candidates;
+    }
+#endif
+    for (int i = 0; i < kPollWaits && m_isRunning; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(kWaitMilliseconds));
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& file : m_files) {
+        std::error_code error;
+        std::filesystem::file_time_type lastWriteTime = std::filesystem::last_write_time(file.first, error);
+        if (lastWriteTime != file.second.lastWriteTime) {
+            file.second.lastWriteTime = lastWriteTime;
+            candidates.push_back(file.first);
+        }
+    }
+    return candidates;
+}
+
+uint64_t FileWatcher::HashFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return 0;
+    }
+    uint64_t hash = 14695981039346656037ull;
+    char buffer[64 * 1024];
+    while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
+        for (std::streamsize i = 0; i < file.gcount(); i++) {
+            hash = (hash ^ (uint8_t)buffer[i]) * 1099511628211ull;
+        }
+    }
+    // 0 is reserved for a missing file
+    return hash == 0 ? 1 : hash;
+}
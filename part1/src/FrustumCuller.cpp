@@ -0,0 +1,230 @@
+#include "FrustumCuller.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <limits>
+
+#include "ThreadPool.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FRUSTUM_CULLER_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // Below this many object/frustum tests a frame the threads cost more than they save
+    const int kTestsPerJob = 64 * 1024;
+}
+
+Frustum Frustum::FromMatrix(const glm::mat4& viewProjection, bool isDepthClipped) {
+    // A clip space point is inside when -w <= x, y, z <= w, every plane is the last row plus or minus another row
+    glm::vec4 rows[4];
+    for (int row = 0; row < 4; row++) {
+        rows[row] = glm::vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row], viewProjection[3][row]);
+    }
+    Frustum frustum;
+    for (int axis = 0; axis < 3; axis++) {
+        frustum.planes[axis * 2] = rows[3] + rows[axis];
+        frustum.planes[axis * 2 + 1] = rows[3] - rows[axis];
+    }
+    for (glm::vec4& plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    if (!isDepthClipped) {
+        // Every point is one unit inside
+        frustum.planes[4] = frustum.planes[5] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+    return frustum;
+}
+
+bool Frustum::IsBoxInside(glm::vec3 worldMin, glm::vec3 worldMax) const {
+    for (const glm::vec4& plane : planes) {
+        // The corner furthest along the plane's normal is the last one to leave
+        glm::vec3 corner(plane.x >= 0.0f ? worldMax.x : worldMin.x,
+                         plane.y >= 0.0f ? worldMax.y : worldMin.y,
+                         plane.z >= 0.0f ? worldMax.z : worldMin.z);
+        if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void FrustumCuller::Clear() {
+    for (std::vector<float>* coordinates : {&m_minX, &m_minY, &m_minZ, &m_maxX, &m_maxY, &m_maxZ,
+                                            &m_centerX, &m_centerY, &m_centerZ, &m_radius}) {
+        coordinates->clear();
+    }
+    m_numObjects = 0;
+}
+
+int FrustumCuller::Add(glm::vec3 worldMin, glm::vec3 worldMax, glm::vec3 sphereCenter, float sphereRadius) {
+    int object = m_numObjects++;
+    if (object % 8 == 0) {
+        // Padding objects have a sphere so negative that every plane has it behind
+        size_t size = object + 8;
+        for (std::vector<float>* coordinates : {&m_minX, &m_minY, &m_minZ, &m_maxX, &m_maxY, &m_maxZ,
+                                                &m_centerX, &m_centerY, &m_centerZ}) {
+            coordinates->resize(size, 0.0f);
+        }
+        m_radius.resize(size, -std::numeric_limits<float>::max());
+    }
+    m_minX[object] = worldMin.x;
+    m_minY[object] = worldMin.y;
+    m_minZ[object] = worldMin.z;
+    m_maxX[object] = worldMax.x;
+    m_maxY[object] = worldMax.y;
+    m_maxZ[object] = worldMax.z;
+    m_centerX[object] = sphereCenter.x;
+    m_centerY[object] = sphereCenter.y;
+    m_centerZ[object] = sphereCenter.z;
+    m_radius[object] = sphereRadius;
+    return object;
+}
+
+void FrustumCuller::Cull(const Frustum* frusta, int numFrusta) {
+    auto start = std::chrono::steady_clock::now();
+#if defined(FRUSTUM_CULLER_AVX2)
+    static const bool isAVX2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+    const bool isAVX2 = false;
+#endif
+    int numBlocks = (m_numObjects + 7) / 8;
+    m_visibleMasks.assign(numBlocks, 0);
+
+    long long numTests = (long long)m_numObjects * numFrusta;
+    int numJobs = (int)std::clamp<long long>(numTests / kTestsPerJob, 1, std::max(numBlocks, 1));
+    numJobs = ThreadPool::GetShared().RunSplit(numJobs, [&](int job, int jobCount) {
+        std::pair<int, int> blocks = ThreadPool::GetJobRange(numBlocks, job, jobCount);
+        CullBlocks(blocks.first, blocks.second, frusta, numFrusta, isAVX2);
+    });
+
+    m_stats.numVisible = 0;
+    for (uint8_t mask : m_visibleMasks) {
+        m_stats.numVisible += std::bitset<8>(mask).count();
+    }
+    m_stats.numObjects = m_numObjects;
+    m_stats.numFrusta = numFrusta;
+    m_stats.numThreads = numJobs;
+    m_stats.isAVX2 = isAVX2;
+    m_stats.cullMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void FrustumCuller::CullBlocks(int firstBlock, int lastBlock, const Frustum* frusta, int numFrusta, bool isAVX2) {
+    if (isAVX2) {
+        CullBlocksAVX2(firstBlock, lastBlock, frusta, numFrusta);
+    } else {
+        CullBlocksSSE(firstBlock, lastBlock, frusta, numFrusta);
+    }
+}
+
+#if defined(FRUSTUM_CULLER_AVX2)
+__attribute__((target("avx2,fma")))
+void FrustumCuller::CullBlocksAVX2(int firstBlock, int lastBlock, const Frustum* frusta, int numFrusta) {
+    const __m256 zero = _mm256_setzero_ps();
+    for (int block = firstBlock; block < lastBlock; block++) {
+        size_t i = (size_t)block * 8;
+        const __m256 minX = _mm256_loadu_ps(&m_minX[i]);
+        const __m256 minY = _mm256_loadu_ps(&m_minY[i]);
+        const __m256 minZ = _mm256_loadu_ps(&m_minZ[i]);
+        const __m256 maxX = _mm256_loadu_ps(&m_maxX[i]);
+        const __m256 maxY = _mm256_loadu_ps(&m_maxY[i]);
+        const __m256 maxZ = _mm256_loadu_ps(&m_maxZ[i]);
+        const __m256 centerX = _mm256_loadu_ps(&m_centerX[i]);
+        const __m256 centerY = _mm256_loadu_ps(&m_centerY[i]);
+        const __m256 centerZ = _mm256_loadu_ps(&m_centerZ[i]);
+        const __m256 radius = _mm256_loadu_ps(&m_radius[i]);
+        int visible = 0;
+        for (int f = 0; f < numFrusta && visible != 0xFF; f++) {
+            __m256 outside = zero;
+            for (const glm::vec4& plane : frusta[f].planes) {
+                const __m256 nx = _mm256_set1_ps(plane.x);
+                const __m256 ny = _mm256_set1_ps(plane.y);
+                const __m256 nz = _mm256_set1_ps(plane.z);
+                const __m256 w = _mm256_set1_ps(plane.w);
+                // Sphere, out when its center is further than its radius behind the plane
+                __m256 distance = _mm256_fmadd_ps(nx, centerX, _mm256_fmadd_ps(ny, centerY, _mm256_fmadd_ps(nz, centerZ, w)));
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_LT_OQ));
+                // Box, out when even its corner furthest along the normal is behind. The plane is the same
+                // for all eight objects, so that corner's coordinates all come from the same side.
+                distance = _mm256_fmadd_ps(nx, plane.x >= 0.0f ? maxX : minX,
+                                           _mm256_fmadd_ps(ny, plane.y >= 0.0f ? maxY : minY,
+                                                           _mm256_fmadd_ps(nz, plane.z >= 0.0f ? maxZ : minZ, w)));
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, zero, _CMP_LT_OQ));
+            }
+            visible |= ~_mm256_movemask_ps(outside) & 0xFF;
+        }
+        m_visibleMasks[block] = visible;
+    }
+}
+#else
+void FrustumCuller::CullBlocksAVX2(int firstBlock, int lastBlock, const Frustum* frusta, int numFrusta) {
+    CullBlocksSSE(firstBlock, lastBlock, frusta, numFrusta);
+}
+#endif
+
+void FrustumCuller::CullBlocksSSE(int firstBlock, int lastBlock, const Frustum* frusta, int numFrusta) {
+#if defined(__SSE2__)
+    // The same tests as CullBlocksAVX2, on each half of a block
+    const __m128 zero = _mm_setzero_ps();
+    for (int block = firstBlock; block < lastBlock; block++) {
+        int visible = 0;
+        for (int half = 0; half < 2; half++) {
+            size_t i = (size_t)block * 8 + half * 4;
+            const __m128 minX = _mm_loadu_ps(&m_minX[i]);
+            const __m128 minY = _mm_loadu_ps(&m_minY[i]);
+            const __m128 minZ = _mm_loadu_ps(&m_minZ[i]);
+            const __m128 maxX = _mm_loadu_ps(&m_maxX[i]);
+            const __m128 maxY = _mm_loadu_ps(&m_maxY[i]);
+            const __m128 maxZ = _mm_loadu_ps(&m_maxZ[i]);
+            const __m128 centerX = _mm_loadu_ps(&m_centerX[i]);
+            const __m128 centerY = _mm_loadu_ps(&m_centerY[i]);
+            const __m128 centerZ = _mm_loadu_ps(&m_centerZ[i]);
+            const __m128 radius = _mm_loadu_ps(&m_radius[i]);
+            int halfVisible = 0;
+            for (int f = 0; f < numFrusta && halfVisible != 0xF; f++) {
+                __m128 outside = zero;
+                for (const glm::vec4& plane : frusta[f].planes) {
+                    const __m128 nx = _mm_set1_ps(plane.x);
+                    const __m128 ny = _mm_set1_ps(plane.y);
+                    const __m128 nz = _mm_set1_ps(plane.z);
+                    const __m128 w = _mm_set1_ps(plane.w);
+                    __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, centerX), _mm_mul_ps(ny, centerY)),
+                                                 _mm_add_ps(_mm_mul_ps(nz, centerZ), w));
+                    outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+                    distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, plane.x >= 0.0f ? maxX : minX),
+                                                     _mm_mul_ps(ny, plane.y >= 0.0f ? maxY : minY)),
+                                          _mm_add_ps(_mm_mul_ps(nz, plane.z >= 0.0f ? maxZ : minZ), w));
+                    outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, zero));
+                }
+                halfVisible |= ~_mm_movemask_ps(outside) & 0xF;
+            }
+            visible |= halfVisible << (half * 4);
+        }
+        m_visibleMasks[block] = visible;
+    }
+#else
+    for (int block = firstBlock; block < lastBlock; block++) {
+        int visible = 0;
+        for (int lane = 0; lane < 8; lane++) {
+            size_t i = (size_t)block * 8 + lane;
+            for (int f = 0; f < numFrusta && !(visible & (1 << lane)); f++) {
+                bool isInside = frusta[f].IsBoxInside(glm::vec3(m_minX[i], m_minY[i], m_minZ[i]), glm::vec3(m_maxX[i], m_maxY[i], m_maxZ[i]));
+                for (int p = 0; p < 6 && isInside; p++) {
+                    const glm::vec4& plane = frusta[f].planes[p];
+                    isInside = glm::dot(glm::vec3(plane), glm::vec3(m_centerX[i], m_centerY[i], m_centerZ[i])) + plane.w + m_radius[i] >= 0.0f;
+                }
+                visible |= isInside ? 1 << lane : 0;
+            }
+        }
+        m_visibleMasks[block] = visible;
+    }
+#endif
+}
+
+const FrustumCuller::Stats& FrustumCuller::GetStats() const {
+    return m_stats;
+}
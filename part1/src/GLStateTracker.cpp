@@ -0,0 +1,206 @@
+#include "GLStateTracker.hpp"
+
+GLStateTracker& GLStateTracker::Get() {
+    static GLStateTracker tracker;
+    return tracker;
+}
+
+bool GLStateTracker::Count(bool isChanged) {
+    if (isChanged) {
+        m_frameStats.numIssued++;
+    } else {
+        m_frameStats.numElided++;
+    }
+    return isChanged;
+}
+
+void GLStateTracker::UseProgram(GLuint program) {
+    if (Count(m_program.Update(program))) {
+        glUseProgram(program);
+    }
+}
+
+void GLStateTracker::BindVertexArray(GLuint vertexArray) {
+    if (Count(m_vertexArray.Update(vertexArray))) {
+        glBindVertexArray(vertexArray);
+    }
+}
+
+void GLStateTracker::BindBuffer(GLenum target, GLuint buffer) {
+    if (target == GL_ELEMENT_ARRAY_BUFFER) {
+        // Only known for a vertex array once it was bound through here
+        GLuint vertexArray = m_vertexArray.isKnown ? m_vertexArray.value : 0;
+        auto found = m_elementBufferByVertexArray.find(vertexArray);
+        bool isChanged = !m_vertexArray.isKnown || found == m_elementBufferByVertexArray.end() || found->second != buffer;
+        if (Count(isChanged)) {
+            glBindBuffer(target, buffer);
+            if (m_vertexArray.isKnown) {
+                m_elementBufferByVertexArray[vertexArray] = buffer;
+            }
+        }
+        return;
+    }
+    if (Count(m_buffers[target].Update(buffer))) {
+        glBindBuffer(target, buffer);
+    }
+}
+
+void GLStateTracker::BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    // Only uniform buffer ranges are used, other targets are always issued
+    bool isChanged = target != GL_UNIFORM_BUFFER || m_uniformBufferRanges[index].Update({(GLintptr)buffer, offset, size});
+    if (Count(isChanged)) {
+        glBindBufferRange(target, index, buffer, offset, size);
+        // Also binds the generic target
+        m_buffers[target].Update(buffer);
+    }
+}
+
+void GLStateTracker::BindFramebuffer(GLenum target, GLuint framebuffer) {
+    bool isChanged = false;
+    if (target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER) {
+        isChanged |= m_drawFramebuffer.Update(framebuffer);
+    }
+    if (target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER) {
+        isChanged |= m_readFramebuffer.Update(framebuffer);
+    }
+    if (Count(isChanged)) {
+        glBindFramebuffer(target, framebuffer);
+    }
+}
+
+void GLStateTracker::ActiveTexture(GLenum textureUnit) {
+    if (Count(m_activeTexture.Update(textureUnit))) {
+        glActiveTexture(textureUnit);
+    }
+}
+
+int GLStateTracker::GetTextureTargetSlot(GLenum target) {
+    switch (target) {
+        case GL_TEXTURE_2D: return TEXTURE_TARGET_2D;
+        case GL_TEXTURE_2D_ARRAY: return TEXTURE_TARGET_2D_ARRAY;
+        case GL_TEXTURE_CUBE_MAP: return TEXTURE_TARGET_CUBE_MAP;
+        case GL_TEXTURE_BUFFER: return TEXTURE_TARGET_BUFFER;
+        default: return -1;
+    }
+}
+
+void GLStateTracker::BindTexture(GLenum target, GLuint texture) {
+    if (!m_activeTexture.isKnown) {
+        ActiveTexture(GL_TEXTURE0);
+    }
+    int slot = GetTextureTargetSlot(target);
+    GLuint unit = m_activeTexture.value - GL_TEXTURE0;
+    bool isChanged = slot < 0 || unit >= (GLuint)kMaxTextureUnits || m_textures[unit][slot].Update(texture);
+    if (Count(isChanged)) {
+        glBindTexture(target, texture);
+    }
+}
+
+void GLStateTracker::BindTextureToUnit(GLuint unit, GLenum target, GLuint texture) {
+    int slot = GetTextureTargetSlot(target);
+    if (slot >= 0 && unit < (GLuint)kMaxTextureUnits && m_textures[unit][slot].isKnown && m_textures[unit][slot].value == texture) {
+        Count(false); // Already bound, the unit does not even need to be activated
+        return;
+    }
+    ActiveTexture(GL_TEXTURE0 + unit);
+    BindTexture(target, texture);
+}
+
+void GLStateTracker::SetCapability(GLenum capability, bool isEnabled) {
+    if (Count(m_capabilities[capability].Update(isEnabled))) {
+        if (isEnabled) {
+            glEnable(capability);
+        } else {
+            glDisable(capability);
+        }
+    }
+}
+
+void GLStateTracker::Enable(GLenum capability) {
+    SetCapability(capability, true);
+}
+
+void GLStateTracker::Disable(GLenum capability) {
+    SetCapability(capability, false);
+}
+
+void GLStateTracker::DepthFunc(GLenum func) {
+    if (Count(m_depthFunc.Update(func))) {
+        glDepthFunc(func);
+    }
+}
+
+void GLStateTracker::DepthMask(GLboolean flag) {
+    if (Count(m_depthMask.Update(flag))) {
+        glDepthMask(flag);
+    }
+}
+
+void GLStateTracker::ColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha) {
+    if (Count(m_colorMask.Update({red, green, blue, alpha}))) {
+        glColorMask(red, green, blue, alpha);
+    }
+}
+
+void GLStateTracker::StencilFunc(GLenum func, GLint ref, GLuint mask) {
+    if (Count(m_stencilFunc.Update({func, (GLuint)ref, mask}))) {
+        glStencilFunc(func, ref, mask);
+    }
+}
+
+void GLStateTracker::StencilOp(GLenum stencilFail, GLenum depthFail, GLenum depthPass) {
+    if (Count(m_stencilOp.Update({stencilFail, depthFail, depthPass}))) {
+        glStencilOp(stencilFail, depthFail, depthPass);
+    }
+}
+
+void GLStateTracker::StencilMask(GLuint mask) {
+    if (Count(m_stencilMask.Update(mask))) {
+        glStencilMask(mask);
+    }
+}
+
+void GLStateTracker::Viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    if (Count(m_viewport.Update({x, y, width, height}))) {
+        glViewport(x, y, width, height);
+    }
+}
+
+void GLStateTracker::Scissor(GLint x, GLint y, GLsizei width, GLsizei height) {
+    if (Count(m_scissor.Update({x, y, width, height}))) {
+        glScissor(x, y, width, height);
+    }
+}
+
+void GLStateTracker::PolygonMode(GLenum face, GLenum mode) {
+    // Core profile only has GL_FRONT_AND_BACK
+    if (Count(face != GL_FRONT_AND_BACK || m_polygonMode.Update(mode))) {
+        glPolygonMode(face, mode);
+    }
+}
+
+void GLStateTracker::PolygonOffset(GLfloat factor, GLfloat units) {
+    if (Count(m_polygonOffset.Update({factor, units}))) {
+        glPolygonOffset(factor, units);
+    }
+}
+
+void GLStateTracker::ClearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a) {
+    if (Count(m_clearColor.Update({r, g, b, a}))) {
+        glClearColor(r, g, b, a);
+    }
+}
+
+void GLStateTracker::Invalidate() {
+    GLStateTracker fresh;
+    fresh.m_frameStats = m_frameStats;
+    *this = fresh;
+}
+
+GLStateTracker::FrameStats GLStateTracker::GetFrameStats() const {
+    return m_frameStats;
+}
+
+void GLStateTracker::ResetFrameStats() {
+    m_frameStats = FrameStats();
+}
@@ -0,0 +1,47 @@
+#include "GPUQuery.hpp"
+
+void GPUQuery::Create(GLenum target) {
+    m_target = target;
+    glGenQueries(kNumQueries, m_queries);
+}
+
+void GPUQuery::Begin() {
+    GLuint query = m_queries[m_currentQuery];
+    if (m_isPending[m_currentQuery]) {
+        // Issued kNumQueries frames ago, normally available by now and this does not wait
+        GLuint64 result = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &result);
+        m_total += result;
+        m_numSamples++;
+        m_isPending[m_currentQuery] = false;
+    }
+    glBeginQuery(m_target, query);
+}
+
+void GPUQuery::End() {
+    glEndQuery(m_target);
+    m_isPending[m_currentQuery] = true;
+    m_currentQuery = (m_currentQuery + 1) % kNumQueries;
+}
+
+double GPUQuery::GetAverage() const {
+    return m_numSamples == 0 ? 0.0 : m_total / m_numSamples;
+}
+
+int GPUQuery::GetNumSamples() const {
+    return m_numSamples;
+}
+
+void GPUQuery::Reset() {
+    // A query begun again simply overwrites its old result
+    for (bool& isPending : m_isPending) {
+        isPending = false;
+    }
+    m_total = 0.0;
+    m_numSamples = 0;
+}
+
+void GPUQuery::CleanUp() {
+    glDeleteQueries(kNumQueries, m_queries);
+    Reset();
+}
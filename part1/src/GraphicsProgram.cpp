@@ -9,6 +9,7 @@
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/matrix_transform.hpp> 
+#include <glm/gtc/type_ptr.hpp>
 
 // C++ Standard Template Library (STL)
 #include <iostream>
@@ -16,6 +17,10 @@
 #include <string>
 #include <fstream>
 #include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <random>
+#include <limits>
 
 // Our libraries
 #include "GraphicsProgram.hpp"
@@ -25,6 +30,7 @@
 #include "ObjModelLoader.hpp"
 #include "PointLight.hpp"
 #include "ShadowDirectionalLight.hpp"
+#include "GLStateTracker.hpp"
 
 void GraphicsProgram::GLClearAllErrors(){
     while(glGetError() != GL_NO_ERROR){ }
@@ -42,124 +48,163 @@ bool GraphicsProgram::GLCheckErrorStatus(const char* function, int line){
 }
 
 
-std::string GraphicsProgram::LoadShaderAsString(const std::string& filename){
-    // Resulting shader program loaded as a single string
-    std::string result = "";
+void GraphicsProgram::RequestShaderPrograms(){
+    m_programCache.Initialize(m_programCacheDirectory, SDL_GL_GetProcAddress);
+    m_shaderLibrary.Initialize(&m_programCache, SDL_GL_GetProcAddress,
+                               IsExtensionSupported("GL_KHR_parallel_shader_compile") ||
+                               IsExtensionSupported("GL_ARB_parallel_shader_compile"));
 
-    std::string line = "";
-    std::ifstream myFile(filename.c_str());
-
-    if(myFile.is_open()){
-        while(std::getline(myFile, line)){
-            result += line + '\n';
-        }
-        myFile.close();
+    // Everything is submitted before anything is waited on, the driver compiles while the model loads
+    RequestLitPrograms();
+    RequestProgram(m_graphicsPipelineLights);
+    RequestProgram(m_graphicsPipelineShadows);
+    RequestProgram(m_graphicsPipelineCubeShadows);
+    RequestProgram(m_graphicsPipelineOutline);
+    RequestProgram(m_graphicsPipelineScreenOutline);
+}
 
+void GraphicsProgram::RequestProgram(ShaderProgram& program){
+    int request = 0;
+    if (&program == &m_graphicsPipelineLit || &program == &m_graphicsPipelineLitUntextured)  {
+        request = m_shaderLibrary.Request(m_vertexShaderSourceTextureLit, m_fragmentShaderSourceTextureLit,
+                                          GetLitDefines(&program == &m_graphicsPipelineLit));
+    } else if (&program == &m_graphicsPipelineLights)  {
+        request = m_shaderLibrary.Request(m_vertexShaderSourceUnlit, m_fragmentShaderSourceUnlit, {});
+    } else if (&program == &m_graphicsPipelineShadows)  {
+        request = m_shaderLibrary.Request(m_shadowVertShader, m_shadowFragShader, {});
+    } else if (&program == &m_graphicsPipelineCubeShadows)  {
+        request = m_shaderLibrary.Request(m_shadowCubeVertShader, m_shadowCubeGeomShader, m_shadowFragShader, {});
+    } else if (&program == &m_graphicsPipelineScreenOutline)  {
+        request = m_shaderLibrary.Request(m_vertexShaderSourceFullScreen, m_fragmentShaderSourceScreenOutline, {});
+    } else {
+        request = m_shaderLibrary.Request(m_vertexShaderSourceOutlineOfObject, m_fragmentShaderSourceOutlineOfObject, {});
     }
-
-    return result;
+    m_pendingPrograms.push_back({&program, request});
 }
 
-
-GLuint GraphicsProgram::CompileShader(GLuint type, const std::string& source){
-	// Compile our shaders
-	GLuint shaderObject;
-
-	// Based on the type passed in, we create a shader object specifically for that
-	// type.
-	if(type == GL_VERTEX_SHADER){
-		shaderObject = glCreateShader(GL_VERTEX_SHADER);
-	}else if(type == GL_FRAGMENT_SHADER){
-		shaderObject = glCreateShader(GL_FRAGMENT_SHADER);
-	}
-
-	const char* src = source.c_str();
-	// The source of our shader
-	glShaderSource(shaderObject, 1, &src, nullptr);
-	// Now compile our shader
-	glCompileShader(shaderObject);
-
-	// Retrieve the result of our compilation
-	int result;
-	// Our goal with glGetShaderiv is to retrieve the compilation status
-	glGetShaderiv(shaderObject, GL_COMPILE_STATUS, &result);
-
-	if(result == GL_FALSE){
-		int length;
-		glGetShaderiv(shaderObject, GL_INFO_LOG_LENGTH, &length);
-		char* errorMessages = new char[length]; // Could also use alloca here.
-		glGetShaderInfoLog(shaderObject, length, &length, errorMessages);
-
-		if(type == GL_VERTEX_SHADER){
-			std::cout << "ERROR: GL_VERTEX_SHADER compilation failed!\n" << errorMessages << "\n";
-		}else if(type == GL_FRAGMENT_SHADER){
-			std::cout << "ERROR: GL_FRAGMENT_SHADER compilation failed!\n" << errorMessages << "\n";
-		}
-		// Reclaim our memory
-		delete[] errorMessages;
-
-		// Delete our broken shader
-		glDeleteShader(shaderObject);
-
-		return 0;
-	}
-
-  return shaderObject;
+std::vector<std::string> GraphicsProgram::GetLitDefines(bool isTextured){
+    std::vector<std::string> defines = {"SHADOWS"};
+    if (isTextured)    {
+        defines.push_back("TEXTURED");
+    }
+    if (m_debugView != 0)  {
+        defines.push_back("DEBUG_VIEW " + std::to_string(m_debugView));
+    }
+    if (m_isDotTextureEnabled)  {
+        defines.push_back("DOT_TEXTURE");
+    }
+    return defines;
 }
 
+void GraphicsProgram::RequestLitPrograms(){
+    RequestProgram(m_graphicsPipelineLit);
+    RequestProgram(m_graphicsPipelineLitUntextured);
+}
 
-GLuint GraphicsProgram::CreateShaderProgram(const std::string& vertexShaderSource, const std::string& fragmentShaderSource){
-
-    // Create a new program object
-    GLuint programObject = glCreateProgram();
-
-    // Compile our shaders
-    GLuint myVertexShader   = CompileShader(GL_VERTEX_SHADER, vertexShaderSource);
-    GLuint myFragmentShader = CompileShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
-
-    // Link our two shader programs together.
-	// Consider this the equivalent of taking two .cpp files, and linking them into
-	// one executable file.
-    glAttachShader(programObject,myVertexShader);
-    glAttachShader(programObject,myFragmentShader);
-    glLinkProgram(programObject);
-
-    // Validate our program
-    glValidateProgram(programObject);
-
-    // Once our final program Object has been created, we can
-	// detach and then delete our individual shaders.
-    glDetachShader(programObject,myVertexShader);
-    glDetachShader(programObject,myFragmentShader);
-	// Delete the individual shaders once we are done
-    glDeleteShader(myVertexShader);
-    glDeleteShader(myFragmentShader);
-
-    return programObject;
+void GraphicsProgram::UpdatePendingPrograms(bool isBlocking){
+    bool hasSwapped = false;
+    // In request order, so a newer request for the same program always lands last
+    while (!m_pendingPrograms.empty() && (isBlocking || m_shaderLibrary.IsReady(m_pendingPrograms.front().second)))    {
+        ShaderProgram& program = *m_pendingPrograms.front().first;
+        int request = m_pendingPrograms.front().second;
+        GLuint programID = m_shaderLibrary.Finish(request);
+        m_pendingPrograms.erase(m_pendingPrograms.begin());
+        // Watched whether or not the build worked, saving a fix to a broken shader requests it again
+        m_programSourceFiles[&program] = m_shaderLibrary.GetSourceFiles(request);
+        m_shaderLibrary.Release(request);
+        for (const std::string& file : m_programSourceFiles[&program])    {
+            m_fileWatcher.Watch(file);
+        }
+        if (programID == 0)    {
+            continue; // Keeps drawing with the previous program, if there is one
+        }
+        program.CleanUp();
+        program.SetProgram(programID);
+        SetUpProgram(program);
+        hasSwapped = true;
+    }
+    if (hasSwapped) {
+        // A new program can get the name of the one just deleted
+        GLStateTracker::Get().Invalidate();
+        // Timings of the old program would skew the benchmark
+        ResetOpaquePassStats();
+    }
 }
 
+void GraphicsProgram::SetUpProgram(ShaderProgram& program){
+    // Uniform block bindings are program state too, every program reads the same binding points
+    program.BindUniformBlock("FrameData", UNIFORM_BLOCK_FRAME_DATA, sizeof(FrameData));
+    program.BindUniformBlock("LightData", UNIFORM_BLOCK_LIGHT_DATA, sizeof(LightData));
+    program.BindUniformBlock("ShadowData", UNIFORM_BLOCK_SHADOW_DATA, sizeof(ShadowData));
+    program.BindUniformBlock("ClusterData", UNIFORM_BLOCK_CLUSTER_DATA, sizeof(ClusterData));
+
+    // Sampler units are program state, so they only need to be set once
+    GLStateTracker::Get().UseProgram(program.GetID());
+    if (program.HasUniform("u_MaterialTable")) {
+        program.SetUniform("u_MaterialTable", m_materialTableTextureUnit);
+    }
+    if (program.HasUniform("u_TextureAtlas")) {
+        program.SetUniform("u_TextureAtlas", 0);
+    }
+    if (program.HasUniform("u_DepthMap"))  {
+        program.SetUniform("u_DepthMap", m_shadowMapTextureUnit);
+    }
+    if (program.HasUniform("u_DotDistance"))  {
+        program.SetUniform("u_DotDistance", m_dotDistanceTextureUnit);
+    }
+    if (program.HasUniform("u_SceneColor"))  {
+        program.SetUniform("u_SceneColor", m_sceneColorTextureUnit);
+        program.SetUniform("u_SceneNormalAndID", m_sceneNormalAndIDTextureUnit);
+        program.SetUniform("u_SceneDepth", m_sceneDepthTextureUnit);
+    }
+    if (program.HasUniform("u_ClusterRecords"))  {
+        program.SetUniform("u_ClusterLights", m_clusterLightsTextureUnit);
+        program.SetUniform("u_ClusterRecords", m_clusterRecordsTextureUnit);
+        program.SetUniform("u_ClusterLightIndices", m_clusterLightIndicesTextureUnit);
+    }
+    if (program.HasUniform("u_ShadowAtlas"))  {
+        program.SetUniform("u_ShadowAtlas", m_shadowAtlasTextureUnit);
+        program.SetUniform("u_ShadowAtlasTiles", m_shadowAtlasTilesTextureUnit);
+    }
+    if (program.HasUniform("u_PointShadowMap"))  {
+        program.SetUniform("u_PointShadowMap", m_pointShadowTextureUnit);
+    }
+}
 
 void GraphicsProgram::CreateGraphicsPipeline(){
-    std::string vertexShaderSourceLit;
-    std::string fragmentShaderSourceLit;
-    vertexShaderSourceLit      = LoadShaderAsString(m_vertexShaderSourceTextureLit);
-    fragmentShaderSourceLit    = LoadShaderAsString(m_fragmentShaderSourceTextureLit);
-
-    std::string vertexShaderSourceUnlit      = LoadShaderAsString(m_vertexShaderSourceUnlit);
-    std::string fragmentShaderSourceUnlit   = LoadShaderAsString(m_fragmentShaderSourceUnlit);
-
-	m_graphicsPipelineLit = CreateShaderProgram(vertexShaderSourceLit,fragmentShaderSourceLit);
-    m_graphicsPipelineLights = CreateShaderProgram(vertexShaderSourceUnlit,fragmentShaderSourceUnlit);
-
-    // Shadows
-    std::string vertexShaderSourceShadow = LoadShaderAsString(m_shadowVertShader);
-    std::string fragShaderSourceShadow = LoadShaderAsString(m_shadowFragShader);
-    m_graphicsPipelineShadows = CreateShaderProgram(vertexShaderSourceShadow, fragShaderSourceShadow);
-
-    // Outlines
-    std::string vertexShaderSourceOutline = LoadShaderAsString(m_vertexShaderSourceOutlineOfObject);
-    std::string fragShaderSourceOutline = LoadShaderAsString(m_fragmentShaderSourceOutlineOfObject);
-    m_graphicsPipelineOutline = CreateShaderProgram(vertexShaderSourceOutline, fragShaderSourceOutline);
+    auto waitStart = std::chrono::steady_clock::now();
+    UpdatePendingPrograms(true);
+    std::chrono::duration<double, std::milli> waitTime = std::chrono::steady_clock::now() - waitStart;
+    ProgramBinaryCache::Stats cacheStats = m_programCache.GetStats();
+    ShaderLibrary::Stats shaderStats = m_shaderLibrary.GetStats();
+    std::cout << "Waited " << waitTime.count() << " ms for " << shaderStats.numRequested << " shader programs ("
+              << (m_shaderLibrary.IsParallelCompileEnabled() ? "parallel" : "serial") << " compile, "
+              << shaderStats.numFailed << " failed), program cache " << cacheStats.numHits << "/"
+              << cacheStats.numHits + cacheStats.numMisses << " hits (" << cacheStats.numRejected << " rejected by the driver, "
+              << cacheStats.numStored << " stored)" << std::endl;
+
+    // A view per shadow cascade, shadow atlas face and the camera, one light, the cascades and the light clusters per frame
+    int maxViewsPerFrame = kMaxShadowCascades + m_shadowAtlas.GetSettings().maxFacesPerFrame + 1;
+    m_uniformRing.Create(maxViewsPerFrame * sizeof(FrameData) + sizeof(LightData) + sizeof(ShadowData) + sizeof(ClusterData),
+                         maxViewsPerFrame + 3);
+
+    // Bound once, nothing else uses their units
+    m_halftoneDotTexture.Create();
+    m_halftoneDotTexture.Bind(GL_TEXTURE0 + m_dotDistanceTextureUnit);
+    m_lightClusters.Create(GL_TEXTURE0 + m_clusterLightsTextureUnit, GL_TEXTURE0 + m_clusterRecordsTextureUnit,
+                           GL_TEXTURE0 + m_clusterLightIndicesTextureUnit);
+    m_shadowAtlas.Create(GL_TEXTURE0 + m_shadowAtlasTextureUnit, GL_TEXTURE0 + m_shadowAtlasTilesTextureUnit);
+    m_opaquePassTimer.Create(GL_TIME_ELAPSED);
+    m_opaquePassFragments.Create(GL_SAMPLES_PASSED);
+    m_depthPrepassFragments.Create(GL_SAMPLES_PASSED);
+    m_shadowPassTimer.Create(GL_TIME_ELAPSED);
+    m_shadowAtlasTimer.Create(GL_TIME_ELAPSED);
+    m_renderQueue.SetInstanceBuffer(&m_instanceBuffer);
+    m_pointShadowTimer.Create(GL_TIME_ELAPSED);
+
+    m_sceneFramebuffer.Create(gScreenWidth, gScreenHeight);
+    m_sceneFramebuffer.BindTextures(m_sceneColorTextureUnit, m_sceneNormalAndIDTextureUnit, m_sceneDepthTextureUnit);
+    glGenVertexArrays(1, &m_vertexArrayObjectFullScreen);
 }
 
 
@@ -206,55 +251,29 @@ void GraphicsProgram::InitializeProgram(){
 		std::cout << "glad did not initialize" << std::endl;
 		exit(1);
 	}
+    // Every vertex array attaches its instance attributes to it as it is created
+    m_instanceBuffer.Create();
 	
 }
 
 void GraphicsProgram::VertexSpecification(std::string modelPath){
+    // Textures decode on worker threads while the OBJ is parsed, so this waits for the slowest single texture
+    auto loadStart = std::chrono::steady_clock::now();
     ObjModelLoader modelLoader(modelPath);
+    modelLoader.WaitForTextures();
+    std::chrono::duration<double, std::milli> loadTime = std::chrono::steady_clock::now() - loadStart;
+    std::cout << "Loaded " << modelPath << " and " << modelLoader.GetTexturePaths().size()
+              << " textures in " << loadTime.count() << " ms" << std::endl;
+    m_modelPath = modelPath;
 	// Vertex Arrays Object (VAO) Setup
 	glGenVertexArrays(1, &m_vertexArrayObject);
 	// We bind (i.e. select) to the Vertex Array Object (VAO) that we want to work withn.
-	glBindVertexArray(m_vertexArrayObject);
-	// Vertex Buffer Object (VBO) creation
+	GLStateTracker::Get().BindVertexArray(m_vertexArrayObject);
+	// Vertex Buffer Object (VBO) and Element Buffer Object (EBO) creation
 	glGenBuffers(1, &m_vertexBufferObject);
-    
-    std::vector<GLfloat> vboData = modelLoader.GetVertexBufferObjectData();
-    glBindBuffer(GL_ARRAY_BUFFER, m_vertexBufferObject);
-    glBufferData(GL_ARRAY_BUFFER, 						        // Kind of buffer we are working with 
-                                                                // (e.g. GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER)
-                    vboData.size() * sizeof(GL_FLOAT), 	// Size of data in bytes
-                    vboData.data(), 					// Raw array of data
-                    GL_STATIC_DRAW);							// How we intend to use the data
-
-    // Element Buffer Object (EBO) creation
     glGenBuffers(1, &m_elementBufferObject);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_elementBufferObject);
-    std::vector<GLuint> eboData = modelLoader.GetElementBufferObjectData();
-    std::cout << "Ebodata size: " << eboData.size() << std::endl;
-    m_numVerticesToDraw = eboData.size();
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, eboData.size() * sizeof(GLuint), eboData.data(), GL_STATIC_DRAW);
-
-    // Texture Object Creation
-    m_isTextureProvided = modelLoader.HasDiffuseTexture();
-    if (m_isTextureProvided)    {
-        glGenTextures(1, &m_textureID);
-        glBindTexture(GL_TEXTURE_2D, m_textureID);
-        glTexImage2D(GL_TEXTURE_2D,
-                     0, // mipmap level
-                     GL_RGB,
-                     modelLoader.GetDiffuseTextureWidth(),
-                     modelLoader.GetDiffuseTextureHeight(),
-                     0, // border (must be 0 for some reason, this would be good to look up later)
-                     GL_RGB,
-                     GL_UNSIGNED_BYTE,
-                     modelLoader.GetDiffuseTextureData().data());
-        glGenerateMipmap(GL_TEXTURE_2D);
-        // These parameters decide how to get the color value if the image is minimized/maximized, this is worth looking further into
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    }
+    UploadModel(modelLoader);
+    std::cout << "Ebodata size: " << m_numVerticesToDraw << std::endl;
 
     // =============================
     // offsets every 3 floats
@@ -267,36 +286,217 @@ void GraphicsProgram::VertexSpecification(std::string modelPath){
     // ============================
     // Position information (x,y,z)
 	glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*11,(void*)0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*12,(void*)0);
     // Color information (r,g,b)
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*11,(GLvoid*)(sizeof(GL_FLOAT)*3));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*12,(GLvoid*)(sizeof(GL_FLOAT)*3));
     // Normal information (nx,ny,nz)
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*11, (GLvoid*)(sizeof(GL_FLOAT)*6));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*12, (GLvoid*)(sizeof(GL_FLOAT)*6));
     // Texture information (tx,ty)
     glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*11, (GLvoid*)(sizeof(GL_FLOAT)*9));
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*12, (GLvoid*)(sizeof(GL_FLOAT)*9));
+    // Material index
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*12, (GLvoid*)(sizeof(GL_FLOAT)*11));
 
 	// Unbind our currently bound Vertex Array Object
-	glBindVertexArray(0);
+	GLStateTracker::Get().BindVertexArray(0);
 	// Disable any attributes we opened in our Vertex Attribute Arrray,
 	// as we do not want to leave them open. 
 	glDisableVertexAttribArray(0);
 	glDisableVertexAttribArray(1);
 	glDisableVertexAttribArray(2);
     glDisableVertexAttribArray(3);
+    glDisableVertexAttribArray(4);
+    // Model matrix and material per instance
+    m_instanceBuffer.Attach(m_vertexArrayObject);
+}
+
+bool GraphicsProgram::UploadModel(ObjModelLoader& modelLoader){
+    std::vector<GLuint> eboData = modelLoader.GetElementBufferObjectData();
+    if (eboData.empty() && m_numVerticesToDraw != 0)   {
+        return false;
+    }
+    std::vector<GLfloat> vboData = modelLoader.GetVertexBufferObjectData();
+    GLStateTracker::Get().BindBuffer(GL_ARRAY_BUFFER, m_vertexBufferObject);
+    glBufferData(GL_ARRAY_BUFFER, 						        // Kind of buffer we are working with 
+                                                                // (e.g. GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER)
+                    vboData.size() * sizeof(GL_FLOAT), 	// Size of data in bytes
+                    vboData.data(), 					// Raw array of data
+                    GL_STATIC_DRAW);							// How we intend to use the data
+
+    GLStateTracker::Get().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_elementBufferObject);
+    m_numVerticesToDraw = eboData.size();
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, eboData.size() * sizeof(GLuint), eboData.data(), GL_STATIC_DRAW);
+
+    // Materials, the vertices store indices relative to this base. The first load has none to replace and adds them.
+    m_modelMaterialBase = m_materialTable.ReplaceMaterials(m_modelMaterialBase, m_modelNumMaterials,
+                                                           modelLoader.GetMaterials(), modelLoader.GetTexturePaths());
+    m_modelNumMaterials = modelLoader.GetMaterials().size();
+
+    // Bounds for culling, and a radius around the origin containing the bounding sphere for texture streaming
+    m_modelBoundsMin = modelLoader.GetBoundsMin();
+    m_modelBoundsMax = modelLoader.GetBoundsMax();
+    m_modelSphereCenter = modelLoader.GetBoundingSphereCenter();
+    m_modelSphereRadius = modelLoader.GetBoundingSphereRadius();
+    m_modelBoundingRadius = glm::length(m_modelSphereCenter) + m_modelSphereRadius;
+    // A thousand triangles or so, the model is its own occluder mesh. Positions are the first 3 of every 12 floats.
+    m_modelOccluderPositions.clear();
+    for (size_t i = 0; i + 2 < vboData.size(); i += 12)    {
+        m_modelOccluderPositions.push_back(glm::vec3(vboData[i], vboData[i + 1], vboData[i + 2]));
+    }
+    m_modelOccluderIndices = eboData;
+    // Spaced and shaded after the model
+    if (m_isModelCrowdEnabled)  {
+        BuildModelCrowd();
+    }
+
+    // Textures are packed once every object has added its materials, see UploadMaterialsAndTextures
+    for (size_t i = 0; i < modelLoader.GetTexturePaths().size(); i++)    {
+        m_loadedTextures[modelLoader.GetTexturePaths()[i]] = modelLoader.GetTexture(i);
+    }
+
+    // A cache that does not exist yet is watched too, compressing a texture offline picks it up
+    m_modelSourceFiles = {m_modelPath};
+    if (!modelLoader.GetMaterialFilePath().empty())    {
+        m_modelSourceFiles.push_back(modelLoader.GetMaterialFilePath());
+    }
+    for (const std::string& texturePath : modelLoader.GetTexturePaths())   {
+        m_modelSourceFiles.push_back(texturePath);
+        m_modelSourceFiles.push_back(TextureCache::GetCachePathForTexture(texturePath));
+    }
+    for (const std::string& file : m_modelSourceFiles)    {
+        m_fileWatcher.Watch(file);
+    }
+    return true;
+}
+
+void GraphicsProgram::ReloadChangedFiles(){
+    std::vector<ShaderProgram*> programsToRequest;
+    for (const std::string& file : m_fileWatcher.TakeChangedFiles())  {
+        std::cout << file << " changed, reloading" << std::endl;
+        for (auto& sources : m_programSourceFiles)   {
+            if (std::find(sources.second.begin(), sources.second.end(), file) != sources.second.end() &&
+                std::find(programsToRequest.begin(), programsToRequest.end(), sources.first) == programsToRequest.end())  {
+                programsToRequest.push_back(sources.first);
+            }
+        }
+        if (std::find(m_modelSourceFiles.begin(), m_modelSourceFiles.end(), file) != m_modelSourceFiles.end())  {
+            m_isModelReloadQueued = true;
+        }
+    }
+    // An include shared by several programs rebuilds each of them once
+    for (ShaderProgram* program : programsToRequest)  {
+        RequestProgram(*program);
+    }
+
+    // One import at a time, files saved during an import start another once it is swapped in
+    if (m_isModelReloadQueued && !m_pendingModel.valid())   {
+        m_isModelReloadQueued = false;
+        std::string modelPath = m_modelPath;
+        // Not on the shared ThreadPool, the loader queues its texture decodes there and waits for them
+        m_pendingModel = std::async(std::launch::async, [modelPath]() {
+            std::unique_ptr<ObjModelLoader> modelLoader = std::make_unique<ObjModelLoader>(modelPath);
+            modelLoader->WaitForTextures();
+            return modelLoader;
+        });
+    }
+}
+
+void GraphicsProgram::UpdatePendingModel(){
+    if (!m_pendingModel.valid() || m_pendingModel.wait_for(std::chrono::seconds(0)) != std::future_status::ready)   {
+        return;
+    }
+    std::unique_ptr<ObjModelLoader> modelLoader = m_pendingModel.get();
+    GLStateTracker& state = GLStateTracker::Get();
+    // The element buffer binding belongs to the vertex array
+    state.BindVertexArray(m_vertexArrayObject);
+    bool isUploaded = UploadModel(*modelLoader);
+    state.BindVertexArray(0);
+    if (!isUploaded)  {
+        std::cout << "Reimported " << m_modelPath << " has no triangles, keeping the previous model" << std::endl;
+        return;
+    }
+
+    // Texture sizes or formats may have changed, so the atlas and the material regions are rebuilt from scratch
+    m_textureAtlas.CleanUp();
+    // The new atlas can get the name of the one just deleted, which the tracker still thinks is bound
+    state.Invalidate();
+    UploadMaterialsAndTextures();
+    std::cout << "Reloaded " << m_modelPath << " with " << m_modelNumMaterials << " materials" << std::endl;
+}
+
+bool GraphicsProgram::IsExtensionSupported(const std::string& extensionName)   {
+    GLint numExtensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+    for (GLint i = 0; i < numExtensions; i++)  {
+        const GLubyte* name = glGetStringi(GL_EXTENSIONS, i);
+        if (name != nullptr && extensionName == reinterpret_cast<const char*>(name))  {
+            return true;
+        }
+    }
+    return false;
+}
+
+void GraphicsProgram::UploadMaterialsAndTextures()    {
+    // Atlas regions are indexed like the table's texture list
+    std::vector<TextureImage> images;
+    for (const std::string& path : m_materialTable.GetTexturePaths())  {
+        auto loaded = m_loadedTextures.find(path);
+        if (loaded != m_loadedTextures.end())   {
+            images.push_back(loaded->second);
+        } else {
+            TextureImage missing;
+            missing.path = path;
+            images.push_back(missing);
+        }
+    }
+    m_loadedTextures.clear(); // The atlas has its own copy of the pixels now
+
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    m_textureAtlas.Build(images, maxTextureSize);
+    m_textureAtlas.Upload(IsExtensionSupported("GL_EXT_texture_compression_s3tc"),
+                          IsExtensionSupported("GL_ARB_texture_compression_bptc"),
+                          m_textureStartupSize);
+    m_textureAtlas.Bind(GL_TEXTURE0);
+    m_textureStreamer.Initialize(m_textureAtlas, m_textureBudgetBytes, m_textureUploadBytesPerFrame);
+
+    m_materialTable.ApplyTextureRegions(m_textureAtlas);
+    m_materialTable.ApplyTextureResidency(m_textureStreamer);
+    m_materialTable.Upload();
+    m_materialTable.Bind(GL_TEXTURE0 + m_materialTableTextureUnit);
+    std::cout << "Uploaded " << m_materialTable.GetMaterials().size() << " materials, "
+              << m_materialTable.GetTexturePaths().size() << " textures" << std::endl;
+}
+
+void GraphicsProgram::RequestTextureDetail(int materialBase, int numMaterials, glm::vec3 translation, float boundingRadius)    {
+    // Projected diameter of the bounding sphere, clamped so being inside the sphere asks for full detail
+    float distance = std::max(-(gCamera.GetViewMatrix() * glm::vec4(translation, 1.0f)).z, boundingRadius * 0.5f);
+    float pixelsPerUnit = gScreenHeight / (2.0f * distance * std::tan(glm::radians(m_fieldOfViewDegrees) * 0.5f));
+    float screenPixelsAcross = 2.0f * boundingRadius * pixelsPerUnit;
+
+    const std::vector<Material>& materials = m_materialTable.GetMaterials();
+    for (int i = materialBase; i < materialBase + numMaterials; i++)  {
+        const Material& m = materials[i];
+        if (m.diffuseTextureLayer >= 0.0f)   {
+            // A packed texture only covers part of the layer
+            float rectScale = std::max(m.diffuseTextureRect[2], m.diffuseTextureRect[3]);
+            m_textureStreamer.RequestTexelDensity((int)m.diffuseTextureLayer, screenPixelsAcross / rectScale);
+        }
+    }
 }
 
 void GraphicsProgram::CreateLights() {
     glGenVertexArrays(1, &m_vertexArrayObjectLights);
-    glBindVertexArray(m_vertexArrayObjectLights);
+    GLStateTracker::Get().BindVertexArray(m_vertexArrayObjectLights);
     glGenBuffers(1, &m_vertexBufferObjectLights);
-    glBindBuffer(GL_ARRAY_BUFFER, m_vertexBufferObjectLights);
+    GLStateTracker::Get().BindBuffer(GL_ARRAY_BUFFER, m_vertexBufferObjectLights);
     PointLight l1(glm::vec3(1.0f, 3.0f, -3.f), glm::vec3(1.f, 1.f, 1.f), glm::vec3(1.f, 1.f, 1.f), glm::vec3(1.f, 1.f, 1.f), 0.f, 0.01f, 0.005f, 0.5f);
     m_lights.push_back(l1);
     std::vector<GLfloat> vboData = l1.GetVertexBufferObjectData();
-    glBindBuffer(GL_ARRAY_BUFFER, m_vertexBufferObjectLights);
+    GLStateTracker::Get().BindBuffer(GL_ARRAY_BUFFER, m_vertexBufferObjectLights);
     glBufferData(GL_ARRAY_BUFFER, 						        // Kind of buffer we are working with 
                                                                 // (e.g. GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER)
                     vboData.size() * sizeof(GL_FLOAT), 	// Size of data in bytes
@@ -312,161 +512,627 @@ void GraphicsProgram::CreateLights() {
 
     // Element Buffer Object (EBO) creation
     glGenBuffers(1, &m_elementBufferObjectLights);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_elementBufferObjectLights);
+    GLStateTracker::Get().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_elementBufferObjectLights);
     std::vector<GLuint> eboData = l1.GetElementBufferObjectData();
     std::cout << "Ebodata size: " << eboData.size() << std::endl;
     m_numVerticesToDrawLights = eboData.size();
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, eboData.size() * sizeof(GLuint), eboData.data(), GL_STATIC_DRAW);
 
+    // Small lights scattered over the ground plane, seeded the same every time so benchmarks compare
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> across(-10.0f, 10.0f);
+    std::uniform_real_distribution<float> height(-0.5f, 1.5f);
+    for (int i = 0; i < m_numClusteredLights; i++)  {
+        glm::vec3 position(across(random), height(random), across(random));
+        m_clusteredLights.push_back(PointLight(position, glm::vec3(1.f, 1.f, 1.f), glm::vec3(1.f, 1.f, 1.f), glm::vec3(1.f, 1.f, 1.f),
+                                               1.0f, 2.0f, 20.0f, 0.0f));
+    }
+
 	// Unbind our currently bound Vertex Array Object
-	glBindVertexArray(0);
+	GLStateTracker::Get().BindVertexArray(0);
 	// Disable any attributes we opened in our Vertex Attribute Arrray,
 	// as we do not want to leave them open. 
 	glDisableVertexAttribArray(0);
 	glDisableVertexAttribArray(1);
+    // Every light's gizmo is an instance of the cube
+    m_instanceBuffer.Attach(m_vertexArrayObjectLights);
 }
 
 
-void GraphicsProgram::PreDraw(int graphicsPipeline, glm::mat4 viewMatrix, glm::mat4 projectionMatrix, 
-                              glm::vec3 modelTranslation, glm::vec3 modelScale) {
+void GraphicsProgram::PreDraw() {
+    // Called before every pass, the tracker only reaches the driver when something actually changes
+    GLStateTracker& state = GLStateTracker::Get();
 	// Disable depth test and face culling.
-    glEnable(GL_DEPTH_TEST);                    // NOTE: Need to enable DEPTH Test
-    //glDisable(GL_DEPTH_TEST);
-    glDisable(GL_CULL_FACE);
+    state.Enable(GL_DEPTH_TEST);                    // NOTE: Need to enable DEPTH Test
+    //state.Disable(GL_DEPTH_TEST);
+    state.Disable(GL_CULL_FACE);
 
     // Set the polygon fill mode
-    glPolygonMode(GL_FRONT_AND_BACK,gPolygonMode);
+    state.PolygonMode(GL_FRONT_AND_BACK,gPolygonMode);
 
     // Initialize clear color
     // This is the background of the screen.
-    glClearColor(0.53f, 0.81f, 0.92f, 1.0f);
-
-    // Use our shader
-	glUseProgram(graphicsPipeline);
+    state.ClearColor(0.53f, 0.81f, 0.92f, 1.0f);
+}
 
+glm::mat4 GraphicsProgram::GetModelMatrix(glm::vec3 modelTranslation, glm::vec3 modelScale) {
     // Model transformation by translating our object into world space
     glm::mat4 model = glm::scale(glm::mat4(1.0f), modelScale); 
     model = glm::translate(model, modelTranslation); 
+    return model;
+}
 
+float GraphicsProgram::GetSortDepth(const glm::mat4& viewMatrix, glm::vec3 worldPosition, float farPlane) {
+    return -(viewMatrix * glm::vec4(worldPosition, 1.0f)).z / farPlane;
+}
 
-    // Retrieve our location of our Model Matrix
-    GLint u_ModelMatrixLocation = glGetUniformLocation(graphicsPipeline,"u_ModelMatrix");
-    if(u_ModelMatrixLocation >=0){
-        glUniformMatrix4fv(u_ModelMatrixLocation,1,GL_FALSE,&model[0][0]);
-    }else{
-        std::cout << "Could not find u_ModelMatrix, maybe a mispelling?\n";
-        exit(EXIT_FAILURE);
+void GraphicsProgram::QueueMesh(GLuint vertexArray, GLsizei numVertices, bool isIndexed, glm::vec3 modelTranslation, glm::vec3 modelScale,
+                                glm::vec3 localMin, glm::vec3 localMax, int materialBase, int numMaterials, float outlineExtrudeDistance,
+                                bool isStaticShadowCaster, ShadowDirectionalLight& shadowCaster, const ShadowPointLight& pointShadow,
+                                int occlusionObject) {
+    InstanceData instance;
+    instance.modelMatrix = GetModelMatrix(modelTranslation, modelScale);
+    instance.materialBase = materialBase;
+    if (outlineExtrudeDistance > 0.0f)  {
+        // IDs only have to differ between neighbouring objects, so wrapping around after 255 is fine
+        instance.outlineID = m_numOutlinedObjects % 255 + 1;
+        m_numOutlinedObjects++;
+    }
+    int firstInstance = m_instanceBuffer.Add(instance);
+    // The scale is applied after the translation, see GetModelMatrix
+    glm::vec3 worldCorner0 = modelScale * (localMin + modelTranslation);
+    glm::vec3 worldCorner1 = modelScale * (localMax + modelTranslation);
+    glm::vec3 worldMin = glm::min(worldCorner0, worldCorner1);
+    glm::vec3 worldMax = glm::max(worldCorner0, worldCorner1);
+    int passes = QUEUED_PASSES_ALL;
+    if (m_isFrustumCullingEnabled)  {
+        // A few single meshes, the crowd is where the culler pays off
+        if (!m_cameraFrustum.IsBoxInside(worldMin, worldMax))  {
+            passes &= ~QUEUED_PASSES_CAMERA;
+        }
+        if (std::none_of(m_shadowFrusta.begin(), m_shadowFrusta.end(),
+                         [&](const Frustum& frustum) { return frustum.IsBoxInside(worldMin, worldMax); }))  {
+            passes &= ~QUEUED_PASSES_MAIN_SHADOW;
+        }
     }
+    if (m_isOcclusionCullingEnabled && (passes & QUEUED_PASSES_CAMERA) && !m_occlusionCuller.IsBoxVisible(worldMin, worldMax))  {
+        passes &= ~QUEUED_PASSES_CAMERA;
+    }
+    QueueInstances(vertexArray, numVertices, isIndexed, firstInstance, 1, worldMin, worldMax, materialBase, numMaterials,
+                   outlineExtrudeDistance, isStaticShadowCaster, shadowCaster, pointShadow, passes, occlusionObject);
+}
 
+void GraphicsProgram::QueueInstances(GLuint vertexArray, GLsizei numVertices, bool isIndexed, int firstInstance, int numInstances,
+                                     glm::vec3 worldMin, glm::vec3 worldMax, int materialBase, int numMaterials, float outlineExtrudeDistance,
+                                     bool isStaticShadowCaster, ShadowDirectionalLight& shadowCaster, const ShadowPointLight& pointShadow,
+                                     int passes, int occlusionObject) {
+    DrawPacket packet;
+    packet.vertexArray = vertexArray;
+    packet.numVertices = numVertices;
+    packet.isIndexed = isIndexed;
+    packet.firstInstance = firstInstance;
+    packet.numInstances = numInstances;
+    packet.worldMin = worldMin;
+    packet.worldMax = worldMax;
+    glm::vec3 worldCenter = (worldMin + worldMax) * 0.5f;
+    float cameraDepth = GetSortDepth(gCamera.GetViewMatrix(), worldCenter, m_farPlane);
+    // A model's materials can use several layers, the first one is close enough for sorting
+    int textureLayer = (int)m_materialTable.GetMaterials()[materialBase].diffuseTextureLayer;
+    bool isTextured = false;
+    for (int i = materialBase; i < materialBase + numMaterials; i++)  {
+        isTextured |= m_materialTable.GetMaterials()[i].diffuseTextureLayer >= 0.0f;
+    }
 
-    // Update the View Matrix
-    GLint u_ViewMatrixLocation = glGetUniformLocation(graphicsPipeline,"u_ViewMatrix");
-    if(u_ViewMatrixLocation>=0){
-        glUniformMatrix4fv(u_ViewMatrixLocation,1,GL_FALSE,&viewMatrix[0][0]);
-    }else{
-        std::cout << "Could not find u_ViewMatrix, maybe a mispelling?\n";
-        exit(EXIT_FAILURE);
+    // The shadow program ignores materials, so only depth orders it. Cascades the mesh does not reach never draw it.
+    packet.program = &m_graphicsPipelineShadows;
+    if (passes & QUEUED_PASSES_MAIN_SHADOW)  {
+        packet.sortKey = RenderQueue::MakeSortKey(packet.program->GetID(), 0, 0,
+                                                  GetSortDepth(shadowCaster.GetViewMatrix(), worldCenter, shadowCaster.GetFarPlane()));
+        packet.viewMask = shadowCaster.GetCascadeMask(worldMin, worldMax);
+        if (packet.viewMask != 0)   {
+            m_renderQueue.Add(isStaticShadowCaster ? RENDER_PASS_SHADOW_STATIC : RENDER_PASS_SHADOW_DYNAMIC, packet);
+        }
+        packet.viewMask = ~0u;
     }
 
-    // Retrieve our location of our perspective matrix uniform 
-    GLint u_ProjectionLocation= glGetUniformLocation(graphicsPipeline,"u_Projection");
-    if(u_ProjectionLocation>=0){
-        glUniformMatrix4fv(u_ProjectionLocation,1,GL_FALSE,&projectionMatrix[0][0]);
-    }else{
-        std::cout << "Could not find u_Projection, maybe a mispelling?\n";
-        exit(EXIT_FAILURE);
+    // Every caster goes into the atlas pass, each face culls it by its world box
+    if (passes & QUEUED_PASSES_SHADOW_ATLAS)  {
+        m_renderQueue.Add(RENDER_PASS_SHADOW_ATLAS, packet);
+        if (!isStaticShadowCaster)  {
+            m_shadowAtlas.InvalidateBox(worldMin, worldMax);
+        }
     }
-}
 
-void GraphicsProgram::SetLightingUniforms(int graphicsPipeline, std::array<u_int8_t, 3> colorOfShadowDots, int numDotsHorizontally) {
-    GLint positionLoc = glGetUniformLocation(graphicsPipeline, "u_Light.worldPosition");
-    glUniform3fv(positionLoc, 1, m_lights[0].GetPositionForUniform());
-    GLint ambientColorLoc = glGetUniformLocation(graphicsPipeline, "u_Light.ambientColor");
-    glUniform3fv(ambientColorLoc, 1, m_lights[0].GetAmbientColorForUniform());
-    GLint ambientStrengthLoc = glGetUniformLocation(graphicsPipeline, "u_Light.ambientStrength");
-    glUniform1f(ambientStrengthLoc, m_lights[0].GetAmbientStrengthForUniform());
-    GLint diffuseColorLoc = glGetUniformLocation(graphicsPipeline, "u_Light.diffuseColor");
-    glUniform3fv(diffuseColorLoc, 1, m_lights[0].GetDiffuseColorForUniform());
-    GLint specularColorLoc = glGetUniformLocation(graphicsPipeline, "u_Light.specularColor");
-    glUniform3fv(specularColorLoc, 1, m_lights[0].GetSpecularColorForUniform());
-    GLint constantFallOffLoc = glGetUniformLocation(graphicsPipeline, "u_Light.constantFallOff");
-    glUniform1f(constantFallOffLoc, m_lights[0].GetConstantFallOffForUniform());
-    GLint linearFallOffLoc = glGetUniformLocation(graphicsPipeline, "u_Light.linearFallOff");
-    glUniform1f(linearFallOffLoc, m_lights[0].GetLinearFallOffForUniform());
-    GLint quadtraticFallOffLoc = glGetUniformLocation(graphicsPipeline, "u_Light.quadtraticFallOff");
-    glUniform1f(quadtraticFallOffLoc, m_lights[0].GetQuadtraticFallOffForUniform());
+    // Decided before the depth pre-pass, which objects hidden last frame stay out of
+    bool isPredictedVisible = true;
+    GLuint occlusionQuery = 0;
+    if (m_occlusionQueryMode != OCCLUSION_QUERIES_OFF && occlusionObject >= 0 && (passes & QUEUED_PASSES_CAMERA))  {
+        // The near plane clips a box the camera is in, its proxy could pass nothing while the object fills the screen
+        glm::vec3 eyePosition(gCamera.GetEyeXPosition(), gCamera.GetEyeYPosition(), gCamera.GetEyeZPosition());
+        glm::vec3 nearMargin = glm::vec3(2.0f * m_nearPlane);
+        bool isEyeInside = glm::all(glm::greaterThanEqual(eyePosition, worldMin - nearMargin)) &&
+                           glm::all(glm::lessThanEqual(eyePosition, worldMax + nearMargin));
+        if (!isEyeInside)   {
+            isPredictedVisible = m_occlusionQueries.IsPredictedVisible(occlusionObject);
+            bool isDrawn = isPredictedVisible || m_occlusionQueryMode == OCCLUSION_QUERIES_CONDITIONAL;
+            occlusionQuery = m_occlusionQueries.IssueQuery(occlusionObject, isPredictedVisible, isDrawn);
+        }
+        if (occlusionQuery != 0)    {
+            // The light gizmo's cube spans -0.3 to 0.3, stretched over the box. The scale goes after the translation, see GetModelMatrix.
+            glm::vec3 proxyScale = glm::max((worldMax - worldMin) / 0.6f, glm::vec3(1e-4f));
+            InstanceData proxyInstance;
+            proxyInstance.modelMatrix = GetModelMatrix(worldCenter / proxyScale, proxyScale);
+            DrawPacket proxyPacket;
+            proxyPacket.program = &m_graphicsPipelineShadows;
+            proxyPacket.vertexArray = m_vertexArrayObjectLights;
+            proxyPacket.numVertices = m_numVerticesToDrawLights;
+            proxyPacket.firstInstance = m_instanceBuffer.Add(proxyInstance);
+            proxyPacket.worldMin = worldMin;
+            proxyPacket.worldMax = worldMax;
+            proxyPacket.occlusionQuery = occlusionQuery;
+            proxyPacket.sortKey = RenderQueue::MakeSortKey(proxyPacket.program->GetID(), 0, 0, cameraDepth);
+            m_renderQueue.Add(RENDER_PASS_OCCLUSION_PROXY, proxyPacket);
+        }
+        // Only the camera's passes, the shadows still need the object
+        if (!isPredictedVisible && m_occlusionQueryMode == OCCLUSION_QUERIES_READBACK)  {
+            passes &= ~QUEUED_PASSES_CAMERA;
+        }
+    }
+
+    if (m_isDepthPrepassEnabled && (passes & QUEUED_PASSES_CAMERA) && isPredictedVisible)   {
+        // Same position only program, from the camera this time, front to back
+        packet.sortKey = RenderQueue::MakeSortKey(packet.program->GetID(), 0, 0, cameraDepth);
+        m_renderQueue.Add(RENDER_PASS_DEPTH, packet);
+    }
 
-    GLint cameraWorldPositionLoc = glGetUniformLocation(graphicsPipeline, "u_CameraWorldPosition");
-    glUniform3f(cameraWorldPositionLoc, gCamera.GetEyeXPosition(), gCamera.GetEyeYPosition(), gCamera.GetEyeZPosition());
+    // One draw for the whole cube map, u_ViewMask tells the geometry shader which faces the mesh reaches
+    if (passes & QUEUED_PASSES_MAIN_SHADOW)  {
+        packet.program = &m_graphicsPipelineCubeShadows;
+        packet.sortKey = RenderQueue::MakeSortKey(packet.program->GetID(), 0, 0,
+                                                  glm::distance(worldCenter, pointShadow.GetPosition()) / pointShadow.GetFarPlane());
+        packet.viewMask = pointShadow.GetFaceMask(worldMin, worldMax);
+        if (packet.viewMask != 0)   {
+            m_renderQueue.Add(RENDER_PASS_SHADOW_CUBE, packet);
+        }
+        packet.viewMask = ~0u;
+    }
 
-    GLint dotColorLoc = glGetUniformLocation(graphicsPipeline, "u_dotColor");
-    glUniform3f(dotColorLoc, colorOfShadowDots[0] / 255.0f, colorOfShadowDots[1] / 255.0f, colorOfShadowDots[2] / 255.0f);
+    if (!(passes & QUEUED_PASSES_CAMERA))  {
+        return;
+    }
+    packet.program = isTextured ? &m_graphicsPipelineLit : &m_graphicsPipelineLitUntextured;
+    packet.sortKey = RenderQueue::MakeSortKey(packet.program->GetID(), materialBase, textureLayer, cameraDepth);
+    packet.stencilRef = outlineExtrudeDistance > 0.0f && !m_isScreenSpaceOutline ? 1 : -1;
+    if (isPredictedVisible) {
+        m_renderQueue.Add(RENDER_PASS_OPAQUE, packet);
+    } else {
+        // Drawn on this frame's query, its outline too. Without one in flight (the last is not back yet) it is just drawn.
+        packet.conditionQuery = occlusionQuery;
+        m_renderQueue.Add(RENDER_PASS_OPAQUE_OCCLUDED, packet);
+    }
 
-    GLint numDotsHorizontallyLoc = glGetUniformLocation(graphicsPipeline, "u_numDotsHorizontally");
-    glUniform1i(numDotsHorizontallyLoc, numDotsHorizontally);
+    if (outlineExtrudeDistance > 0.0f && !m_isScreenSpaceOutline)  {
+        packet.program = &m_graphicsPipelineOutline;
+        packet.sortKey = RenderQueue::MakeSortKey(packet.program->GetID(), 0, 0, cameraDepth);
+        packet.outlineExtrudeDistance = outlineExtrudeDistance;
+        packet.stencilRef = -1;
+        m_renderQueue.Add(RENDER_PASS_OUTLINE, packet);
+    }
 }
 
-// Note: Not used in halftoon shader
-void GraphicsProgram::SetTextureUniforms(int graphicsPipeline)  {
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_textureID);
-    GLint sampler = glGetUniformLocation(graphicsPipeline, "u_TextureSampler");
-    glUniform1i(sampler, 0);
+void GraphicsProgram::QueueLightGizmos()  {
+    InstanceData instance;
+    instance.modelMatrix = GetModelMatrix(m_lights[0].GetPosition(), glm::vec3(1.0f));
+    instance.color = glm::vec4(m_lights[0].GetDiffuseColor(), 1.0f);
+    int firstInstance = m_instanceBuffer.Add(instance);
+    glm::vec3 worldMin = m_lights[0].GetPosition();
+    glm::vec3 worldMax = m_lights[0].GetPosition();
+    if (m_isClusteredLightingEnabled)   {
+        // A quarter of the main light's size
+        const float clusteredLightScale = 0.25f;
+        for (const PointLight& light : m_clusteredLights)  {
+            instance.modelMatrix = GetModelMatrix(light.GetPosition() / clusteredLightScale, glm::vec3(clusteredLightScale));
+            instance.color = glm::vec4(light.GetDiffuseColor(), 1.0f);
+            m_instanceBuffer.Add(instance);
+            worldMin = glm::min(worldMin, light.GetPosition());
+            worldMax = glm::max(worldMax, light.GetPosition());
+        }
+    }
+
+    // Every gizmo in one draw, with the depth test the order between them does not matter
+    DrawPacket lightPacket;
+    lightPacket.program = &m_graphicsPipelineLights;
+    lightPacket.vertexArray = m_vertexArrayObjectLights;
+    lightPacket.numVertices = m_numVerticesToDrawLights;
+    lightPacket.firstInstance = firstInstance;
+    lightPacket.numInstances = m_instanceBuffer.GetNumInstances() - firstInstance;
+    lightPacket.worldMin = worldMin;
+    lightPacket.worldMax = worldMax;
+    lightPacket.sortKey = RenderQueue::MakeSortKey(m_graphicsPipelineLights.GetID(), 0, 0,
+                                                   GetSortDepth(gCamera.GetViewMatrix(), m_lights[0].GetPosition(), m_farPlane));
+    m_renderQueue.Add(RENDER_PASS_LIGHTS, lightPacket);
 }
 
-void GraphicsProgram::SetShadowUniforms(int graphicsPipeline, ShadowDirectionalLight shadowCaster)  {
-    glActiveTexture(shadowCaster.GetTexUnit());
-    GLint u_ShadowLightSpaceMatrixLoc = glGetUniformLocation(graphicsPipeline,"u_ShadowLightSpaceMatrix");
-    if(u_ShadowLightSpaceMatrixLoc >=0){
-        glUniformMatrix4fv(u_ShadowLightSpaceMatrixLoc,1,GL_FALSE,&(shadowCaster.GetWorldToLightSpaceTransform()[0][0]));
-    }else{
-        std::cout << "Could not find u_ShadowLightSpaceMatrix, maybe a mispelling?\n";
-        exit(EXIT_FAILURE);
+void GraphicsProgram::BuildModelCrowd()  {
+    m_crowdInstances.clear();
+    m_crowdChunks.clear();
+    m_crowdCuller.Clear();
+    // A square grid centered on the scene, a little wider apart than the model's bounding sphere
+    int side = (int)std::ceil(std::sqrt((float)m_numCrowdInstances));
+    float spacing = 2.2f * m_modelBoundingRadius * m_crowdScale;
+    glm::vec3 corner = glm::vec3(-0.5f * (side - 1) * spacing, 0.0f, -0.5f * (side - 1) * spacing);
+    glm::vec3 modelScale = glm::vec3(m_crowdScale);
+    InstanceData instance;
+    instance.materialBase = m_modelMaterialBase;
+    // Chunk by chunk, so each chunk's instances are next to each other in the buffer and in the world
+    for (int chunkZ = 0; chunkZ < side; chunkZ += m_crowdChunkSide)  {
+        for (int chunkX = 0; chunkX < side; chunkX += m_crowdChunkSide)  {
+            CrowdChunk chunk;
+            chunk.firstInstance = m_crowdInstances.size();
+            chunk.worldMin = glm::vec3(std::numeric_limits<float>::max());
+            chunk.worldMax = glm::vec3(-std::numeric_limits<float>::max());
+            for (int z = chunkZ; z < std::min(chunkZ + m_crowdChunkSide, side); z++)  {
+                for (int x = chunkX; x < std::min(chunkX + m_crowdChunkSide, side); x++)  {
+                    if ((int)m_crowdInstances.size() >= m_numCrowdInstances)  {
+                        break;
+                    }
+                    glm::vec3 worldCenter = corner + glm::vec3(x * spacing, 0.0f, z * spacing);
+                    instance.modelMatrix = GetModelMatrix(worldCenter / modelScale, modelScale);
+                    m_crowdInstances.push_back(instance);
+                    glm::vec3 worldMin = worldCenter + m_modelBoundsMin * m_crowdScale;
+                    glm::vec3 worldMax = worldCenter + m_modelBoundsMax * m_crowdScale;
+                    m_crowdCuller.Add(worldMin, worldMax, worldCenter + m_modelSphereCenter * m_crowdScale, m_modelSphereRadius * m_crowdScale);
+                    chunk.worldMin = glm::min(chunk.worldMin, worldMin);
+                    chunk.worldMax = glm::max(chunk.worldMax, worldMax);
+                }
+            }
+            chunk.numInstances = m_crowdInstances.size() - chunk.firstInstance;
+            if (chunk.numInstances > 0)  {
+                m_crowdChunks.push_back(chunk);
+            }
+        }
     }
+}
 
-    // Something about this block is causing the objects to not render
-    
-    GLint depthMapLoc = glGetUniformLocation(graphicsPipeline, "u_DepthMap");
-    if (depthMapLoc >=0)    {
-        glUniform1i(depthMapLoc, 1); // TODO: Change this to shadowCaster.getTexUnit - GL_TEXTURE0
+void GraphicsProgram::UpdateCullingFrusta(const glm::mat4& viewProjection, ShadowDirectionalLight& shadowCaster,
+                                          const ShadowPointLight& pointShadow)  {
+    m_cameraFrustum = Frustum::FromMatrix(viewProjection);
+    m_shadowFrusta.clear();
+    if (m_isPointShadowEnabled)    {
+        for (int face = 0; face < ShadowPointLight::kNumFaces; face++)  {
+            m_shadowFrusta.push_back(Frustum::FromMatrix(pointShadow.GetFaceMatrix(face)));
+        }
     } else {
-        std::cout << "Could not find u_DepthMap uniform, maybe a mispelling\n";
-        exit(EXIT_FAILURE);
+        // Casters in front of a cascade's near plane still shadow it, see GetCascadeMask
+        for (int cascade = 0; cascade < shadowCaster.GetNumCascades(); cascade++)   {
+            m_shadowFrusta.push_back(Frustum::FromMatrix(shadowCaster.GetCascadeProjectionMatrix(cascade) * shadowCaster.GetCascadeViewMatrix(),
+                                                         false));
+        }
     }
-    
 }
 
-void GraphicsProgram::SetOutlineUniforms(int graphicsPipeline, float outlineExtrudeDistance) {
-    GLint outlineExtrudeDistanceLoc = glGetUniformLocation(graphicsPipeline, "u_OutlineExtrudeDistance");
-    glUniform1f(outlineExtrudeDistanceLoc, outlineExtrudeDistance);
+void GraphicsProgram::CullModelCrowd()  {
+    m_crowdCameraVisible.assign(m_crowdInstances.size(), 1);
+    m_crowdShadowVisible.assign(m_crowdInstances.size(), 1);
+    if (!m_isFrustumCullingEnabled)  {
+        return;
+    }
+    m_crowdCuller.Cull(&m_cameraFrustum, 1);
+    const FrustumCuller::Stats& stats = m_crowdCuller.GetStats();
+    m_cameraCullMilliseconds += stats.cullMilliseconds;
+    m_numCameraVisibleInstances += stats.numVisible;
+    for (size_t i = 0; i < m_crowdInstances.size(); i++)  {
+        m_crowdCameraVisible[i] = m_crowdCuller.IsVisible(i);
+    }
+    m_crowdCuller.Cull(m_shadowFrusta.data(), m_shadowFrusta.size());
+    m_shadowCullMilliseconds += stats.cullMilliseconds;
+    m_numShadowVisibleInstances += stats.numVisible;
+    for (size_t i = 0; i < m_crowdInstances.size(); i++)  {
+        m_crowdShadowVisible[i] = m_crowdCuller.IsVisible(i);
+    }
+
+    m_numCullSamples++;
+    if (m_numCullSamples >= m_benchmarkFrames)   {
+        // Per 100k objects, so runs with other crowd sizes compare
+        double per100k = 100000.0 / std::max(stats.numObjects, 1);
+        std::cout << "Frustum culling: " << stats.numObjects << " crowd instances, " << m_numCameraVisibleInstances / m_numCullSamples
+                  << " visible to the camera in " << m_cameraCullMilliseconds / m_numCullSamples << " ms and "
+                  << m_numShadowVisibleInstances / m_numCullSamples << " to the main light's " << stats.numFrusta << " views in "
+                  << m_shadowCullMilliseconds / m_numCullSamples << " ms (" << m_cameraCullMilliseconds / m_numCullSamples * per100k
+                  << " and " << m_shadowCullMilliseconds / m_numCullSamples * per100k << " ms per 100k objects), "
+                  << (stats.isAVX2 ? "AVX2" : "SSE") << " on " << stats.numThreads << " threads, over "
+                  << m_numCullSamples << " frames" << std::endl;
+        m_numCullSamples = 0;
+        m_cameraCullMilliseconds = 0.0;
+        m_shadowCullMilliseconds = 0.0;
+        m_numCameraVisibleInstances = 0;
+        m_numShadowVisibleInstances = 0;
+    }
 }
 
-void GraphicsProgram::DrawLit(){
-    // Enable our attributes
-	glBindVertexArray(m_vertexArrayObject);
-    
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_elementBufferObject);
-    //std::cout << "Number of vertices to draw: " << m_numVerticesToDraw << std::endl;
-    //Render data
-    glDrawElements(GL_TRIANGLES, m_numVerticesToDraw, GL_UNSIGNED_INT, nullptr);
+void GraphicsProgram::AddCrowdOccluders()  {
+    // The instances nearest to the camera hide the most of the rest
+    glm::vec3 eyePosition(gCamera.GetEyeXPosition(), gCamera.GetEyeYPosition(), gCamera.GetEyeZPosition());
+    std::vector<std::pair<float, int>> candidates;
+    for (size_t i = 0; i < m_crowdInstances.size(); i++)  {
+        if (m_crowdCameraVisible[i])    {
+            candidates.emplace_back(glm::distance(eyePosition, glm::vec3(m_crowdInstances[i].modelMatrix[3])), i);
+        }
+    }
+    int numOccluders = std::min<int>(m_numCrowdOccluders, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + numOccluders, candidates.end());
+    for (int i = 0; i < numOccluders; i++)  {
+        m_occlusionCuller.AddOccluder(m_modelOccluderPositions, m_modelOccluderIndices, m_crowdInstances[candidates[i].second].modelMatrix);
+    }
+}
+
+void GraphicsProgram::QueueModelCrowd(ShadowDirectionalLight& shadowCaster, const ShadowPointLight& pointShadow)  {
+    if (!m_isFrustumCullingEnabled && !m_isOcclusionCullingEnabled)  {
+        // Same reasoning as the model, a chunk is one instanced draw per pass and culled by its box
+        // Chunk c is object 1 + c for the occlusion queries, the model is 0
+        for (size_t c = 0; c < m_crowdChunks.size(); c++)   {
+            const CrowdChunk& chunk = m_crowdChunks[c];
+            int firstInstance = m_instanceBuffer.Add(&m_crowdInstances[chunk.firstInstance], chunk.numInstances);
+            QueueInstances(m_vertexArrayObject, m_numVerticesToDraw, true, firstInstance, chunk.numInstances, chunk.worldMin,
+                           chunk.worldMax, m_modelMaterialBase, m_modelNumMaterials, 0.0f, false, shadowCaster, pointShadow,
+                           QUEUED_PASSES_ALL, 1 + c);
+        }
+        return;
+    }
 
-	// Stop using our current graphics pipeline
-	// Note: This is not necessary if we only have one graphics pipeline.
-    glUseProgram(0);
+    if (m_isOcclusionCullingEnabled)    {
+        // Only what the camera sees can be hidden from it, the shadows still need the instances behind
+        std::vector<int> occludees;
+        std::vector<glm::vec3> worldMins, worldMaxs;
+        for (size_t i = 0; i < m_crowdInstances.size(); i++)  {
+            if (m_crowdCameraVisible[i])    {
+                glm::vec3 worldCenter = glm::vec3(m_crowdInstances[i].modelMatrix[3]);
+                occludees.push_back(i);
+                worldMins.push_back(worldCenter + m_modelBoundsMin * m_crowdScale);
+                worldMaxs.push_back(worldCenter + m_modelBoundsMax * m_crowdScale);
+            }
+        }
+        std::vector<uint8_t> isVisible;
+        m_occlusionCuller.TestBoxes(worldMins, worldMaxs, isVisible);
+        for (size_t o = 0; o < occludees.size(); o++)  {
+            m_crowdCameraVisible[occludees[o]] = isVisible[o];
+        }
+    }
+
+    // Still a draw per chunk and pass, of only the chunk's instances the pass's views can see
+    std::vector<glm::ivec2> cameraInstances = AddVisibleCrowdInstances(m_crowdCameraVisible);
+    std::vector<glm::ivec2> shadowInstances = AddVisibleCrowdInstances(m_crowdShadowVisible);
+    for (size_t c = 0; c < m_crowdChunks.size(); c++)   {
+        const CrowdChunk& chunk = m_crowdChunks[c];
+        if (cameraInstances[c].y > 0)   {
+            QueueInstances(m_vertexArrayObject, m_numVerticesToDraw, true, cameraInstances[c].x, cameraInstances[c].y, chunk.worldMin,
+                           chunk.worldMax, m_modelMaterialBase, m_modelNumMaterials, 0.0f, false, shadowCaster, pointShadow,
+                           QUEUED_PASSES_CAMERA, 1 + c);
+        }
+        if (shadowInstances[c].y > 0)   {
+            QueueInstances(m_vertexArrayObject, m_numVerticesToDraw, true, shadowInstances[c].x, shadowInstances[c].y, chunk.worldMin,
+                           chunk.worldMax, m_modelMaterialBase, m_modelNumMaterials, 0.0f, false, shadowCaster, pointShadow,
+                           QUEUED_PASSES_MAIN_SHADOW);
+        }
+        // The atlas faces look in every direction from lights all around the scene, they keep culling whole chunks
+        if (m_isClusteredLightingEnabled)   {
+            int firstInstance = m_instanceBuffer.Add(&m_crowdInstances[chunk.firstInstance], chunk.numInstances);
+            QueueInstances(m_vertexArrayObject, m_numVerticesToDraw, true, firstInstance, chunk.numInstances, chunk.worldMin,
+                           chunk.worldMax, m_modelMaterialBase, m_modelNumMaterials, 0.0f, false, shadowCaster, pointShadow,
+                           QUEUED_PASSES_SHADOW_ATLAS);
+        }
+    }
 }
 
-void GraphicsProgram::DrawLights()  {
-    // Enable our attributes
-	glBindVertexArray(m_vertexArrayObjectLights);
-    
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_elementBufferObjectLights);
-    //std::cout << "Number of vertices to draw: " << m_numVerticesToDraw << std::endl;
-    //Render data
-    glDrawElements(GL_TRIANGLES, m_numVerticesToDrawLights, GL_UNSIGNED_INT, nullptr);
+std::vector<glm::ivec2> GraphicsProgram::AddVisibleCrowdInstances(const std::vector<uint8_t>& isVisible)  {
+    std::vector<glm::ivec2> chunkInstances(m_crowdChunks.size());
+    for (size_t c = 0; c < m_crowdChunks.size(); c++)   {
+        const CrowdChunk& chunk = m_crowdChunks[c];
+        chunkInstances[c].x = m_instanceBuffer.GetNumInstances();
+        for (int i = chunk.firstInstance; i < chunk.firstInstance + chunk.numInstances; i++)  {
+            if (isVisible[i])  {
+                m_instanceBuffer.Add(m_crowdInstances[i]);
+            }
+        }
+        chunkInstances[c].y = m_instanceBuffer.GetNumInstances() - chunkInstances[c].x;
+    }
+    return chunkInstances;
+}
+
+void GraphicsProgram::ReportOcclusionCulling()  {
+    const OcclusionCuller::Stats& stats = m_occlusionCuller.GetStats();
+    m_numOcclusionSamples++;
+    m_occlusionRasterizeMilliseconds += stats.rasterizeMilliseconds;
+    m_occlusionTestMilliseconds += stats.testMilliseconds;
+    m_numOcclusionTested += stats.numTested;
+    m_numOccluded += stats.numOccluded;
+    if (m_numOcclusionSamples >= m_benchmarkFrames)   {
+        std::cout << "Occlusion culling: " << stats.numOccluders << " occluders of " << stats.numOccluderTriangles
+                  << " triangles rasterized in " << m_occlusionRasterizeMilliseconds / m_numOcclusionSamples << " ms on "
+                  << stats.numThreads << " threads, " << m_numOccluded / m_numOcclusionSamples << " of "
+                  << m_numOcclusionTested / m_numOcclusionSamples << " objects in view occluded, tested in "
+                  << m_occlusionTestMilliseconds / m_numOcclusionSamples << " ms, over " << m_numOcclusionSamples << " frames" << std::endl;
+        m_numOcclusionSamples = 0;
+        m_occlusionRasterizeMilliseconds = 0.0;
+        m_occlusionTestMilliseconds = 0.0;
+        m_numOcclusionTested = 0;
+        m_numOccluded = 0;
+    }
+}
 
-	// Stop using our current graphics pipeline
-	// Note: This is not necessary if we only have one graphics pipeline.
-    glUseProgram(0);
+void GraphicsProgram::ReportOcclusionQueries()  {
+    const OcclusionQueries::Stats& stats = m_occlusionQueries.GetStats();
+    m_numOcclusionQuerySamples++;
+    m_numQueriesIssued += stats.numIssued;
+    m_numQueriesPredictedHidden += stats.numPredictedHidden;
+    m_numQueriesPending += stats.numResultsPending;
+    m_numQueryFalseNegatives += stats.numFalseNegatives;
+    m_numQueryPops += stats.numPops;
+    if (m_numOcclusionQuerySamples >= m_benchmarkFrames)   {
+        // Pops are objects that came into view a frame or more before they were drawn, only skipping them makes any
+        std::cout << "Occlusion queries (" << GetOcclusionQueryModeName() << "): " << m_numQueriesIssued / m_numOcclusionQuerySamples
+                  << " issued per frame, " << m_numQueriesPredictedHidden / m_numOcclusionQuerySamples << " objects predicted hidden, "
+                  << m_numQueriesPending / m_numOcclusionQuerySamples << " results not back after a frame, "
+                  << m_numQueryFalseNegatives << " false negatives and " << m_numQueryPops << " pops over "
+                  << m_numOcclusionQuerySamples << " frames, " << stats.numPooledQueries << " pooled queries" << std::endl;
+        m_numOcclusionQuerySamples = 0;
+        m_numQueriesIssued = 0;
+        m_numQueriesPredictedHidden = 0;
+        m_numQueriesPending = 0;
+        m_numQueryFalseNegatives = 0;
+        m_numQueryPops = 0;
+    }
+}
+
+const char* GraphicsProgram::GetOcclusionQueryModeName() const  {
+    switch (m_occlusionQueryMode)   {
+        case OCCLUSION_QUERIES_CONDITIONAL: return "conditional render";
+        case OCCLUSION_QUERIES_READBACK: return "frame late readback";
+        default: return "off";
+    }
+}
+
+void GraphicsProgram::PushFrameData(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
+    FrameData frameData;
+    frameData.viewMatrix = viewMatrix;
+    frameData.projection = projectionMatrix;
+    frameData.cameraWorldPos[0] = gCamera.GetEyeXPosition();
+    frameData.cameraWorldPos[1] = gCamera.GetEyeYPosition();
+    frameData.cameraWorldPos[2] = gCamera.GetEyeZPosition();
+    frameData.cameraWorldPos[3] = 1.0f;
+    m_uniformRing.Push(UNIFORM_BLOCK_FRAME_DATA, &frameData, sizeof(FrameData));
+}
+
+void GraphicsProgram::PushLightData()   {
+    LightData lightData = m_lights[0].GetUniformBlockData();
+    m_uniformRing.Push(UNIFORM_BLOCK_LIGHT_DATA, &lightData, sizeof(LightData));
+}
+
+void GraphicsProgram::BindShadowMap(ShadowDirectionalLight& shadowCaster, const ShadowPointLight& pointShadow)  {
+    // u_DepthMap and u_PointShadowMap are set once in SetUpProgram, the cascade matrices, splits and PCF kernel are in ShadowData
+    GLStateTracker& state = GLStateTracker::Get();
+    state.BindTextureToUnit(shadowCaster.GetTexUnit() - GL_TEXTURE0, GL_TEXTURE_2D_ARRAY, shadowCaster.GetDepthMapTexture());
+    state.BindTextureToUnit(pointShadow.GetTexUnit() - GL_TEXTURE0, GL_TEXTURE_CUBE_MAP, pointShadow.GetDepthMapTexture());
+    ShadowData shadowData = shadowCaster.GetShadowData();
+    m_shadowFilter.FillShadowData(shadowData, shadowCaster.GetCascadeResolution());
+    if (m_isPointShadowEnabled)    {
+        pointShadow.FillShadowData(shadowData, m_shadowFilter.GetPresetSettings().radiusTexels);
+        shadowData.numCascades = 0; // The cascades debug view shows no cascade
+    }
+    m_uniformRing.Push(UNIFORM_BLOCK_SHADOW_DATA, &shadowData, sizeof(ShadowData));
+}
+
+void GraphicsProgram::DrawPointShadow(ShadowPointLight& pointShadow)  {
+    m_pointShadowTimer.Begin();
+    pointShadow.BeginShadowPass(m_shadowFilter.GetPresetSettings().radiusTexels);
+    // The faces' matrices take the place of FrameData, the geometry shader projects into all six
+    GLStateTracker::Get().UseProgram(m_graphicsPipelineCubeShadows.GetID());
+    for (int face = 0; face < ShadowPointLight::kNumFaces; face++)  {
+        m_graphicsPipelineCubeShadows.SetUniform("u_CubeFaceMatrices[" + std::to_string(face) + "]", pointShadow.GetFaceMatrix(face));
+    }
+    m_renderQueue.Execute(RENDER_PASS_SHADOW_CUBE);
+    pointShadow.EndShadowPass();
+    m_pointShadowTimer.End();
+
+    m_numPointShadowCasters += m_renderQueue.GetNumPackets(RENDER_PASS_SHADOW_CUBE);
+    for (int face = 0; face < ShadowPointLight::kNumFaces; face++)  {
+        m_numPointShadowFaceDraws += m_renderQueue.GetNumPackets(RENDER_PASS_SHADOW_CUBE, 1u << face);
+    }
+    if (m_pointShadowTimer.GetNumSamples() >= m_benchmarkFrames)   {
+        int numFrames = m_pointShadowTimer.GetNumSamples();
+        std::cout << "Point light shadow: " << m_pointShadowTimer.GetAverage() / 1.0e6 << " ms on the GPU, "
+                  << m_numPointShadowCasters / numFrames << " casters in one draw each, sent to "
+                  << m_numPointShadowFaceDraws / numFrames << " of " << m_numPointShadowCasters * ShadowPointLight::kNumFaces / numFrames
+                  << " faces after CPU culling, over " << numFrames << " frames" << std::endl;
+        m_pointShadowTimer.Reset();
+        m_numPointShadowCasters = 0;
+        m_numPointShadowFaceDraws = 0;
+    }
+}
+
+const std::vector<PointLight>& GraphicsProgram::GetClusteredLights() const  {
+    // Turned off, every cluster is empty and the lit pass only has the main light
+    static const std::vector<PointLight> noLights;
+    return m_isClusteredLightingEnabled ? m_clusteredLights : noLights;
+}
+
+void GraphicsProgram::UpdateLightClusters(const glm::mat4& viewMatrix)  {
+    m_lightClusters.AssignLights(GetClusteredLights(), viewMatrix,
+                                 glm::radians(m_fieldOfViewDegrees), (float)gScreenWidth/(float)gScreenHeight,
+                                 m_nearPlane, m_farPlane, m_clusteredLightCutoff);
+    m_lightClusters.Upload();
+    ClusterData clusterData = m_lightClusters.GetClusterData(gScreenWidth, gScreenHeight);
+    m_uniformRing.Push(UNIFORM_BLOCK_CLUSTER_DATA, &clusterData, sizeof(ClusterData));
+
+    const LightClusters::Stats& stats = m_lightClusters.GetStats();
+    m_numClusterSamples++;
+    m_clusterAssignMilliseconds += stats.assignMilliseconds;
+    m_numClusterLightIndices += stats.numLightIndices;
+    m_maxLightsPerCluster = std::max(m_maxLightsPerCluster, stats.maxLightsPerCluster);
+    if (m_numClusterSamples >= m_benchmarkFrames)   {
+        std::cout << "Light clusters: " << stats.numLights << " lights assigned in " << m_clusterAssignMilliseconds / m_numClusterSamples
+                  << " ms on " << stats.numThreads << " threads, " << m_numClusterLightIndices / m_numClusterSamples
+                  << " light indices, at most " << m_maxLightsPerCluster << " lights in a cluster, over "
+                  << m_numClusterSamples << " frames" << std::endl;
+        m_numClusterSamples = 0;
+        m_clusterAssignMilliseconds = 0.0;
+        m_numClusterLightIndices = 0;
+        m_maxLightsPerCluster = 0;
+    }
+}
+
+void GraphicsProgram::DrawShadowAtlas()   {
+    m_shadowAtlasTimer.Begin();
+    m_shadowAtlas.BeginShadowPass();
+    for (const ShadowAtlasFace& face : m_shadowAtlas.GetFacesToDraw())   {
+        m_shadowAtlas.BeginFace(face);
+        PushFrameData(face.viewMatrix, face.projectionMatrix);
+        m_renderQueue.ExecuteCulled(RENDER_PASS_SHADOW_ATLAS, [&face](glm::vec3 worldMin, glm::vec3 worldMax) {
+            return ShadowAtlas::IsBoxInFace(face.lightPosition, face.range, face.face, worldMin, worldMax);
+        });
+    }
+    m_shadowAtlas.EndShadowPass();
+    m_shadowAtlasTimer.End();
+    // Lights whose faces are all drawn now cast their shadows
+    m_shadowAtlas.Upload();
+
+    const ShadowAtlas::Stats& stats = m_shadowAtlas.GetStats();
+    m_shadowAtlasTotals.numShadowedLights += stats.numShadowedLights;
+    m_shadowAtlasTotals.numFacesDrawn += stats.numFacesDrawn;
+    m_shadowAtlasTotals.numFacesReused += stats.numFacesReused;
+    m_shadowAtlasTotals.numFacesWaiting += stats.numFacesWaiting;
+    if (m_shadowAtlasTimer.GetNumSamples() >= m_benchmarkFrames)   {
+        int numFrames = m_shadowAtlasTimer.GetNumSamples();
+        int resolution = m_shadowAtlas.GetSettings().resolution;
+        std::cout << "Shadow atlas: " << m_shadowAtlasTimer.GetAverage() / 1.0e6 << " ms on the GPU, "
+                  << m_shadowAtlasTotals.numShadowedLights / numFrames << " lights shadowed, "
+                  << m_shadowAtlasTotals.numFacesDrawn / numFrames << " faces drawn and "
+                  << m_shadowAtlasTotals.numFacesReused / numFrames << " reused per frame ("
+                  << m_shadowAtlasTotals.numFacesWaiting / numFrames << " waiting), "
+                  << 100.0 * stats.numAllocatedTexels / ((double)resolution * resolution) << "% of the atlas in tiles, over "
+                  << numFrames << " frames" << std::endl;
+        m_shadowAtlasTimer.Reset();
+        m_shadowAtlasTotals = ShadowAtlas::Stats();
+    }
+}
+
+void GraphicsProgram::ResetOpaquePassStats()  {
+    m_opaquePassTimer.Reset();
+    m_opaquePassFragments.Reset();
+    m_depthPrepassFragments.Reset();
+}
+
+void GraphicsProgram::DrawScreenSpaceOutline()  {
+    GLStateTracker& state = GLStateTracker::Get();
+    state.BindFramebuffer(GL_FRAMEBUFFER, 0);
+    // Every pixel is written, so the screen needs no clear and no depth test
+    state.Disable(GL_DEPTH_TEST);
+    state.PolygonMode(GL_FRONT_AND_BACK, GL_FILL); // Wireframe is for the scene, not the full-screen triangle
+    state.UseProgram(m_graphicsPipelineScreenOutline.GetID());
+    m_graphicsPipelineScreenOutline.SetUniform("u_OutlineColor", m_outlineColor);
+    m_graphicsPipelineScreenOutline.SetUniform("u_OutlineWidth", m_outlineWidthPixels);
+    state.BindVertexArray(m_vertexArrayObjectFullScreen);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
 }
 
 // TODO: epochTime needs milliseconds as well, right now only updating once a frame
@@ -547,6 +1213,86 @@ void GraphicsProgram::Input(){
         }
         std::cout << "Changed polygon mode" << std::endl;
     }
+    if (state[SDL_SCANCODE_V]) {
+        SDL_Delay(250);
+        // Compiled as a permutation, the halftone shader has no debug branches otherwise
+        m_debugView = (m_debugView + 1) % m_numDebugViews;
+        RequestLitPrograms();
+        std::cout << "Changed debug view to " << m_debugViewNames[m_debugView] << std::endl;
+    }
+    if (state[SDL_SCANCODE_H]) {
+        SDL_Delay(250);
+        // Compare the two in the opaque pass timings printed every few seconds
+        m_isDotTextureEnabled = !m_isDotTextureEnabled;
+        RequestLitPrograms();
+        std::cout << "Changed halftone dots to " << (m_isDotTextureEnabled ? "dot texture" : "analytic") << std::endl;
+    }
+    if (state[SDL_SCANCODE_P]) {
+        SDL_Delay(250);
+        m_isDepthPrepassEnabled = !m_isDepthPrepassEnabled;
+        ResetOpaquePassStats();
+        std::cout << "Changed depth pre-pass to " << (m_isDepthPrepassEnabled ? "on" : "off") << std::endl;
+    }
+    if (state[SDL_SCANCODE_O]) {
+        SDL_Delay(250);
+        m_isScreenSpaceOutline = !m_isScreenSpaceOutline;
+        std::cout << "Changed outlines to " << (m_isScreenSpaceOutline ? "screen space" : "stencil") << std::endl;
+    }
+    if (state[SDL_SCANCODE_F]) {
+        SDL_Delay(250);
+        // Only ShadowData changes, no program is rebuilt. Compare the presets in the opaque pass timings.
+        m_shadowFilter.SetPreset((m_shadowFilter.GetPreset() + 1) % ShadowFilter::kNumPresets);
+        ResetOpaquePassStats();
+        const ShadowFilterPreset& preset = m_shadowFilter.GetPresetSettings();
+        std::cout << "Changed shadow filtering to " << preset.name << " (" << preset.numTaps << " taps over "
+                  << preset.radiusTexels << " texels)" << std::endl;
+    }
+    if (state[SDL_SCANCODE_L]) {
+        SDL_Delay(250);
+        m_isClusteredLightingEnabled = !m_isClusteredLightingEnabled;
+        ResetOpaquePassStats();
+        std::cout << "Changed clustered lights to " << (m_isClusteredLightingEnabled ? "on" : "off") << std::endl;
+    }
+    if (state[SDL_SCANCODE_C]) {
+        SDL_Delay(250);
+        // Only ShadowData changes, no program is rebuilt
+        m_isPointShadowEnabled = !m_isPointShadowEnabled;
+        ResetOpaquePassStats();
+        std::cout << "Changed main light shadow to " << (m_isPointShadowEnabled ? "cube map" : "cascades") << std::endl;
+    }
+    if (state[SDL_SCANCODE_I]) {
+        SDL_Delay(250);
+        m_isModelCrowdEnabled = !m_isModelCrowdEnabled;
+        if (m_isModelCrowdEnabled)  {
+            BuildModelCrowd();
+        }
+        ResetOpaquePassStats();
+        std::cout << "Changed model crowd to " << (m_isModelCrowdEnabled ? "on" : "off") << ", " << m_crowdInstances.size()
+                  << " instances in " << m_crowdChunks.size() << " instanced draws per pass" << std::endl;
+    }
+    if (state[SDL_SCANCODE_K]) {
+        SDL_Delay(250);
+        m_isFrustumCullingEnabled = !m_isFrustumCullingEnabled;
+        ResetOpaquePassStats();
+        std::cout << "Changed frustum culling to " << (m_isFrustumCullingEnabled ? "on" : "off") << std::endl;
+    }
+    if (state[SDL_SCANCODE_J]) {
+        SDL_Delay(250);
+        m_isOcclusionCullingEnabled = !m_isOcclusionCullingEnabled;
+        ResetOpaquePassStats();
+        std::cout << "Changed occlusion culling to " << (m_isOcclusionCullingEnabled ? "on" : "off") << std::endl;
+    }
+    if (state[SDL_SCANCODE_G]) {
+        SDL_Delay(250);
+        m_occlusionQueryMode = (m_occlusionQueryMode + 1) % OCCLUSION_QUERIES_COUNT;
+        ResetOpaquePassStats();
+        std::cout << "Changed occlusion queries to " << GetOcclusionQueryModeName() << std::endl;
+    }
+    if (state[SDL_SCANCODE_LEFTBRACKET] || state[SDL_SCANCODE_RIGHTBRACKET]) {
+        SDL_Delay(250);
+        m_outlineWidthPixels = std::clamp(m_outlineWidthPixels + (state[SDL_SCANCODE_RIGHTBRACKET] ? 1 : -1), 1, 8);
+        std::cout << "Changed screen space outline width to " << m_outlineWidthPixels << " pixels" << std::endl;
+    }
 }
 
 
@@ -561,7 +1307,10 @@ void GraphicsProgram::MainLoop(){
 
     Plane plane(20.0f, {0, 200, 0});
     // Position is behind origin for now, in future can make this position equal to the position of the light to emulate shadow from light
-    ShadowDirectionalLight shadowCaster(GL_TEXTURE1, glm::vec3(0, 0.3, 1), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0), 0.1f, 30.0f);
+    ShadowDirectionalLight shadowCaster(GL_TEXTURE0 + m_shadowMapTextureUnit, glm::vec3(0, 0.3, 1), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0), 0.1f, 30.0f,
+                                        m_shadowCascadeSettings);
+    // Shadows the main light from where it really is, in every direction
+    ShadowPointLight pointShadow(GL_TEXTURE0 + m_pointShadowTextureUnit, m_pointShadowSettings);
 
     // Chalice
     glm::vec3 objFileTranslation = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -578,6 +1327,15 @@ void GraphicsProgram::MainLoop(){
     Plane plane1(2.0f, {255, 0, 0}); // Floating plane to test shadow
     glm::vec3 planeTranslation1 = glm::vec3(3.0f, 0.8f, 4.0f);
     glm::vec3 planeScale1 = glm::vec3(1.0f, 1.0f, 1.0f);
+    m_instanceBuffer.Attach(plane.GetVertexArrayObject());
+    m_instanceBuffer.Attach(plane1.GetVertexArrayObject());
+    std::vector<glm::vec3> planeOccluder = plane.GetTrianglePositions();
+    std::vector<glm::vec3> planeOccluder1 = plane1.GetTrianglePositions();
+
+    // The model's materials come from its MTL file, the planes are not loaded from a file so give them one here
+    int planeMaterial = m_materialTable.AddMaterial(Material::CreateHalftone({0, 200, 0}, {34, 139, 34}, 120));
+    int planeMaterial1 = m_materialTable.AddMaterial(Material::CreateHalftone({255, 0, 0}, {100, 0, 0}, 20));
+    UploadMaterialsAndTextures();
 
 	// While application is running
 	while(!gQuit){
@@ -585,82 +1343,265 @@ void GraphicsProgram::MainLoop(){
 
 		// Handle Input
 		Input();
+        // Edited files are rebuilt in the background, programs and the model swap in once they are done
+        ReloadChangedFiles();
+        UpdatePendingPrograms(false);
+        UpdatePendingModel();
+
+        // TEXTURE STREAMING, the model is the only textured object
+        m_textureStreamer.BeginFrame();
+        RequestTextureDetail(m_modelMaterialBase, m_modelNumMaterials, objFileTranslation,
+                             m_modelBoundingRadius * std::max(objFileScale.x, std::max(objFileScale.y, objFileScale.z)));
+        if (m_textureStreamer.Update())    {
+            m_materialTable.ApplyTextureResidency(m_textureStreamer);
+            m_materialTable.Upload();
+            TextureStreamer::Stats stats = m_textureStreamer.GetStats();
+            std::cout << "Texture streaming: base mip " << stats.baseLevel << ", " << stats.numLayersAtWantedDetail << "/"
+                      << stats.numLayers << " layers at wanted detail, " << stats.residentBytes / 1024 << "/"
+                      << stats.budgetBytes / 1024 << " KB, " << stats.numPendingRequests << " pending, "
+                      << stats.numUploadsLastFrame << " uploads (" << stats.uploadedBytesLastFrame / 1024 << " KB) this frame" << std::endl;
+        }
 
-        // SHADOW MAP PASS
-        shadowCaster.ActivateTexUnitAndBindFBO();
-        glClear(GL_DEPTH_BUFFER_BIT); // TODO: May not need this as already clear at end of loop, check this later
-        glViewport(0, 0, shadowCaster.GetShadowMapWidth(), shadowCaster.GetShadowMapHeight());
-        PreDraw(m_graphicsPipelineShadows, shadowCaster.GetViewMatrix(), shadowCaster.GetProjectionMatrix(), objFileTranslation, objFileScale);
-        DrawLit();
-        PreDraw(m_graphicsPipelineShadows, shadowCaster.GetViewMatrix(), shadowCaster.GetProjectionMatrix(), planeTranslation, planeScale);
-        plane.Draw();
-        PreDraw(m_graphicsPipelineShadows, shadowCaster.GetViewMatrix(), shadowCaster.GetProjectionMatrix(), planeTranslation1, planeScale1);
-        plane1.Draw();
-
-
-        // REAL RENDERING PASS
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT); // Clear buffer from shadow pass
-        glViewport(0, 0, gScreenWidth, gScreenHeight);
-        // Projection matrix (in perspective) 
-        glm::mat4 projectionMatrix = glm::perspective(glm::radians(45.0f),
-                                             (float)gScreenWidth/(float)gScreenHeight,
-                                             0.1f,
-                                             20.0f);
-        // DRAW LIGHT
+        // PER FRAME UNIFORM BLOCKS
+        // Lights move first so the shadow map and the lit pass agree on where the light is
+        m_uniformRing.BeginFrame();
         RotateLights();
-        PreDraw(m_graphicsPipelineLights, gCamera.GetViewMatrix(), projectionMatrix, m_lights[0].GetPosition());
-        DrawLights();
-
-        // DRAW MODEL
-		// Setup anything (i.e. OpenGL State) that needs to take
-		// place before draw calls
-		PreDraw(m_graphicsPipelineLit, gCamera.GetViewMatrix(), projectionMatrix, objFileTranslation, objFileScale);
         shadowCaster.SetEyePosition(glm::vec3(m_lights[0].GetPosition()));
-        SetShadowUniforms(m_graphicsPipelineLit, shadowCaster);
-
-        // Gold Chalice
-        SetLightingUniforms(m_graphicsPipelineLit, {204, 164, 0}, 75);
-        // Astronaut
-        // SetLightingUniforms(m_graphicsPipelineLit, {200, 200, 200}, 75);
+        pointShadow.SetPosition(m_lights[0].GetPosition());
+        PushLightData();
+
+        // Cascades split the camera's view and fit what they cover, the scene bounds keep them from covering empty space
+        glm::vec3 modelMin = m_modelBoundsMin;
+        glm::vec3 modelMax = m_modelBoundsMax;
+        glm::vec3 sceneMin = glm::min(objFileScale * (objFileTranslation + modelMin), objFileScale * (objFileTranslation + modelMax));
+        glm::vec3 sceneMax = glm::max(objFileScale * (objFileTranslation + modelMin), objFileScale * (objFileTranslation + modelMax));
+        sceneMin = glm::min(sceneMin, planeScale * (plane.GetMinCorner() + planeTranslation));
+        sceneMax = glm::max(sceneMax, planeScale * (plane.GetMaxCorner() + planeTranslation));
+        sceneMin = glm::min(sceneMin, planeScale1 * (plane1.GetMinCorner() + planeTranslation1));
+        sceneMax = glm::max(sceneMax, planeScale1 * (plane1.GetMaxCorner() + planeTranslation1));
+        if (m_isModelCrowdEnabled)  {
+            for (const CrowdChunk& chunk : m_crowdChunks)   {
+                sceneMin = glm::min(sceneMin, chunk.worldMin);
+                sceneMax = glm::max(sceneMax, chunk.worldMax);
+            }
+        }
+        shadowCaster.SetSceneBounds(sceneMin, sceneMax);
+        shadowCaster.UpdateCascades(gCamera.GetViewMatrix(), glm::radians(m_fieldOfViewDegrees),
+                                    (float)gScreenWidth/(float)gScreenHeight, m_nearPlane, m_farPlane);
+        // Before the meshes are queued, moving casters mark the atlas faces they reach as stale
+        m_shadowAtlas.AssignTiles(GetClusteredLights(), m_clusteredLightCutoff, gCamera.GetViewMatrix(), glm::radians(m_fieldOfViewDegrees),
+                                  (float)gScreenWidth/(float)gScreenHeight, m_nearPlane, m_farPlane, gScreenHeight);
+
+        // Projection matrix (in perspective)
+        glm::mat4 projectionMatrix = glm::perspective(glm::radians(m_fieldOfViewDegrees),
+                                             (float)gScreenWidth/(float)gScreenHeight,
+                                             m_nearPlane,
+                                             m_farPlane);
+        UpdateCullingFrusta(projectionMatrix * gCamera.GetViewMatrix(), shadowCaster, pointShadow);
+        if (m_isModelCrowdEnabled)  {
+            CullModelCrowd();
+        }
+        if (m_isOcclusionCullingEnabled)    {
+            // The occluders are the model, the planes and the crowd's nearest instances, each its own occluder mesh
+            m_occlusionCuller.BeginFrame(projectionMatrix * gCamera.GetViewMatrix());
+            m_occlusionCuller.AddOccluder(m_modelOccluderPositions, m_modelOccluderIndices, GetModelMatrix(objFileTranslation, objFileScale));
+            m_occlusionCuller.AddOccluder(planeOccluder, {}, GetModelMatrix(planeTranslation, planeScale));
+            m_occlusionCuller.AddOccluder(planeOccluder1, {}, GetModelMatrix(planeTranslation1, planeScale1));
+            if (m_isModelCrowdEnabled)  {
+                AddCrowdOccluders();
+            }
+            m_occlusionCuller.RasterizeOccluders();
+        }
 
-        if (m_isTextureProvided)    {
-            SetTextureUniforms(m_graphicsPipelineLit);
+        // RENDER QUEUE
+        // Every object is recorded into the passes it takes part in, each pass then draws sorted by program, material and depth
+        m_renderQueue.Clear();
+        m_instanceBuffer.Clear();
+        m_numOutlinedObjects = 0;
+        if (m_occlusionQueryMode != OCCLUSION_QUERIES_OFF)  {
+            // Last frame's results that are in by now, the rest keep their prediction another frame
+            m_occlusionQueries.BeginFrame();
+        }
+        // Hot reload can swap the model any frame, so it is drawn into the shadow map every frame like a moving caster
+        QueueMesh(m_vertexArrayObject, m_numVerticesToDraw, true, objFileTranslation, objFileScale, modelMin, modelMax,
+                  m_modelMaterialBase, m_modelNumMaterials, objFileOutlineExtrudeDistance, false, shadowCaster, pointShadow, 0);
+        QueueMesh(plane.GetVertexArrayObject(), plane.GetNumVertices(), false, planeTranslation, planeScale,
+                  plane.GetMinCorner(), plane.GetMaxCorner(), planeMaterial, 1, 0.0f, true, shadowCaster, pointShadow);
+        QueueMesh(plane1.GetVertexArrayObject(), plane1.GetNumVertices(), false, planeTranslation1, planeScale1,
+                  plane1.GetMinCorner(), plane1.GetMaxCorner(), planeMaterial1, 1, 0.0f, true, shadowCaster, pointShadow);
+        if (m_isModelCrowdEnabled)  {
+            QueueModelCrowd(shadowCaster, pointShadow);
         }
+        QueueLightGizmos();
+        if (m_isOcclusionCullingEnabled)    {
+            ReportOcclusionCulling();
+        }
+        if (m_occlusionQueryMode != OCCLUSION_QUERIES_OFF)  {
+            ReportOcclusionQueries();
+        }
+        // Every instance of the frame in one upload, before the first draw reads them
+        m_instanceBuffer.Upload();
+        m_renderQueue.Sort();
 
-        // Enable stencil test to outline object
-        glEnable(GL_STENCIL_TEST);
-        glStencilMask(0xFF); // enable writing to all parts of the stencil buffer
-        glClear(GL_STENCIL_BUFFER_BIT); // glStencilMask must be 0xFF to write the stencil buffer back to 0
-        glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE); // Place 1's for fragments that pass the stencil and depth test
-        glStencilFunc(GL_ALWAYS, 1, 0xFF); // all fragments should pass the stencil test. The only thing we care about for this pass is the depth test.
-		DrawLit();
-        //PrintStencilBuffer(gScreenWidth, gScreenHeight);
+        // SHADOW MAP PASS
+        GLStateTracker& state = GLStateTracker::Get();
+        if (m_isPointShadowEnabled)    {
+            // One layered pass, every caster is drawn once and the geometry shader sends it to the faces it reaches
+            PreDraw();
+            DrawPointShadow(pointShadow);
+        } else {
+            // Every cascade starts from a copy of its static cache, which is only redrawn once the cascade moved,
+            // and draws the moving casters that reach it on top
+            m_shadowPassTimer.Begin();
+            state.Viewport(0, 0, shadowCaster.GetCascadeResolution(), shadowCaster.GetCascadeResolution());
+            PreDraw();
+            shadowCaster.SetFilterRadius(m_shadowFilter.GetPresetSettings().radiusTexels);
+            shadowCaster.BeginShadowPass();
+            for (int cascade = 0; cascade < shadowCaster.GetNumCascades(); cascade++)   {
+                PushFrameData(shadowCaster.GetCascadeViewMatrix(), shadowCaster.GetCascadeProjectionMatrix(cascade));
+                uint32_t cascadeBit = 1u << cascade;
+                if (shadowCaster.IsStaticCacheStale(cascade))   {
+                    shadowCaster.BindStaticCacheFBO(cascade);
+                    glClear(GL_DEPTH_BUFFER_BIT);
+                    m_renderQueue.Execute(RENDER_PASS_SHADOW_STATIC, cascadeBit);
+                    m_numStaticShadowRedraws++;
+                }
+                bool hasDynamicCasters = m_renderQueue.GetNumPackets(RENDER_PASS_SHADOW_DYNAMIC, cascadeBit) > 0;
+                shadowCaster.BeginDynamicCasters(cascade, hasDynamicCasters);
+                if (hasDynamicCasters)  {
+                    m_renderQueue.Execute(RENDER_PASS_SHADOW_DYNAMIC, cascadeBit);
+                }
+            }
+            shadowCaster.EndShadowPass();
+            m_shadowPassTimer.End();
+        }
+        DrawShadowAtlas();
 
 
-        // Draw outline of object
-        glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
-        glStencilMask(0x00); // disable writing to the stencil buffer
-        PreDraw(m_graphicsPipelineOutline, gCamera.GetViewMatrix(), projectionMatrix, objFileTranslation, objFileScale);
-        SetOutlineUniforms(m_graphicsPipelineOutline, objFileOutlineExtrudeDistance);
-        //glDisable(GL_DEPTH_TEST); // Don't think I need this, I want it to be hidden behind things
-        DrawLit(); // Not actually lit, just draws the model. Should be renamed to DrawModel()
-        glDisable(GL_STENCIL_TEST);
+        // REAL RENDERING PASS
+        // Screen space outlines read the scene back, so it is drawn offscreen and DrawScreenSpaceOutline puts it on screen
+        state.StencilMask(0xFF); // glClear only clears the stencil bits the mask lets through
+        if (m_isScreenSpaceOutline)    {
+            m_sceneFramebuffer.Bind();
+            m_sceneFramebuffer.Clear();
+        } else {
+            state.BindFramebuffer(GL_FRAMEBUFFER, 0);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT); // Clear buffer from shadow pass
+        }
+        state.Viewport(0, 0, gScreenWidth, gScreenHeight);
+        PushFrameData(gCamera.GetViewMatrix(), projectionMatrix);
+        UpdateLightClusters(gCamera.GetViewMatrix());
+        PreDraw();
+
+        // DEPTH PRE-PASS
+        // Lays down the final depth, so the lit pass only shades the fragments that end up visible
+        m_opaquePassTimer.Begin();
+        if (m_isDepthPrepassEnabled)   {
+            state.ColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE); // The shadow program writes no color
+            m_depthPrepassFragments.Begin();
+            m_renderQueue.Execute(RENDER_PASS_DEPTH);
+            m_depthPrepassFragments.End();
+            state.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            state.DepthFunc(GL_EQUAL);
+            state.DepthMask(GL_FALSE);
+        }
 
-         // DRAW PLANE
-        PreDraw(m_graphicsPipelineLit, gCamera.GetViewMatrix(), projectionMatrix, planeTranslation, planeScale);
-        SetLightingUniforms(m_graphicsPipelineLit, {34, 139, 34}, 120);
-        plane.Draw();
-        PreDraw(m_graphicsPipelineLit, gCamera.GetViewMatrix(), projectionMatrix, planeTranslation1, planeScale1);
-        SetLightingUniforms(m_graphicsPipelineLit, {100, 0, 0}, 20);
-        plane1.Draw();
+        // DRAW OPAQUE OBJECTS AND LIGHTS
+        BindShadowMap(shadowCaster, pointShadow);
+        // Outlined objects place 1's in the stencil for fragments that pass the depth test, the rest leave it alone
+        if (!m_isScreenSpaceOutline)   {
+            state.Enable(GL_STENCIL_TEST);
+            state.StencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+            state.StencilFunc(GL_ALWAYS, 0, 0xFF);
+        }
+        m_opaquePassFragments.Begin();
+        m_renderQueue.Execute(RENDER_PASS_OPAQUE);
+        m_opaquePassFragments.End();
+        // Objects hidden last frame were not in the pre-pass either, they test and write depth as usual
+        state.DepthFunc(GL_LESS);
+        state.DepthMask(GL_TRUE);
+        if (m_renderQueue.GetNumPackets(RENDER_PASS_OCCLUSION_PROXY) > 0)   {
+            // The proxies only test against what the visible objects left in the depth buffer, a box touching
+            // its own object's surface counts as visible
+            state.ColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            state.DepthMask(GL_FALSE);
+            state.DepthFunc(GL_LEQUAL);
+            m_renderQueue.Execute(RENDER_PASS_OCCLUSION_PROXY);
+            state.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            state.DepthMask(GL_TRUE);
+            state.DepthFunc(GL_LESS);
+        }
+        m_renderQueue.Execute(RENDER_PASS_OPAQUE_OCCLUDED);
+        m_opaquePassTimer.End();
+        // Lights were not in the pre-pass, they test and write depth as usual
+        m_renderQueue.Execute(RENDER_PASS_LIGHTS);
+        //PrintStencilBuffer(gScreenWidth, gScreenHeight);
 
+        if (m_isScreenSpaceOutline)    {
+            DrawScreenSpaceOutline();
+        } else {
+            // Draw outline of objects, only where they did not write the stencil
+            state.StencilFunc(GL_NOTEQUAL, 1, 0xFF);
+            m_renderQueue.Execute(RENDER_PASS_OUTLINE);
+            state.Disable(GL_STENCIL_TEST);
+        }
+        m_uniformRing.EndFrame();
 		//Update screen of our specified window
 		SDL_GL_SwapWindow(gGraphicsApplicationWindow);
 
+        ShaderProgram::FrameStats uniformStats = ShaderProgram::GetFrameStats();
+        m_numUniformStatsFrames++;
+        m_numUniformUploads += uniformStats.numUploads;
+        m_numUniformsSkipped += uniformStats.numSkipped;
+        if (m_numUniformStatsFrames >= m_benchmarkFrames)   {
+            std::cout << "Uniform uploads: " << m_numUniformUploads / m_numUniformStatsFrames << " per frame, "
+                      << m_numUniformsSkipped / m_numUniformStatsFrames << " skipped as unchanged, over "
+                      << m_numUniformStatsFrames << " frames" << std::endl;
+            m_numUniformStatsFrames = 0;
+            m_numUniformUploads = 0;
+            m_numUniformsSkipped = 0;
+        }
+        ShaderProgram::ResetFrameStats();
+
+        GLStateTracker::FrameStats stateStats = state.GetFrameStats();
+        m_numStateStatsFrames++;
+        m_numStateChangesIssued += stateStats.numIssued;
+        m_numStateChangesElided += stateStats.numElided;
+        if (m_numStateStatsFrames >= m_benchmarkFrames)   {
+            std::cout << "GL state changes: " << m_numStateChangesIssued / m_numStateStatsFrames << " issued per frame, "
+                      << m_numStateChangesElided / m_numStateStatsFrames << " elided as redundant, over "
+                      << m_numStateStatsFrames << " frames" << std::endl;
+            m_numStateStatsFrames = 0;
+            m_numStateChangesIssued = 0;
+            m_numStateChangesElided = 0;
+        }
+        state.ResetFrameStats();
+
+        if (m_opaquePassTimer.GetNumSamples() >= m_benchmarkFrames)   {
+            std::cout << "Opaque pass: " << m_opaquePassTimer.GetAverage() / 1.0e6 << " ms on the GPU, "
+                      << (long long)m_opaquePassFragments.GetAverage() << " fragments shaded with "
+                      << (m_isDotTextureEnabled ? "dot texture" : "analytic") << " halftone dots and "
+                      << m_shadowFilter.GetPresetSettings().name << " shadow filtering, ";
+            if (m_isDepthPrepassEnabled)    {
+                std::cout << "after a depth pre-pass of " << (long long)m_depthPrepassFragments.GetAverage() << " fragments";
+            } else {
+                std::cout << "no depth pre-pass";
+            }
+            std::cout << ", over " << m_opaquePassTimer.GetNumSamples() << " frames" << std::endl;
+            ResetOpaquePassStats();
+        }
+        if (m_shadowPassTimer.GetNumSamples() >= m_benchmarkFrames)   {
+            std::cout << "Shadow pass: " << m_shadowPassTimer.GetAverage() / 1.0e6 << " ms on the GPU, static casters redrawn into "
+                      << m_numStaticShadowRedraws << " of " << m_shadowPassTimer.GetNumSamples() * shadowCaster.GetNumCascades()
+                      << " cascades, over " << m_shadowPassTimer.GetNumSamples() << " frames" << std::endl;
+            m_shadowPassTimer.Reset();
+            m_numStaticShadowRedraws = 0;
+        }
+
         //Clear color buffer and Depth Buffer
   	    glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
 	}
+    pointShadow.CleanUp();
 }
 
 void GraphicsProgram::PrintStencilBuffer(int width, int height) {
@@ -683,6 +1624,8 @@ void GraphicsProgram::PrintStencilBuffer(int width, int height) {
 
 
 void GraphicsProgram::CleanUp(){
+    m_fileWatcher.Stop();
+
 	//Destroy our SDL2 Window
 	SDL_DestroyWindow(gGraphicsApplicationWindow );
 	gGraphicsApplicationWindow = nullptr;
@@ -691,10 +1634,33 @@ void GraphicsProgram::CleanUp(){
     glDeleteBuffers(1, &m_vertexBufferObject);
     glDeleteBuffers(1, &m_elementBufferObject);
     glDeleteVertexArrays(1, &m_vertexArrayObject);
+    m_materialTable.CleanUp();
+    m_textureAtlas.CleanUp();
 
 	// Delete our Graphics pipeline
-    glDeleteProgram(m_graphicsPipelineLit);
-    glDeleteProgram(m_graphicsPipelineLights);
+    m_graphicsPipelineLit.CleanUp();
+    m_graphicsPipelineLitUntextured.CleanUp();
+    m_graphicsPipelineLights.CleanUp();
+    m_graphicsPipelineShadows.CleanUp();
+    m_graphicsPipelineCubeShadows.CleanUp();
+    m_instanceBuffer.CleanUp();
+    m_graphicsPipelineOutline.CleanUp();
+    m_graphicsPipelineScreenOutline.CleanUp();
+    m_uniformRing.CleanUp();
+    m_sceneFramebuffer.CleanUp();
+    glDeleteVertexArrays(1, &m_vertexArrayObjectFullScreen);
+    m_halftoneDotTexture.CleanUp();
+    m_opaquePassTimer.CleanUp();
+    m_opaquePassFragments.CleanUp();
+    m_occlusionQueries.CleanUp();
+    m_depthPrepassFragments.CleanUp();
+    m_shadowPassTimer.CleanUp();
+    m_lightClusters.CleanUp();
+    m_shadowAtlas.CleanUp();
+    m_shadowAtlasTimer.CleanUp();
+    m_pointShadowTimer.CleanUp();
+    // Names of deleted objects can be reused
+    GLStateTracker::Get().Invalidate();
 
 	//Quit SDL subsystems
 	SDL_Quit();
@@ -704,10 +1670,21 @@ void GraphicsProgram::CleanUp(){
 void GraphicsProgram::Start(std::string modelPath){
     std::cout << "Use w s a and d keys to move forward and back\n";
     std::cout << "Use tab to toggle wireframe\n";
+    std::cout << "Use v to cycle debug views\n";
+    std::cout << "Use h to switch between dot texture and analytic halftone dots\n";
+    std::cout << "Use p to toggle the depth pre-pass\n";
+    std::cout << "Use l to toggle the clustered lights\n";
+    std::cout << "Use c to switch the main light's shadow between a cube map and cascades\n";
+    std::cout << "Use i to toggle " << m_numCrowdInstances << " instanced copies of the model\n";
+    std::cout << "Use k to toggle frustum culling, j to toggle occlusion culling\n";
+    std::cout << "Use g to cycle occlusion queries between off, conditional render and frame late readback\n";
+    std::cout << "Use o to switch between screen space and stencil outlines, [ and ] to change their width\n";
     std::cout << "Press ESC to quit\n";
 
 	// 1. Setup the graphics program
 	InitializeProgram();
+	// Shaders compile in the background while the geometry loads
+	RequestShaderPrograms();
 	
 	// 2. Setup our geometry
 	VertexSpecification(modelPath);
@@ -715,9 +1692,12 @@ void GraphicsProgram::Start(std::string modelPath){
 	
 	// 3. Create our graphics pipeline
 	// 	- At a minimum, this means the vertex and fragment shader
+	// 	- Waits for the programs requested in step 1
 	CreateGraphicsPipeline();
 	
 	// 4. Call the main application loop
+	// Shaders, the model and its textures reload when they are saved
+	m_fileWatcher.Start();
 	MainLoop();	
 
 	// 5. Call the cleanup function when our program terminates
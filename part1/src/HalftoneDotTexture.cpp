@@ -0,0 +1,48 @@
+#include "HalftoneDotTexture.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "GLStateTracker.hpp"
+
+void HalftoneDotTexture::Create(int width) {
+    int height = width * 2;
+    std::vector<float> distances = ComputeDistances(width, height);
+
+    glGenTextures(1, &m_texture);
+    GLStateTracker::Get().BindTexture(GL_TEXTURE_2D, m_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, width, height, 0, GL_RED, GL_FLOAT, distances.data());
+    // No mips, like the analytic path the dots alias once they are smaller than a pixel
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+}
+
+std::vector<float> HalftoneDotTexture::ComputeDistances(int width, int height) {
+    // Dots of the tile in spacing units: the even rows at y = 0 and y = 2, the odd row shifted half a spacing.
+    // Corners are included so texels near the tile edges see the dots of the neighbouring tiles.
+    const float dots[5][2] = {{0.0f, 0.0f}, {1.0f, 0.0f}, {0.0f, 2.0f}, {1.0f, 2.0f}, {0.5f, 1.0f}};
+    std::vector<float> distances(width * height);
+    for (int row = 0; row < height; row++) {
+        for (int column = 0; column < width; column++) {
+            float x = (column + 0.5f) / width;
+            float y = (row + 0.5f) / height * 2.0f;
+            float nearest = 1.0f;
+            for (const float* dot : dots) {
+                nearest = std::min(nearest, std::hypot(x - dot[0], y - dot[1]));
+            }
+            distances[row * width + column] = nearest;
+        }
+    }
+    return distances;
+}
+
+void HalftoneDotTexture::Bind(GLenum texUnit) {
+    GLStateTracker::Get().BindTextureToUnit(texUnit - GL_TEXTURE0, GL_TEXTURE_2D, m_texture);
+}
+
+void HalftoneDotTexture::CleanUp() {
+    glDeleteTextures(1, &m_texture);
+    m_texture = 0;
+}
@@ -0,0 +1,67 @@
+#include "InstanceBuffer.hpp"
+
+#include "GLStateTracker.hpp"
+
+void InstanceBuffer::Create() {
+    glGenBuffers(1, &m_buffer);
+    Upload();
+}
+
+void InstanceBuffer::Attach(GLuint vertexArray) {
+    GLStateTracker& state = GLStateTracker::Get();
+    state.BindVertexArray(vertexArray);
+    for (GLuint attribute = kFirstAttribute; attribute < kFirstAttribute + 6; attribute++) {
+        glEnableVertexAttribArray(attribute);
+        glVertexAttribDivisor(attribute, 1);
+    }
+    // Pointed at the buffer by the first BindInstances
+    m_boundFirstInstance.erase(vertexArray);
+    BindInstances(vertexArray, 0);
+    state.BindVertexArray(0);
+}
+
+void InstanceBuffer::Clear() {
+    m_instances.clear();
+}
+
+int InstanceBuffer::Add(const InstanceData& instance) {
+    m_instances.push_back(instance);
+    return m_instances.size() - 1;
+}
+
+int InstanceBuffer::Add(const InstanceData* instances, int numInstances) {
+    int firstInstance = m_instances.size();
+    m_instances.insert(m_instances.end(), instances, instances + numInstances);
+    return firstInstance;
+}
+
+void InstanceBuffer::Upload() {
+    // New storage every frame, the GPU may still be drawing from last frame's
+    GLStateTracker::Get().BindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    glBufferData(GL_ARRAY_BUFFER, m_instances.size() * sizeof(InstanceData), m_instances.data(), GL_STREAM_DRAW);
+}
+
+void InstanceBuffer::BindInstances(GLuint vertexArray, int firstInstance) {
+    auto bound = m_boundFirstInstance.find(vertexArray);
+    if (bound != m_boundFirstInstance.end() && bound->second == firstInstance) {
+        return;
+    }
+    m_boundFirstInstance[vertexArray] = firstInstance;
+    // Attribute pointers are vertex array state, taken from the buffer bound to GL_ARRAY_BUFFER when they are set
+    GLStateTracker::Get().BindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    size_t base = firstInstance * sizeof(InstanceData);
+    for (GLuint column = 0; column < 4; column++) {
+        glVertexAttribPointer(kFirstAttribute + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (GLvoid*)(base + offsetof(InstanceData, modelMatrix) + column * sizeof(glm::vec4)));
+    }
+    glVertexAttribPointer(kFirstAttribute + 4, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                          (GLvoid*)(base + offsetof(InstanceData, color)));
+    glVertexAttribIPointer(kFirstAttribute + 5, 2, GL_INT, sizeof(InstanceData),
+                           (GLvoid*)(base + offsetof(InstanceData, materialBase)));
+}
+
+void InstanceBuffer::CleanUp() {
+    glDeleteBuffers(1, &m_buffer);
+    m_buffer = 0;
+    m_boundFirstInstance.clear();
+}
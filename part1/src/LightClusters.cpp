@@ -0,0 +1,283 @@
+#include "LightClusters.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include "GLStateTracker.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // Below this many sphere/box tests a frame the threads cost more than they save
+    const int kTestsPerJob = 32 * 1024;
+}
+
+LightClusters::LightClusters(const LightClusterSettings& settings) : m_settings(settings) {
+    m_settings.tilesX = std::max(m_settings.tilesX, 1);
+    m_settings.tilesY = std::max(m_settings.tilesY, 1);
+    m_settings.slices = std::max(m_settings.slices, 1);
+    m_sliceLights.resize(m_settings.slices);
+    for (SliceLights& slice : m_sliceLights) {
+        slice.counts.resize(m_settings.tilesX * m_settings.tilesY);
+    }
+    m_records.resize(m_settings.tilesX * m_settings.tilesY * m_settings.slices * 2);
+}
+
+float LightClusters::GetSliceDepth(int slice) const {
+    return m_nearPlane * std::pow(m_farPlane / m_nearPlane, slice / (float)m_settings.slices);
+}
+
+void LightClusters::BuildClusterBounds(float fieldOfViewRadians, float aspectRatio, float nearPlane, float farPlane) {
+    glm::vec4 projection(fieldOfViewRadians, aspectRatio, nearPlane, farPlane);
+    if (projection == m_boundsProjection && !m_clusterBounds.empty()) {
+        return;
+    }
+    m_boundsProjection = projection;
+    m_nearPlane = nearPlane;
+    m_farPlane = farPlane;
+
+    float tanHalfHeight = std::tan(fieldOfViewRadians * 0.5f);
+    float tanHalfWidth = tanHalfHeight * aspectRatio;
+    m_clusterBounds.resize(m_settings.tilesX * m_settings.tilesY * m_settings.slices);
+    for (int slice = 0; slice < m_settings.slices; slice++) {
+        float sliceNear = GetSliceDepth(slice);
+        float sliceFar = GetSliceDepth(slice + 1);
+        for (int tileY = 0; tileY < m_settings.tilesY; tileY++) {
+            float bottom = (-1.0f + 2.0f * tileY / m_settings.tilesY) * tanHalfHeight;
+            float top = (-1.0f + 2.0f * (tileY + 1) / m_settings.tilesY) * tanHalfHeight;
+            for (int tileX = 0; tileX < m_settings.tilesX; tileX++) {
+                float left = (-1.0f + 2.0f * tileX / m_settings.tilesX) * tanHalfWidth;
+                float right = (-1.0f + 2.0f * (tileX + 1) / m_settings.tilesX) * tanHalfWidth;
+                // The tile's edges spread out with depth, so the box is made of its near and far corners
+                ClusterBounds& bounds = m_clusterBounds[(slice * m_settings.tilesY + tileY) * m_settings.tilesX + tileX];
+                bounds.min = glm::vec3(std::min(left * sliceNear, left * sliceFar), std::min(bottom * sliceNear, bottom * sliceFar), -sliceFar);
+                bounds.max = glm::vec3(std::max(right * sliceNear, right * sliceFar), std::max(top * sliceNear, top * sliceFar), -sliceNear);
+            }
+        }
+    }
+}
+
+void LightClusters::AssignLights(const std::vector<PointLight>& lights, const glm::mat4& viewMatrix, float fieldOfViewRadians,
+                                 float aspectRatio, float nearPlane, float farPlane, float cutoff) {
+    auto start = std::chrono::steady_clock::now();
+    BuildClusterBounds(fieldOfViewRadians, aspectRatio, nearPlane, farPlane);
+
+    // The index list is 16 bit
+    size_t numLights = std::min<size_t>(lights.size(), std::numeric_limits<uint16_t>::max());
+    m_lightX.resize(numLights);
+    m_lightY.resize(numLights);
+    m_lightZ.resize(numLights);
+    m_lightRadius.resize(numLights);
+    m_lightTexels.resize(numLights * 8);
+    for (size_t i = 0; i < numLights; i++) {
+        const PointLight& light = lights[i];
+        glm::vec3 position = light.GetPosition();
+        glm::vec3 viewPosition = glm::vec3(viewMatrix * glm::vec4(position, 1.0f));
+        float range = light.GetRange(cutoff);
+        m_lightX[i] = viewPosition.x;
+        m_lightY[i] = viewPosition.y;
+        m_lightZ[i] = viewPosition.z;
+        m_lightRadius[i] = range;
+
+        float* texels = &m_lightTexels[i * 8];
+        texels[0] = position.x;
+        texels[1] = position.y;
+        texels[2] = position.z;
+        texels[3] = range;
+        texels[4] = light.GetConstantFallOffForUniform();
+        texels[5] = light.GetLinearFallOffForUniform();
+        texels[6] = light.GetQuadtraticFallOffForUniform();
+        texels[7] = 0.0f;
+    }
+
+    // Slices are handed out round robin, near slices are small and hold few lights so that evens out the work
+    int numClusters = m_settings.tilesX * m_settings.tilesY * m_settings.slices;
+    long long numTests = (long long)numLights * numClusters;
+    int numJobs = (int)std::clamp<long long>(numTests / kTestsPerJob, 1, m_settings.slices);
+    numJobs = ThreadPool::GetShared().RunSplit(numJobs, [this](int job, int jobStep) { AssignSlices(job, jobStep); });
+
+    // Every slice's lists one after the other
+    m_indices.clear();
+    m_stats.maxLightsPerCluster = 0;
+    int tilesPerSlice = m_settings.tilesX * m_settings.tilesY;
+    for (int slice = 0; slice < m_settings.slices; slice++) {
+        const SliceLights& sliceLights = m_sliceLights[slice];
+        uint32_t offset = m_indices.size();
+        for (int tile = 0; tile < tilesPerSlice; tile++) {
+            uint32_t count = sliceLights.counts[tile];
+            m_records[(slice * tilesPerSlice + tile) * 2] = offset;
+            m_records[(slice * tilesPerSlice + tile) * 2 + 1] = count;
+            offset += count;
+            m_stats.maxLightsPerCluster = std::max<int>(m_stats.maxLightsPerCluster, count);
+        }
+        m_indices.insert(m_indices.end(), sliceLights.indices.begin(), sliceLights.indices.end());
+    }
+
+    m_stats.numLights = numLights;
+    m_stats.numLightIndices = m_indices.size();
+    m_stats.numThreads = numJobs;
+    m_stats.assignMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void LightClusters::AssignSlices(int firstSlice, int sliceStep) {
+    for (int slice = firstSlice; slice < m_settings.slices; slice += sliceStep) {
+        SliceLights& sliceLights = m_sliceLights[slice];
+        float sliceNear = GetSliceDepth(slice);
+        float sliceFar = GetSliceDepth(slice + 1);
+
+        // Only lights reaching the slice's depth range are tested against its clusters
+        sliceLights.x.clear();
+        sliceLights.y.clear();
+        sliceLights.z.clear();
+        sliceLights.radiusSquared.clear();
+        sliceLights.lightIndices.clear();
+        for (size_t i = 0; i < m_lightZ.size(); i++) {
+            float depth = -m_lightZ[i];
+            if (depth + m_lightRadius[i] >= sliceNear && depth - m_lightRadius[i] <= sliceFar) {
+                sliceLights.x.push_back(m_lightX[i]);
+                sliceLights.y.push_back(m_lightY[i]);
+                sliceLights.z.push_back(m_lightZ[i]);
+                sliceLights.radiusSquared.push_back(m_lightRadius[i] * m_lightRadius[i]);
+                sliceLights.lightIndices.push_back(i);
+            }
+        }
+        // Padding lights have a negative squared radius, no distance passes that
+        while (sliceLights.x.size() % 4 != 0) {
+            sliceLights.x.push_back(0.0f);
+            sliceLights.y.push_back(0.0f);
+            sliceLights.z.push_back(0.0f);
+            sliceLights.radiusSquared.push_back(-1.0f);
+            sliceLights.lightIndices.push_back(0);
+        }
+
+        sliceLights.indices.clear();
+        int tilesPerSlice = m_settings.tilesX * m_settings.tilesY;
+        for (int tile = 0; tile < tilesPerSlice; tile++) {
+            sliceLights.counts[tile] = sliceLights.x.empty() ? 0 : TestCluster(m_clusterBounds[slice * tilesPerSlice + tile], sliceLights);
+        }
+    }
+}
+
+uint32_t LightClusters::TestCluster(const ClusterBounds& bounds, SliceLights& slice) {
+    uint32_t count = 0;
+    size_t numLights = slice.x.size();
+#if defined(__SSE2__)
+    // Distance from each sphere's center to the box, per axis max(min - p, p - max, 0)
+    const __m128 minX = _mm_set1_ps(bounds.min.x);
+    const __m128 minY = _mm_set1_ps(bounds.min.y);
+    const __m128 minZ = _mm_set1_ps(bounds.min.z);
+    const __m128 maxX = _mm_set1_ps(bounds.max.x);
+    const __m128 maxY = _mm_set1_ps(bounds.max.y);
+    const __m128 maxZ = _mm_set1_ps(bounds.max.z);
+    const __m128 zero = _mm_setzero_ps();
+    for (size_t i = 0; i < numLights; i += 4) {
+        __m128 x = _mm_loadu_ps(&slice.x[i]);
+        __m128 y = _mm_loadu_ps(&slice.y[i]);
+        __m128 z = _mm_loadu_ps(&slice.z[i]);
+        __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minX, x), _mm_sub_ps(x, maxX)), zero);
+        __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minY, y), _mm_sub_ps(y, maxY)), zero);
+        __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minZ, z), _mm_sub_ps(z, maxZ)), zero);
+        __m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        int mask = _mm_movemask_ps(_mm_cmple_ps(distanceSquared, _mm_loadu_ps(&slice.radiusSquared[i])));
+        for (int lane = 0; mask != 0 && lane < 4; lane++) {
+            if (mask & (1 << lane)) {
+                slice.indices.push_back(slice.lightIndices[i + lane]);
+                count++;
+            }
+        }
+    }
+#else
+    for (size_t i = 0; i < numLights; i++) {
+        float dx = std::max(std::max(bounds.min.x - slice.x[i], slice.x[i] - bounds.max.x), 0.0f);
+        float dy = std::max(std::max(bounds.min.y - slice.y[i], slice.y[i] - bounds.max.y), 0.0f);
+        float dz = std::max(std::max(bounds.min.z - slice.z[i], slice.z[i] - bounds.max.z), 0.0f);
+        if (dx * dx + dy * dy + dz * dz <= slice.radiusSquared[i]) {
+            slice.indices.push_back(slice.lightIndices[i]);
+            count++;
+        }
+    }
+#endif
+    return count;
+}
+
+void LightClusters::Create(GLenum lightsTexUnit, GLenum recordsTexUnit, GLenum indicesTexUnit) {
+    glGenBuffers(1, &m_lightsBuffer);
+    glGenTextures(1, &m_lightsTexture);
+    glGenBuffers(1, &m_recordsBuffer);
+    glGenTextures(1, &m_recordsTexture);
+    glGenBuffers(1, &m_indicesBuffer);
+    glGenTextures(1, &m_indicesTexture);
+    // A buffer texture needs storage behind it before its first draw
+    m_lightTexels.clear();
+    m_indices.clear();
+    Upload();
+
+    // The textures keep pointing at their buffers when Upload replaces the storage, so they are bound once
+    GLStateTracker& state = GLStateTracker::Get();
+    state.BindTextureToUnit(lightsTexUnit - GL_TEXTURE0, GL_TEXTURE_BUFFER, m_lightsTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_lightsBuffer);
+    state.BindTextureToUnit(recordsTexUnit - GL_TEXTURE0, GL_TEXTURE_BUFFER, m_recordsTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, m_recordsBuffer);
+    state.BindTextureToUnit(indicesTexUnit - GL_TEXTURE0, GL_TEXTURE_BUFFER, m_indicesTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R16UI, m_indicesBuffer);
+}
+
+void LightClusters::Upload() {
+    // Refilled every frame, glBufferData orphans the old storage instead of waiting for draws still reading it.
+    // Empty lists upload one texel, a buffer texture needs some storage behind it.
+    GLStateTracker& state = GLStateTracker::Get();
+    const float noLight[8] = {};
+    const uint16_t noIndex = 0;
+    state.BindBuffer(GL_TEXTURE_BUFFER, m_lightsBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(m_lightTexels.size(), 8) * sizeof(float),
+                 m_lightTexels.empty() ? noLight : m_lightTexels.data(), GL_STREAM_DRAW);
+    state.BindBuffer(GL_TEXTURE_BUFFER, m_recordsBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, m_records.size() * sizeof(uint32_t), m_records.data(), GL_STREAM_DRAW);
+    state.BindBuffer(GL_TEXTURE_BUFFER, m_indicesBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(m_indices.size(), 1) * sizeof(uint16_t),
+                 m_indices.empty() ? &noIndex : m_indices.data(), GL_STREAM_DRAW);
+}
+
+ClusterData LightClusters::GetClusterData(int screenWidth, int screenHeight) const {
+    ClusterData clusterData;
+    clusterData.gridSize[0] = m_settings.tilesX;
+    clusterData.gridSize[1] = m_settings.tilesY;
+    clusterData.gridSize[2] = m_settings.slices;
+    clusterData.gridSize[3] = m_stats.numLights;
+    // slice = log(depth / near) / log(far / near) * slices, split so the shader does one log, a multiply and a subtract
+    float slicesPerLogDepth = m_settings.slices / std::log(m_farPlane / m_nearPlane);
+    clusterData.scale[0] = m_settings.tilesX / (float)screenWidth;
+    clusterData.scale[1] = m_settings.tilesY / (float)screenHeight;
+    clusterData.scale[2] = slicesPerLogDepth;
+    clusterData.scale[3] = std::log(m_nearPlane) * slicesPerLogDepth;
+    return clusterData;
+}
+
+glm::uvec2 LightClusters::GetClusterRecord(int tileX, int tileY, int slice) const {
+    int cluster = (slice * m_settings.tilesY + tileY) * m_settings.tilesX + tileX;
+    return glm::uvec2(m_records[cluster * 2], m_records[cluster * 2 + 1]);
+}
+
+const std::vector<uint16_t>& LightClusters::GetLightIndices() const {
+    return m_indices;
+}
+
+const LightClusters::Stats& LightClusters::GetStats() const {
+    return m_stats;
+}
+
+void LightClusters::CleanUp() {
+    glDeleteTextures(1, &m_lightsTexture);
+    glDeleteBuffers(1, &m_lightsBuffer);
+    glDeleteTextures(1, &m_recordsTexture);
+    glDeleteBuffers(1, &m_recordsBuffer);
+    glDeleteTextures(1, &m_indicesTexture);
+    glDeleteBuffers(1, &m_indicesBuffer);
+    m_lightsTexture = m_lightsBuffer = 0;
+    m_recordsTexture = m_recordsBuffer = 0;
+    m_indicesTexture = m_indicesBuffer = 0;
+}
@@ -2,8 +2,8 @@
 #include <fstream>
 #include <iostream>
 #include <sstream>
-#include "Pixel.hpp"
 #include "Utils.hpp"
+#include "ThreadPool.hpp"
 #include <cstdint>
 
 MaterialLoader::MaterialLoader(std::string materialFilePath)    {
@@ -20,42 +20,136 @@ MaterialLoader::MaterialLoader(std::string materialFilePath)    {
     } else {
         std::cout << "Could not open file " + materialFilePath << std::endl;
     }
+
+    // Materials without a halftone_color get a darker version of their diffuse color for the dots
+    for (Material& m : m_materials)  {
+        if (m.dotColor[0] < 0.0f)   {
+            for (int c = 0; c < 3; c++) {
+                m.dotColor[c] = m.diffuseColor[c] * 0.8f;
+            }
+        }
+    }
 }
 
 void MaterialLoader::ProcessLineFromMaterialFile(std::string line)  {
     std::stringstream stream(line);
     std::string tok;
-    while(stream >> tok)  {
-        if (tok == "map_Kd")    {
-            std::string diffuseTextureFileName;
-            stream >> diffuseTextureFileName;
-            m_diffuseTexture = PPM(Utils::GetDirectoryOfFile(m_materialFilePath) + diffuseTextureFileName);
-            //m_diffuseTexture.value().savePPM("./notflipped.ppm"); // TODO: Remove this
-            m_diffuseTexture.value().VerticalFlip(); // PPM reads starting at top left, while OpenGL reads bottom left pixel first.
-            //m_diffuseTexture.value().savePPM("./flipped.ppm"); // TODO: Remove this
+    if (!(stream >> tok) || tok[0] == '#')  {
+        return;
+    }
+
+    if (tok == "newmtl")    {
+        std::string materialName;
+        stream >> materialName;
+        m_materialIndexByName[materialName] = m_materials.size();
+        m_materials.push_back(Material::CreateDefault());
+        return;
+    }
+    if (m_materials.empty())    {
+        return; // Statements before the first newmtl have nothing to apply to
+    }
+    Material& m = m_materials.back();
+
+    if (tok == "Kd" || tok == "Ka" || tok == "Ks" || tok == "Ke" || tok == "halftone_color") {
+        float* color = m.diffuseColor;
+        if (tok == "Ka") {
+            color = m.ambientColor;
+        } else if (tok == "Ks") {
+            color = m.specularColor;
+        } else if (tok == "Ke") {
+            color = m.emissiveColor;
+        } else if (tok == "halftone_color") {
+            color = m.dotColor;
+        }
+        stream >> color[0] >> color[1] >> color[2];
+    } else if (tok == "Ns") {
+        stream >> m.specularExponent;
+    } else if (tok == "d")  {
+        stream >> m.dissolve;
+    } else if (tok == "Tr") { // Transparency, the inverse of d
+        float transparency = 0.0f;
+        stream >> transparency;
+        m.dissolve = 1.0f - transparency;
+    } else if (tok == "illum")  {
+        stream >> m.illuminationModel;
+    } else if (tok == "halftone_dots")  {
+        stream >> m.numDotsHorizontally;
+    } else {
+        int slot = -1;
+        if (tok == "map_Kd") {
+            slot = TEXTURE_SLOT_DIFFUSE;
+        } else if (tok == "map_Ka") {
+            slot = TEXTURE_SLOT_AMBIENT;
+        } else if (tok == "map_Ks") {
+            slot = TEXTURE_SLOT_SPECULAR;
+        } else if (tok == "map_Ns") {
+            slot = TEXTURE_SLOT_SPECULAR_EXPONENT;
+        } else if (tok == "map_d") {
+            slot = TEXTURE_SLOT_DISSOLVE;
+        } else if (tok == "map_Ke") {
+            slot = TEXTURE_SLOT_EMISSIVE;
+        } else if (tok == "map_Bump" || tok == "map_bump" || tok == "bump" || tok == "norm") {
+            slot = TEXTURE_SLOT_BUMP;
+        } else if (tok == "disp") {
+            slot = TEXTURE_SLOT_DISPLACEMENT;
+        }
+        if (slot == -1) {
+            return; // Ni, Tf, sharpness etc. are not used by the renderer
+        }
+
+        // Map statements can have options (i.e. "map_Kd -s 1 1 1 wood.ppm"), the file name is always last
+        std::string textureFileName;
+        std::string option;
+        while (stream >> option)    {
+            textureFileName = option;
+        }
+        if (textureFileName.empty())    {
+            return;
+        }
+        std::string texturePath = Utils::GetDirectoryOfFile(m_materialFilePath) + textureFileName;
+        m.textureIndices[slot] = (float)AddTexturePath(texturePath);
+
+        if (slot == TEXTURE_SLOT_DIFFUSE && m_diffuseTextureIndex == -1)   {
+            m_diffuseTextureIndex = (int)m.textureIndices[slot];
         }
     }
 }
 
+int MaterialLoader::AddTexturePath(const std::string& texturePath)    {
+    auto existing = m_textureIndexByPath.find(texturePath);
+    if (existing != m_textureIndexByPath.end())   {
+        return existing->second;
+    }
+    int index = m_texturePaths.size();
+    m_texturePaths.push_back(texturePath);
+    m_textureIndexByPath[texturePath] = index;
+    m_textureJobs.push_back(ThreadPool::GetShared().Submit([texturePath]() {
+        return TextureImage::LoadFromFile(texturePath);
+    }).share());
+    return index;
+}
+
+const TextureImage& MaterialLoader::GetTexture(int textureIndex) const    {
+    return m_textureJobs[textureIndex].get();
+}
+
+void MaterialLoader::WaitForTextures() const    {
+    for (const std::shared_future<TextureImage>& job : m_textureJobs)    {
+        job.wait();
+    }
+}
+
 std::vector<uint8_t> MaterialLoader::GetDiffuseTexturePixelData() const  {
-    if (!m_diffuseTexture.has_value())   {
+    if (!HasDiffuseTexture())   {
         // TODO: These should probably throw errors when no diffuse texture is provided
         return std::vector<uint8_t>();
     }
-    std::vector<Pixel> pixels = m_diffuseTexture.value().pixelData();
-    int maxRange = m_diffuseTexture.value().getMaxRange();
-    std::vector<uint8_t> result;
-    for (Pixel p : pixels)  {
-        result.push_back(p.r);
-        result.push_back(p.g);
-        result.push_back(p.b);
-    }
-    return result;
+    return GetTexture(m_diffuseTextureIndex).rgb;
 }
 
 int MaterialLoader::GetDiffuseTextureWidth() const {
-    if (m_diffuseTexture.has_value())   {
-        return m_diffuseTexture.value().getWidth();
+    if (HasDiffuseTexture())   {
+        return GetTexture(m_diffuseTextureIndex).width;
     } else {
         // TODO: These should probably throw errors when no diffuse texture is provided
         return -1;
@@ -63,13 +157,33 @@ int MaterialLoader::GetDiffuseTextureWidth() const {
 }
 
 int MaterialLoader::GetDiffuseTextureHeight() const {
-    if (m_diffuseTexture.has_value())   {
-        return m_diffuseTexture.value().getHeight();
+    if (HasDiffuseTexture())   {
+        return GetTexture(m_diffuseTextureIndex).height;
     } else {
         return -1;
     }
 }
 
 bool MaterialLoader::HasDiffuseTexture() const  {
-    return m_diffuseTexture.has_value();
+    return m_diffuseTextureIndex != -1 && GetTexture(m_diffuseTextureIndex).IsValid();
+}
+
+const std::vector<Material>& MaterialLoader::GetMaterials() const {
+    return m_materials;
+}
+
+const std::string& MaterialLoader::GetMaterialFilePath() const {
+    return m_materialFilePath;
+}
+
+const std::vector<std::string>& MaterialLoader::GetTexturePaths() const  {
+    return m_texturePaths;
+}
+
+int MaterialLoader::GetMaterialIndex(const std::string& materialName) const  {
+    auto found = m_materialIndexByName.find(materialName);
+    if (found == m_materialIndexByName.end())   {
+        return -1;
+    }
+    return found->second;
 }
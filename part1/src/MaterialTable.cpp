@@ -0,0 +1,173 @@
+#include "MaterialTable.hpp"
+
+#include <algorithm>
+
+#include "GLStateTracker.hpp"
+
+Material MaterialTable::RemapTextureIndices(Material m, const std::vector<std::string>& texturePaths) {
+    for (int slot = 0; slot < TEXTURE_SLOT_COUNT; slot++) {
+        int localIndex = (int)m.textureIndices[slot];
+        if (localIndex < 0 || localIndex >= (int)texturePaths.size()) {
+            m.textureIndices[slot] = -1.0f;
+            continue;
+        }
+        const std::string& path = texturePaths[localIndex];
+        auto existing = m_textureIndexByPath.find(path);
+        if (existing == m_textureIndexByPath.end()) {
+            existing = m_textureIndexByPath.emplace(path, (int)m_texturePaths.size()).first;
+            m_texturePaths.push_back(path);
+        }
+        m.textureIndices[slot] = (float)existing->second;
+    }
+    return m;
+}
+
+int MaterialTable::AllocateRange(int count) {
+    for (size_t i = 0; i < m_freeRanges.size(); i++) {
+        std::pair<int, int>& range = m_freeRanges[i];
+        if (range.second >= count) {
+            int first = range.first;
+            range.first += count;
+            range.second -= count;
+            if (range.second == 0) {
+                m_freeRanges.erase(m_freeRanges.begin() + i);
+            }
+            return first;
+        }
+    }
+    int first = m_materials.size();
+    m_materials.resize(m_materials.size() + count);
+    return first;
+}
+
+void MaterialTable::FreeRange(int first, int count) {
+    if (count <= 0) {
+        return;
+    }
+    // Reset so a stale ID still reads a plain untextured material
+    std::fill(m_materials.begin() + first, m_materials.begin() + first + count, Material::CreateDefault());
+    auto next = std::lower_bound(m_freeRanges.begin(), m_freeRanges.end(), std::make_pair(first, count));
+    next = m_freeRanges.insert(next, {first, count});
+    // Merge with the neighbours it touches
+    if (next + 1 != m_freeRanges.end() && next->first + next->second == (next + 1)->first) {
+        next->second += (next + 1)->second;
+        m_freeRanges.erase(next + 1);
+    }
+    if (next != m_freeRanges.begin() && (next - 1)->first + (next - 1)->second == next->first) {
+        (next - 1)->second += next->second;
+        next = m_freeRanges.erase(next) - 1;
+    }
+    if (next->first + next->second == (int)m_materials.size()) {
+        m_materials.resize(next->first);
+        m_freeRanges.erase(next);
+    }
+}
+
+int MaterialTable::AddMaterials(const std::vector<Material>& materials, const std::vector<std::string>& texturePaths) {
+    int baseID = AllocateRange(materials.size());
+    for (size_t i = 0; i < materials.size(); i++) {
+        m_materials[baseID + i] = RemapTextureIndices(materials[i], texturePaths);
+    }
+    return baseID;
+}
+
+int MaterialTable::ReplaceMaterials(int materialBase, int numMaterials, const std::vector<Material>& materials,
+                                    const std::vector<std::string>& texturePaths) {
+    int newBase = materialBase;
+    if ((int)materials.size() > numMaterials) {
+        // Other objects' materials follow the old range, so it cannot grow in place
+        FreeRange(materialBase, numMaterials);
+        newBase = AddMaterials(materials, texturePaths);
+    } else {
+        for (size_t i = 0; i < materials.size(); i++) {
+            m_materials[materialBase + i] = RemapTextureIndices(materials[i], texturePaths);
+        }
+        FreeRange(materialBase + materials.size(), numMaterials - materials.size());
+    }
+    RemoveUnusedTexturePaths();
+    return newBase;
+}
+
+void MaterialTable::RemoveUnusedTexturePaths() {
+    std::vector<std::string> usedPaths;
+    std::unordered_map<std::string, int> usedIndexByPath;
+    for (Material& m : m_materials) {
+        for (int slot = 0; slot < TEXTURE_SLOT_COUNT; slot++) {
+            int index = (int)m.textureIndices[slot];
+            if (index < 0) {
+                continue;
+            }
+            const std::string& path = m_texturePaths[index];
+            auto used = usedIndexByPath.find(path);
+            if (used == usedIndexByPath.end()) {
+                used = usedIndexByPath.emplace(path, (int)usedPaths.size()).first;
+                usedPaths.push_back(path);
+            }
+            m.textureIndices[slot] = (float)used->second;
+        }
+    }
+    m_texturePaths = std::move(usedPaths);
+    m_textureIndexByPath = std::move(usedIndexByPath);
+}
+
+int MaterialTable::AddMaterial(const Material& material) {
+    return AddMaterials({material}, {});
+}
+
+const std::vector<Material>& MaterialTable::GetMaterials() const {
+    return m_materials;
+}
+
+const std::vector<std::string>& MaterialTable::GetTexturePaths() const {
+    return m_texturePaths;
+}
+
+void MaterialTable::ApplyTextureRegions(const TextureAtlas& atlas) {
+    for (Material& m : m_materials) {
+        int textureIndex = (int)m.textureIndices[TEXTURE_SLOT_DIFFUSE];
+        if (textureIndex < 0 || textureIndex >= atlas.GetNumTextures()) {
+            m.diffuseTextureLayer = -1.0f;
+            continue;
+        }
+        const TextureAtlas::Region& region = atlas.GetRegion(textureIndex);
+        m.diffuseTextureLayer = (float)region.layer;
+        m.diffuseTextureRect[0] = region.uvOffset[0];
+        m.diffuseTextureRect[1] = region.uvOffset[1];
+        m.diffuseTextureRect[2] = region.uvScale[0];
+        m.diffuseTextureRect[3] = region.uvScale[1];
+    }
+}
+
+void MaterialTable::ApplyTextureResidency(const TextureStreamer& streamer) {
+    for (Material& m : m_materials) {
+        int layer = (int)m.diffuseTextureLayer;
+        if (layer < 0 || !streamer.IsEnabled()) {
+            m.diffuseTextureMinLod = 0.0f;
+            continue;
+        }
+        m.diffuseTextureMinLod = (float)(streamer.GetResidentLevel(layer) - streamer.GetBaseLevel());
+    }
+}
+
+void MaterialTable::Upload() {
+    if (m_bufferObject == 0) {
+        glGenBuffers(1, &m_bufferObject);
+        glGenTextures(1, &m_bufferTexture);
+    }
+    GLStateTracker& state = GLStateTracker::Get();
+    state.BindBuffer(GL_TEXTURE_BUFFER, m_bufferObject);
+    glBufferData(GL_TEXTURE_BUFFER, m_materials.size() * sizeof(Material), m_materials.data(), GL_STATIC_DRAW);
+    state.BindTexture(GL_TEXTURE_BUFFER, m_bufferTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_bufferObject);
+}
+
+void MaterialTable::Bind(GLenum texUnit) {
+    GLStateTracker::Get().BindTextureToUnit(texUnit - GL_TEXTURE0, GL_TEXTURE_BUFFER, m_bufferTexture);
+}
+
+void MaterialTable::CleanUp() {
+    glDeleteTextures(1, &m_bufferTexture);
+    glDeleteBuffers(1, &m_bufferObject);
+    m_bufferTexture = 0;
+    m_bufferObject = 0;
+}
@@ -7,7 +7,9 @@
 #include <vector>
 #include <glm/vec3.hpp>
 #include <glm/vec2.hpp>
+#include <glm/glm.hpp>
 #include <regex>
+#include <algorithm>
 #include <array>
 #include "Geometry.hpp"
 #include <MaterialLoader.hpp>
@@ -25,11 +27,29 @@ ObjModelLoader::ObjModelLoader(std::string filePath)    {
             ProcessLineFromOBJFile(line);
         }
         inputFile.close();
+        ComputeBounds();
     } else {
         std::cout << "Could not open file " + filePath << std::endl;
     }
 }
 
+void ObjModelLoader::ComputeBounds()    {
+    if (vertices.empty())  {
+        return;
+    }
+    m_boundsMin = m_boundsMax = glm::vec3(vertices[0].x, vertices[0].y, vertices[0].z);
+    for (const Geometry::Vertex& vertex : vertices)  {
+        m_boundsMin = glm::min(m_boundsMin, glm::vec3(vertex.x, vertex.y, vertex.z));
+        m_boundsMax = glm::max(m_boundsMax, glm::vec3(vertex.x, vertex.y, vertex.z));
+    }
+    // Not the smallest sphere, but close for most models and only one more pass
+    m_boundingSphereCenter = (m_boundsMin + m_boundsMax) * 0.5f;
+    m_boundingSphereRadius = 0.0f;
+    for (const Geometry::Vertex& vertex : vertices)  {
+        m_boundingSphereRadius = std::max(m_boundingSphereRadius, glm::distance(m_boundingSphereCenter, glm::vec3(vertex.x, vertex.y, vertex.z)));
+    }
+}
+
 void ObjModelLoader::ProcessLineFromOBJFile(std::string line)    {
     std::stringstream stream(line);
     std::string tok;
@@ -59,6 +79,15 @@ void ObjModelLoader::ProcessLineFromOBJFile(std::string line)    {
             stream >> materialFileName;
             // Object will look for material in same folder as object
             material = MaterialLoader(Utils::GetDirectoryOfFile(m_objFilePath) + materialFileName);
+        } else if (tok == "usemtl") {
+            std::string materialName;
+            stream >> materialName;
+            int materialIndex = material.has_value() ? material.value().GetMaterialIndex(materialName) : -1;
+            if (materialIndex == -1)    {
+                std::cout << "Material " << materialName << " not found, using first material" << std::endl;
+                materialIndex = 0;
+            }
+            currentMaterialIndex = materialIndex;
         }
     }
 }
@@ -86,7 +115,7 @@ GLuint ObjModelLoader::GetVertexIndex(std::string const &s)   {
     }
 
     normalIndex = std::stoi(s.substr(secondSlash + 1));
-    std::array<int, 3> vertexInfo = {positionIndex, textureIndex, normalIndex};
+    std::array<int, 4> vertexInfo = {positionIndex, textureIndex, normalIndex, currentMaterialIndex};
     if (vertexMap.count(vertexInfo) == 0)   {
         return AddUniqueVertexAndReturnIndex(vertexInfo);
     } else {
@@ -95,7 +124,7 @@ GLuint ObjModelLoader::GetVertexIndex(std::string const &s)   {
     }
 }
 
-GLuint ObjModelLoader::AddUniqueVertexAndReturnIndex(std::array<int, 3> vertexInfo)  {
+GLuint ObjModelLoader::AddUniqueVertexAndReturnIndex(std::array<int, 4> vertexInfo)  {
     vertexMap[vertexInfo] = vertices.size(); // Add index number of new vertex to hashmap
     Geometry::Vertex newVertex;
     glm::vec3 p = positions[vertexInfo[0] - 1]; // - 1 because .obj files start index starting at 1, there will never be 0//7 or 7//0
@@ -103,9 +132,15 @@ GLuint ObjModelLoader::AddUniqueVertexAndReturnIndex(std::array<int, 3> vertexIn
     newVertex.y = p.y;
     newVertex.z = p.z;
 
-    newVertex.r = (float)defaultColorR / 255.0f; // Normalize colors
-    newVertex.g = (float)defaultColorG / 255.0f;
-    newVertex.b = (float)defaultColorB / 255.0f;
+    // The lit shader reads colors from the material table, vertex color is kept for the unlit shaders
+    newVertex.materialIndex = (float)vertexInfo[3];
+    Material m = Material::CreateDefault();
+    if (material.has_value() && vertexInfo[3] < (int)material.value().GetMaterials().size())  {
+        m = material.value().GetMaterials()[vertexInfo[3]];
+    }
+    newVertex.r = m.diffuseColor[0];
+    newVertex.g = m.diffuseColor[1];
+    newVertex.b = m.diffuseColor[2];
     
     // If a texture index is provided
     if (vertexInfo[1] != -1)    { 
@@ -158,3 +193,38 @@ int ObjModelLoader::GetDiffuseTextureHeight()   {
     }
     return material.value().GetDiffuseTextureHeight();
 }
+
+std::vector<Material> ObjModelLoader::GetMaterials()    {
+    if (material.has_value() && !material.value().GetMaterials().empty())   {
+        return material.value().GetMaterials();
+    }
+    Material defaultMaterial = Material::CreateDefault();
+    for (int c = 0; c < 3; c++) {
+        defaultMaterial.dotColor[c] = defaultMaterial.diffuseColor[c] * 0.8f;
+    }
+    return std::vector<Material>{defaultMaterial};
+}
+
+std::vector<std::string> ObjModelLoader::GetTexturePaths()  {
+    if (!material.has_value())  {
+        return std::vector<std::string>();
+    }
+    return material.value().GetTexturePaths();
+}
+
+std::string ObjModelLoader::GetMaterialFilePath()  {
+    if (!material.has_value())  {
+        return std::string();
+    }
+    return material.value().GetMaterialFilePath();
+}
+
+const TextureImage& ObjModelLoader::GetTexture(int textureIndex)    {
+    return material.value().GetTexture(textureIndex);
+}
+
+void ObjModelLoader::WaitForTextures()  {
+    if (material.has_value())   {
+        material.value().WaitForTextures();
+    }
+}
@@ -0,0 +1,244 @@
+#include "OcclusionCuller.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "ThreadPool.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // Below these counts a frame the threads cost more than they save
+    const int kTrianglesPerJob = 512;
+    const int kBoxesPerJob = 4096;
+}
+
+OcclusionCuller::OcclusionCuller(const OcclusionCullerSettings& settings) : m_settings(settings) {
+    // Whole tiles, so a tile row or an SSE register never runs off the buffer
+    m_settings.width = std::max((m_settings.width + kTileSize - 1) / kTileSize, 1) * kTileSize;
+    m_settings.height = std::max((m_settings.height + kTileSize - 1) / kTileSize, 1) * kTileSize;
+    m_tilesX = m_settings.width / kTileSize;
+    m_tilesY = m_settings.height / kTileSize;
+    m_depth.assign(m_settings.width * m_settings.height, 1.0f);
+    m_tileMaxDepth.assign(m_tilesX * m_tilesY, 1.0f);
+}
+
+void OcclusionCuller::BeginFrame(const glm::mat4& viewProjection) {
+    m_viewProjection = viewProjection;
+    m_triangles.clear();
+    m_stats = Stats();
+}
+
+void OcclusionCuller::AddOccluder(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, const glm::mat4& modelMatrix) {
+    glm::mat4 modelViewProjection = m_viewProjection * modelMatrix;
+    size_t numCorners = indices.empty() ? positions.size() : indices.size();
+    m_stats.numOccluders++;
+    m_stats.numOccluderTriangles += numCorners / 3;
+    for (size_t first = 0; first + 2 < numCorners; first += 3) {
+        ScreenTriangle triangle;
+        bool isInFrontOfNearPlane = true;
+        for (int corner = 0; corner < 3 && isInFrontOfNearPlane; corner++) {
+            size_t index = indices.empty() ? first + corner : indices[first + corner];
+            glm::vec4 clip = modelViewProjection * glm::vec4(positions[index], 1.0f);
+            isInFrontOfNearPlane = clip.z >= -clip.w && clip.w > 0.0f;
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            triangle.corners[corner] = glm::vec3((ndc.x * 0.5f + 0.5f) * m_settings.width, (ndc.y * 0.5f + 0.5f) * m_settings.height,
+                                                 ndc.z * 0.5f + 0.5f);
+        }
+        if (!isInFrontOfNearPlane) {
+            continue;
+        }
+        // Rows whose pixel centers the triangle can cover
+        float minY = std::min(triangle.corners[0].y, std::min(triangle.corners[1].y, triangle.corners[2].y));
+        float maxY = std::max(triangle.corners[0].y, std::max(triangle.corners[1].y, triangle.corners[2].y));
+        triangle.minY = std::max((int)std::ceil(minY - 0.5f), 0);
+        triangle.maxY = std::min((int)std::floor(maxY - 0.5f), m_settings.height - 1);
+        if (triangle.minY <= triangle.maxY) {
+            m_triangles.push_back(triangle);
+        }
+    }
+}
+
+void OcclusionCuller::RasterizeOccluders() {
+    auto start = std::chrono::steady_clock::now();
+    std::fill(m_depth.begin(), m_depth.end(), 1.0f);
+    int numJobs = m_triangles.size() < kTrianglesPerJob ? 1 : m_tilesY;
+    numJobs = ThreadPool::GetShared().RunSplit(numJobs, [this](int job, int jobStep) { RasterizeTileRows(job, jobStep); });
+    m_stats.numThreads = numJobs;
+    m_stats.rasterizeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void OcclusionCuller::RasterizeTileRows(int firstTileRow, int tileRowStep) {
+    // Tile rows are interleaved between the jobs, occluders tend to gather in the middle of the screen
+    for (int tileRow = firstTileRow; tileRow < m_tilesY; tileRow += tileRowStep) {
+        int rowMinY = tileRow * kTileSize;
+        int rowMaxY = rowMinY + kTileSize - 1;
+        for (const ScreenTriangle& triangle : m_triangles) {
+            if (triangle.maxY >= rowMinY && triangle.minY <= rowMaxY) {
+                RasterizeTriangle(triangle, std::max(triangle.minY, rowMinY), std::min(triangle.maxY, rowMaxY));
+            }
+        }
+        for (int tileX = 0; tileX < m_tilesX; tileX++) {
+            float maxDepth = 0.0f;
+            for (int y = rowMinY; y <= rowMaxY; y++) {
+                const float* depth = &m_depth[y * m_settings.width + tileX * kTileSize];
+                maxDepth = std::max(maxDepth, *std::max_element(depth, depth + kTileSize));
+            }
+            m_tileMaxDepth[tileRow * m_tilesX + tileX] = maxDepth;
+        }
+    }
+}
+
+void OcclusionCuller::RasterizeTriangle(const ScreenTriangle& triangle, int minY, int maxY) {
+    glm::vec3 v0 = triangle.corners[0];
+    glm::vec3 v1 = triangle.corners[1];
+    glm::vec3 v2 = triangle.corners[2];
+    float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+    if (std::abs(area) < 1.0e-6f) {
+        return;
+    }
+    // Occluders are drawn from both sides, counter clockwise keeps the inside of every edge positive
+    if (area < 0.0f) {
+        std::swap(v1, v2);
+        area = -area;
+    }
+    // Edge i is opposite corner i, a * x + b * y + c is positive on the triangle's side of it
+    const glm::vec3 corners[3] = {v0, v1, v2};
+    float a[3], b[3], c[3];
+    for (int edge = 0; edge < 3; edge++) {
+        glm::vec3 from = corners[(edge + 1) % 3];
+        glm::vec3 to = corners[(edge + 2) % 3];
+        a[edge] = from.y - to.y;
+        b[edge] = to.x - from.x;
+        c[edge] = -(a[edge] * from.x + b[edge] * from.y);
+    }
+    // Depth is linear in screen space, weighted by each corner's edge function
+    float depthA = (a[0] * v0.z + a[1] * v1.z + a[2] * v2.z) / area;
+    float depthB = (b[0] * v0.z + b[1] * v1.z + b[2] * v2.z) / area;
+    float depthC = (c[0] * v0.z + c[1] * v1.z + c[2] * v2.z) / area;
+
+    float minX = std::min(v0.x, std::min(v1.x, v2.x));
+    float maxX = std::max(v0.x, std::max(v1.x, v2.x));
+    int firstX = std::max((int)std::ceil(minX - 0.5f), 0) & ~3; // Whole SSE registers
+    int lastX = std::min((int)std::floor(maxX - 0.5f), m_settings.width - 1);
+    if (firstX > lastX) {
+        return;
+    }
+#if defined(__SSE2__)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 pixelOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 edgeA0 = _mm_set1_ps(a[0]), edgeA1 = _mm_set1_ps(a[1]), edgeA2 = _mm_set1_ps(a[2]);
+    const __m128 slopeX = _mm_set1_ps(depthA);
+    for (int y = minY; y <= maxY; y++) {
+        float pixelY = y + 0.5f;
+        const __m128 rowEdge0 = _mm_set1_ps(b[0] * pixelY + c[0]);
+        const __m128 rowEdge1 = _mm_set1_ps(b[1] * pixelY + c[1]);
+        const __m128 rowEdge2 = _mm_set1_ps(b[2] * pixelY + c[2]);
+        const __m128 rowDepth = _mm_set1_ps(depthB * pixelY + depthC);
+        float* depthRow = &m_depth[y * m_settings.width];
+        for (int x = firstX; x <= lastX; x += 4) {
+            __m128 pixelX = _mm_add_ps(_mm_set1_ps((float)x), pixelOffsets);
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA0, pixelX), rowEdge0), zero),
+                                       _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA1, pixelX), rowEdge1), zero));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA2, pixelX), rowEdge2), zero));
+            if (_mm_movemask_ps(inside) == 0) {
+                continue;
+            }
+            // Nearest depth where the triangle covers the pixel, the old depth elsewhere
+            __m128 oldDepth = _mm_loadu_ps(depthRow + x);
+            __m128 newDepth = _mm_min_ps(oldDepth, _mm_add_ps(_mm_mul_ps(slopeX, pixelX), rowDepth));
+            _mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(inside, newDepth), _mm_andnot_ps(inside, oldDepth)));
+        }
+    }
+#else
+    for (int y = minY; y <= maxY; y++) {
+        float pixelY = y + 0.5f;
+        float* depthRow = &m_depth[y * m_settings.width];
+        for (int x = firstX; x <= lastX; x++) {
+            float pixelX = x + 0.5f;
+            bool isInside = true;
+            for (int edge = 0; edge < 3; edge++) {
+                isInside &= a[edge] * pixelX + b[edge] * pixelY + c[edge] >= 0.0f;
+            }
+            if (isInside) {
+                depthRow[x] = std::min(depthRow[x], depthA * pixelX + depthB * pixelY + depthC);
+            }
+        }
+    }
+#endif
+}
+
+bool OcclusionCuller::IsBoxVisible(glm::vec3 worldMin, glm::vec3 worldMax) {
+    bool isVisible = TestBox(worldMin, worldMax);
+    m_stats.numTested++;
+    m_stats.numOccluded += isVisible ? 0 : 1;
+    return isVisible;
+}
+
+void OcclusionCuller::TestBoxes(const std::vector<glm::vec3>& worldMins, const std::vector<glm::vec3>& worldMaxs, std::vector<uint8_t>& isVisible) {
+    auto start = std::chrono::steady_clock::now();
+    int numBoxes = worldMins.size();
+    isVisible.resize(numBoxes);
+    int numJobs = std::max(numBoxes / kBoxesPerJob, 1);
+    ThreadPool::GetShared().RunSplit(numJobs, [&](int job, int jobCount) {
+        std::pair<int, int> boxes = ThreadPool::GetJobRange(numBoxes, job, jobCount);
+        for (int box = boxes.first; box < boxes.second; box++) {
+            isVisible[box] = TestBox(worldMins[box], worldMaxs[box]) ? 1 : 0;
+        }
+    });
+    m_stats.numTested += numBoxes;
+    m_stats.numOccluded += std::count(isVisible.begin(), isVisible.end(), 0);
+    m_stats.testMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool OcclusionCuller::TestBox(glm::vec3 worldMin, glm::vec3 worldMax) const {
+    glm::vec2 screenMin(m_settings.width, m_settings.height);
+    glm::vec2 screenMax(0.0f);
+    float nearestDepth = 1.0f;
+    for (int corner = 0; corner < 8; corner++) {
+        glm::vec3 worldCorner((corner & 1) ? worldMax.x : worldMin.x,
+                              (corner & 2) ? worldMax.y : worldMin.y,
+                              (corner & 4) ? worldMax.z : worldMin.z);
+        glm::vec4 clip = m_viewProjection * glm::vec4(worldCorner, 1.0f);
+        if (clip.z < -clip.w || clip.w <= 0.0f) {
+            // Reaches behind the near plane, the camera could be inside it
+            return true;
+        }
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        glm::vec2 screen((ndc.x * 0.5f + 0.5f) * m_settings.width, (ndc.y * 0.5f + 0.5f) * m_settings.height);
+        screenMin = glm::min(screenMin, screen);
+        screenMax = glm::max(screenMax, screen);
+        nearestDepth = std::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+    }
+    // Every pixel the box's screen rectangle touches, not only the ones whose centers it covers
+    int minX = std::max((int)std::floor(screenMin.x), 0);
+    int minY = std::max((int)std::floor(screenMin.y), 0);
+    int maxX = std::min((int)std::floor(screenMax.x), m_settings.width - 1);
+    int maxY = std::min((int)std::floor(screenMax.y), m_settings.height - 1);
+    if (minX > maxX || minY > maxY) {
+        // Off screen, the frustum culler's call
+        return true;
+    }
+    for (int tileY = minY / kTileSize; tileY <= maxY / kTileSize; tileY++) {
+        for (int tileX = minX / kTileSize; tileX <= maxX / kTileSize; tileX++) {
+            if (nearestDepth > m_tileMaxDepth[tileY * m_tilesX + tileX]) {
+                continue; // Behind every pixel of the tile
+            }
+            for (int y = std::max(minY, tileY * kTileSize); y <= std::min(maxY, tileY * kTileSize + kTileSize - 1); y++) {
+                for (int x = std::max(minX, tileX * kTileSize); x <= std::min(maxX, tileX * kTileSize + kTileSize - 1); x++) {
+                    if (nearestDepth <= m_depth[y * m_settings.width + x]) {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+const OcclusionCuller::Stats& OcclusionCuller::GetStats() const {
+    return m_stats;
+}
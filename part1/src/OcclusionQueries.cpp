@@ -0,0 +1,80 @@
+#include "OcclusionQueries.hpp"
+
+void OcclusionQueries::BeginFrame() {
+    m_frame++;
+    int numPooledQueries = m_stats.numPooledQueries;
+    m_stats = Stats();
+    m_stats.numPooledQueries = numPooledQueries;
+    for (ObjectQuery& object : m_objects) {
+        if (object.query == 0) {
+            continue;
+        }
+        GLuint isAvailable = GL_FALSE;
+        glGetQueryObjectuiv(object.query, GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+        if (!isAvailable) {
+            m_stats.numResultsPending++;
+            continue;
+        }
+        GLuint anySamplesPassed = GL_FALSE;
+        glGetQueryObjectuiv(object.query, GL_QUERY_RESULT, &anySamplesPassed);
+        object.isVisible = anySamplesPassed != GL_FALSE;
+        if (object.isVisible && !object.wasPredictedVisible) {
+            m_stats.numFalseNegatives++;
+            m_stats.numPops += object.wasDrawn ? 0 : 1;
+        }
+        m_stats.numResultsRead++;
+        m_freeQueries.push_back(object.query);
+        object.query = 0;
+    }
+}
+
+bool OcclusionQueries::IsPredictedVisible(int object) const {
+    if (object >= (int)m_objects.size()) {
+        return true;
+    }
+    // Out of view or not queried for a while, the result is too old to go by
+    const ObjectQuery& objectQuery = m_objects[object];
+    return objectQuery.isVisible || (objectQuery.query == 0 && m_frame - objectQuery.lastIssuedFrame > 1);
+}
+
+GLuint OcclusionQueries::IssueQuery(int object, bool isPredictedVisible, bool isDrawn) {
+    if (object >= (int)m_objects.size()) {
+        m_objects.resize(object + 1);
+    }
+    m_stats.numPredictedHidden += isPredictedVisible ? 0 : 1;
+    ObjectQuery& objectQuery = m_objects[object];
+    if (objectQuery.query != 0) {
+        return 0;
+    }
+    if (m_freeQueries.empty()) {
+        GLuint query = 0;
+        glGenQueries(1, &query);
+        m_freeQueries.push_back(query);
+        m_stats.numPooledQueries++;
+    }
+    objectQuery.query = m_freeQueries.back();
+    m_freeQueries.pop_back();
+    objectQuery.wasPredictedVisible = isPredictedVisible;
+    objectQuery.wasDrawn = isDrawn;
+    objectQuery.lastIssuedFrame = m_frame;
+    m_stats.numIssued++;
+    return objectQuery.query;
+}
+
+const OcclusionQueries::Stats& OcclusionQueries::GetStats() const {
+    return m_stats;
+}
+
+void OcclusionQueries::CleanUp() {
+    for (ObjectQuery& object : m_objects) {
+        if (object.query != 0) {
+            m_freeQueries.push_back(object.query);
+        }
+    }
+    if (!m_freeQueries.empty()) {
+        glDeleteQueries(m_freeQueries.size(), m_freeQueries.data());
+    }
+    m_freeQueries.clear();
+    m_objects.clear();
+    m_stats = Stats();
+}
@@ -10,8 +10,19 @@
 // Constructor loads a filename with the .ppm extension
 PPM::PPM(std::string fileName){
   std::ifstream inputFile;
-  inputFile.open(fileName);
+  inputFile.open(fileName, std::ios::binary);
   if (inputFile.is_open())  {
+    // Binary PPMs are read in one go, anything else goes through the P3 text parser below
+    std::string magic;
+    inputFile >> magic;
+    if (magic == "P6")  {
+      loadP6(inputFile);
+      inputFile.close();
+      return;
+    }
+    inputFile.clear();
+    inputFile.seekg(0);
+
     bool foundP3 = false;
     bool foundDimensions = false;
     bool foundRange = false;
@@ -51,6 +62,55 @@ PPM::PPM(std::string fileName){
   }
 }
 
+void PPM::loadP6(std::ifstream& inputFile) {
+  // Header is width, height and max range separated by whitespace, and may contain # comments
+  int headerValues[3];
+  for (int i = 0; i < 3; i++)  {
+    inputFile >> std::ws;
+    while (inputFile.peek() == '#')  {
+      std::string comment;
+      std::getline(inputFile, comment);
+      inputFile >> std::ws;
+    }
+    inputFile >> headerValues[i];
+  }
+  m_width = headerValues[0];
+  m_height = headerValues[1];
+  m_maxRange = headerValues[2];
+  inputFile.get(); // Exactly one whitespace character separates the header from the pixels
+  if (!inputFile || m_width <= 0 || m_height <= 0 || m_maxRange <= 0 || m_maxRange > 65535)  {
+    std::cout << "Invalid P6 header" << std::endl;
+    m_width = m_height = 0;
+    return;
+  }
+
+  // Samples are 1 byte each, or 2 bytes (most significant first) when the range does not fit in a byte
+  const size_t bytesPerSample = m_maxRange < 256 ? 1 : 2;
+  const size_t numPixels = (size_t)m_width * m_height;
+  std::vector<uint8_t> raw(numPixels * 3 * bytesPerSample);
+  inputFile.read(reinterpret_cast<char*>(raw.data()), raw.size());
+  if ((size_t)inputFile.gcount() != raw.size())  {
+    std::cout << "P6 file is missing pixel data" << std::endl;
+  }
+
+  m_PixelData.resize(numPixels);
+  for (size_t i = 0; i < numPixels; i++)  {
+    uint8_t rgb[3];
+    for (int c = 0; c < 3; c++)  {
+      if (bytesPerSample == 1)  {
+        rgb[c] = raw[i * 3 + c];
+      } else {
+        int sample = (raw[(i * 3 + c) * 2] << 8) | raw[(i * 3 + c) * 2 + 1];
+        rgb[c] = (uint8_t)(sample * 255 / m_maxRange);
+      }
+    }
+    m_PixelData[i] = Pixel{rgb[0], rgb[1], rgb[2]};
+  }
+  if (bytesPerSample == 2)  {
+    m_maxRange = 255;
+  }
+}
+
 u_int8_t PPM::getNextInteger(std::ifstream& inputFile, std::stringstream& stream) {
     std::string line;
     std::string chunk_of_data;
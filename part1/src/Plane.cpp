@@ -1,4 +1,5 @@
 #include "Plane.hpp"
+#include "GLStateTracker.hpp"
 
 
 Plane::Plane(float size, std::array<u_int8_t, 3> planeColorRGB) : m_size(size), m_planeColorRGB(planeColorRGB) {
@@ -17,6 +18,7 @@ Plane::Plane(float size, std::array<u_int8_t, 3> planeColorRGB) : m_size(size),
             bottomLeft.z = -1 * row * edgeOfFaceSize;
             bottomLeft.tx = 0.0f; // TODO: Change these tex coords if implement resolutions
             bottomLeft.ty = 0.0f;
+            bottomLeft.materialIndex = 0.0f; // Planes have a single material, picked by the instance's materialBase
             Geometry::Vertex bottomRight;
             bottomRight = bottomLeft;
             bottomRight.x += edgeOfFaceSize;
@@ -52,12 +54,12 @@ Plane::Plane(float size, std::array<u_int8_t, 3> planeColorRGB) : m_size(size),
     // Setup VAO
     // Vertex Arrays Object (VAO) Setup
 	glGenVertexArrays(1, &m_vertexArrayObject);
-    glBindVertexArray(m_vertexArrayObject);
+    GLStateTracker::Get().BindVertexArray(m_vertexArrayObject);
 
     // Vertex Buffer Object (VBO) creation
     m_vboData = GetVertexBufferObjectData();
 	glGenBuffers(1, &m_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    GLStateTracker::Get().BindBuffer(GL_ARRAY_BUFFER, m_vbo);
     glBufferData(GL_ARRAY_BUFFER, 						        // Kind of buffer we are working with 
                                                                 // (e.g. GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER)
                     m_vboData.size() * sizeof(GL_FLOAT), 	// Size of data in bytes
@@ -76,25 +78,29 @@ Plane::Plane(float size, std::array<u_int8_t, 3> planeColorRGB) : m_size(size),
     // ============================
     // Position information (x,y,z)
 	glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*11,(void*)0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*12,(void*)0);
     // Color information (r,g,b)
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*11,(GLvoid*)(sizeof(GL_FLOAT)*3));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*12,(GLvoid*)(sizeof(GL_FLOAT)*3));
     // Normal information (nx,ny,nz)
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*11, (GLvoid*)(sizeof(GL_FLOAT)*6));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*12, (GLvoid*)(sizeof(GL_FLOAT)*6));
     // Texture information (tx,ty)
     glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*11, (GLvoid*)(sizeof(GL_FLOAT)*9));
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*12, (GLvoid*)(sizeof(GL_FLOAT)*9));
+    // Material index
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE,sizeof(GL_FLOAT)*12, (GLvoid*)(sizeof(GL_FLOAT)*11));
 
 	// Unbind our currently bound Vertex Array Object
-	glBindVertexArray(0);
+	GLStateTracker::Get().BindVertexArray(0);
 	// Disable any attributes we opened in our Vertex Attribute Arrray,
 	// as we do not want to leave them open. 
 	glDisableVertexAttribArray(0);
 	glDisableVertexAttribArray(1);
 	glDisableVertexAttribArray(2);
     glDisableVertexAttribArray(3);
+    glDisableVertexAttribArray(4);
 
 }
 
@@ -109,14 +115,18 @@ std::vector<GLfloat> Plane::GetVertexBufferObjectData()    {
 
 void Plane::Draw()  {
     // Enable our attributes
-	glBindVertexArray(m_vertexArrayObject);
-    
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_vbo);
+	GLStateTracker::Get().BindVertexArray(m_vertexArrayObject);
     //std::cout << "Number of vertices to draw: " << m_numVerticesToDraw << std::endl;
-    //Render data
+    //Render data, non indexed so no element buffer
     glDrawArrays(GL_TRIANGLES, 0, m_mesh.size() * 3);
+}
 
-	// Stop using our current graphics pipeline
-	// Note: This is not necessary if we only have one graphics pipeline.
-    glUseProgram(0);
-}
\ No newline at end of file
+std::vector<glm::vec3> Plane::GetTrianglePositions()    {
+    std::vector<glm::vec3> positions;
+    for (const Geometry::Triangle& triangle : m_mesh)  {
+        for (const Geometry::Vertex& vertex : triangle.vertices)   {
+            positions.push_back(glm::vec3(vertex.x, vertex.y, vertex.z));
+        }
+    }
+    return positions;
+}
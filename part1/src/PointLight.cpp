@@ -1,5 +1,9 @@
 #include "PointLight.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 PointLight::PointLight(glm::vec3 position, glm::vec3 ambientColor, glm::vec3 diffuseColor, glm::vec3 specularColor, 
                        GLfloat constantFallOff, GLfloat linearFallOff, GLfloat quadtraticFallOff, GLfloat ambientStrength) : 
                        m_position(position),
@@ -55,10 +59,26 @@ std::vector<GLuint> PointLight::GetElementBufferObjectData()    {
     };
 }
 
-glm::vec3 PointLight::GetPosition() {
+glm::vec3 PointLight::GetPosition() const {
     return m_position;
 }
 
+glm::vec3 PointLight::GetDiffuseColor() const {
+    return m_diffuseColor;
+}
+
+float PointLight::GetRange(float cutoff) const {
+    // Solve quadtratic * d^2 + linear * d + constant - 1 / cutoff = 0 for the positive root
+    float c = m_constantFallOff - 1.0f / cutoff;
+    if (m_quadtraticFallOff > 0.0f) {
+        return (-m_linearFallOff + std::sqrt(m_linearFallOff * m_linearFallOff - 4.0f * m_quadtraticFallOff * c)) / (2.0f * m_quadtraticFallOff);
+    }
+    if (m_linearFallOff > 0.0f) {
+        return std::max(-c / m_linearFallOff, 0.0f);
+    }
+    return std::numeric_limits<float>::infinity();
+}
+
 const float* PointLight::GetPositionForUniform() const  {
     return &m_position[0];
 }
@@ -84,3 +104,18 @@ const float PointLight::GetQuadtraticFallOffForUniform() const  {
     return m_quadtraticFallOff;
 }
                     
+
+LightData PointLight::GetUniformBlockData() const   {
+    LightData data = {};
+    for (int i = 0; i < 3; i++) {
+        data.worldPosition[i] = m_position[i];
+        data.ambientColor[i] = m_ambientColor[i];
+        data.diffuseColor[i] = m_diffuseColor[i];
+        data.specularColor[i] = m_specularColor[i];
+    }
+    data.ambientStrength = m_ambientStrength;
+    data.constantFallOff = m_constantFallOff;
+    data.linearFallOff = m_linearFallOff;
+    data.quadtraticFallOff = m_quadtraticFallOff;
+    return data;
+}
@@ -0,0 +1,166 @@
+#include "ProgramBinaryCache.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+namespace {
+    const GLenum kProgramBinaryRetrievableHint = 0x8257; // GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+    const GLenum kProgramBinaryLength = 0x8741;          // GL_PROGRAM_BINARY_LENGTH
+    const GLenum kNumProgramBinaryFormats = 0x87FE;      // GL_NUM_PROGRAM_BINARY_FORMATS
+
+    const char kMagic[4] = {'P', 'B', 'C', '1'};
+
+    struct FileHeader {
+        char magic[4];
+        uint32_t binaryFormat;
+        uint64_t key;       // Guards against a file renamed or copied to the wrong name
+        uint64_t size;
+    };
+
+    const char* GetGLString(GLenum name) {
+        const GLubyte* value = glGetString(name);
+        return value != nullptr ? reinterpret_cast<const char*>(value) : "";
+    }
+}
+
+void ProgramBinaryCache::Initialize(const std::string& cacheDirectory, GLADloadproc loadProc) {
+    m_cacheDirectory = cacheDirectory;
+    m_getProgramBinary = (GetProgramBinaryProc)loadProc("glGetProgramBinary");
+    m_programBinary = (ProgramBinaryProc)loadProc("glProgramBinary");
+    m_programParameteri = (ProgramParameteriProc)loadProc("glProgramParameteri");
+
+    GLint numFormats = 0;
+    glGetIntegerv(kNumProgramBinaryFormats, &numFormats);
+    m_isEnabled = m_getProgramBinary != nullptr && m_programBinary != nullptr && numFormats > 0;
+    if (!m_isEnabled) {
+        std::cout << "Program binaries not supported by the driver, shaders compile from source every launch" << std::endl;
+        return;
+    }
+    m_driverString = std::string(GetGLString(GL_VENDOR)) + "\n" + GetGLString(GL_RENDERER) + "\n" + GetGLString(GL_VERSION);
+
+    std::error_code error;
+    std::filesystem::create_directories(m_cacheDirectory, error);
+    if (error) {
+        std::cout << "Could not create program cache directory " << m_cacheDirectory << ": " << error.message() << std::endl;
+        m_isEnabled = false;
+    }
+}
+
+bool ProgramBinaryCache::IsEnabled() const {
+    return m_isEnabled;
+}
+
+uint64_t ProgramBinaryCache::GetKey(const std::string& vertexShaderSource, const std::string& geometryShaderSource,
+                                    const std::string& fragmentShaderSource) const {
+    uint64_t hash = 14695981039346656037ull;
+    // Each part's length goes first, so "ab" + "c" never hashes like "a" + "bc" whatever bytes the sources hold
+    for (const std::string* part : {&vertexShaderSource, &geometryShaderSource, &fragmentShaderSource, &m_driverString}) {
+        uint64_t length = part->size();
+        for (int i = 0; i < 8; i++) {
+            hash = (hash ^ (uint8_t)(length >> (8 * i))) * 1099511628211ull;
+        }
+        for (char c : *part) {
+            hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+std::string ProgramBinaryCache::GetCachePath(uint64_t key) const {
+    std::ostringstream path;
+    path << m_cacheDirectory << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".progbin";
+    return path.str();
+}
+
+GLuint ProgramBinaryCache::Load(const std::string& vertexShaderSource, const std::string& geometryShaderSource,
+                                const std::string& fragmentShaderSource) {
+    if (!m_isEnabled) {
+        return 0;
+    }
+    uint64_t key = GetKey(vertexShaderSource, geometryShaderSource, fragmentShaderSource);
+    std::ifstream file(GetCachePath(key), std::ios::binary | std::ios::ate);
+    uint64_t fileSize = file ? (uint64_t)file.tellg() : 0;
+    file.seekg(0);
+    FileHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.key != key) {
+        m_stats.numMisses++;
+        return 0;
+    }
+    // A truncated or corrupt file compiles from source like a missing one, before anything is allocated for it
+    if (header.size == 0 || header.size != fileSize - sizeof(header) || header.size > (uint64_t)INT32_MAX) {
+        m_stats.numMisses++;
+        return 0;
+    }
+    std::vector<char> binary(header.size);
+    if (!file.read(binary.data(), binary.size())) {
+        m_stats.numMisses++;
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    m_programBinary(program, header.binaryFormat, binary.data(), binary.size());
+    GLint linkStatus = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+    if (linkStatus == GL_FALSE) {
+        glDeleteProgram(program);
+        m_stats.numRejected++;
+        m_stats.numMisses++;
+        return 0;
+    }
+    m_stats.numHits++;
+    return program;
+}
+
+void ProgramBinaryCache::PrepareForLink(GLuint program) {
+    if (m_isEnabled && m_programParameteri != nullptr) {
+        m_programParameteri(program, kProgramBinaryRetrievableHint, GL_TRUE);
+    }
+}
+
+void ProgramBinaryCache::Store(GLuint program, const std::string& vertexShaderSource, const std::string& geometryShaderSource,
+                               const std::string& fragmentShaderSource) {
+    if (!m_isEnabled) {
+        return;
+    }
+    GLint length = 0;
+    glGetProgramiv(program, kProgramBinaryLength, &length);
+    if (length <= 0) {
+        return;
+    }
+    std::vector<char> binary(length);
+    GLenum binaryFormat = 0;
+    m_getProgramBinary(program, length, &length, &binaryFormat, binary.data());
+
+    FileHeader header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.binaryFormat = binaryFormat;
+    header.key = GetKey(vertexShaderSource, geometryShaderSource, fragmentShaderSource);
+    header.size = length;
+    // Written under a temporary name first so a crash never leaves half a binary behind
+    std::string path = GetCachePath(header.key);
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(binary.data(), length);
+        if (!file) {
+            std::cout << "Could not write program cache file " << temporaryPath << std::endl;
+            return;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+    if (!error) {
+        m_stats.numStored++;
+    }
+}
+
+ProgramBinaryCache::Stats ProgramBinaryCache::GetStats() const {
+    return m_stats;
+}
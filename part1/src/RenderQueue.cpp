@@ -0,0 +1,127 @@
+#include "RenderQueue.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "GLStateTracker.hpp"
+
+uint64_t RenderQueue::MakeSortKey(GLuint program, int material, int texture, float depth) {
+    uint64_t programBits = std::min<uint64_t>(program, 0xFF);
+    uint64_t materialBits = std::clamp(material, 0, 0xFFFF);
+    uint64_t textureBits = std::clamp(texture, 0, 0xFFFF);
+    uint64_t depthBits = (uint64_t)std::lround(std::clamp(depth, 0.0f, 1.0f) * 0xFFFFFF);
+    return (programBits << 56) | (materialBits << 40) | (textureBits << 24) | depthBits;
+}
+
+void RenderQueue::Clear() {
+    for (int pass = 0; pass < RENDER_PASS_COUNT; pass++) {
+        m_buckets[pass].clear();
+        m_sortedOrder[pass].clear();
+    }
+}
+
+void RenderQueue::Add(RenderPass pass, const DrawPacket& packet) {
+    m_buckets[pass].push_back(packet);
+}
+
+void RenderQueue::Sort() {
+    for (int pass = 0; pass < RENDER_PASS_COUNT; pass++) {
+        RadixSort((RenderPass)pass);
+    }
+}
+
+void RenderQueue::RadixSort(RenderPass pass) {
+    const std::vector<DrawPacket>& bucket = m_buckets[pass];
+    std::vector<std::pair<uint64_t, uint32_t>>* from = &m_sortScratch[0];
+    std::vector<std::pair<uint64_t, uint32_t>>* to = &m_sortScratch[1];
+    from->resize(bucket.size());
+    to->resize(bucket.size());
+    for (size_t i = 0; i < bucket.size(); i++) {
+        (*from)[i] = {bucket[i].sortKey, (uint32_t)i};
+    }
+
+    // Least significant byte first, each pass is a stable counting sort
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t counts[256] = {};
+        for (const auto& entry : *from) {
+            counts[(entry.first >> shift) & 0xFF]++;
+        }
+        // Every key shares this byte, which is common for the upper bytes, nothing to reorder
+        if (bucket.empty() || counts[((*from)[0].first >> shift) & 0xFF] == bucket.size()) {
+            continue;
+        }
+        size_t offset = 0;
+        for (size_t& count : counts) {
+            size_t bucketStart = offset;
+            offset += count;
+            count = bucketStart;
+        }
+        for (const auto& entry : *from) {
+            (*to)[counts[(entry.first >> shift) & 0xFF]++] = entry;
+        }
+        std::swap(from, to);
+    }
+
+    m_sortedOrder[pass].resize(bucket.size());
+    for (size_t i = 0; i < bucket.size(); i++) {
+        m_sortedOrder[pass][i] = (*from)[i].second;
+    }
+}
+
+void RenderQueue::Execute(RenderPass pass, uint32_t viewMask) {
+    const std::vector<DrawPacket>& bucket = m_buckets[pass];
+    // An unsorted bucket draws in the order it was added
+    bool isSorted = m_sortedOrder[pass].size() == bucket.size();
+    for (size_t i = 0; i < bucket.size(); i++) {
+        const DrawPacket& packet = bucket[isSorted ? m_sortedOrder[pass][i] : i];
+        if ((packet.viewMask & viewMask) != 0) {
+            Draw(packet);
+        }
+    }
+}
+
+void RenderQueue::Draw(const DrawPacket& packet) {
+    GLStateTracker& state = GLStateTracker::Get();
+    ShaderProgram& program = *packet.program;
+    state.UseProgram(program.GetID());
+    if (program.HasUniform("u_OutlineExtrudeDistance")) {
+        program.SetUniform("u_OutlineExtrudeDistance", packet.outlineExtrudeDistance);
+    }
+    if (program.HasUniform("u_ViewMask")) {
+        program.SetUniform("u_ViewMask", (int)packet.viewMask);
+    }
+    if (packet.stencilRef >= 0) {
+        state.StencilMask(0xFF);
+        state.StencilFunc(GL_ALWAYS, packet.stencilRef, 0xFF);
+    } else {
+        state.StencilMask(0x00);
+    }
+    state.BindVertexArray(packet.vertexArray);
+    m_instanceBuffer->BindInstances(packet.vertexArray, packet.firstInstance);
+    if (packet.occlusionQuery != 0) {
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, packet.occlusionQuery);
+    }
+    if (packet.conditionQuery != 0) {
+        // The GPU draws anyway when the result is not in yet, so this never stalls
+        glBeginConditionalRender(packet.conditionQuery, GL_QUERY_NO_WAIT);
+    }
+    if (packet.isIndexed) {
+        glDrawElementsInstanced(GL_TRIANGLES, packet.numVertices, GL_UNSIGNED_INT, nullptr, packet.numInstances);
+    } else {
+        glDrawArraysInstanced(GL_TRIANGLES, 0, packet.numVertices, packet.numInstances);
+    }
+    if (packet.conditionQuery != 0) {
+        glEndConditionalRender();
+    }
+    if (packet.occlusionQuery != 0) {
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+    }
+}
+
+int RenderQueue::GetNumPackets(RenderPass pass, uint32_t viewMask) const {
+    int numPackets = 0;
+    for (const DrawPacket& packet : m_buckets[pass]) {
+        numPackets += (packet.viewMask & viewMask) != 0;
+    }
+    return numPackets;
+}
@@ -0,0 +1,65 @@
+#include "SceneFramebuffer.hpp"
+
+#include <iostream>
+
+#include "GLStateTracker.hpp"
+
+void SceneFramebuffer::Create(int width, int height) {
+    m_colorTexture = CreateTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+    m_normalAndIDTexture = CreateTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+    m_depthStencilTexture = CreateTexture(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, width, height);
+
+    glGenFramebuffers(1, &m_framebuffer);
+    GLStateTracker::Get().BindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_colorTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_normalAndIDTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_depthStencilTexture, 0);
+    // Draw buffers are framebuffer state, set once
+    const GLenum drawBuffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "Scene framebuffer is incomplete" << std::endl;
+    }
+    GLStateTracker::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+GLuint SceneFramebuffer::CreateTexture(GLenum internalFormat, GLenum format, GLenum type, int width, int height) {
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    GLStateTracker::Get().BindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+void SceneFramebuffer::Bind() {
+    GLStateTracker::Get().BindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+}
+
+void SceneFramebuffer::Clear() {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    // glClear gives every draw buffer the clear color, an alpha of 1 would read as outline ID 255
+    const GLfloat noNormalOrID[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    glClearBufferfv(GL_COLOR, 1, noNormalOrID);
+}
+
+void SceneFramebuffer::BindTextures(GLuint colorUnit, GLuint normalAndIDUnit, GLuint depthUnit) {
+    GLStateTracker& state = GLStateTracker::Get();
+    state.BindTextureToUnit(colorUnit, GL_TEXTURE_2D, m_colorTexture);
+    state.BindTextureToUnit(normalAndIDUnit, GL_TEXTURE_2D, m_normalAndIDTexture);
+    state.BindTextureToUnit(depthUnit, GL_TEXTURE_2D, m_depthStencilTexture);
+}
+
+void SceneFramebuffer::CleanUp() {
+    glDeleteFramebuffers(1, &m_framebuffer);
+    glDeleteTextures(1, &m_colorTexture);
+    glDeleteTextures(1, &m_normalAndIDTexture);
+    glDeleteTextures(1, &m_depthStencilTexture);
+    m_framebuffer = 0;
+    m_colorTexture = 0;
+    m_normalAndIDTexture = 0;
+    m_depthStencilTexture = 0;
+}
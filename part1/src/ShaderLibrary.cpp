@@ -0,0 +1,193 @@
+#include "ShaderLibrary.hpp"
+
+#include <iostream>
+
+namespace {
+    const GLenum kCompletionStatus = 0x91B1; // GL_COMPLETION_STATUS_KHR, same value for the ARB version
+}
+
+void ShaderLibrary::Initialize(ProgramBinaryCache* programCache, GLADloadproc loadProc, bool isParallelCompileSupported) {
+    m_programCache = programCache;
+    if (!isParallelCompileSupported) {
+        return;
+    }
+    MaxShaderCompilerThreadsProc maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)loadProc("glMaxShaderCompilerThreadsKHR");
+    if (maxShaderCompilerThreads == nullptr) {
+        maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)loadProc("glMaxShaderCompilerThreadsARB");
+    }
+    if (maxShaderCompilerThreads != nullptr) {
+        // Let the driver decide how many threads, the default may be none
+        maxShaderCompilerThreads(0xFFFFFFFF);
+    }
+    m_isParallelCompileEnabled = true;
+}
+
+bool ShaderLibrary::IsParallelCompileEnabled() const {
+    return m_isParallelCompileEnabled;
+}
+
+GLuint ShaderLibrary::SubmitShader(GLenum type, const std::string& source) {
+    GLuint shader = glCreateShader(type);
+    const char* sourcePointer = source.c_str();
+    glShaderSource(shader, 1, &sourcePointer, nullptr);
+    glCompileShader(shader);
+    return shader;
+}
+
+int ShaderLibrary::Request(const std::string& vertexShaderPath, const std::string& fragmentShaderPath,
+                           const std::vector<std::string>& defines) {
+    return Request(vertexShaderPath, "", fragmentShaderPath, defines);
+}
+
+int ShaderLibrary::Request(const std::string& vertexShaderPath, const std::string& geometryShaderPath, const std::string& fragmentShaderPath,
+                           const std::vector<std::string>& defines) {
+    m_stats.numRequested++;
+    PendingProgram pending;
+    pending.name = vertexShaderPath + (geometryShaderPath.empty() ? "" : ", " + geometryShaderPath) + " and " + fragmentShaderPath;
+    pending.vertex = ShaderPreprocessor::Process(vertexShaderPath, defines);
+    pending.fragment = ShaderPreprocessor::Process(fragmentShaderPath, defines);
+    bool isGeometryValid = true;
+    if (!geometryShaderPath.empty()) {
+        pending.geometry = ShaderPreprocessor::Process(geometryShaderPath, defines);
+        isGeometryValid = pending.geometry.isValid;
+    }
+    if (pending.vertex.isValid && pending.fragment.isValid && isGeometryValid) {
+        // The cache key covers every stage
+        if (m_programCache != nullptr) {
+            pending.program = m_programCache->Load(pending.vertex.source, pending.geometry.source, pending.fragment.source);
+            pending.isFromCache = pending.program != 0;
+        }
+        if (!pending.isFromCache) {
+            // No status queries here, those would wait for the compile
+            pending.vertexShader = SubmitShader(GL_VERTEX_SHADER, pending.vertex.source);
+            pending.fragmentShader = SubmitShader(GL_FRAGMENT_SHADER, pending.fragment.source);
+            pending.program = glCreateProgram();
+            glAttachShader(pending.program, pending.vertexShader);
+            glAttachShader(pending.program, pending.fragmentShader);
+            if (!pending.geometry.source.empty()) {
+                pending.geometryShader = SubmitShader(GL_GEOMETRY_SHADER, pending.geometry.source);
+                glAttachShader(pending.program, pending.geometryShader);
+            }
+            if (m_programCache != nullptr) {
+                m_programCache->PrepareForLink(pending.program);
+            }
+            glLinkProgram(pending.program);
+        }
+    }
+    if (!m_releasedRequests.empty()) {
+        int request = m_releasedRequests.back();
+        m_releasedRequests.pop_back();
+        m_requests[request] = std::move(pending);
+        return request;
+    }
+    m_requests.push_back(std::move(pending));
+    return m_requests.size() - 1;
+}
+
+bool ShaderLibrary::IsReady(int request) {
+    const PendingProgram& pending = m_requests[request];
+    if (!m_isParallelCompileEnabled || pending.isFromCache || pending.isFinished || pending.program == 0) {
+        return true;
+    }
+    GLint isComplete = GL_TRUE;
+    glGetProgramiv(pending.program, kCompletionStatus, &isComplete);
+    return isComplete == GL_TRUE;
+}
+
+bool ShaderLibrary::CheckShader(GLuint shader, const ShaderPreprocessor::Result& source) {
+    GLint result = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
+    if (result == GL_TRUE) {
+        return true;
+    }
+    GLint length = 0;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+    std::vector<char> errorMessages(length + 1);
+    glGetShaderInfoLog(shader, length, &length, errorMessages.data());
+    std::cout << "ERROR: " << source.files[0] << " compilation failed!\n" << errorMessages.data();
+    // The number before the line in the driver's messages is the file
+    for (size_t i = 1; i < source.files.size(); i++) {
+        std::cout << "  " << i << ": " << source.files[i] << "\n";
+    }
+    std::cout << std::endl;
+    return false;
+}
+
+GLuint ShaderLibrary::Finish(int request) {
+    PendingProgram& pending = m_requests[request];
+    if (pending.isFinished) {
+        std::cout << "Shader program " << pending.name << " was already finished" << std::endl;
+        return 0;
+    }
+    pending.isFinished = true;
+    if (pending.isFromCache) {
+        m_stats.numFromCache++;
+        return pending.program;
+    }
+    if (pending.program == 0) {
+        m_stats.numFailed++;
+        return 0;
+    }
+
+    bool isCompiled = CheckShader(pending.vertexShader, pending.vertex);
+    isCompiled = CheckShader(pending.fragmentShader, pending.fragment) && isCompiled;
+    if (pending.geometryShader != 0) {
+        isCompiled = CheckShader(pending.geometryShader, pending.geometry) && isCompiled;
+    }
+    GLint linkStatus = GL_FALSE;
+    glGetProgramiv(pending.program, GL_LINK_STATUS, &linkStatus);
+    if (isCompiled && linkStatus == GL_FALSE) {
+        GLint length = 0;
+        glGetProgramiv(pending.program, GL_INFO_LOG_LENGTH, &length);
+        std::vector<char> errorMessages(length + 1);
+        glGetProgramInfoLog(pending.program, length, &length, errorMessages.data());
+        std::cout << "ERROR: linking " << pending.name << " failed!\n" << errorMessages.data() << std::endl;
+    }
+
+    // Once our final program Object has been created, we can
+    // detach and then delete our individual shaders.
+    glDetachShader(pending.program, pending.vertexShader);
+    glDetachShader(pending.program, pending.fragmentShader);
+    glDeleteShader(pending.vertexShader);
+    glDeleteShader(pending.fragmentShader);
+    if (pending.geometryShader != 0) {
+        glDetachShader(pending.program, pending.geometryShader);
+        glDeleteShader(pending.geometryShader);
+    }
+    pending.vertexShader = 0;
+    pending.geometryShader = 0;
+    pending.fragmentShader = 0;
+
+    if (!isCompiled || linkStatus == GL_FALSE) {
+        glDeleteProgram(pending.program);
+        pending.program = 0;
+        m_stats.numFailed++;
+        return 0;
+    }
+    if (m_programCache != nullptr) {
+        m_programCache->Store(pending.program, pending.vertex.source, pending.geometry.source, pending.fragment.source);
+    }
+    return pending.program;
+}
+
+std::vector<std::string> ShaderLibrary::GetSourceFiles(int request) const {
+    std::vector<std::string> files = m_requests[request].vertex.files;
+    files.insert(files.end(), m_requests[request].geometry.files.begin(), m_requests[request].geometry.files.end());
+    files.insert(files.end(), m_requests[request].fragment.files.begin(), m_requests[request].fragment.files.end());
+    return files;
+}
+
+void ShaderLibrary::Release(int request) {
+    if (!m_requests[request].isFinished) {
+        std::cout << "Shader program " << m_requests[request].name << " was released before it was finished" << std::endl;
+        return;
+    }
+    // Drops the preprocessed sources, the program itself belongs to whoever finished it
+    m_requests[request] = PendingProgram();
+    m_requests[request].isFinished = true; // A stale handle is not finished twice
+    m_releasedRequests.push_back(request);
+}
+
+ShaderLibrary::Stats ShaderLibrary::GetStats() const {
+    return m_stats;
+}
@@ -0,0 +1,85 @@
+#include "ShaderPreprocessor.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace {
+    std::string GetDirectory(const std::string& path) {
+        size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+    }
+
+    // Returns true and the quoted path for a line like: #include "include/frame_data.glsl"
+    bool ParseInclude(const std::string& line, std::string& includePath) {
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+            return false;
+        }
+        size_t open = line.find('"', start + 8);
+        size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+        if (close == std::string::npos) {
+            return false;
+        }
+        includePath = line.substr(open + 1, close - open - 1);
+        return true;
+    }
+}
+
+ShaderPreprocessor::Result ShaderPreprocessor::Process(const std::string& path, const std::vector<std::string>& defines) {
+    Result result;
+    std::vector<std::string> includeStack;
+    result.isValid = ProcessFile(path, defines, includeStack, result);
+    return result;
+}
+
+bool ShaderPreprocessor::ProcessFile(const std::string& path, const std::vector<std::string>& defines,
+                                     std::vector<std::string>& includeStack, Result& result) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cout << "ERROR: could not open shader " << path;
+        if (!includeStack.empty()) {
+            std::cout << " included from " << includeStack.back();
+        }
+        std::cout << std::endl;
+        return false;
+    }
+    int fileIndex = result.files.size();
+    result.files.push_back(path);
+    includeStack.push_back(path);
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        std::string includePath;
+        if (ParseInclude(line, includePath)) {
+            includePath = GetDirectory(path) + includePath;
+            if (std::find(includeStack.begin(), includeStack.end(), includePath) != includeStack.end()) {
+                std::cout << "ERROR: " << path << " includes " << includePath << " which includes it back" << std::endl;
+                return false;
+            }
+            // Already spliced in by an earlier include, leave a blank line so line numbers stay put
+            if (std::find(result.files.begin(), result.files.end(), includePath) != result.files.end()) {
+                result.source += "\n";
+                continue;
+            }
+            result.source += "#line 1 " + std::to_string(result.files.size()) + "\n";
+            if (!ProcessFile(includePath, defines, includeStack, result)) {
+                return false;
+            }
+            result.source += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+            continue;
+        }
+        result.source += line + "\n";
+        // #version has to stay the first line, the defines go right after it
+        if (fileIndex == 0 && line.compare(0, 8, "#version") == 0) {
+            for (const std::string& define : defines) {
+                result.source += "#define " + define + "\n";
+            }
+            result.source += "#line " + std::to_string(lineNumber + 1) + " 0\n";
+        }
+    }
+    includeStack.pop_back();
+    return true;
+}
@@ -0,0 +1,135 @@
+#include "ShaderProgram.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+ShaderProgram::FrameStats ShaderProgram::s_frameStats;
+
+void ShaderProgram::SetProgram(GLuint programID) {
+    m_programID = programID;
+    m_uniforms.clear();
+    m_reportedMissing.clear();
+    if (programID == 0) {
+        return;
+    }
+
+    GLint numUniforms = 0;
+    GLint maxNameLength = 0;
+    glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &numUniforms);
+    glGetProgramiv(programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+    std::vector<char> nameBuffer(maxNameLength + 1);
+    for (GLint i = 0; i < numUniforms; i++) {
+        Uniform uniform;
+        GLsizei nameLength = 0;
+        glGetActiveUniform(programID, i, nameBuffer.size(), &nameLength, &uniform.size, &uniform.type, nameBuffer.data());
+        std::string name(nameBuffer.data(), nameLength);
+        uniform.location = glGetUniformLocation(programID, name.c_str());
+        if (uniform.location < 0) {
+            continue; // Members of uniform blocks have no location
+        }
+        // Arrays are reported as "u_Name[0]", allow setting the first element by plain name
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+            name.erase(name.size() - 3);
+        }
+        m_uniforms[name] = uniform;
+    }
+}
+
+GLuint ShaderProgram::GetID() const {
+    return m_programID;
+}
+
+bool ShaderProgram::HasUniform(const std::string& name) const {
+    return m_uniforms.find(name) != m_uniforms.end();
+}
+
+const ShaderProgram::Uniform* ShaderProgram::GetUniform(const std::string& name) const {
+    auto found = m_uniforms.find(name);
+    return found == m_uniforms.end() ? nullptr : &found->second;
+}
+
+ShaderProgram::Uniform* ShaderProgram::PrepareUpload(const std::string& name, const float* value, int numFloats,
+                                                     bool isFloatType, GLenum expectedType) {
+    auto found = m_uniforms.find(name);
+    if (found == m_uniforms.end()) {
+        if (m_reportedMissing.insert(name).second) {
+            std::cout << "Uniform " << name << " is not active in program " << m_programID
+                      << " (misspelled or optimized out), ignoring it" << std::endl;
+        }
+        return nullptr;
+    }
+    Uniform& uniform = found->second;
+    // Samplers and bools are set with glUniform1i too, so ints only have to avoid the float types
+    bool isFloatUniform = uniform.type == GL_FLOAT || uniform.type == GL_FLOAT_VEC2 || uniform.type == GL_FLOAT_VEC3 ||
+                          uniform.type == GL_FLOAT_VEC4 || uniform.type == GL_FLOAT_MAT3 || uniform.type == GL_FLOAT_MAT4;
+    bool isTypeMatching = isFloatType ? uniform.type == expectedType : !isFloatUniform;
+    if (!isTypeMatching) {
+        if (m_reportedMissing.insert(name).second) {
+            std::cout << "Uniform " << name << " in program " << m_programID << " is set with the wrong type" << std::endl;
+        }
+        return nullptr;
+    }
+    if (uniform.hasValue && std::memcmp(uniform.value.data(), value, numFloats * sizeof(float)) == 0) {
+        s_frameStats.numSkipped++;
+        return nullptr;
+    }
+    std::memcpy(uniform.value.data(), value, numFloats * sizeof(float));
+    uniform.hasValue = true;
+    s_frameStats.numUploads++;
+    return &uniform;
+}
+
+void ShaderProgram::SetUniform(const std::string& name, int value) {
+    float bits;
+    std::memcpy(&bits, &value, sizeof(float));
+    if (Uniform* uniform = PrepareUpload(name, &bits, 1, false, GL_INT)) {
+        glUniform1i(uniform->location, value);
+    }
+}
+
+void ShaderProgram::SetUniform(const std::string& name, float value) {
+    if (Uniform* uniform = PrepareUpload(name, &value, 1, true, GL_FLOAT)) {
+        glUniform1f(uniform->location, value);
+    }
+}
+
+void ShaderProgram::SetUniform(const std::string& name, const glm::vec3& value) {
+    if (Uniform* uniform = PrepareUpload(name, &value[0], 3, true, GL_FLOAT_VEC3)) {
+        glUniform3fv(uniform->location, 1, &value[0]);
+    }
+}
+
+void ShaderProgram::SetUniform(const std::string& name, const glm::mat4& value) {
+    if (Uniform* uniform = PrepareUpload(name, &value[0][0], 16, true, GL_FLOAT_MAT4)) {
+        glUniformMatrix4fv(uniform->location, 1, GL_FALSE, &value[0][0]);
+    }
+}
+
+bool ShaderProgram::BindUniformBlock(const std::string& blockName, GLuint bindingIndex, size_t expectedSize) {
+    GLuint blockIndex = glGetUniformBlockIndex(m_programID, blockName.c_str());
+    if (blockIndex == GL_INVALID_INDEX) {
+        return false;
+    }
+    GLint dataSize = 0;
+    glGetActiveUniformBlockiv(m_programID, blockIndex, GL_UNIFORM_BLOCK_DATA_SIZE, &dataSize);
+    if ((size_t)dataSize != expectedSize) {
+        std::cout << "Uniform block " << blockName << " in program " << m_programID << " is " << dataSize
+                  << " bytes but C++ expects " << expectedSize << ", the layouts have drifted" << std::endl;
+    }
+    glUniformBlockBinding(m_programID, blockIndex, bindingIndex);
+    return true;
+}
+
+void ShaderProgram::CleanUp() {
+    glDeleteProgram(m_programID);
+    SetProgram(0);
+}
+
+ShaderProgram::FrameStats ShaderProgram::GetFrameStats() {
+    return s_frameStats;
+}
+
+void ShaderProgram::ResetFrameStats() {
+    s_frameStats = FrameStats();
+}
@@ -0,0 +1,388 @@
+#include "ShadowAtlas.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "GLStateTracker.hpp"
+
+namespace {
+    // Direction and up vector of each face, as in the GL cube map table
+    const glm::vec3 kFaceDirections[ShadowAtlas::kNumFaces] = {
+        {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}
+    };
+    const glm::vec3 kFaceUps[ShadowAtlas::kNumFaces] = {
+        {0, -1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}, {0, -1, 0}, {0, -1, 0}
+    };
+
+    // Whether a view space sphere reaches into a perspective camera's frustum, the camera looks down -z
+    bool IsSphereInView(glm::vec3 center, float radius, float tanHalfWidth, float tanHalfHeight, float nearPlane, float farPlane) {
+        float depth = -center.z;
+        if (depth + radius < nearPlane || depth - radius > farPlane) {
+            return false;
+        }
+        // Distances to the side planes, positive outside
+        float widthScale = 1.0f / std::sqrt(1.0f + tanHalfWidth * tanHalfWidth);
+        float heightScale = 1.0f / std::sqrt(1.0f + tanHalfHeight * tanHalfHeight);
+        return (std::abs(center.x) - depth * tanHalfWidth) * widthScale <= radius &&
+               (std::abs(center.y) - depth * tanHalfHeight) * heightScale <= radius;
+    }
+}
+
+ShadowAtlas::ShadowAtlas(const ShadowAtlasSettings& settings) : m_settings(settings) {
+    m_settings.minTileSize = std::clamp(m_settings.minTileSize, 1, m_settings.resolution);
+    m_settings.maxTileSize = std::clamp(m_settings.maxTileSize, m_settings.minTileSize, m_settings.resolution);
+    m_freeTiles.resize(GetLevel(m_settings.minTileSize) + 1);
+    m_freeTiles[0].push_back(glm::ivec2(0));
+}
+
+void ShadowAtlas::Create(GLenum depthTexUnit, GLenum tilesTexUnit) {
+    GLStateTracker& state = GLStateTracker::Get();
+    glGenTextures(1, &m_depthTexture);
+    state.BindTextureToUnit(depthTexUnit - GL_TEXTURE0, GL_TEXTURE_2D, m_depthTexture);
+    // 16 bit, a 4096 atlas is 32 MB. The faces' depth ranges are short, only as deep as their light reaches.
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT16, m_settings.resolution, m_settings.resolution, 0,
+                 GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    // Sampled through sampler2DShadow like the cascades, the shader keeps lookups half a texel inside their tile
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    // One frame buffer for every tile
+    glGenFramebuffers(1, &m_framebuffer);
+    state.BindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_depthTexture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    state.BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // The texture keeps pointing at its buffer when Upload replaces the storage, so it is bound once
+    glGenBuffers(1, &m_tilesBuffer);
+    glGenTextures(1, &m_tilesTexture);
+    Upload();
+    state.BindTextureToUnit(tilesTexUnit - GL_TEXTURE0, GL_TEXTURE_BUFFER, m_tilesTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_tilesBuffer);
+    state.ActiveTexture(GL_TEXTURE0); // Reset active texture unit
+}
+
+int ShadowAtlas::GetLevel(int tileSize) const {
+    int level = 0;
+    for (int size = m_settings.resolution; size > tileSize && size > 1; size /= 2) {
+        level++;
+    }
+    return level;
+}
+
+bool ShadowAtlas::AllocateTile(int level, glm::ivec2& tile) {
+    if (!m_freeTiles[level].empty()) {
+        tile = m_freeTiles[level].back();
+        m_freeTiles[level].pop_back();
+        return true;
+    }
+    glm::ivec2 parent;
+    if (level == 0 || !AllocateTile(level - 1, parent)) {
+        return false;
+    }
+    // Keep the bottom left quarter, the other three are free
+    int size = m_settings.resolution >> level;
+    m_freeTiles[level].push_back(parent + glm::ivec2(size, 0));
+    m_freeTiles[level].push_back(parent + glm::ivec2(0, size));
+    m_freeTiles[level].push_back(parent + glm::ivec2(size, size));
+    tile = parent;
+    return true;
+}
+
+void ShadowAtlas::FreeTile(int level, glm::ivec2 tile) {
+    if (level > 0) {
+        // Merges back into the parent once all four quarters are free
+        int size = m_settings.resolution >> level;
+        glm::ivec2 parent = tile / (size * 2) * (size * 2);
+        std::vector<glm::ivec2>& freeTiles = m_freeTiles[level];
+        int numFreeSiblings = 0;
+        for (const glm::ivec2& freeTile : freeTiles) {
+            numFreeSiblings += freeTile / (size * 2) * (size * 2) == parent;
+        }
+        if (numFreeSiblings == 3) {
+            freeTiles.erase(std::remove_if(freeTiles.begin(), freeTiles.end(), [&](const glm::ivec2& freeTile) {
+                return freeTile / (size * 2) * (size * 2) == parent;
+            }), freeTiles.end());
+            FreeTile(level - 1, parent);
+            return;
+        }
+    }
+    m_freeTiles[level].push_back(tile);
+}
+
+bool ShadowAtlas::AllocateLight(LightShadow& shadow, int tileSize) {
+    // Smaller tiles when the wanted size no longer fits
+    for (; tileSize >= m_settings.minTileSize; tileSize /= 2) {
+        int level = GetLevel(tileSize);
+        int numAllocated = 0;
+        while (numAllocated < kNumFaces && AllocateTile(level, shadow.faceTiles[numAllocated])) {
+            numAllocated++;
+        }
+        if (numAllocated == kNumFaces) {
+            shadow.tileSize = tileSize;
+            for (int face = 0; face < kNumFaces; face++) {
+                shadow.isFaceValid[face] = false;
+                shadow.isFaceStale[face] = true;
+            }
+            return true;
+        }
+        while (numAllocated > 0) {
+            numAllocated--;
+            FreeTile(level, shadow.faceTiles[numAllocated]);
+        }
+    }
+    return false;
+}
+
+void ShadowAtlas::FreeLight(LightShadow& shadow) {
+    if (shadow.tileSize == 0) {
+        return;
+    }
+    int level = GetLevel(shadow.tileSize);
+    for (int face = 0; face < kNumFaces; face++) {
+        FreeTile(level, shadow.faceTiles[face]);
+        shadow.isFaceValid[face] = false;
+    }
+    shadow.tileSize = 0;
+}
+
+bool ShadowAtlas::IsLightReady(const LightShadow& shadow) const {
+    if (shadow.tileSize == 0) {
+        return false;
+    }
+    for (int face = 0; face < kNumFaces; face++) {
+        if (!shadow.isFaceValid[face]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ShadowAtlas::AssignTiles(const std::vector<PointLight>& lights, float cutoff, const glm::mat4& viewMatrix, float fieldOfViewRadians,
+                              float aspectRatio, float nearPlane, float farPlane, int screenHeight) {
+    for (size_t i = lights.size(); i < m_lightShadows.size(); i++) {
+        FreeLight(m_lightShadows[i]);
+    }
+    m_lightShadows.resize(lights.size());
+
+    // Importance is the radius of the light's range on screen, lights out of view light nothing visible and need no shadow
+    float tanHalfHeight = std::tan(fieldOfViewRadians * 0.5f);
+    float tanHalfWidth = tanHalfHeight * aspectRatio;
+    float pixelsPerSlope = screenHeight * 0.5f / tanHalfHeight;
+    m_lightOrder.clear();
+    for (size_t i = 0; i < lights.size(); i++) {
+        LightShadow& shadow = m_lightShadows[i];
+        glm::vec3 position = lights[i].GetPosition();
+        float range = std::min(lights[i].GetRange(cutoff), farPlane);
+        if (shadow.tileSize > 0 && (position != shadow.position || range != shadow.range)) {
+            for (bool& isStale : shadow.isFaceStale) {
+                isStale = true;
+            }
+        }
+        shadow.position = position;
+        shadow.range = range;
+        glm::vec3 viewPosition = glm::vec3(viewMatrix * glm::vec4(position, 1.0f));
+        shadow.importance = 0.0f;
+        if (IsSphereInView(viewPosition, range, tanHalfWidth, tanHalfHeight, nearPlane, farPlane)) {
+            // Inside the range the light covers the whole screen
+            shadow.importance = range / std::max(glm::length(viewPosition), range) * pixelsPerSlope;
+            m_lightOrder.push_back(i);
+        }
+    }
+    std::stable_sort(m_lightOrder.begin(), m_lightOrder.end(), [this](int a, int b) {
+        return m_lightShadows[a].importance > m_lightShadows[b].importance;
+    });
+    if ((int)m_lightOrder.size() > m_settings.maxShadowedLights) {
+        m_lightOrder.resize(m_settings.maxShadowedLights);
+    }
+
+    // Lights that lost their shadow or need another tile size give their tiles back first
+    std::vector<int> wantedTileSizes(lights.size(), 0);
+    for (int light : m_lightOrder) {
+        LightShadow& shadow = m_lightShadows[light];
+        float wantedTexels = std::min(shadow.importance * m_settings.texelsPerPixel, (float)m_settings.maxTileSize);
+        int tileSize = m_settings.minTileSize;
+        while (tileSize * 2 <= wantedTexels) {
+            tileSize *= 2;
+        }
+        // Only shrinks once the light needs less than half its tile, so lights near a size boundary do not flip every frame
+        if (shadow.tileSize == tileSize * 2) {
+            tileSize = shadow.tileSize;
+        }
+        wantedTileSizes[light] = tileSize;
+    }
+    for (size_t i = 0; i < lights.size(); i++) {
+        if (m_lightShadows[i].tileSize != wantedTileSizes[i]) {
+            FreeLight(m_lightShadows[i]);
+        }
+    }
+
+    // Most important first, taking the tiles of the least important lights when the atlas is full
+    int leastImportant = (int)m_lightOrder.size() - 1;
+    for (int rank = 0; rank < (int)m_lightOrder.size(); rank++) {
+        LightShadow& shadow = m_lightShadows[m_lightOrder[rank]];
+        if (shadow.tileSize > 0) {
+            continue;
+        }
+        while (!AllocateLight(shadow, wantedTileSizes[m_lightOrder[rank]])) {
+            while (leastImportant > rank && m_lightShadows[m_lightOrder[leastImportant]].tileSize == 0) {
+                leastImportant--;
+            }
+            if (leastImportant <= rank) {
+                break;
+            }
+            FreeLight(m_lightShadows[m_lightOrder[leastImportant]]);
+        }
+    }
+}
+
+void ShadowAtlas::InvalidateBox(glm::vec3 worldMin, glm::vec3 worldMax) {
+    for (LightShadow& shadow : m_lightShadows) {
+        if (shadow.tileSize == 0) {
+            continue;
+        }
+        for (int face = 0; face < kNumFaces; face++) {
+            if (!shadow.isFaceStale[face] && IsBoxInFace(shadow.position, shadow.range, face, worldMin, worldMax)) {
+                shadow.isFaceStale[face] = true;
+            }
+        }
+    }
+}
+
+void ShadowAtlas::BeginShadowPass() {
+    // Most important lights first, the rest wait when there are more stale faces than the frame allows
+    m_facesToDraw.clear();
+    m_stats = Stats();
+    for (int light : m_lightOrder) {
+        LightShadow& shadow = m_lightShadows[light];
+        if (shadow.tileSize == 0) {
+            continue;
+        }
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, m_settings.nearPlane, shadow.range);
+        for (int face = 0; face < kNumFaces; face++) {
+            if (shadow.isFaceValid[face] && !shadow.isFaceStale[face]) {
+                m_stats.numFacesReused++;
+                continue;
+            }
+            if ((int)m_facesToDraw.size() >= m_settings.maxFacesPerFrame) {
+                m_stats.numFacesWaiting++;
+                continue;
+            }
+            ShadowAtlasFace drawFace;
+            drawFace.light = light;
+            drawFace.face = face;
+            drawFace.lightPosition = shadow.position;
+            drawFace.range = shadow.range;
+            drawFace.viewMatrix = GetFaceViewMatrix(shadow.position, face);
+            drawFace.projectionMatrix = projection;
+            drawFace.viewport = glm::ivec4(shadow.faceTiles[face], shadow.tileSize, shadow.tileSize);
+            m_facesToDraw.push_back(drawFace);
+            shadow.isFaceValid[face] = true;
+            shadow.isFaceStale[face] = false;
+        }
+    }
+    for (const LightShadow& shadow : m_lightShadows) {
+        m_stats.numShadowedLights += IsLightReady(shadow);
+        m_stats.numAllocatedTexels += kNumFaces * shadow.tileSize * shadow.tileSize;
+    }
+    m_stats.numFacesDrawn = m_facesToDraw.size();
+    if (m_facesToDraw.empty()) {
+        return;
+    }
+
+    GLStateTracker& state = GLStateTracker::Get();
+    // The atlas stays bound to its unit, the shadow program never samples it
+    state.BindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    state.Enable(GL_SCISSOR_TEST);
+    state.Enable(GL_POLYGON_OFFSET_FILL);
+    state.PolygonOffset(m_settings.depthBiasSlope, m_settings.depthBiasUnits);
+}
+
+const std::vector<ShadowAtlasFace>& ShadowAtlas::GetFacesToDraw() const {
+    return m_facesToDraw;
+}
+
+void ShadowAtlas::BeginFace(const ShadowAtlasFace& face) {
+    // glClear only clears inside the scissor box, the other tiles keep their contents
+    GLStateTracker& state = GLStateTracker::Get();
+    state.Viewport(face.viewport.x, face.viewport.y, face.viewport.z, face.viewport.w);
+    state.Scissor(face.viewport.x, face.viewport.y, face.viewport.z, face.viewport.w);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void ShadowAtlas::EndShadowPass() {
+    GLStateTracker& state = GLStateTracker::Get();
+    state.Disable(GL_SCISSOR_TEST);
+    // The depth pre-pass draws with the same program and must match the lit pass exactly
+    state.Disable(GL_POLYGON_OFFSET_FILL);
+}
+
+void ShadowAtlas::Upload() {
+    // Lights without all six faces drawn have a tile size of 0, the shader skips their lookup
+    m_tileTexels.assign(std::max<size_t>(m_lightShadows.size(), 1) * kTexelsPerLight * 4, 0.0f);
+    for (size_t i = 0; i < m_lightShadows.size(); i++) {
+        const LightShadow& shadow = m_lightShadows[i];
+        if (!IsLightReady(shadow)) {
+            continue;
+        }
+        float* texels = &m_tileTexels[i * kTexelsPerLight * 4];
+        for (int face = 0; face < kNumFaces; face++) {
+            texels[face * 2] = shadow.faceTiles[face].x / (float)m_settings.resolution;
+            texels[face * 2 + 1] = shadow.faceTiles[face].y / (float)m_settings.resolution;
+        }
+        texels[12] = shadow.tileSize / (float)m_settings.resolution;
+        texels[13] = m_settings.nearPlane;
+        texels[14] = shadow.range;
+    }
+    // Orphaned every frame like the light clusters
+    GLStateTracker::Get().BindBuffer(GL_TEXTURE_BUFFER, m_tilesBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, m_tileTexels.size() * sizeof(float), m_tileTexels.data(), GL_STREAM_DRAW);
+}
+
+const ShadowAtlas::Stats& ShadowAtlas::GetStats() const {
+    return m_stats;
+}
+
+void ShadowAtlas::CleanUp() {
+    glDeleteFramebuffers(1, &m_framebuffer);
+    glDeleteTextures(1, &m_depthTexture);
+    glDeleteTextures(1, &m_tilesTexture);
+    glDeleteBuffers(1, &m_tilesBuffer);
+    m_framebuffer = m_depthTexture = 0;
+    m_tilesTexture = m_tilesBuffer = 0;
+}
+
+glm::mat4 ShadowAtlas::GetFaceViewMatrix(glm::vec3 lightPosition, int face) {
+    return glm::lookAt(lightPosition, lightPosition + kFaceDirections[face], kFaceUps[face]);
+}
+
+bool ShadowAtlas::IsBoxInFace(glm::vec3 lightPosition, float range, int face, glm::vec3 worldMin, glm::vec3 worldMax) {
+    // Out of the light's range
+    glm::vec3 closest = glm::clamp(lightPosition, worldMin, worldMax);
+    glm::vec3 toClosest = closest - lightPosition;
+    if (glm::dot(toClosest, toClosest) > range * range) {
+        return false;
+    }
+    // A face's frustum is where its axis is the largest, bounded by the four planes at 45 degrees to it.
+    // The box is outside once the corner furthest along a plane's inward normal is behind it.
+    glm::vec3 axis = kFaceDirections[face];
+    glm::vec3 sideAxes[2] = {glm::vec3(0.0f), glm::vec3(0.0f)};
+    sideAxes[0][(face / 2 + 1) % 3] = 1.0f;
+    sideAxes[1][(face / 2 + 2) % 3] = 1.0f;
+    for (const glm::vec3& side : sideAxes) {
+        for (float sign : {1.0f, -1.0f}) {
+            glm::vec3 normal = axis + sign * side;
+            glm::vec3 corner = glm::mix(worldMin, worldMax, glm::vec3(glm::greaterThan(normal, glm::vec3(0.0f))));
+            if (glm::dot(normal, corner - lightPosition) < 0.0f) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -1,37 +1,82 @@
 #include "ShadowDirectionalLight.hpp"
 #include "glm/gtc/matrix_transform.hpp"
+#include "GLStateTracker.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 ShadowDirectionalLight::ShadowDirectionalLight(GLenum texUnit, glm::vec3 eyePosition, glm::vec3 target, glm::vec3 upVector,
-                                               float nearPlane, float farPlane): 
-    m_texUnit(texUnit), m_eyePosition(eyePosition), m_target(target), 
+                                               float nearPlane, float farPlane, const ShadowCascadeSettings& settings): 
+    m_texUnit(texUnit), m_settings(settings), m_eyePosition(eyePosition), m_target(target), 
     m_upVector(upVector), m_nearPlane(nearPlane), m_farPlane(farPlane)  {
-    glActiveTexture(m_texUnit);
+    m_settings.numCascades = std::clamp(m_settings.numCascades, 1, kMaxShadowCascades);
+    m_cascades.resize(m_settings.numCascades);
 
-    glGenFramebuffers(1, &m_depthMapFBO);
-    glGenTextures(1, &m_depthMapTex);
-    glBindTexture(GL_TEXTURE_2D, m_depthMapTex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, 
-                m_shadowMapWidth, m_shadowMapHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT); 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    CreateDepthMap(m_staticDepthMapTex, m_staticCascadeFBOs);
+    // Created last so it is the one left bound to m_texUnit
+    CreateDepthMap(m_depthMapTex, m_cascadeFBOs);
+}
+
+void ShadowDirectionalLight::CreateDepthMap(unsigned int& depthMapTex, std::vector<GLuint>& framebuffers)   {
+    GLStateTracker& state = GLStateTracker::Get();
+    glGenTextures(1, &depthMapTex);
+    state.BindTextureToUnit(m_texUnit - GL_TEXTURE0, GL_TEXTURE_2D_ARRAY, depthMapTex);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, 
+                m_settings.resolution, m_settings.resolution, m_settings.numCascades, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    // Sampled through sampler2DArrayShadow, every lookup compares the 4 nearest texels and filters the results
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    // A cascade fitted to the scene bounds can end before its slice does, nothing casts a shadow out there
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER); 
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    const GLfloat farthestDepth[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, farthestDepth);
 
-    // Attach depthMap to frame buffer
-    glBindFramebuffer(GL_FRAMEBUFFER, m_depthMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_depthMapTex, 0);
+    // Attach each layer of the depth map to its own frame buffer
+    framebuffers.resize(m_settings.numCascades);
+    glGenFramebuffers(m_settings.numCascades, framebuffers.data());
+    for (int cascade = 0; cascade < m_settings.numCascades; cascade++)  {
+        state.BindFramebuffer(GL_FRAMEBUFFER, framebuffers[cascade]);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthMapTex, 0, cascade);
+        // No need for color buffer, as we just need depth map for shadows
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    }
 
-    // No need for color buffer, as we just need depth map for shadows
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
+    state.BindFramebuffer(GL_FRAMEBUFFER, 0);
+    state.ActiveTexture(GL_TEXTURE0); // Reset active texture unit
+}
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);  
-    glActiveTexture(GL_TEXTURE0); // Reset active texture unit
+bool ShadowDirectionalLight::IsStaticCacheStale(int cascade)  {
+    // Cascades are snapped to texels and only turn with the light in steps, so an unchanged one is bit for bit the same
+    const Cascade& current = m_cascades[cascade];
+    return !current.isStaticCacheValid || current.staticCacheProjection != current.projection;
 }
 
-void ShadowDirectionalLight::ActivateTexUnitAndBindFBO()    {
-    glActiveTexture(m_texUnit);
-    glBindFramebuffer(GL_FRAMEBUFFER, m_depthMapFBO);
+void ShadowDirectionalLight::BindStaticCacheFBO(int cascade)    {
+    // The depth map stays bound to its unit, the shadow program never samples it
+    GLStateTracker::Get().BindFramebuffer(GL_FRAMEBUFFER, m_staticCascadeFBOs[cascade]);
+}
+
+void ShadowDirectionalLight::BeginDynamicCasters(int cascade, bool hasDynamicCasters)  {
+    GLStateTracker& state = GLStateTracker::Get();
+    Cascade& current = m_cascades[cascade];
+    if (IsStaticCacheStale(cascade))    {
+        current.staticCacheProjection = current.projection;
+        current.isStaticCacheValid = true;
+        current.isCopyOfStaticCache = false;
+    }
+    if (!current.isCopyOfStaticCache)  {
+        state.BindFramebuffer(GL_READ_FRAMEBUFFER, m_staticCascadeFBOs[cascade]);
+        state.BindFramebuffer(GL_DRAW_FRAMEBUFFER, m_cascadeFBOs[cascade]);
+        glBlitFramebuffer(0, 0, m_settings.resolution, m_settings.resolution, 0, 0, m_settings.resolution, m_settings.resolution,
+                          GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    }
+    // Moving casters drawn now have to be copied over again next frame
+    current.isCopyOfStaticCache = !hasDynamicCasters;
+    state.BindFramebuffer(GL_FRAMEBUFFER, m_cascadeFBOs[cascade]);
 }
 
 glm::mat4 ShadowDirectionalLight::GetViewMatrix()   {
@@ -40,11 +85,162 @@ glm::mat4 ShadowDirectionalLight::GetViewMatrix()   {
                 m_upVector);
 }
 
-glm::mat4 ShadowDirectionalLight::GetProjectionMatrix()   {
-    // TODO: Check this 10.0f number if shadows don't work
-    return glm::ortho(-7.0f, 7.0f, -7.0f, 7.0f, m_nearPlane, m_farPlane);
+void ShadowDirectionalLight::SetSceneBounds(glm::vec3 sceneMin, glm::vec3 sceneMax)   {
+    m_sceneMin = sceneMin;
+    m_sceneMax = sceneMax;
 }
 
-glm::mat4 ShadowDirectionalLight::GetWorldToLightSpaceTransform()   {
-    return GetProjectionMatrix() * GetViewMatrix();
-}
\ No newline at end of file
+void ShadowDirectionalLight::UpdateCascades(const glm::mat4& cameraViewMatrix, float fieldOfViewRadians, float aspectRatio,
+                                            float nearPlane, float farPlane)   {
+    // Light space only rotates with the light, so snapping to texels in it holds while the camera moves.
+    // It follows the light in steps, in between every cascade's static cache stays valid.
+    glm::vec3 direction = glm::normalize(m_target - m_eyePosition);
+    if (glm::dot(direction, m_lightDirection) < std::cos(glm::radians(m_settings.lightUpdateAngleDegrees)))  {
+        glm::vec3 up = std::abs(glm::dot(direction, glm::normalize(m_upVector))) > 0.99f ? glm::vec3(1, 0, 0) : m_upVector;
+        m_lightRotation = glm::lookAt(glm::vec3(0.0f), direction, up);
+        m_lightDirection = direction;
+        for (Cascade& cascade : m_cascades)  {
+            cascade.isStaticCacheValid = false;
+        }
+    }
+
+    glm::vec3 lightSceneMin(std::numeric_limits<float>::max());
+    glm::vec3 lightSceneMax(-std::numeric_limits<float>::max());
+    for (int corner = 0; corner < 8; corner++)  {
+        glm::vec3 worldCorner((corner & 1) ? m_sceneMax.x : m_sceneMin.x,
+                              (corner & 2) ? m_sceneMax.y : m_sceneMin.y,
+                              (corner & 4) ? m_sceneMax.z : m_sceneMin.z);
+        glm::vec3 lightCorner = glm::vec3(m_lightRotation * glm::vec4(worldCorner, 1.0f));
+        lightSceneMin = glm::min(lightSceneMin, lightCorner);
+        lightSceneMax = glm::max(lightSceneMax, lightCorner);
+    }
+    glm::vec2 sceneSize = glm::vec2(lightSceneMax - lightSceneMin);
+    glm::vec2 sceneCenter = glm::vec2(lightSceneMin + lightSceneMax) * 0.5f;
+    // Every cascade spans the whole scene in depth, casters between the light and a slice still land in its map
+    float depthMargin = 0.01f * (lightSceneMax.z - lightSceneMin.z) + 0.1f;
+    float lightNear = -lightSceneMax.z - depthMargin;
+    float lightFar = -lightSceneMin.z + depthMargin;
+
+    glm::mat4 cameraToLight = m_lightRotation * glm::inverse(cameraViewMatrix);
+    float tanHalfHeight = std::tan(fieldOfViewRadians * 0.5f);
+    float tanHalfWidth = tanHalfHeight * aspectRatio;
+    float shadowFar = std::min(farPlane, m_settings.maxDistance);
+    float sliceNear = nearPlane;
+    for (int cascade = 0; cascade < m_settings.numCascades; cascade++)  {
+        // Practical split scheme, logarithmic splits match perspective but give the first slice almost nothing
+        float fraction = (cascade + 1) / (float)m_settings.numCascades;
+        float logarithmicSplit = nearPlane * std::pow(shadowFar / nearPlane, fraction);
+        float uniformSplit = nearPlane + (shadowFar - nearPlane) * fraction;
+        float sliceFar = m_settings.splitLambda * logarithmicSplit + (1.0f - m_settings.splitLambda) * uniformSplit;
+
+        glm::vec3 sliceCorners[8];
+        glm::vec3 sliceCenter(0.0f);
+        for (int corner = 0; corner < 8; corner++)  {
+            float depth = (corner & 4) ? sliceFar : sliceNear;
+            glm::vec4 cameraCorner((corner & 1 ? 1.0f : -1.0f) * depth * tanHalfWidth,
+                                   (corner & 2 ? 1.0f : -1.0f) * depth * tanHalfHeight, -depth, 1.0f);
+            sliceCorners[corner] = glm::vec3(cameraToLight * cameraCorner);
+            sliceCenter += sliceCorners[corner] / 8.0f;
+        }
+        // A sphere around the slice has the same size however the camera is turned
+        float radius = 0.0f;
+        for (const glm::vec3& corner : sliceCorners)  {
+            radius = std::max(radius, glm::length(corner - sliceCenter));
+        }
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        float size = 2.0f * radius;
+        glm::vec2 center = glm::vec2(sliceCenter);
+        float sceneExtent = std::max(sceneSize.x, sceneSize.y);
+        if (sceneExtent < size)  {
+            // The whole scene fits, which does not change while the light stays put
+            size = sceneExtent * (1.0f + 2.0f / m_settings.resolution);
+            center = sceneCenter;
+        } else {
+            // Slide the square back over the scene, texels outside it would only ever see empty space
+            for (int axis = 0; axis < 2; axis++)  {
+                center[axis] = sceneSize[axis] < size ? sceneCenter[axis]
+                                                      : std::clamp(center[axis], lightSceneMin[axis] + size * 0.5f, lightSceneMax[axis] - size * 0.5f);
+            }
+        }
+        // Moving by whole texels keeps every texel sampling the same part of the scene
+        float texelSize = size / m_settings.resolution;
+        center = glm::floor(center / texelSize) * texelSize;
+
+        m_cascades[cascade].projection = glm::ortho(center.x - size * 0.5f, center.x + size * 0.5f,
+                                                    center.y - size * 0.5f, center.y + size * 0.5f, lightNear, lightFar);
+        m_cascades[cascade].farDepth = sliceFar;
+        sliceNear = sliceFar;
+    }
+}
+
+glm::mat4 ShadowDirectionalLight::GetCascadeViewMatrix()   {
+    return m_lightRotation;
+}
+
+glm::mat4 ShadowDirectionalLight::GetCascadeProjectionMatrix(int cascade)   {
+    return m_cascades[cascade].projection;
+}
+
+uint32_t ShadowDirectionalLight::GetCascadeMask(glm::vec3 worldMin, glm::vec3 worldMax)   {
+    // Depth always spans the scene, so only the box's extent across the light's view matters
+    glm::vec2 lightMin(std::numeric_limits<float>::max());
+    glm::vec2 lightMax(-std::numeric_limits<float>::max());
+    for (int corner = 0; corner < 8; corner++)  {
+        glm::vec3 worldCorner((corner & 1) ? worldMax.x : worldMin.x,
+                              (corner & 2) ? worldMax.y : worldMin.y,
+                              (corner & 4) ? worldMax.z : worldMin.z);
+        glm::vec2 lightCorner = glm::vec2(m_lightRotation * glm::vec4(worldCorner, 1.0f));
+        lightMin = glm::min(lightMin, lightCorner);
+        lightMax = glm::max(lightMax, lightCorner);
+    }
+    uint32_t mask = 0;
+    for (int cascade = 0; cascade < m_settings.numCascades; cascade++)  {
+        // Orthographic, so the projection maps light space x and y straight to -1 to 1
+        const glm::mat4& projection = m_cascades[cascade].projection;
+        glm::vec2 clipMin = glm::vec2(projection * glm::vec4(lightMin, 0.0f, 1.0f));
+        glm::vec2 clipMax = glm::vec2(projection * glm::vec4(lightMax, 0.0f, 1.0f));
+        if (clipMax.x >= -1.0f && clipMin.x <= 1.0f && clipMax.y >= -1.0f && clipMin.y <= 1.0f)  {
+            mask |= 1u << cascade;
+        }
+    }
+    return mask;
+}
+
+void ShadowDirectionalLight::SetFilterRadius(float radiusTexels)    {
+    if (radiusTexels == m_filterRadiusTexels)    {
+        return;
+    }
+    m_filterRadiusTexels = radiusTexels;
+    // The cached casters were drawn with the old bias
+    for (Cascade& cascade : m_cascades)  {
+        cascade.isStaticCacheValid = false;
+    }
+}
+
+void ShadowDirectionalLight::BeginShadowPass()  {
+    GLStateTracker& state = GLStateTracker::Get();
+    state.Enable(GL_POLYGON_OFFSET_FILL);
+    state.PolygonOffset(m_settings.depthBiasSlope * (1.0f + m_filterRadiusTexels), m_settings.depthBiasUnits);
+}
+
+void ShadowDirectionalLight::EndShadowPass()    {
+    // The depth pre-pass draws with the same program and must match the lit pass exactly
+    GLStateTracker::Get().Disable(GL_POLYGON_OFFSET_FILL);
+}
+
+ShadowData ShadowDirectionalLight::GetShadowData()   {
+    ShadowData shadowData = {};
+    for (int cascade = 0; cascade < kMaxShadowCascades; cascade++)  {
+        if (cascade < m_settings.numCascades)  {
+            shadowData.cascadeMatrices[cascade] = m_cascades[cascade].projection * m_lightRotation;
+            shadowData.cascadeFarDepths[cascade] = m_cascades[cascade].farDepth;
+        } else {
+            // Unused cascades never match, see GetShadowCascade in halftone_toon.glsl
+            shadowData.cascadeMatrices[cascade] = glm::mat4(1.0f);
+            shadowData.cascadeFarDepths[cascade] = std::numeric_limits<float>::max();
+        }
+    }
+    shadowData.numCascades = m_settings.numCascades;
+    return shadowData;
+}
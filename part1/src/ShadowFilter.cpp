@@ -0,0 +1,88 @@
+#include "ShadowFilter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+const ShadowFilterPreset ShadowFilter::kPresets[kNumPresets] = {
+    {"hard",   SHADOW_KERNEL_ROTATED_GRID, 1,  0.0f, false}, // Only the comparison sampler's own 2x2 filter
+    {"low",    SHADOW_KERNEL_ROTATED_GRID, 4,  1.0f, false},
+    {"medium", SHADOW_KERNEL_POISSON,      8,  1.5f, true},
+    {"high",   SHADOW_KERNEL_POISSON,      16, 2.0f, true},
+};
+
+ShadowFilter::ShadowFilter() {
+    SetPreset(m_preset);
+}
+
+void ShadowFilter::SetPreset(int preset) {
+    m_preset = std::clamp(preset, 0, kNumPresets - 1);
+    const ShadowFilterPreset& settings = kPresets[m_preset];
+    int numTaps = std::clamp(settings.numTaps, 1, kMaxShadowKernelTaps);
+    m_kernel = settings.kernel == SHADOW_KERNEL_POISSON ? MakePoissonDisk(numTaps) : MakeRotatedGrid(numTaps);
+}
+
+void ShadowFilter::FillShadowData(ShadowData& shadowData, int cascadeResolution) const {
+    const ShadowFilterPreset& settings = kPresets[m_preset];
+    for (int tap = 0; tap < kMaxShadowKernelTaps; tap++) {
+        glm::vec2 offset = tap < (int)m_kernel.size() ? m_kernel[tap] : glm::vec2(0.0f);
+        shadowData.kernel[tap * 2] = offset.x;
+        shadowData.kernel[tap * 2 + 1] = offset.y;
+    }
+    shadowData.numKernelTaps = m_kernel.size();
+    shadowData.kernelRadius = settings.radiusTexels / cascadeResolution;
+    shadowData.isKernelRotated = settings.isRotatedPerPixel ? 1 : 0;
+}
+
+std::vector<glm::vec2> ShadowFilter::MakeRotatedGrid(int numTaps) {
+    int side = std::max((int)std::lround(std::sqrt((float)numTaps)), 1);
+    if (side == 1) {
+        return {glm::vec2(0.0f)};
+    }
+    // Turned by atan(1/2) every tap lands on its own row and column of texels, like RGSS antialiasing
+    float angle = std::atan(0.5f);
+    glm::mat2 rotation(std::cos(angle), std::sin(angle), -std::sin(angle), std::cos(angle));
+    std::vector<glm::vec2> kernel;
+    float longest = 0.0f;
+    for (int y = 0; y < side; y++) {
+        for (int x = 0; x < side; x++) {
+            glm::vec2 offset = rotation * (glm::vec2(x + 0.5f, y + 0.5f) / (float)side * 2.0f - 1.0f);
+            longest = std::max(longest, glm::length(offset));
+            kernel.push_back(offset);
+        }
+    }
+    for (glm::vec2& offset : kernel) {
+        offset /= longest;
+    }
+    return kernel;
+}
+
+std::vector<glm::vec2> ShadowFilter::MakePoissonDisk(int numTaps) {
+    // Mitchell's best candidate: of a few random points, keep the one furthest from the taps so far.
+    // Seeded the same every time, so a preset always looks the same.
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const int kCandidatesPerTap = 16;
+    std::vector<glm::vec2> kernel;
+    while ((int)kernel.size() < numTaps) {
+        glm::vec2 best(0.0f);
+        float bestDistance = -1.0f;
+        for (int candidate = 0; candidate < kCandidatesPerTap * ((int)kernel.size() + 1); candidate++) {
+            // Uniform over the disc's area
+            float radius = std::sqrt(unit(random));
+            float angle = 6.2831853f * unit(random);
+            glm::vec2 point = radius * glm::vec2(std::cos(angle), std::sin(angle));
+            float distance = std::numeric_limits<float>::max();
+            for (const glm::vec2& tap : kernel) {
+                distance = std::min(distance, glm::length(point - tap));
+            }
+            if (distance > bestDistance) {
+                best = point;
+                bestDistance = distance;
+            }
+        }
+        kernel.push_back(best);
+    }
+    return kernel;
+}
@@ -0,0 +1,90 @@
+#include "ShadowPointLight.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "GLStateTracker.hpp"
+#include "ShadowAtlas.hpp"
+
+ShadowPointLight::ShadowPointLight(GLenum texUnit, const ShadowPointLightSettings& settings):
+    m_texUnit(texUnit), m_settings(settings) {
+    GLStateTracker& state = GLStateTracker::Get();
+    glGenTextures(1, &m_depthMapTex);
+    state.BindTextureToUnit(m_texUnit - GL_TEXTURE0, GL_TEXTURE_CUBE_MAP, m_depthMapTex);
+    for (int face = 0; face < kNumFaces; face++)    {
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, m_settings.resolution, m_settings.resolution, 0,
+                     GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    }
+    // Sampled through samplerCubeShadow, compared and bilinearly filtered like the cascades
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    // Filters across the face edges instead of clamping at them, otherwise the seams show in the shadow
+    state.Enable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    // Layered, the geometry shader's gl_Layer picks the face
+    glGenFramebuffers(1, &m_framebuffer);
+    state.BindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthMapTex, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    state.BindFramebuffer(GL_FRAMEBUFFER, 0);
+    state.ActiveTexture(GL_TEXTURE0); // Reset active texture unit
+
+    SetPosition(m_position);
+}
+
+void ShadowPointLight::SetPosition(glm::vec3 position)  {
+    m_position = position;
+    glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, m_settings.nearPlane, m_settings.farPlane);
+    for (int face = 0; face < kNumFaces; face++)    {
+        m_faceMatrices[face] = projection * ShadowAtlas::GetFaceViewMatrix(m_position, face);
+    }
+}
+
+glm::mat4 ShadowPointLight::GetFaceMatrix(int face) const  {
+    return m_faceMatrices[face];
+}
+
+uint32_t ShadowPointLight::GetFaceMask(glm::vec3 worldMin, glm::vec3 worldMax) const  {
+    uint32_t faceMask = 0;
+    for (int face = 0; face < kNumFaces; face++)    {
+        if (ShadowAtlas::IsBoxInFace(m_position, m_settings.farPlane, face, worldMin, worldMax))  {
+            faceMask |= 1u << face;
+        }
+    }
+    return faceMask;
+}
+
+void ShadowPointLight::BeginShadowPass(float filterRadiusTexels)    {
+    GLStateTracker& state = GLStateTracker::Get();
+    // The cube map stays bound to its unit, the shadow program never samples it
+    state.BindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    state.Viewport(0, 0, m_settings.resolution, m_settings.resolution);
+    // A layered frame buffer clears every layer at once
+    state.DepthMask(GL_TRUE);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    state.Enable(GL_POLYGON_OFFSET_FILL);
+    state.PolygonOffset(m_settings.depthBiasSlope * (1.0f + filterRadiusTexels), m_settings.depthBiasUnits);
+}
+
+void ShadowPointLight::EndShadowPass()  {
+    GLStateTracker::Get().Disable(GL_POLYGON_OFFSET_FILL);
+}
+
+void ShadowPointLight::FillShadowData(ShadowData& shadowData, float filterRadiusTexels) const  {
+    shadowData.pointShadowNearPlane = m_settings.nearPlane;
+    shadowData.pointShadowFarPlane = m_settings.farPlane;
+    // Face coordinates go from -1 to 1 across the face, so a texel is 2 / resolution of them
+    shadowData.pointShadowKernelRadius = filterRadiusTexels * 2.0f / m_settings.resolution;
+    shadowData.isPointShadow = 1;
+}
+
+void ShadowPointLight::CleanUp()    {
+    glDeleteFramebuffers(1, &m_framebuffer);
+    glDeleteTextures(1, &m_depthMapTex);
+    m_framebuffer = m_depthMapTex = 0;
+}
@@ -0,0 +1,335 @@
+#include "TextureAtlas.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+
+#include "GLStateTracker.hpp"
+
+namespace {
+    int NextPowerOfTwo(int value) {
+        int result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    // glad is generated for core 3.3 without extensions, so these enums are not in glad.h
+    const GLenum kCompressedRGBS3TCDXT1 = 0x83F0;  // GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+    const GLenum kCompressedRGBAS3TCDXT5 = 0x83F3; // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+    const GLenum kCompressedRGBABPTC = 0x8E8C;     // GL_COMPRESSED_RGBA_BPTC_UNORM
+}
+
+std::vector<uint8_t> TextureAtlas::GetRGBA(const TextureImage& image) {
+    if (image.IsCompressed()) {
+        return TextureCompressor::Decompress(image.compressed->GetMipData(0), image.width, image.height,
+                                             image.compressed->GetFormat());
+    }
+    return TextureCompressor::ExpandRGBToRGBA(image.rgb);
+}
+
+void TextureAtlas::Build(const std::vector<TextureImage>& images, int maxPageSize, int padding) {
+    m_regions.assign(images.size(), Region());
+    m_layerPixels.clear();
+    m_compressedLayers.clear();
+    m_internalFormat = 0;   // Set again by Upload when the new images are compressed
+    m_baseLevel = 0;
+    m_isPacked = false;
+    m_numLayers = 0;
+    m_layerWidth = 0;
+    m_layerHeight = 0;
+
+    std::vector<int> validImages;
+    for (size_t i = 0; i < images.size(); i++) {
+        if (images[i].IsValid()) {
+            validImages.push_back(i);
+        } else {
+            std::cout << "Texture " << images[i].path << " could not be loaded, material will be untextured" << std::endl;
+        }
+    }
+    if (validImages.empty()) {
+        return;
+    }
+
+    // Same size and same format: every texture is simply a layer, no UV remapping needed
+    const TextureImage& first = images[validImages[0]];
+    bool canUseLayers = true;
+    for (int i : validImages) {
+        const TextureImage& image = images[i];
+        bool sameFormat = image.IsCompressed() == first.IsCompressed() &&
+                          (!image.IsCompressed() || (image.compressed->GetFormat() == first.compressed->GetFormat() &&
+                                                     image.compressed->GetMipCount() == first.compressed->GetMipCount()));
+        if (image.width != first.width || image.height != first.height || !sameFormat) {
+            canUseLayers = false;
+            break;
+        }
+    }
+    if (canUseLayers) {
+        m_layerWidth = first.width;
+        m_layerHeight = first.height;
+        for (int i : validImages) {
+            m_regions[i].layer = first.IsCompressed() ? m_compressedLayers.size() : m_layerPixels.size();
+            if (first.IsCompressed()) {
+                m_compressedLayers.push_back(images[i].compressed);
+            } else {
+                m_layerPixels.push_back(GetRGBA(images[i]));
+            }
+        }
+        m_numLayers = validImages.size();
+        return;
+    }
+
+    // Mixed sizes: skyline pack into square pages, tallest textures first
+    m_isPacked = true;
+    std::sort(validImages.begin(), validImages.end(), [&images](int a, int b) {
+        return images[a].height > images[b].height;
+    });
+    long long paddedArea = 0;
+    int largestSide = 0;
+    for (int i : validImages) {
+        paddedArea += (long long)(images[i].width + 2 * padding) * (images[i].height + 2 * padding);
+        largestSide = std::max(largestSide, std::max(images[i].width, images[i].height) + 2 * padding);
+    }
+    int pageSize = NextPowerOfTwo(std::max(largestSide, (int)std::ceil(std::sqrt((double)paddedArea))));
+    pageSize = std::min(pageSize, maxPageSize);
+    m_layerWidth = pageSize;
+    m_layerHeight = pageSize;
+
+    std::vector<std::vector<SkylineNode>> skylines;
+    for (int i : validImages) {
+        const TextureImage& image = images[i];
+        int paddedWidth = image.width + 2 * padding;
+        int paddedHeight = image.height + 2 * padding;
+        if (paddedWidth > pageSize || paddedHeight > pageSize) {
+            std::cout << "Texture " << image.path << " is larger than the atlas page size " << pageSize << std::endl;
+            continue;
+        }
+
+        int x = 0, y = 0;
+        size_t node = 0;
+        size_t page = 0;
+        for (; page < skylines.size(); page++) {
+            if (FindSkylinePosition(skylines[page], pageSize, paddedWidth, paddedHeight, x, y, node)) {
+                break;
+            }
+        }
+        if (page == skylines.size()) {
+            skylines.push_back({SkylineNode{0, 0, pageSize}});
+            m_layerPixels.push_back(std::vector<uint8_t>((size_t)pageSize * pageSize * 4, 0));
+            FindSkylinePosition(skylines[page], pageSize, paddedWidth, paddedHeight, x, y, node);
+        }
+        AddSkylineLevel(skylines[page], node, x, y, paddedWidth, paddedHeight);
+        BlitWithPadding(GetRGBA(image), image.width, image.height, m_layerPixels[page], pageSize, x + padding, y + padding, padding);
+
+        Region& region = m_regions[i];
+        region.layer = page;
+        region.uvOffset[0] = (float)(x + padding) / pageSize;
+        region.uvOffset[1] = (float)(y + padding) / pageSize;
+        region.uvScale[0] = (float)image.width / pageSize;
+        region.uvScale[1] = (float)image.height / pageSize;
+    }
+    m_numLayers = m_layerPixels.size();
+    std::cout << "Packed " << validImages.size() << " textures into " << m_layerPixels.size() << " atlas pages of "
+              << pageSize << "x" << pageSize << std::endl;
+}
+
+bool TextureAtlas::FindSkylinePosition(const std::vector<SkylineNode>& skyline, int pageSize, int width, int height,
+                                       int& bestX, int& bestY, size_t& bestNode) {
+    bool found = false;
+    int bestTop = pageSize + 1;
+    int bestSegmentWidth = pageSize + 1;
+    for (size_t i = 0; i < skyline.size(); i++) {
+        int x = skyline[i].x;
+        if (x + width > pageSize) {
+            break; // Nodes are sorted by x, nothing further right can fit either
+        }
+        // The rect rests on the highest node it spans
+        int y = 0;
+        int remainingWidth = width;
+        size_t j = i;
+        while (remainingWidth > 0 && j < skyline.size()) {
+            y = std::max(y, skyline[j].y);
+            remainingWidth -= skyline[j].width;
+            j++;
+        }
+        if (remainingWidth > 0 || y + height > pageSize) {
+            continue;
+        }
+        // Lowest top edge wins, ties go to the narrowest segment to leave wide gaps open
+        if (y + height < bestTop || (y + height == bestTop && skyline[i].width < bestSegmentWidth)) {
+            found = true;
+            bestTop = y + height;
+            bestSegmentWidth = skyline[i].width;
+            bestX = x;
+            bestY = y;
+            bestNode = i;
+        }
+    }
+    return found;
+}
+
+void TextureAtlas::AddSkylineLevel(std::vector<SkylineNode>& skyline, size_t nodeIndex, int x, int y, int width, int height) {
+    skyline.insert(skyline.begin() + nodeIndex, SkylineNode{x, y + height, width});
+
+    // Shrink or remove the nodes the new level now covers
+    for (size_t i = nodeIndex + 1; i < skyline.size(); i++) {
+        const SkylineNode& previous = skyline[i - 1];
+        int overlap = previous.x + previous.width - skyline[i].x;
+        if (overlap <= 0) {
+            break;
+        }
+        skyline[i].x += overlap;
+        skyline[i].width -= overlap;
+        if (skyline[i].width > 0) {
+            break;
+        }
+        skyline.erase(skyline.begin() + i);
+        i--;
+    }
+
+    // Merge neighbours at the same height
+    for (size_t i = 0; i + 1 < skyline.size(); i++) {
+        if (skyline[i].y == skyline[i + 1].y) {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+            i--;
+        }
+    }
+}
+
+void TextureAtlas::BlitWithPadding(const std::vector<uint8_t>& rgba, int width, int height,
+                                   std::vector<uint8_t>& page, int pageSize, int x, int y, int padding) {
+    for (int row = -padding; row < height + padding; row++) {
+        int sourceRow = std::clamp(row, 0, height - 1);
+        for (int col = -padding; col < width + padding; col++) {
+            int sourceCol = std::clamp(col, 0, width - 1);
+            std::memcpy(page.data() + ((size_t)(y + row) * pageSize + (x + col)) * 4,
+                        rgba.data() + ((size_t)sourceRow * width + sourceCol) * 4, 4);
+        }
+    }
+}
+
+void TextureAtlas::Upload(bool isS3TCSupported, bool isBPTCSupported, int maxStartupSize) {
+    if (m_layerPixels.empty() && m_compressedLayers.empty()) {
+        return;
+    }
+    glGenTextures(1, &m_texture);
+    GLStateTracker::Get().BindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+
+    if (!m_compressedLayers.empty()) {
+        const TextureCache& first = *m_compressedLayers[0];
+        GLenum internalFormat = 0;
+        switch (first.GetFormat()) {
+            case TextureCompressor::Format::BC1: internalFormat = isS3TCSupported ? kCompressedRGBS3TCDXT1 : 0; break;
+            case TextureCompressor::Format::BC3: internalFormat = isS3TCSupported ? kCompressedRGBAS3TCDXT5 : 0; break;
+            case TextureCompressor::Format::BC7: internalFormat = isBPTCSupported ? kCompressedRGBABPTC : 0; break;
+        }
+        if (internalFormat != 0) {
+            m_internalFormat = internalFormat;
+            m_baseLevel = 0;
+            while (maxStartupSize > 0 && m_baseLevel < first.GetMipCount() - 1 &&
+                   std::max(first.GetMipWidth(m_baseLevel), first.GetMipHeight(m_baseLevel)) > maxStartupSize) {
+                m_baseLevel++;
+            }
+            // Layers of a level are contiguous in a compressed array texture
+            for (int level = m_baseLevel; level < first.GetMipCount(); level++) {
+                std::vector<uint8_t> levelData;
+                for (const std::shared_ptr<TextureCache>& layer : m_compressedLayers) {
+                    levelData.insert(levelData.end(), layer->GetMipData(level), layer->GetMipData(level) + layer->GetMipSize(level));
+                }
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat,
+                                       first.GetMipWidth(level), first.GetMipHeight(level), m_compressedLayers.size(),
+                                       0, levelData.size(), levelData.data());
+            }
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, m_baseLevel);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, first.GetMipCount() - 1);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        } else {
+            std::cout << "Driver does not support " << TextureCompressor::GetFormatName(first.GetFormat())
+                      << ", decompressing textures on the CPU" << std::endl;
+            for (const std::shared_ptr<TextureCache>& layer : m_compressedLayers) {
+                m_layerPixels.push_back(TextureCompressor::Decompress(layer->GetMipData(0), m_layerWidth, m_layerHeight, layer->GetFormat()));
+            }
+            m_compressedLayers.clear();
+        }
+    }
+
+    if (m_compressedLayers.empty()) {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, m_layerWidth, m_layerHeight, m_layerPixels.size(),
+                     0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        for (size_t layer = 0; layer < m_layerPixels.size(); layer++) {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, m_layerWidth, m_layerHeight, 1,
+                            GL_RGBA, GL_UNSIGNED_BYTE, m_layerPixels[layer].data());
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    }
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // Packed pages wrap in the shader with fract(), repeating here would bleed in the neighbouring texture
+    GLint wrap = m_isPacked ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+
+    // The GPU has its copy now
+    m_layerPixels.clear();
+    m_layerPixels.shrink_to_fit();
+}
+
+void TextureAtlas::Bind(GLenum texUnit) {
+    GLStateTracker::Get().BindTextureToUnit(texUnit - GL_TEXTURE0, GL_TEXTURE_2D_ARRAY, m_texture);
+}
+
+const TextureAtlas::Region& TextureAtlas::GetRegion(int textureIndex) const {
+    return m_regions[textureIndex];
+}
+
+int TextureAtlas::GetNumTextures() const {
+    return m_regions.size();
+}
+
+int TextureAtlas::GetNumLayers() const {
+    return m_numLayers;
+}
+
+int TextureAtlas::GetLayerWidth() const {
+    return m_layerWidth;
+}
+
+int TextureAtlas::GetLayerHeight() const {
+    return m_layerHeight;
+}
+
+bool TextureAtlas::IsPacked() const {
+    return m_isPacked;
+}
+
+bool TextureAtlas::IsStreamable() const {
+    return m_internalFormat != 0 && !m_compressedLayers.empty() && m_compressedLayers[0]->GetMipCount() > 1;
+}
+
+GLuint TextureAtlas::GetTexture() const {
+    return m_texture;
+}
+
+GLenum TextureAtlas::GetInternalFormat() const {
+    return m_internalFormat;
+}
+
+int TextureAtlas::GetBaseLevel() const {
+    return m_baseLevel;
+}
+
+const std::vector<std::shared_ptr<TextureCache>>& TextureAtlas::GetCompressedLayers() const {
+    return m_compressedLayers;
+}
+
+void TextureAtlas::CleanUp() {
+    glDeleteTextures(1, &m_texture);
+    m_texture = 0;
+    m_internalFormat = 0;
+    m_baseLevel = 0;
+}
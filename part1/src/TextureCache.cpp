@@ -0,0 +1,249 @@
+#include "TextureCache.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#if defined(LINUX) || defined(MAC)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "PPM.hpp"
+
+namespace {
+    const char kMagic[4] = {'T', 'X', 'C', '1'};
+    const uint32_t kVersion = 1;
+    const uint64_t kDataAlignment = 16;
+}
+
+TextureCache::TextureCache(const std::string& cacheFilePath) {
+#if defined(LINUX) || defined(MAC)
+    int fileDescriptor = open(cacheFilePath.c_str(), O_RDONLY);
+    if (fileDescriptor >= 0) {
+        struct stat fileInfo;
+        if (fstat(fileDescriptor, &fileInfo) == 0 && fileInfo.st_size > 0) {
+            void* mapping = mmap(nullptr, (size_t)fileInfo.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+            if (mapping != MAP_FAILED) {
+                m_fileData = static_cast<const uint8_t*>(mapping);
+                m_fileSize = (size_t)fileInfo.st_size;
+                m_isMapped = true;
+            }
+        }
+        close(fileDescriptor); // The mapping stays valid after the descriptor is closed
+    }
+#endif
+    if (!m_isMapped) {
+        std::ifstream inputFile(cacheFilePath, std::ios::binary);
+        if (!inputFile.is_open()) {
+            return;
+        }
+        m_fileContents.assign(std::istreambuf_iterator<char>(inputFile), std::istreambuf_iterator<char>());
+        m_fileData = m_fileContents.data();
+        m_fileSize = m_fileContents.size();
+    }
+
+    if (!ValidateLayout()) {
+        std::cout << "Texture cache " << cacheFilePath << " is corrupt or from an older version, ignoring it" << std::endl;
+        m_header = nullptr;
+        m_mips = nullptr;
+    }
+}
+
+TextureCache::~TextureCache() {
+#if defined(LINUX) || defined(MAC)
+    if (m_isMapped) {
+        munmap(const_cast<uint8_t*>(m_fileData), m_fileSize);
+    }
+#endif
+}
+
+bool TextureCache::ValidateLayout() {
+    if (m_fileData == nullptr || m_fileSize < sizeof(Header)) {
+        return false;
+    }
+    m_header = reinterpret_cast<const Header*>(m_fileData);
+    if (std::memcmp(m_header->magic, kMagic, 4) != 0 || m_header->version != kVersion || m_header->mipCount == 0) {
+        return false;
+    }
+    if (m_header->format != (uint32_t)TextureCompressor::Format::BC1 &&
+        m_header->format != (uint32_t)TextureCompressor::Format::BC3 &&
+        m_header->format != (uint32_t)TextureCompressor::Format::BC7) {
+        return false;
+    }
+    if (sizeof(Header) + (uint64_t)m_header->mipCount * sizeof(MipEntry) > m_fileSize) {
+        return false;
+    }
+    if (m_header->width == 0 || m_header->height == 0 || m_header->width > INT32_MAX || m_header->height > INT32_MAX) {
+        return false;
+    }
+    m_mips = reinterpret_cast<const MipEntry*>(m_fileData + sizeof(Header));
+    // Every level halves the one before it, like TextureCompressor::BuildMipChain, and holds exactly its blocks.
+    // The data check is written so offset + size cannot wrap around.
+    uint32_t width = m_header->width;
+    uint32_t height = m_header->height;
+    for (uint32_t i = 0; i < m_header->mipCount; i++) {
+        if (m_mips[i].width != width || m_mips[i].height != height) {
+            return false;
+        }
+        TextureCompressor::Format format = static_cast<TextureCompressor::Format>(m_header->format);
+        if (m_mips[i].size != TextureCompressor::GetCompressedSize(format, (int)width, (int)height) ||
+            m_mips[i].size > m_fileSize || m_mips[i].offset > m_fileSize - m_mips[i].size) {
+            return false;
+        }
+        width = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
+    }
+    return true;
+}
+
+bool TextureCache::IsValid() const {
+    return m_header != nullptr;
+}
+
+TextureCompressor::Format TextureCache::GetFormat() const {
+    return static_cast<TextureCompressor::Format>(m_header->format);
+}
+
+int TextureCache::GetWidth() const {
+    return (int)m_header->width;
+}
+
+int TextureCache::GetHeight() const {
+    return (int)m_header->height;
+}
+
+int TextureCache::GetMipCount() const {
+    return IsValid() ? (int)m_header->mipCount : 0;
+}
+
+int TextureCache::GetMipWidth(int level) const {
+    return (int)m_mips[level].width;
+}
+
+int TextureCache::GetMipHeight(int level) const {
+    return (int)m_mips[level].height;
+}
+
+size_t TextureCache::GetMipSize(int level) const {
+    return (size_t)m_mips[level].size;
+}
+
+const uint8_t* TextureCache::GetMipData(int level) const {
+    return m_fileData + m_mips[level].offset;
+}
+
+std::string TextureCache::GetCachePathForTexture(const std::string& texturePath) {
+    size_t locationOfLastDot = texturePath.find_last_of(".");
+    size_t locationOfLastSlash = texturePath.find_last_of("/");
+    if (locationOfLastDot == std::string::npos ||
+        (locationOfLastSlash != std::string::npos && locationOfLastDot < locationOfLastSlash)) {
+        return texturePath + ".texcache";
+    }
+    return texturePath.substr(0, locationOfLastDot) + ".texcache";
+}
+
+bool TextureCache::Write(const std::string& cacheFilePath, TextureCompressor::Format format,
+                         const std::vector<TextureCompressor::MipLevel>& compressedMips) {
+    if (compressedMips.empty()) {
+        return false;
+    }
+    std::ofstream outputFile(cacheFilePath, std::ios::binary | std::ios::trunc);
+    if (!outputFile.is_open()) {
+        std::cout << "Could not open file " + cacheFilePath << std::endl;
+        return false;
+    }
+
+    Header header;
+    std::memcpy(header.magic, kMagic, 4);
+    header.version = kVersion;
+    header.format = (uint32_t)format;
+    header.width = (uint32_t)compressedMips[0].width;
+    header.height = (uint32_t)compressedMips[0].height;
+    header.mipCount = (uint32_t)compressedMips.size();
+
+    std::vector<MipEntry> entries;
+    uint64_t offset = sizeof(Header) + compressedMips.size() * sizeof(MipEntry);
+    for (const TextureCompressor::MipLevel& mip : compressedMips) {
+        offset = (offset + kDataAlignment - 1) & ~(kDataAlignment - 1);
+        MipEntry entry;
+        entry.width = (uint32_t)mip.width;
+        entry.height = (uint32_t)mip.height;
+        entry.offset = offset;
+        entry.size = mip.data.size();
+        entries.push_back(entry);
+        offset += entry.size;
+    }
+
+    outputFile.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    outputFile.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(MipEntry));
+    uint64_t written = sizeof(Header) + entries.size() * sizeof(MipEntry);
+    for (size_t i = 0; i < compressedMips.size(); i++) {
+        const char padding[kDataAlignment] = {};
+        outputFile.write(padding, entries[i].offset - written);
+        outputFile.write(reinterpret_cast<const char*>(compressedMips[i].data.data()), entries[i].size);
+        written = entries[i].offset + entries[i].size;
+    }
+    return outputFile.good();
+}
+
+bool TextureCache::CompressPPM(const std::string& ppmFilePath, TextureCompressor::Format format) {
+    PPM image(ppmFilePath);
+    if (image.getWidth() <= 0 || image.getHeight() <= 0) {
+        std::cout << "Could not load texture " << ppmFilePath << std::endl;
+        return false;
+    }
+    image.VerticalFlip(); // Store in OpenGL order (bottom left pixel first), same as MaterialLoader
+
+    std::vector<uint8_t> rgb;
+    for (Pixel p : image.pixelData()) {
+        rgb.push_back(p.r);
+        rgb.push_back(p.g);
+        rgb.push_back(p.b);
+    }
+    std::vector<TextureCompressor::MipLevel> sourceMips =
+        TextureCompressor::BuildMipChain(TextureCompressor::ExpandRGBToRGBA(rgb), image.getWidth(), image.getHeight());
+
+    std::cout << "Compressing " << ppmFilePath << " (" << image.getWidth() << "x" << image.getHeight() << ") to "
+              << TextureCompressor::GetFormatName(format) << std::endl;
+    const bool includeAlpha = format != TextureCompressor::Format::BC1;
+    std::vector<TextureCompressor::MipLevel> compressedMips;
+    double totalSeconds = 0.0;
+    size_t totalPixels = 0;
+    for (size_t level = 0; level < sourceMips.size(); level++) {
+        const TextureCompressor::MipLevel& source = sourceMips[level];
+        auto start = std::chrono::steady_clock::now();
+        TextureCompressor::MipLevel compressed;
+        compressed.width = source.width;
+        compressed.height = source.height;
+        compressed.data = TextureCompressor::Compress(source.data.data(), source.width, source.height, format);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        size_t numPixels = (size_t)source.width * source.height;
+        std::vector<uint8_t> decoded = TextureCompressor::Decompress(compressed.data.data(), source.width, source.height, format);
+        double psnr = TextureCompressor::ComputePSNR(source.data.data(), decoded.data(), numPixels, includeAlpha);
+        std::cout << "  mip " << level << " " << source.width << "x" << source.height
+                  << "  PSNR " << std::fixed << std::setprecision(2) << psnr << " dB"
+                  << "  " << elapsed.count() * 1000.0 << " ms" << std::endl;
+
+        totalSeconds += elapsed.count();
+        totalPixels += numPixels;
+        compressedMips.push_back(std::move(compressed));
+    }
+    if (totalSeconds > 0.0) {
+        std::cout << "Encode speed: " << std::fixed << std::setprecision(2)
+                  << (totalPixels / 1.0e6) / totalSeconds << " MPixels/s" << std::endl;
+    }
+
+    std::string cacheFilePath = GetCachePathForTexture(ppmFilePath);
+    if (!Write(cacheFilePath, format, compressedMips)) {
+        return false;
+    }
+    std::cout << "Wrote " << cacheFilePath << std::endl;
+    return true;
+}
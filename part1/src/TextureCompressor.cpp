@@ -0,0 +1,735 @@
+#include "TextureCompressor.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // Block pixels split by channel so four pixels can be processed per SSE register
+    struct BlockSoA {
+        alignas(16) float r[16];
+        alignas(16) float g[16];
+        alignas(16) float b[16];
+        alignas(16) float a[16];
+    };
+
+    // BC7 interpolation weights for 4 bit indices, out of 64
+    const int kBC7Weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+    void LoadBlockSoA(const uint8_t* blockRGBA, BlockSoA& block) {
+        for (int i = 0; i < 16; i++) {
+            block.r[i] = blockRGBA[i * 4 + 0];
+            block.g[i] = blockRGBA[i * 4 + 1];
+            block.b[i] = blockRGBA[i * 4 + 2];
+            block.a[i] = blockRGBA[i * 4 + 3];
+        }
+    }
+
+    // Finds the direction of greatest variance of the block (power iteration on the covariance matrix)
+    void ComputePrincipalAxis(const BlockSoA& block, int channels, float mean[4], float axis[4]) {
+        const float* ch[4] = {block.r, block.g, block.b, block.a};
+        for (int c = 0; c < 4; c++) {
+            mean[c] = 0.0f;
+            axis[c] = 0.0f;
+        }
+        for (int c = 0; c < channels; c++) {
+            for (int i = 0; i < 16; i++) {
+                mean[c] += ch[c][i];
+            }
+            mean[c] /= 16.0f;
+        }
+
+        float cov[4][4] = {};
+        for (int i = 0; i < 16; i++) {
+            for (int c0 = 0; c0 < channels; c0++) {
+                for (int c1 = c0; c1 < channels; c1++) {
+                    cov[c0][c1] += (ch[c0][i] - mean[c0]) * (ch[c1][i] - mean[c1]);
+                }
+            }
+        }
+        for (int c0 = 0; c0 < channels; c0++) {
+            for (int c1 = 0; c1 < c0; c1++) {
+                cov[c0][c1] = cov[c1][c0];
+            }
+        }
+
+        float v[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+        for (int iteration = 0; iteration < 8; iteration++) {
+            float next[4] = {};
+            for (int c0 = 0; c0 < channels; c0++) {
+                for (int c1 = 0; c1 < channels; c1++) {
+                    next[c0] += cov[c0][c1] * v[c1];
+                }
+            }
+            float length = 0.0f;
+            for (int c = 0; c < channels; c++) {
+                length += next[c] * next[c];
+            }
+            if (length < 1e-12f) {
+                break; // Flat block, any axis works
+            }
+            length = std::sqrt(length);
+            for (int c = 0; c < channels; c++) {
+                v[c] = next[c] / length;
+            }
+        }
+        for (int c = 0; c < channels; c++) {
+            axis[c] = v[c];
+        }
+    }
+
+    // Projects every pixel onto the axis through the mean and returns the smallest and largest projection
+    void FindProjectionExtents(const BlockSoA& block, int channels, const float mean[4], const float axis[4],
+                               float& minProjection, float& maxProjection) {
+#if defined(__SSE2__)
+        __m128 minV = _mm_set1_ps(std::numeric_limits<float>::max());
+        __m128 maxV = _mm_set1_ps(-std::numeric_limits<float>::max());
+        const __m128 axisR = _mm_set1_ps(axis[0]);
+        const __m128 axisG = _mm_set1_ps(axis[1]);
+        const __m128 axisB = _mm_set1_ps(axis[2]);
+        const __m128 axisA = _mm_set1_ps(channels == 4 ? axis[3] : 0.0f);
+        for (int i = 0; i < 16; i += 4) {
+            __m128 p = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(block.r + i), _mm_set1_ps(mean[0])), axisR);
+            p = _mm_add_ps(p, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(block.g + i), _mm_set1_ps(mean[1])), axisG));
+            p = _mm_add_ps(p, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(block.b + i), _mm_set1_ps(mean[2])), axisB));
+            p = _mm_add_ps(p, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(block.a + i), _mm_set1_ps(mean[3])), axisA));
+            minV = _mm_min_ps(minV, p);
+            maxV = _mm_max_ps(maxV, p);
+        }
+        alignas(16) float mins[4];
+        alignas(16) float maxs[4];
+        _mm_store_ps(mins, minV);
+        _mm_store_ps(maxs, maxV);
+        minProjection = std::min(std::min(mins[0], mins[1]), std::min(mins[2], mins[3]));
+        maxProjection = std::max(std::max(maxs[0], maxs[1]), std::max(maxs[2], maxs[3]));
+#else
+        const float* ch[4] = {block.r, block.g, block.b, block.a};
+        minProjection = std::numeric_limits<float>::max();
+        maxProjection = -std::numeric_limits<float>::max();
+        for (int i = 0; i < 16; i++) {
+            float p = 0.0f;
+            for (int c = 0; c < channels; c++) {
+                p += (ch[c][i] - mean[c]) * axis[c];
+            }
+            minProjection = std::min(minProjection, p);
+            maxProjection = std::max(maxProjection, p);
+        }
+#endif
+    }
+
+    // Picks the closest palette entry for every pixel, returns the summed squared error
+    float FindNearestPaletteIndices(const BlockSoA& block, const float (*palette)[4], int paletteSize, bool useAlpha,
+                                    int indices[16]) {
+#if defined(__SSE2__)
+        __m128 totalError = _mm_setzero_ps();
+        for (int i = 0; i < 16; i += 4) {
+            const __m128 pr = _mm_load_ps(block.r + i);
+            const __m128 pg = _mm_load_ps(block.g + i);
+            const __m128 pb = _mm_load_ps(block.b + i);
+            const __m128 pa = _mm_load_ps(block.a + i);
+            __m128 bestError = _mm_set1_ps(std::numeric_limits<float>::max());
+            __m128i bestIndex = _mm_setzero_si128();
+            for (int p = 0; p < paletteSize; p++) {
+                __m128 dr = _mm_sub_ps(pr, _mm_set1_ps(palette[p][0]));
+                __m128 dg = _mm_sub_ps(pg, _mm_set1_ps(palette[p][1]));
+                __m128 db = _mm_sub_ps(pb, _mm_set1_ps(palette[p][2]));
+                __m128 error = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+                if (useAlpha) {
+                    __m128 da = _mm_sub_ps(pa, _mm_set1_ps(palette[p][3]));
+                    error = _mm_add_ps(error, _mm_mul_ps(da, da));
+                }
+                __m128i isBetter = _mm_castps_si128(_mm_cmplt_ps(error, bestError));
+                bestError = _mm_min_ps(error, bestError);
+                bestIndex = _mm_or_si128(_mm_and_si128(isBetter, _mm_set1_epi32(p)), _mm_andnot_si128(isBetter, bestIndex));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(indices + i), bestIndex);
+            totalError = _mm_add_ps(totalError, bestError);
+        }
+        alignas(16) float errors[4];
+        _mm_store_ps(errors, totalError);
+        return errors[0] + errors[1] + errors[2] + errors[3];
+#else
+        float totalError = 0.0f;
+        for (int i = 0; i < 16; i++) {
+            float bestError = std::numeric_limits<float>::max();
+            for (int p = 0; p < paletteSize; p++) {
+                float dr = block.r[i] - palette[p][0];
+                float dg = block.g[i] - palette[p][1];
+                float db = block.b[i] - palette[p][2];
+                float da = useAlpha ? block.a[i] - palette[p][3] : 0.0f;
+                float error = dr * dr + dg * dg + db * db + da * da;
+                if (error < bestError) {
+                    bestError = error;
+                    indices[i] = p;
+                }
+            }
+            totalError += bestError;
+        }
+        return totalError;
+#endif
+    }
+
+    // Solves for the two endpoints that best fit the block given each pixel's weight towards endpoint 1.
+    // Returns false if the system is singular (every pixel uses the same weight).
+    bool RefineEndpointsLeastSquares(const BlockSoA& block, int channels, const float weights[16], float e0[4], float e1[4]) {
+        const float* ch[4] = {block.r, block.g, block.b, block.a};
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float ax[4] = {}, bx[4] = {};
+        for (int i = 0; i < 16; i++) {
+            float b = weights[i];
+            float a = 1.0f - b;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for (int c = 0; c < channels; c++) {
+                ax[c] += a * ch[c][i];
+                bx[c] += b * ch[c][i];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) < 1e-6f) {
+            return false;
+        }
+        float inverse = 1.0f / determinant;
+        for (int c = 0; c < channels; c++) {
+            e0[c] = std::clamp((ax[c] * bb - bx[c] * ab) * inverse, 0.0f, 255.0f);
+            e1[c] = std::clamp((bx[c] * aa - ax[c] * ab) * inverse, 0.0f, 255.0f);
+        }
+        return true;
+    }
+
+    uint16_t PackRGB565(const float color[4]) {
+        int r = std::clamp((int)std::lround(color[0] * 31.0f / 255.0f), 0, 31);
+        int g = std::clamp((int)std::lround(color[1] * 63.0f / 255.0f), 0, 63);
+        int b = std::clamp((int)std::lround(color[2] * 31.0f / 255.0f), 0, 31);
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    void UnpackRGB565(uint16_t packed, float color[4]) {
+        int r = (packed >> 11) & 31;
+        int g = (packed >> 5) & 63;
+        int b = packed & 31;
+        color[0] = (float)((r << 3) | (r >> 2));
+        color[1] = (float)((g << 2) | (g >> 4));
+        color[2] = (float)((b << 3) | (b >> 2));
+        color[3] = 255.0f;
+    }
+
+    // BC1 4 color palette, entry 2 is 1/3 of the way from c0 to c1 and entry 3 is 2/3
+    void BuildBC1Palette(uint16_t c0, uint16_t c1, float palette[4][4]) {
+        UnpackRGB565(c0, palette[0]);
+        UnpackRGB565(c1, palette[1]);
+        for (int c = 0; c < 4; c++) {
+            palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+            palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+        }
+    }
+
+    // Writes bits least significant first, the way BC7 blocks are laid out
+    class BitWriter {
+    public:
+        explicit BitWriter(uint8_t* out) : m_out(out) { std::memset(m_out, 0, 16); }
+        void Write(uint32_t value, int numBits) {
+            for (int i = 0; i < numBits; i++, m_position++) {
+                if ((value >> i) & 1) {
+                    m_out[m_position >> 3] |= (uint8_t)(1 << (m_position & 7));
+                }
+            }
+        }
+    private:
+        uint8_t* m_out;
+        int m_position = 0;
+    };
+
+    class BitReader {
+    public:
+        explicit BitReader(const uint8_t* in) : m_in(in) {}
+        uint32_t Read(int numBits) {
+            uint32_t value = 0;
+            for (int i = 0; i < numBits; i++, m_position++) {
+                value |= (uint32_t)((m_in[m_position >> 3] >> (m_position & 7)) & 1) << i;
+            }
+            return value;
+        }
+    private:
+        const uint8_t* m_in;
+        int m_position = 0;
+    };
+
+    // Mode 6 endpoints are 7 bits per channel plus one p-bit shared by all channels of the endpoint
+    void QuantizeBC7Endpoint(const float endpoint[4], int quantized[4], int& pBit) {
+        float bestError = std::numeric_limits<float>::max();
+        for (int p = 0; p < 2; p++) {
+            int candidate[4];
+            float error = 0.0f;
+            for (int c = 0; c < 4; c++) {
+                candidate[c] = std::clamp((int)std::lround((endpoint[c] - p) / 2.0f), 0, 127);
+                float delta = endpoint[c] - (float)((candidate[c] << 1) | p);
+                error += delta * delta;
+            }
+            if (error < bestError) {
+                bestError = error;
+                pBit = p;
+                std::copy(candidate, candidate + 4, quantized);
+            }
+        }
+    }
+
+    void BuildBC7Palette(const int q0[4], int p0, const int q1[4], int p1, float palette[16][4]) {
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < 4; c++) {
+                int e0 = (q0[c] << 1) | p0;
+                int e1 = (q1[c] << 1) | p1;
+                palette[i][c] = (float)(((64 - kBC7Weights4[i]) * e0 + kBC7Weights4[i] * e1 + 32) >> 6);
+            }
+        }
+    }
+}
+
+int TextureCompressor::GetBlockSizeInBytes(Format format) {
+    return format == Format::BC1 ? 8 : 16;
+}
+
+size_t TextureCompressor::GetCompressedSize(Format format, int width, int height) {
+    size_t blocksWide = (size_t)(width + 3) / 4;
+    size_t blocksHigh = (size_t)(height + 3) / 4;
+    return blocksWide * blocksHigh * GetBlockSizeInBytes(format);
+}
+
+bool TextureCompressor::ParseFormat(const std::string& name, Format& format) {
+    if (name == "bc1" || name == "BC1") {
+        format = Format::BC1;
+    } else if (name == "bc3" || name == "BC3") {
+        format = Format::BC3;
+    } else if (name == "bc7" || name == "BC7") {
+        format = Format::BC7;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::string TextureCompressor::GetFormatName(Format format) {
+    switch (format) {
+        case Format::BC1: return "BC1";
+        case Format::BC3: return "BC3";
+        case Format::BC7: return "BC7";
+    }
+    return "unknown";
+}
+
+std::vector<uint8_t> TextureCompressor::ExpandRGBToRGBA(const std::vector<uint8_t>& rgb) {
+    std::vector<uint8_t> rgba;
+    rgba.reserve(rgb.size() / 3 * 4);
+    for (size_t i = 0; i + 2 < rgb.size(); i += 3) {
+        rgba.push_back(rgb[i]);
+        rgba.push_back(rgb[i + 1]);
+        rgba.push_back(rgb[i + 2]);
+        rgba.push_back(255);
+    }
+    return rgba;
+}
+
+std::vector<TextureCompressor::MipLevel> TextureCompressor::BuildMipChain(const std::vector<uint8_t>& rgba, int width, int height) {
+    std::vector<MipLevel> chain;
+    MipLevel base;
+    base.width = width;
+    base.height = height;
+    base.data = rgba;
+    chain.push_back(base);
+
+    while (chain.back().width > 1 || chain.back().height > 1) {
+        const MipLevel& previous = chain.back();
+        MipLevel next;
+        next.width = std::max(1, previous.width / 2);
+        next.height = std::max(1, previous.height / 2);
+        next.data.resize((size_t)next.width * next.height * 4);
+        for (int y = 0; y < next.height; y++) {
+            for (int x = 0; x < next.width; x++) {
+                // Average the 2x2 footprint, clamped for odd sized levels
+                int x0 = std::min(x * 2, previous.width - 1);
+                int x1 = std::min(x * 2 + 1, previous.width - 1);
+                int y0 = std::min(y * 2, previous.height - 1);
+                int y1 = std::min(y * 2 + 1, previous.height - 1);
+                for (int c = 0; c < 4; c++) {
+                    int sum = previous.data[((size_t)y0 * previous.width + x0) * 4 + c]
+                            + previous.data[((size_t)y0 * previous.width + x1) * 4 + c]
+                            + previous.data[((size_t)y1 * previous.width + x0) * 4 + c]
+                            + previous.data[((size_t)y1 * previous.width + x1) * 4 + c];
+                    next.data[((size_t)y * next.width + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+                }
+            }
+        }
+        chain.push_back(std::move(next));
+    }
+    return chain;
+}
+
+void TextureCompressor::FetchBlock(const uint8_t* rgba, int width, int height, int blockX, int blockY, uint8_t* blockRGBA) {
+    for (int y = 0; y < 4; y++) {
+        int sourceY = std::min(blockY * 4 + y, height - 1);
+        for (int x = 0; x < 4; x++) {
+            int sourceX = std::min(blockX * 4 + x, width - 1);
+            std::memcpy(blockRGBA + (y * 4 + x) * 4, rgba + ((size_t)sourceY * width + sourceX) * 4, 4);
+        }
+    }
+}
+
+std::vector<uint8_t> TextureCompressor::Compress(const uint8_t* rgba, int width, int height, Format format, unsigned int numThreads) {
+    const int blocksWide = (width + 3) / 4;
+    const int blocksHigh = (height + 3) / 4;
+    const int blockSize = GetBlockSizeInBytes(format);
+    std::vector<uint8_t> result(GetCompressedSize(format, width, height));
+
+    auto compressRows = [&](int firstRow, int lastRow) {
+        uint8_t blockRGBA[64];
+        for (int by = firstRow; by < lastRow; by++) {
+            for (int bx = 0; bx < blocksWide; bx++) {
+                FetchBlock(rgba, width, height, bx, by, blockRGBA);
+                uint8_t* out = result.data() + ((size_t)by * blocksWide + bx) * blockSize;
+                switch (format) {
+                    case Format::BC1:
+                        CompressBlockBC1(blockRGBA, out);
+                        break;
+                    case Format::BC3:
+                        CompressBlockBC4Alpha(blockRGBA, out);
+                        CompressBlockBC1(blockRGBA, out + 8);
+                        break;
+                    case Format::BC7:
+                        CompressBlockBC7(blockRGBA, out);
+                        break;
+                }
+            }
+        }
+    };
+
+    if (numThreads == 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    numThreads = std::min(numThreads, (unsigned int)blocksHigh);
+    if (numThreads <= 1) {
+        compressRows(0, blocksHigh);
+        return result;
+    }
+
+    // Each thread gets a contiguous band of block rows, blocks never overlap so no locking is needed
+    std::vector<std::thread> workers;
+    int rowsPerThread = (blocksHigh + numThreads - 1) / numThreads;
+    for (unsigned int t = 0; t < numThreads; t++) {
+        int firstRow = t * rowsPerThread;
+        int lastRow = std::min(blocksHigh, firstRow + rowsPerThread);
+        if (firstRow >= lastRow) {
+            break;
+        }
+        workers.emplace_back(compressRows, firstRow, lastRow);
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    return result;
+}
+
+void TextureCompressor::CompressBlockBC1(const uint8_t* blockRGBA, uint8_t* out) {
+    BlockSoA block;
+    LoadBlockSoA(blockRGBA, block);
+
+    // Initial endpoints are the extremes of the block along its principal axis
+    float mean[4], axis[4];
+    ComputePrincipalAxis(block, 3, mean, axis);
+    float minProjection, maxProjection;
+    FindProjectionExtents(block, 3, mean, axis, minProjection, maxProjection);
+    float e0[4] = {0, 0, 0, 255}, e1[4] = {0, 0, 0, 255};
+    for (int c = 0; c < 3; c++) {
+        e0[c] = std::clamp(mean[c] + axis[c] * maxProjection, 0.0f, 255.0f);
+        e1[c] = std::clamp(mean[c] + axis[c] * minProjection, 0.0f, 255.0f);
+    }
+
+    uint16_t bestC0 = 0, bestC1 = 0;
+    int bestIndices[16] = {};
+    float bestError = std::numeric_limits<float>::max();
+
+    for (int iteration = 0; iteration < 2; iteration++) {
+        uint16_t c0 = PackRGB565(e0);
+        uint16_t c1 = PackRGB565(e1);
+        if (c0 < c1) {
+            std::swap(c0, c1); // c0 > c1 selects the 4 color mode
+        }
+        int indices[16] = {};
+        float error;
+        float palette[4][4];
+        BuildBC1Palette(c0, c1, palette);
+        if (c0 == c1) {
+            error = FindNearestPaletteIndices(block, palette, 1, false, indices);
+        } else {
+            error = FindNearestPaletteIndices(block, palette, 4, false, indices);
+        }
+        if (error < bestError) {
+            bestError = error;
+            bestC0 = c0;
+            bestC1 = c1;
+            std::copy(indices, indices + 16, bestIndices);
+        }
+        if (c0 == c1) {
+            break;
+        }
+
+        // Refit the endpoints to the chosen indices and try again
+        const float weightOfIndex[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+        float weights[16];
+        for (int i = 0; i < 16; i++) {
+            weights[i] = weightOfIndex[indices[i]];
+        }
+        if (!RefineEndpointsLeastSquares(block, 3, weights, e0, e1)) {
+            break;
+        }
+    }
+
+    out[0] = (uint8_t)(bestC0 & 0xFF);
+    out[1] = (uint8_t)(bestC0 >> 8);
+    out[2] = (uint8_t)(bestC1 & 0xFF);
+    out[3] = (uint8_t)(bestC1 >> 8);
+    uint32_t packedIndices = 0;
+    for (int i = 0; i < 16; i++) {
+        packedIndices |= (uint32_t)bestIndices[i] << (i * 2);
+    }
+    for (int i = 0; i < 4; i++) {
+        out[4 + i] = (uint8_t)(packedIndices >> (i * 8));
+    }
+}
+
+void TextureCompressor::CompressBlockBC4Alpha(const uint8_t* blockRGBA, uint8_t* out) {
+    int maxAlpha = 0, minAlpha = 255;
+    for (int i = 0; i < 16; i++) {
+        maxAlpha = std::max(maxAlpha, (int)blockRGBA[i * 4 + 3]);
+        minAlpha = std::min(minAlpha, (int)blockRGBA[i * 4 + 3]);
+    }
+
+    // a0 > a1 selects the 8 alpha mode: a0, a1, then 6 interpolated values
+    int palette[8];
+    palette[0] = maxAlpha;
+    palette[1] = minAlpha;
+    for (int i = 2; i < 8; i++) {
+        palette[i] = ((8 - i) * maxAlpha + (i - 1) * minAlpha) / 7;
+    }
+
+    uint64_t packedIndices = 0;
+    if (maxAlpha != minAlpha) {
+        for (int i = 0; i < 16; i++) {
+            int alpha = blockRGBA[i * 4 + 3];
+            int bestIndex = 0;
+            int bestError = 256;
+            for (int p = 0; p < 8; p++) {
+                int error = std::abs(alpha - palette[p]);
+                if (error < bestError) {
+                    bestError = error;
+                    bestIndex = p;
+                }
+            }
+            packedIndices |= (uint64_t)bestIndex << (i * 3);
+        }
+    }
+
+    out[0] = (uint8_t)maxAlpha;
+    out[1] = (uint8_t)minAlpha;
+    for (int i = 0; i < 6; i++) {
+        out[2 + i] = (uint8_t)(packedIndices >> (i * 8));
+    }
+}
+
+void TextureCompressor::CompressBlockBC7(const uint8_t* blockRGBA, uint8_t* out) {
+    BlockSoA block;
+    LoadBlockSoA(blockRGBA, block);
+
+    float mean[4], axis[4];
+    ComputePrincipalAxis(block, 4, mean, axis);
+    float minProjection, maxProjection;
+    FindProjectionExtents(block, 4, mean, axis, minProjection, maxProjection);
+    float e0[4], e1[4];
+    for (int c = 0; c < 4; c++) {
+        e0[c] = std::clamp(mean[c] + axis[c] * minProjection, 0.0f, 255.0f);
+        e1[c] = std::clamp(mean[c] + axis[c] * maxProjection, 0.0f, 255.0f);
+    }
+
+    int bestQ0[4] = {}, bestQ1[4] = {};
+    int bestP0 = 0, bestP1 = 0;
+    int bestIndices[16] = {};
+    float bestError = std::numeric_limits<float>::max();
+
+    for (int iteration = 0; iteration < 2; iteration++) {
+        int q0[4], q1[4], p0, p1;
+        QuantizeBC7Endpoint(e0, q0, p0);
+        QuantizeBC7Endpoint(e1, q1, p1);
+        float palette[16][4];
+        BuildBC7Palette(q0, p0, q1, p1, palette);
+        int indices[16];
+        float error = FindNearestPaletteIndices(block, palette, 16, true, indices);
+        if (error < bestError) {
+            bestError = error;
+            std::copy(q0, q0 + 4, bestQ0);
+            std::copy(q1, q1 + 4, bestQ1);
+            bestP0 = p0;
+            bestP1 = p1;
+            std::copy(indices, indices + 16, bestIndices);
+        }
+
+        float weights[16];
+        for (int i = 0; i < 16; i++) {
+            weights[i] = kBC7Weights4[indices[i]] / 64.0f;
+        }
+        if (!RefineEndpointsLeastSquares(block, 4, weights, e0, e1)) {
+            break;
+        }
+    }
+
+    // The anchor (first) index is stored with an implicit 0 high bit, flip the endpoints if it would be set
+    if (bestIndices[0] & 8) {
+        std::swap(bestQ0, bestQ1);
+        std::swap(bestP0, bestP1);
+        for (int i = 0; i < 16; i++) {
+            bestIndices[i] = 15 - bestIndices[i];
+        }
+    }
+
+    BitWriter writer(out);
+    writer.Write(1 << 6, 7); // Mode 6
+    for (int c = 0; c < 4; c++) {
+        writer.Write(bestQ0[c], 7);
+        writer.Write(bestQ1[c], 7);
+    }
+    writer.Write(bestP0, 1);
+    writer.Write(bestP1, 1);
+    writer.Write(bestIndices[0], 3);
+    for (int i = 1; i < 16; i++) {
+        writer.Write(bestIndices[i], 4);
+    }
+}
+
+std::vector<uint8_t> TextureCompressor::Decompress(const uint8_t* blocks, int width, int height, Format format) {
+    const int blocksWide = (width + 3) / 4;
+    const int blocksHigh = (height + 3) / 4;
+    const int blockSize = GetBlockSizeInBytes(format);
+    std::vector<uint8_t> rgba((size_t)width * height * 4);
+
+    uint8_t blockRGBA[64];
+    for (int by = 0; by < blocksHigh; by++) {
+        for (int bx = 0; bx < blocksWide; bx++) {
+            const uint8_t* in = blocks + ((size_t)by * blocksWide + bx) * blockSize;
+            switch (format) {
+                case Format::BC1:
+                    DecompressBlockBC1(in, blockRGBA, false);
+                    break;
+                case Format::BC3:
+                    DecompressBlockBC1(in + 8, blockRGBA, true);
+                    DecompressBlockBC4Alpha(in, blockRGBA);
+                    break;
+                case Format::BC7:
+                    DecompressBlockBC7(in, blockRGBA);
+                    break;
+            }
+            for (int y = 0; y < 4 && by * 4 + y < height; y++) {
+                for (int x = 0; x < 4 && bx * 4 + x < width; x++) {
+                    std::memcpy(rgba.data() + ((size_t)(by * 4 + y) * width + bx * 4 + x) * 4, blockRGBA + (y * 4 + x) * 4, 4);
+                }
+            }
+        }
+    }
+    return rgba;
+}
+
+void TextureCompressor::DecompressBlockBC1(const uint8_t* in, uint8_t* blockRGBA, bool alwaysFourColors) {
+    uint16_t c0 = (uint16_t)(in[0] | (in[1] << 8));
+    uint16_t c1 = (uint16_t)(in[2] | (in[3] << 8));
+    float palette[4][4];
+    BuildBC1Palette(c0, c1, palette);
+    if (c0 <= c1 && !alwaysFourColors) {
+        // 3 color mode, entry 2 is the midpoint and entry 3 is transparent black
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2.0f;
+            palette[3][c] = 0.0f;
+        }
+        palette[3][3] = 0.0f;
+    }
+    uint32_t packedIndices = in[4] | (in[5] << 8) | (in[6] << 16) | ((uint32_t)in[7] << 24);
+    for (int i = 0; i < 16; i++) {
+        int index = (packedIndices >> (i * 2)) & 3;
+        for (int c = 0; c < 4; c++) {
+            blockRGBA[i * 4 + c] = (uint8_t)palette[index][c];
+        }
+    }
+}
+
+void TextureCompressor::DecompressBlockBC4Alpha(const uint8_t* in, uint8_t* blockRGBA) {
+    int palette[8];
+    palette[0] = in[0];
+    palette[1] = in[1];
+    if (palette[0] > palette[1]) {
+        for (int i = 2; i < 8; i++) {
+            palette[i] = ((8 - i) * palette[0] + (i - 1) * palette[1]) / 7;
+        }
+    } else {
+        for (int i = 2; i < 6; i++) {
+            palette[i] = ((6 - i) * palette[0] + (i - 1) * palette[1]) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+    uint64_t packedIndices = 0;
+    for (int i = 0; i < 6; i++) {
+        packedIndices |= (uint64_t)in[2 + i] << (i * 8);
+    }
+    for (int i = 0; i < 16; i++) {
+        blockRGBA[i * 4 + 3] = (uint8_t)palette[(packedIndices >> (i * 3)) & 7];
+    }
+}
+
+void TextureCompressor::DecompressBlockBC7(const uint8_t* in, uint8_t* blockRGBA) {
+    BitReader reader(in);
+    if (reader.Read(7) != (1 << 6)) {
+        // Only mode 6 is produced by this compressor, show anything else as magenta
+        for (int i = 0; i < 16; i++) {
+            blockRGBA[i * 4 + 0] = 255;
+            blockRGBA[i * 4 + 1] = 0;
+            blockRGBA[i * 4 + 2] = 255;
+            blockRGBA[i * 4 + 3] = 255;
+        }
+        return;
+    }
+    int q0[4], q1[4];
+    for (int c = 0; c < 4; c++) {
+        q0[c] = (int)reader.Read(7);
+        q1[c] = (int)reader.Read(7);
+    }
+    int p0 = (int)reader.Read(1);
+    int p1 = (int)reader.Read(1);
+    float palette[16][4];
+    BuildBC7Palette(q0, p0, q1, p1, palette);
+    for (int i = 0; i < 16; i++) {
+        int index = (int)reader.Read(i == 0 ? 3 : 4);
+        for (int c = 0; c < 4; c++) {
+            blockRGBA[i * 4 + c] = (uint8_t)palette[index][c];
+        }
+    }
+}
+
+double TextureCompressor::ComputePSNR(const uint8_t* a, const uint8_t* b, size_t numPixels, bool includeAlpha) {
+    const int channels = includeAlpha ? 4 : 3;
+    double squaredError = 0.0;
+    for (size_t i = 0; i < numPixels; i++) {
+        for (int c = 0; c < channels; c++) {
+            double delta = (double)a[i * 4 + c] - (double)b[i * 4 + c];
+            squaredError += delta * delta;
+        }
+    }
+    double meanSquaredError = squaredError / (double)(numPixels * channels);
+    if (meanSquaredError == 0.0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return 10.0 * std::log10((255.0 * 255.0) / meanSquaredError);
+}
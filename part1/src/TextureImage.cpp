@@ -0,0 +1,49 @@
+#include "TextureImage.hpp"
+
+#include <filesystem>
+#include <iostream>
+
+#include "PPM.hpp"
+
+namespace {
+    // A cache written before the image was last saved no longer shows it. Without the image the cache is all there is.
+    bool IsCacheOlderThanSource(const std::string& cachePath, const std::string& sourcePath) {
+        std::error_code cacheError, sourceError;
+        std::filesystem::file_time_type cacheTime = std::filesystem::last_write_time(cachePath, cacheError);
+        std::filesystem::file_time_type sourceTime = std::filesystem::last_write_time(sourcePath, sourceError);
+        return !cacheError && !sourceError && cacheTime < sourceTime;
+    }
+}
+
+TextureImage TextureImage::LoadFromFile(const std::string& texturePath) {
+    TextureImage image;
+    image.path = texturePath;
+
+    // Prefer the offline compressed cache, it skips decoding the PPM entirely
+    std::string cachePath = TextureCache::GetCachePathForTexture(texturePath);
+    if (IsCacheOlderThanSource(cachePath, texturePath)) {
+        std::cout << "Texture cache " << cachePath << " is older than " << texturePath
+                  << ", loading the image instead (rebuild it with --compress-texture)" << std::endl;
+    } else {
+        std::shared_ptr<TextureCache> cache = std::make_shared<TextureCache>(cachePath);
+        if (cache->IsValid()) {
+            image.width = cache->GetWidth();
+            image.height = cache->GetHeight();
+            image.compressed = cache;
+            return image;
+        }
+    }
+
+    PPM ppm(texturePath);
+    ppm.VerticalFlip(); // PPM reads starting at top left, while OpenGL reads bottom left pixel first.
+    image.width = ppm.getWidth();
+    image.height = ppm.getHeight();
+    std::vector<Pixel> pixels = ppm.pixelData();
+    image.rgb.reserve(pixels.size() * 3);
+    for (Pixel p : pixels) {
+        image.rgb.push_back(p.r);
+        image.rgb.push_back(p.g);
+        image.rgb.push_back(p.b);
+    }
+    return image;
+}
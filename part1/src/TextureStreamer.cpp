@@ -0,0 +1,201 @@
+#include "TextureStreamer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#include "GLStateTracker.hpp"
+#include "ThreadPool.hpp"
+
+void TextureStreamer::Initialize(const TextureAtlas& atlas, size_t budgetBytes, size_t maxUploadBytesPerFrame) {
+    m_budgetBytes = budgetBytes;
+    m_maxUploadBytesPerFrame = maxUploadBytesPerFrame;
+    // A rebuilt atlas starts over, reads still in flight belong to the old layers
+    m_layers.clear();
+    m_layerStates.clear();
+    m_pendingRequests.clear();
+    m_framesBaseLevelUnwanted = 0;
+    if (!atlas.IsStreamable()) {
+        return;
+    }
+    m_layers = atlas.GetCompressedLayers();
+    m_texture = atlas.GetTexture();
+    m_internalFormat = atlas.GetInternalFormat();
+    m_layerSize = std::max(atlas.GetLayerWidth(), atlas.GetLayerHeight());
+    m_mipCount = m_layers[0]->GetMipCount();
+    m_baseLevel = atlas.GetBaseLevel();
+    m_layerStates.assign(m_layers.size(), LayerState());
+    for (LayerState& state : m_layerStates) {
+        state.residentLevel = m_baseLevel;
+        state.wantedLevel = m_mipCount - 1;
+    }
+    std::cout << "Streaming " << m_layers.size() << " texture layers, " << GetResidentBytes() / 1024
+              << " KB resident at startup, budget " << m_budgetBytes / 1024 << " KB" << std::endl;
+}
+
+bool TextureStreamer::IsEnabled() const {
+    return !m_layers.empty();
+}
+
+void TextureStreamer::BeginFrame() {
+    for (LayerState& state : m_layerStates) {
+        state.wantedLevel = m_mipCount - 1;
+    }
+}
+
+void TextureStreamer::RequestTexelDensity(int layer, float screenPixelsAcross) {
+    if (layer < 0 || layer >= (int)m_layerStates.size()) {
+        return;
+    }
+    // One texel per pixel: each level halves the texels, so the level is log2 of the texel to pixel ratio
+    float texelsPerPixel = m_layerSize / std::max(screenPixelsAcross, 1.0f);
+    int level = std::clamp((int)std::floor(std::log2(std::max(texelsPerPixel, 1.0f))), 0, m_mipCount - 1);
+    m_layerStates[layer].wantedLevel = std::min(m_layerStates[layer].wantedLevel, level);
+}
+
+bool TextureStreamer::Update() {
+    m_numUploadsLastFrame = 0;
+    m_uploadedBytesLastFrame = 0;
+    if (!IsEnabled()) {
+        return false;
+    }
+    // Usually already bound, then this costs nothing
+    GLStateTracker::Get().BindTextureToUnit(0, GL_TEXTURE_2D_ARRAY, m_texture);
+    bool hasChanged = false;
+
+    // Evict first. A level nobody wants is freed once it has stayed unwanted for a while,
+    // and when over budget the finest level goes, it is 3/4 of the memory for the least needed detail
+    int finestWantedLevel = m_mipCount - 1;
+    for (const LayerState& state : m_layerStates) {
+        finestWantedLevel = std::min(finestWantedLevel, state.wantedLevel);
+    }
+    m_framesBaseLevelUnwanted = finestWantedLevel > m_baseLevel ? m_framesBaseLevelUnwanted + 1 : 0;
+    if (m_framesBaseLevelUnwanted >= kEvictDelayFrames) {
+        FreeBaseLevel();
+        hasChanged = true;
+    }
+    while (GetResidentBytes() > m_budgetBytes && m_baseLevel < m_mipCount - 1) {
+        FreeBaseLevel();
+        hasChanged = true;
+    }
+
+    // Allocate at most one finer level per frame, and only within budget
+    if (finestWantedLevel < m_baseLevel && GetResidentBytes() + GetLevelBytes(m_baseLevel - 1) <= m_budgetBytes) {
+        AllocateLevel(m_baseLevel - 1);
+        hasChanged = true;
+    }
+
+    // Upload finished reads until this frame's upload budget is used up
+    for (size_t i = 0; i < m_pendingRequests.size() && m_uploadedBytesLastFrame < m_maxUploadBytesPerFrame;) {
+        PendingRequest& request = m_pendingRequests[i];
+        if (request.data.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            i++;
+            continue;
+        }
+        std::vector<uint8_t> data = request.data.get();
+        LayerState& state = m_layerStates[request.layer];
+        state.isPending = false;
+        // The level may have been freed while it was read
+        if (request.level >= m_baseLevel && request.level == state.residentLevel - 1) {
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, request.level, 0, 0, request.layer,
+                                      m_layers[request.layer]->GetMipWidth(request.level),
+                                      m_layers[request.layer]->GetMipHeight(request.level), 1,
+                                      m_internalFormat, data.size(), data.data());
+            state.residentLevel = request.level;
+            m_numUploadsLastFrame++;
+            m_uploadedBytesLastFrame += data.size();
+            hasChanged = true;
+        }
+        m_pendingRequests.erase(m_pendingRequests.begin() + i);
+    }
+
+    // Queue the next level of the layers furthest from the detail they want
+    std::vector<int> candidates;
+    for (size_t layer = 0; layer < m_layerStates.size(); layer++) {
+        const LayerState& state = m_layerStates[layer];
+        if (!state.isPending && state.residentLevel > std::max(state.wantedLevel, m_baseLevel)) {
+            candidates.push_back(layer);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [this](int a, int b) {
+        return m_layerStates[a].residentLevel - m_layerStates[a].wantedLevel >
+               m_layerStates[b].residentLevel - m_layerStates[b].wantedLevel;
+    });
+    for (int layer : candidates) {
+        if ((int)m_pendingRequests.size() >= kMaxPendingRequests) {
+            break;
+        }
+        int level = m_layerStates[layer].residentLevel - 1;
+        std::shared_ptr<TextureCache> cache = m_layers[layer];
+        // Copying out of the mapping is what faults the file in, so it happens off the render thread
+        std::future<std::vector<uint8_t>> data = ThreadPool::GetShared().Submit([cache, level]() {
+            return std::vector<uint8_t>(cache->GetMipData(level), cache->GetMipData(level) + cache->GetMipSize(level));
+        });
+        m_pendingRequests.push_back(PendingRequest{layer, level, std::move(data)});
+        m_layerStates[layer].isPending = true;
+    }
+    return hasChanged;
+}
+
+void TextureStreamer::AllocateLevel(int level) {
+    // Data is left undefined, layers only sample it once their own copy is uploaded
+    glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, m_internalFormat,
+                           m_layers[0]->GetMipWidth(level), m_layers[0]->GetMipHeight(level), m_layers.size(),
+                           0, GetLevelBytes(level), nullptr);
+    m_baseLevel = level;
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, m_baseLevel);
+}
+
+void TextureStreamer::FreeBaseLevel() {
+    int freedLevel = m_baseLevel;
+    m_baseLevel++;
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, m_baseLevel);
+    // Respecifying the level with no size releases its storage
+    glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, freedLevel, m_internalFormat, 0, 0, 0, 0, 0, nullptr);
+    for (LayerState& state : m_layerStates) {
+        state.residentLevel = std::max(state.residentLevel, m_baseLevel);
+    }
+    m_framesBaseLevelUnwanted = 0;
+}
+
+void TextureStreamer::SetBudget(size_t budgetBytes) {
+    m_budgetBytes = budgetBytes;
+}
+
+size_t TextureStreamer::GetLevelBytes(int level) const {
+    return m_layers[0]->GetMipSize(level) * m_layers.size();
+}
+
+size_t TextureStreamer::GetResidentBytes() const {
+    size_t bytes = 0;
+    for (int level = m_baseLevel; level < m_mipCount; level++) {
+        bytes += GetLevelBytes(level);
+    }
+    return bytes;
+}
+
+int TextureStreamer::GetBaseLevel() const {
+    return m_baseLevel;
+}
+
+int TextureStreamer::GetResidentLevel(int layer) const {
+    return m_layerStates[layer].residentLevel;
+}
+
+TextureStreamer::Stats TextureStreamer::GetStats() const {
+    Stats stats;
+    stats.numLayers = m_layerStates.size();
+    for (const LayerState& state : m_layerStates) {
+        if (state.residentLevel <= state.wantedLevel) {
+            stats.numLayersAtWantedDetail++;
+        }
+    }
+    stats.baseLevel = m_baseLevel;
+    stats.residentBytes = IsEnabled() ? GetResidentBytes() : 0;
+    stats.budgetBytes = m_budgetBytes;
+    stats.numPendingRequests = m_pendingRequests.size();
+    stats.numUploadsLastFrame = m_numUploadsLastFrame;
+    stats.uploadedBytesLastFrame = m_uploadedBytesLastFrame;
+    return stats;
+}
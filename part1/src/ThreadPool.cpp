@@ -0,0 +1,65 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int numThreads) {
+    if (numThreads == 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned int i = 0; i < numThreads; i++) {
+        m_workers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_isStopping = true;
+    }
+    m_condition.notify_all();
+    for (std::thread& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::WorkerLoop() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() { return m_isStopping || !m_jobs.empty(); });
+            if (m_jobs.empty()) {
+                return; // Stopping and nothing left to do
+            }
+            job = std::move(m_jobs.front());
+            m_jobs.pop();
+        }
+        job();
+    }
+}
+
+unsigned int ThreadPool::GetNumThreads() const {
+    return m_workers.size();
+}
+
+int ThreadPool::RunSplit(int numJobs, const std::function<void(int job, int numJobs)>& job) {
+    numJobs = std::clamp<int>(numJobs, 1, GetNumThreads() + 1);
+    std::vector<std::future<void>> jobs;
+    for (int index = 1; index < numJobs; index++) {
+        jobs.push_back(Submit([&job, index, numJobs]() { job(index, numJobs); }));
+    }
+    job(0, numJobs);
+    for (std::future<void>& submitted : jobs) {
+        submitted.get();
+    }
+    return numJobs;
+}
+
+std::pair<int, int> ThreadPool::GetJobRange(int count, int job, int numJobs) {
+    return {(int)((long long)count * job / numJobs), (int)((long long)count * (job + 1) / numJobs)};
+}
+
+ThreadPool& ThreadPool::GetShared() {
+    static ThreadPool sharedPool;
+    return sharedPool;
+}
@@ -0,0 +1,64 @@
+#include "UniformBufferRing.hpp"
+
+#include <cstring>
+#include <iostream>
+
+#include "GLStateTracker.hpp"
+
+void UniformBufferRing::Create(size_t bytesPerFrame, int maxPushesPerFrame) {
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    m_alignment = alignment > 0 ? alignment : 256;
+    // Regions start aligned too, so the region size is rounded up
+    m_regionSize = bytesPerFrame + maxPushesPerFrame * m_alignment;
+    m_regionSize = (m_regionSize + m_alignment - 1) / m_alignment * m_alignment;
+
+    glGenBuffers(1, &m_buffer);
+    GLStateTracker::Get().BindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, m_regionSize * kNumFrames, nullptr, GL_DYNAMIC_DRAW);
+    m_frame = kNumFrames - 1; // The first BeginFrame moves to region 0
+}
+
+void UniformBufferRing::BeginFrame() {
+    m_frame = (m_frame + 1) % kNumFrames;
+    m_offset = 0;
+    if (m_fences[m_frame] != nullptr) {
+        // Normally long signaled, the swap chain is at most a frame or two deep
+        glClientWaitSync(m_fences[m_frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        glDeleteSync(m_fences[m_frame]);
+        m_fences[m_frame] = nullptr;
+    }
+}
+
+void UniformBufferRing::Push(GLuint bindingIndex, const void* data, size_t size) {
+    if (m_offset + size > m_regionSize) {
+        std::cout << "Uniform buffer ring region of " << m_regionSize << " bytes is full, increase bytesPerFrame" << std::endl;
+        return;
+    }
+    size_t offset = m_frame * m_regionSize + m_offset;
+    GLStateTracker::Get().BindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    // Unsynchronized is safe, the fence in BeginFrame already made sure the GPU is done with this region
+    void* mapped = glMapBufferRange(GL_UNIFORM_BUFFER, offset, size,
+                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (mapped != nullptr) {
+        std::memcpy(mapped, data, size);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+    }
+    GLStateTracker::Get().BindBufferRange(GL_UNIFORM_BUFFER, bindingIndex, m_buffer, offset, size);
+    m_offset += (size + m_alignment - 1) / m_alignment * m_alignment;
+}
+
+void UniformBufferRing::EndFrame() {
+    m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void UniformBufferRing::CleanUp() {
+    for (GLsync& fence : m_fences) {
+        if (fence != nullptr) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    glDeleteBuffers(1, &m_buffer);
+    m_buffer = 0;
+}
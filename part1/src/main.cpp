@@ -3,7 +3,9 @@
 */
 
 #include "GraphicsProgram.hpp"
+#include "TextureCache.hpp"
 #include <iostream>
+#include <string>
 
 
 int main( int argc, char* args[] ){
@@ -11,6 +13,15 @@ int main( int argc, char* args[] ){
         std::cout << "Incorrect # of args, need 1 arg, provide model to render" << std::endl;
         return 1;
     }
+    // Offline texture compression, i.e. ./prog --compress-texture ./3DObjects/wood.ppm bc7
+    if (std::string(args[1]) == "--compress-texture")   {
+        TextureCompressor::Format format = TextureCompressor::Format::BC1;
+        if (argc < 3 || (argc >= 4 && !TextureCompressor::ParseFormat(args[3], format)))   {
+            std::cout << "Usage: prog --compress-texture <texture.ppm> [bc1|bc3|bc7]" << std::endl;
+            return 1;
+        }
+        return TextureCache::CompressPPM(args[2], format) ? 0 : 1;
+    }
     GraphicsProgram p;
     p.Start(args[1]);
 	return 0;